@@ -0,0 +1,45 @@
+#include "cache_simulator.hpp"
+
+#include <cassert>
+
+static constexpr uint64_t INVALID_TAG = ~0ull;
+
+CacheSimulator::CacheSimulator(size_t capacity, size_t lineSize, size_t ways)
+    : m_LineSize(lineSize), m_Ways(ways), m_Sets(capacity / (lineSize * ways))
+{
+    assert(m_Sets > 0 && "Cache must hold at least one set");
+
+    reset();
+}
+
+bool CacheSimulator::access(uint64_t address)
+{
+    m_Accesses++;
+
+    uint64_t line = address / m_LineSize;
+    uint64_t* set = &m_Tags[(line % m_Sets) * m_Ways];
+
+    size_t way = 0;
+    while (way < m_Ways && set[way] != line)
+        way++;
+
+    bool hit = way != m_Ways;
+    if (!hit) {
+        m_Misses++;
+        way = m_Ways - 1;
+    }
+
+    // Move to the front, evicting the least recently used on a miss
+    for (size_t i = way; i > 0; i--)
+        set[i] = set[i - 1];
+    set[0] = line;
+
+    return hit;
+}
+
+void CacheSimulator::reset()
+{
+    m_Tags.assign(m_Sets * m_Ways, INVALID_TAG);
+    m_Accesses = 0;
+    m_Misses = 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Set associative cache with least recently used replacement. Only addresses are tracked, used
+// to compare access patterns rather than to model a specific CPU.
+class CacheSimulator {
+  public:
+    CacheSimulator(size_t capacity, size_t lineSize, size_t ways);
+
+    // Returns true on a hit
+    bool access(uint64_t address);
+
+    void reset();
+
+    uint64_t getAccesses() const { return m_Accesses; }
+    uint64_t getMisses() const { return m_Misses; }
+
+  private:
+    size_t m_LineSize;
+    size_t m_Ways;
+    size_t m_Sets;
+
+    // m_Ways tags per set, most recently used first
+    std::vector<uint64_t> m_Tags;
+
+    uint64_t m_Accesses = 0;
+    uint64_t m_Misses = 0;
+};
@@ -0,0 +1,81 @@
+#include <CLI/CLI.hpp>
+
+#include "generators/distance_field.hpp"
+#include "generators/task_scheduler.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+struct BenchmarkArgs {
+    uint32_t size = 1024;
+    uint32_t runs = 3;
+    uint32_t threads = 0;
+};
+
+// Hollow sphere with a scattering of single voxels, so both long and short distances occur
+static void seedScene(std::vector<uint8_t>& distances, uint32_t size)
+{
+    const float centre = size / 2.f;
+    const float radius = size * 0.35f;
+
+    Generators::TaskScheduler::getInstance().parallelFor(size, 1, [&](size_t y) {
+        for (size_t z = 0; z < size; z++) {
+            for (size_t x = 0; x < size; x++) {
+                glm::vec3 offset = glm::vec3(x, y, z) - centre;
+                bool shell = std::abs(glm::length(offset) - radius) < 1.f;
+                bool scatter = ((x * 73856093) ^ (y * 19349663) ^ (z * 83492791)) % 50000 == 0;
+
+                size_t index = x + z * size + y * size * size;
+                distances[index] = shell || scatter ? 0 : Generators::MaxDistance;
+            }
+        }
+    });
+}
+
+int main(int argc, char** argv)
+{
+    CLI::App app { "Time the grid distance field precompute" };
+    argv = app.ensure_utf8(argv);
+
+    BenchmarkArgs args;
+
+    app.add_option("-s,--size", args.size, "Edge length of the cubic grid");
+    app.add_option("-n,--runs", args.runs, "Number of timed runs");
+    app.add_option("-j,--threads", args.threads, "Worker threads (Defaults to all cores)");
+
+    CLI11_PARSE(app, argc, argv);
+
+    Generators::TaskScheduler::getInstance().init(args.threads);
+
+    const glm::uvec3 dimensions(args.size);
+    const size_t cells = (size_t)args.size * args.size * args.size;
+    std::vector<uint8_t> distances(cells);
+
+    printf("%u^3 grid, %u threads\n", args.size,
+        Generators::TaskScheduler::getInstance().getThreadCount());
+    printf("%-4s %12s %14s\n", "Run", "Time (ms)", "Mcells/s");
+
+    for (uint32_t run = 0; run < args.runs; run++) {
+        seedScene(distances, args.size);
+
+        auto start = std::chrono::steady_clock::now();
+        Generators::transformDistanceField(distances, dimensions);
+        auto end = std::chrono::steady_clock::now();
+
+        double milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+        printf("%-4u %12.1f %14.1f\n", run, milliseconds, cells / milliseconds / 1000.);
+    }
+
+    // Average number of cells a ray may skip from an empty cell
+    uint64_t total = 0;
+    uint64_t empty = 0;
+    for (uint8_t distance : distances) {
+        if (distance != 0) {
+            total += distance;
+            empty++;
+        }
+    }
+    printf("Mean empty cell distance %.2f\n", empty ? total / (double)empty : 0.);
+
+    return 0;
+}
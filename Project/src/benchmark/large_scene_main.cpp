@@ -0,0 +1,401 @@
+#include <CLI/CLI.hpp>
+
+#include "octree_traversal.hpp"
+
+#include "generators/block_stream.hpp"
+#include "generators/brickmap.hpp"
+#include "generators/contree.hpp"
+#include "generators/grid.hpp"
+#include "generators/octree.hpp"
+#include "generators/task_scheduler.hpp"
+#include "generators/texture.hpp"
+#include "loaders/primitive_loader.hpp"
+#include "morton/morton_code.hpp"
+#include "serializers/common.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+struct TestArgs {
+    uint32_t threads = 0;
+    // Grids and textures beyond 2^32 voxels take at least 16 GB each
+    bool dense = false;
+};
+
+struct Box {
+    glm::uvec3 min;
+    glm::uvec3 max;
+    glm::vec3 colour;
+};
+
+// Sparse scene of axis aligned boxes, cells without a box are never visited
+class BoxLoader : public PrimitiveLoader {
+  public:
+    BoxLoader(glm::uvec3 dimensions, std::vector<Box> boxes)
+        : PrimitiveLoader(dimensions), m_Boxes(std::move(boxes))
+    {
+    }
+
+    uint32_t getPrimitiveCount() const override { return m_Boxes.size(); }
+
+    void overlapping(const std::vector<uint32_t>& candidates, glm::uvec3 origin, uint32_t edge,
+        std::vector<uint32_t>& overlaps) override
+    {
+        for (uint32_t candidate : candidates) {
+            if (intersects(m_Boxes[candidate], origin, origin + edge))
+                overlaps.push_back(candidate);
+        }
+    }
+
+    std::optional<glm::vec3> getVoxel(
+        const std::vector<uint32_t>& candidates, glm::uvec3 index) override
+    {
+        for (uint32_t candidate : candidates) {
+            if (intersects(m_Boxes[candidate], index, index + 1u))
+                return m_Boxes[candidate].colour;
+        }
+        return {};
+    }
+
+    std::optional<glm::vec3> getVoxel(glm::uvec3 index) override
+    {
+        for (const Box& box : m_Boxes) {
+            if (intersects(box, index, index + 1u))
+                return box.colour;
+        }
+        return {};
+    }
+
+    static bool intersects(const Box& box, glm::uvec3 min, glm::uvec3 max)
+    {
+        return glm::all(glm::lessThan(box.min, max)) && glm::all(glm::lessThan(min, box.max));
+    }
+
+    uint64_t voxelCount() const
+    {
+        uint64_t count = 0;
+        for (const Box& box : m_Boxes) {
+            glm::u64vec3 size = box.max - box.min;
+            count += size.x * size.y * size.z;
+        }
+        return count;
+    }
+
+  private:
+    std::vector<Box> m_Boxes;
+};
+
+// 4^3 boxes in every corner and the centre. The far corner is white so a ray can find it.
+static std::vector<Box> cornerBoxes(glm::uvec3 dimensions)
+{
+    std::vector<Box> boxes;
+    for (uint32_t corner = 0; corner < 8; corner++) {
+        glm::uvec3 far = glm::uvec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1);
+        glm::uvec3 min = far * (dimensions - 4u);
+        boxes.push_back({ min, min + 4u, corner == 7 ? glm::vec3(1.f) : glm::vec3(0.f, 0.f, 1.f) });
+    }
+
+    glm::uvec3 centre = dimensions / 8u * 4u;
+    boxes.push_back({ centre, centre + 4u, glm::vec3(0.f, 1.f, 0.f) });
+    return boxes;
+}
+
+// Single voxels scattered through the volume, each costing a full path of tree nodes
+static std::vector<Box> scatteredVoxels(glm::uvec3 dimensions, uint32_t count)
+{
+    std::vector<Box> boxes;
+    for (uint64_t i = 0; i < count; i++) {
+        glm::uvec3 position = glm::uvec3(i * 73856093, i * 19349663, i * 83492791) % dimensions;
+        boxes.push_back({ position, position + 1u, glm::vec3(1.f) });
+    }
+    return boxes;
+}
+
+// Sends every block of the stream from another thread, empty blocks share a single allocation so
+// volumes beyond 2^32 voxels stream quickly. block returns nullptr for empty blocks.
+static std::jthread streamBlocks(Generators::BlockStream& stream,
+    std::function<std::shared_ptr<Generators::VoxelBlock>(glm::uvec3)> block)
+{
+    return std::jthread([&stream, block]() {
+        auto empty = std::make_shared<Generators::VoxelBlock>();
+        memset(empty->occupancy, 0, sizeof(empty->occupancy));
+
+        const glm::uvec3 blocks = Generators::blockGridDimensions(stream.getDimensions());
+        for (uint32_t z = 0; z < blocks.z; z++) {
+            for (uint32_t y = 0; y < blocks.y; y++) {
+                for (uint32_t x = 0; x < blocks.x; x++) {
+                    std::shared_ptr<Generators::VoxelBlock> sent = block(glm::uvec3(x, y, z));
+                    if (!stream.push(sent != nullptr ? sent : empty))
+                        return;
+                }
+            }
+        }
+        stream.close();
+    });
+}
+
+static std::shared_ptr<Generators::VoxelBlock> sampleBlock(BoxLoader& loader, glm::uvec3 position)
+{
+    const glm::uvec3 origin = position * Generators::VoxelBlock::Edge;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> all(loader.getPrimitiveCount());
+    for (uint32_t i = 0; i < all.size(); i++)
+        all[i] = i;
+
+    loader.overlapping(all, origin, Generators::VoxelBlock::Edge, candidates);
+    if (candidates.empty())
+        return nullptr;
+
+    auto block = std::make_shared<Generators::VoxelBlock>();
+    block->position = position;
+    memset(block->occupancy, 0, sizeof(block->occupancy));
+
+    for (uint32_t z = 0; z < Generators::VoxelBlock::Edge; z++) {
+        for (uint32_t y = 0; y < Generators::VoxelBlock::Edge; y++) {
+            for (uint32_t x = 0; x < Generators::VoxelBlock::Edge; x++) {
+                auto voxel = loader.getVoxel(candidates, origin + glm::uvec3(x, y, z));
+                if (!voxel.has_value())
+                    continue;
+
+                uint32_t index = Generators::VoxelBlock::localIndex(glm::uvec3(x, y, z));
+                block->occupancy[index / 64] |= 1ull << (index % 64);
+                block->colours[index] = voxel.value();
+            }
+        }
+    }
+    return block;
+}
+
+static uint32_t failures = 0;
+
+static void check(bool passed, const char* name)
+{
+    printf("%-4s %s\n", passed ? "ok" : "FAIL", name);
+    if (!passed)
+        failures++;
+}
+
+static std::vector<uint32_t> packNodes(const std::vector<Generators::OctreeNode>& nodes)
+{
+    std::vector<uint32_t> raw;
+    for (const Generators::OctreeNode& node : nodes)
+        raw.push_back(node.getData());
+    return raw;
+}
+
+static void checkTrees(glm::uvec3 dimensions)
+{
+    BoxLoader loader(dimensions, cornerBoxes(dimensions));
+
+    Generators::GenerationInfo info;
+    glm::uvec3 treeDimensions;
+    bool finished = false;
+    auto octree
+        = Generators::generateOctree(std::stop_token(), loader, info, treeDimensions, finished);
+    check(finished && info.voxelCount == loader.voxelCount(), "octree generated");
+
+    // Rays in from either corner along the diagonal, the far one must reach the white box past
+    // 2^32 linear voxels
+    std::vector<uint32_t> raw = packNodes(octree);
+    OctreeTraversal traversal(raw, [](size_t) { });
+    auto far = traversal.trace(glm::vec3(1.5f), glm::vec3(-1.f));
+    auto near = traversal.trace(glm::vec3(-0.5f), glm::vec3(1.f));
+    check(far == 0xFFFFFFu && near.has_value() && near != far, "octree far corner traced");
+
+    info = {};
+    finished = false;
+    auto contree
+        = Generators::generateContree(std::stop_token(), loader, info, treeDimensions, finished);
+    check(finished && !contree.empty() && info.voxelCount == loader.voxelCount(),
+        "contree generated");
+}
+
+static void checkBrickmap(glm::uvec3 dimensions)
+{
+    using Generators::BrickSize;
+
+    BoxLoader loader(dimensions, cornerBoxes(dimensions));
+    Generators::BlockStream stream(dimensions);
+    auto producer
+        = streamBlocks(stream, [&](glm::uvec3 position) { return sampleBlock(loader, position); });
+
+    Generators::GenerationInfo info;
+    glm::uvec3 brickgridDim;
+    bool finished = false;
+    auto [brickgrid, bricks, colours] = Generators::generateBrickmap(
+        std::stop_token(), stream, info, brickgridDim, finished);
+    check(finished && bricks.size() == cornerBoxes(dimensions).size(), "brickmap generated");
+
+    // Last voxel of the last brick belongs to the white box
+    const glm::uvec3 lastBrick = brickgridDim - 1u;
+    const size_t entry = Generators::brickgridIndex(
+        lastBrick, brickgridDim, Generators::BrickgridLayout::LINEAR);
+    bool found = false;
+    if (finished && (brickgrid[entry] >> 2) != 0) {
+        const Generators::Brickmap& brick = bricks[(brickgrid[entry] >> 2) - 1];
+        const uint32_t bit = (BrickSize - 1) * (1 + BrickSize + BrickSize * BrickSize);
+        found = (brick.occupancy[bit / 64] >> (bit % 64)) & 1;
+    }
+    check(found, "brickmap far corner placed");
+}
+
+static void checkDense(glm::uvec3 dimensions)
+{
+    const size_t voxels = (size_t)dimensions.x * dimensions.y * dimensions.z;
+    const glm::uvec3 last = dimensions - 1u;
+    BoxLoader loader(dimensions, cornerBoxes(dimensions));
+
+    {
+        Generators::BlockStream stream(dimensions);
+        auto producer = streamBlocks(
+            stream, [&](glm::uvec3 position) { return sampleBlock(loader, position); });
+
+        Generators::GenerationInfo info;
+        glm::uvec3 gridDimensions;
+        bool finished = false;
+        auto grid = Generators::generateGrid(
+            std::stop_token(), stream, info, gridDimensions, finished);
+        size_t index = last.x + last.z * (size_t)dimensions.x
+            + last.y * (size_t)dimensions.x * dimensions.z;
+        check(finished && grid.size() == voxels && grid[index].visible
+                && grid[index].colour == glm::u8vec3(255),
+            "grid sized");
+    }
+
+    {
+        Generators::BlockStream stream(dimensions);
+        auto producer = streamBlocks(
+            stream, [&](glm::uvec3 position) { return sampleBlock(loader, position); });
+
+        Generators::GenerationInfo info;
+        glm::uvec3 textureDimensions;
+        bool finished = false;
+        auto texture = Generators::generateTexture(
+            std::stop_token(), stream, info, textureDimensions, finished);
+        size_t index = last.x + last.y * (size_t)dimensions.x
+            + last.z * (size_t)dimensions.x * dimensions.y;
+        check(finished && texture.size() == voxels && texture[index].a != 0, "texture sized");
+    }
+}
+
+static void checkHeader(glm::uvec3 dimensions)
+{
+    const uint64_t voxels = (uint64_t)dimensions.x * dimensions.y * dimensions.z;
+    const uint64_t nodes = (1ull << 33) + 5;
+
+    ASProto::Header written;
+    Serializers::writeHeader(&written, dimensions, voxels, nodes);
+
+    ASProto::Header read;
+    read.ParseFromString(written.SerializeAsString());
+    auto info = Serializers::readHeader(read);
+    check(info.has_value() && info->dimensions == dimensions && info->voxels == voxels
+            && info->nodes == nodes && info->version == Serializers::FormatVersion,
+        "header round trip");
+
+    read.set_version(Serializers::FormatVersion + 1);
+    check(!Serializers::readHeader(read).has_value(), "header from newer version refused");
+}
+
+// Block positions of scenes this large pass 2^10 per axis, which no longer fit 32 bit codes
+static void checkMorton()
+{
+    const glm::uvec3 positions[] = {
+        glm::uvec3(1024),
+        glm::uvec3(1, 5000, 1u << 19),
+        glm::uvec3((1u << 20) - 1, 1u << 10, 3),
+        glm::uvec3((1u << 20) - 1),
+    };
+
+    bool octree = true;
+    bool contree = true;
+    for (glm::uvec3 position : positions) {
+        octree &= MortonCode::decode(MortonCode::encode(position)) == position;
+        contree &= MortonCode::decode2(MortonCode::encode2(position)) == position;
+    }
+    octree &= MortonCode::decode(MortonCode::encode(glm::uvec3((1u << 21) - 1)))
+        == glm::uvec3((1u << 21) - 1);
+
+    check(octree, "octree Morton codes past 2^10 per axis round trip");
+    check(contree, "contree Morton codes past 2^10 per axis round trip");
+}
+
+// The generators are built with small limits for this test, a scene past them must leave the
+// generator unfinished rather than producing a truncated structure
+static void checkLimits(glm::uvec3 treeScene, glm::uvec3 streamedScene)
+{
+    BoxLoader scattered(treeScene, scatteredVoxels(treeScene, 2048));
+
+    Generators::GenerationInfo info;
+    glm::uvec3 treeDimensions;
+    bool finished = false;
+    auto octree
+        = Generators::generateOctree(std::stop_token(), scattered, info, treeDimensions, finished);
+    check(!finished && octree.empty(), "octree past MaxOctreeNodes refused");
+
+    finished = false;
+    auto contree
+        = Generators::generateContree(std::stop_token(), scattered, info, treeDimensions, finished);
+    check(!finished && contree.empty(), "contree past MaxContreeNodes refused");
+
+    // One distinct colour per block, repeated in two of its bricks so shared bricks are looked up
+    // after the limit is reached
+    const uint32_t filled = Generators::MaxBricks + 1024;
+    Generators::BlockStream stream(streamedScene);
+    const glm::uvec3 blocks = Generators::blockGridDimensions(streamedScene);
+    auto producer = streamBlocks(stream, [&](glm::uvec3 position) {
+        uint64_t i = position.x + (uint64_t)position.y * blocks.x
+            + (uint64_t)position.z * blocks.x * blocks.y;
+        if (i >= filled)
+            return std::shared_ptr<Generators::VoxelBlock>();
+
+        auto block = std::make_shared<Generators::VoxelBlock>();
+        block->position = position;
+        memset(block->occupancy, 0, sizeof(block->occupancy));
+        for (uint32_t x : { 0u, Generators::VoxelBlock::Edge / 2 }) {
+            uint32_t index = Generators::VoxelBlock::localIndex(glm::uvec3(x, 0, 0));
+            block->occupancy[index / 64] |= 1ull << (index % 64);
+            block->colours[index] = glm::vec3(i % 256, (i / 256) % 256, 0) / 255.f;
+        }
+        return block;
+    });
+
+    glm::uvec3 brickgridDim;
+    finished = false;
+    auto [brickgrid, bricks, colours] = Generators::generateBrickmap(
+        std::stop_token(), stream, info, brickgridDim, finished, true);
+    check(!finished && bricks.size() <= Generators::MaxBricks, "brickmap past MaxBricks refused");
+}
+
+int main(int argc, char** argv)
+{
+    CLI::App app { "Check generation of sparse scenes beyond 2^32 voxels" };
+    argv = app.ensure_utf8(argv);
+
+    TestArgs args;
+
+    app.add_option("-j,--threads", args.threads, "Worker threads (Defaults to all cores)");
+    app.add_flag("--dense", args.dense, "Also build a grid and texture past 2^32 voxels");
+
+    CLI11_PARSE(app, argc, argv);
+
+    Generators::TaskScheduler::getInstance().init(args.threads);
+
+    // Tree dimensions are cubes, the streamed scene is just past 2^32 voxels to keep its block
+    // count down
+    const glm::uvec3 treeScene(4096);
+    const glm::uvec3 streamedScene(2048, 2048, 1040);
+
+    checkTrees(treeScene);
+    checkBrickmap(streamedScene);
+    if (args.dense)
+        checkDense(streamedScene);
+    checkHeader(treeScene);
+    checkMorton();
+    checkLimits(treeScene, streamedScene);
+
+    printf("%u failed\n", failures);
+    return failures == 0 ? 0 : 1;
+}
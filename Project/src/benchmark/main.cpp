@@ -0,0 +1,124 @@
+#include <CLI/CLI.hpp>
+
+#include "cache_simulator.hpp"
+#include "octree_traversal.hpp"
+
+#include "generators/octree.hpp"
+#include "serializers/octree.hpp"
+
+#include <glm/gtc/constants.hpp>
+
+#include <cstdio>
+
+struct BenchmarkArgs {
+    std::string input = "";
+    uint32_t resolution = 256;
+    uint32_t views = 8;
+    uint32_t cacheSize = 32;
+    uint32_t tlbEntries = 64;
+};
+
+static const char* layoutName(Generators::OctreeLayout layout)
+{
+    switch (layout) {
+    case Generators::OctreeLayout::DEPTH_FIRST:
+        return "dfs";
+    case Generators::OctreeLayout::BREADTH_FIRST:
+        return "bfs";
+    case Generators::OctreeLayout::VAN_EMDE_BOAS:
+        return "veb";
+    }
+
+    return "unknown";
+}
+
+int main(int argc, char** argv)
+{
+    CLI::App app { "Measure cache misses per ray for each octree node layout" };
+    argv = app.ensure_utf8(argv);
+
+    BenchmarkArgs args;
+
+    app.add_option("input", args.input, "Octree directory to benchmark")
+        ->check(CLI::ExistingDirectory);
+    app.add_option("-r,--resolution", args.resolution, "Rays per side of each view");
+    app.add_option("-v,--views", args.views, "Number of views around the model");
+    app.add_option("--cache", args.cacheSize, "Simulated data cache size in KB (64 B lines)");
+    app.add_option("--tlb", args.tlbEntries, "Simulated TLB entries (4 KB pages)");
+
+    CLI11_PARSE(app, argc, argv);
+
+    auto data = Serializers::loadOctree(std::filesystem::path(args.input));
+    if (!data.has_value()) {
+        fprintf(stderr, "Failed to load %s\n", args.input.c_str());
+        return -1;
+    }
+
+    const std::vector<Generators::OctreeNode>& nodes = std::get<1>(data.value());
+
+    const uint64_t rayCount = (uint64_t)args.resolution * args.resolution * args.views;
+
+    printf("%-6s %10s %12s %14s %14s\n", "Layout", "Nodes", "Reads/ray", "Lines/ray", "Pages/ray");
+
+    std::optional<uint64_t> referenceChecksum;
+
+    for (Generators::OctreeLayout layout : { Generators::OctreeLayout::DEPTH_FIRST,
+             Generators::OctreeLayout::BREADTH_FIRST, Generators::OctreeLayout::VAN_EMDE_BOAS }) {
+        std::vector<Generators::OctreeNode> laidOut = Generators::layoutOctree(nodes, layout);
+
+        std::vector<uint32_t> raw;
+        for (const Generators::OctreeNode& node : laidOut) {
+            raw.push_back(node.getData());
+        }
+
+        // Ropes depend on node indices so are rebuilt and checked for every layout
+        auto ropes = Generators::generateOctreeRopes(laidOut);
+        if (ropes.has_value() && !Generators::validateOctreeRopes(laidOut, ropes.value())) {
+            fprintf(stderr, "Layout %s produced ropes which disagree with a neighbour search\n",
+                layoutName(layout));
+        }
+
+        CacheSimulator lines(args.cacheSize * 1024, 64, 8);
+        CacheSimulator pages(args.tlbEntries * 4096, 4096, args.tlbEntries);
+
+        OctreeTraversal traversal(raw, [&](size_t index) {
+            lines.access(index * sizeof(uint32_t));
+            pages.access(index * sizeof(uint32_t));
+        });
+
+        // Coherent primary rays, each view orbits the model looking at its centre
+        uint64_t checksum = 0;
+        const glm::vec3 centre(0.5f);
+        for (uint32_t view = 0; view < args.views; view++) {
+            float angle = view * glm::two_pi<float>() / args.views;
+            glm::vec3 origin = centre + glm::vec3(std::cos(angle), 0.4f, std::sin(angle)) * 1.5f;
+
+            glm::vec3 forward = glm::normalize(centre - origin);
+            glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0, 1, 0)));
+            glm::vec3 up = glm::cross(right, forward);
+
+            for (uint32_t y = 0; y < args.resolution; y++) {
+                for (uint32_t x = 0; x < args.resolution; x++) {
+                    glm::vec2 uv = (glm::vec2(x, y) + 0.5f) / (float)args.resolution * 2.f - 1.f;
+                    glm::vec3 offset = (uv.x * right + uv.y * up) * 0.6f;
+                    glm::vec3 direction = glm::normalize(forward + offset);
+
+                    auto hit = traversal.trace(origin, direction);
+                    checksum = checksum * 31 + (hit.has_value() ? hit.value() + 1 : 0);
+                }
+            }
+        }
+
+        if (!referenceChecksum.has_value()) {
+            referenceChecksum = checksum;
+        } else if (referenceChecksum.value() != checksum) {
+            fprintf(stderr, "Layout %s produced different hits\n", layoutName(layout));
+        }
+
+        printf("%-6s %10zu %12.2f %14.3f %14.3f\n", layoutName(layout), raw.size(),
+            lines.getAccesses() / (double)rayCount, lines.getMisses() / (double)rayCount,
+            pages.getMisses() / (double)rayCount);
+    }
+
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include "octree_traversal.hpp"
+
+#include <algorithm>
+#include <array>
+
+OctreeTraversal::OctreeTraversal(const std::vector<uint32_t>& nodes, AccessCallback onAccess)
+    : m_Nodes(nodes), m_OnAccess(onAccess)
+{
+}
+
+std::optional<uint32_t> OctreeTraversal::trace(glm::vec3 origin, glm::vec3 direction)
+{
+    if (m_Nodes.empty())
+        return {};
+
+    m_Origin = origin;
+    m_InverseDirection = 1.f / direction;
+
+    return visit(0, glm::vec3(0), 1.f);
+}
+
+std::optional<uint32_t> OctreeTraversal::visit(size_t index, glm::vec3 minimum, float size)
+{
+    uint32_t data = read(index);
+
+    bool solid = ((data >> 30) & 0x1) != 0;
+    if (solid)
+        return data & 0xFFFFFF;
+
+    uint32_t childMask = (data >> 22) & 0xFF;
+    if (childMask == 0)
+        return {};
+
+    size_t childStart = index + (data & 0x1FFFFF);
+    if ((data & 0x200000) != 0)
+        childStart += read(childStart);
+
+    // Children sorted front to back by entry distance
+    std::array<std::pair<float, uint32_t>, 8> order;
+    uint32_t count = 0;
+
+    float half = size / 2.f;
+    for (uint32_t child = 0; child < 8; child++) {
+        if (((childMask >> child) & 1) == 0)
+            continue;
+
+        // Child bits match the renderer, x -> 1, z -> 2, y -> 4
+        glm::vec3 offset = glm::vec3(child & 1, (child >> 2) & 1, (child >> 1) & 1);
+        glm::vec3 childMin = minimum + offset * half;
+
+        glm::vec3 t0 = (childMin - m_Origin) * m_InverseDirection;
+        glm::vec3 t1 = (childMin + half - m_Origin) * m_InverseDirection;
+        glm::vec3 tNear = glm::min(t0, t1);
+        glm::vec3 tFar = glm::max(t0, t1);
+
+        float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.f));
+        float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+        if (entry <= exit)
+            order[count++] = { entry, child };
+    }
+
+    std::sort(order.begin(), order.begin() + count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t child = order[i].second;
+
+        // Siblings are stored from the highest child index down
+        size_t childIndex = childStart + glm::bitCount(childMask >> (child + 1));
+
+        glm::vec3 offset = glm::vec3(child & 1, (child >> 2) & 1, (child >> 1) & 1);
+        auto hit = visit(childIndex, minimum + offset * half, half);
+        if (hit.has_value())
+            return hit;
+    }
+
+    return {};
+}
+
+uint32_t OctreeTraversal::read(size_t index)
+{
+    m_OnAccess(index);
+    return m_Nodes.at(index);
+}
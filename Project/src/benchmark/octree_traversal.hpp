@@ -0,0 +1,32 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+// CPU reference traversal over the packed node format used by the renderer. Every node read is
+// reported so the access pattern of a layout can be measured.
+class OctreeTraversal {
+  public:
+    using AccessCallback = std::function<void(size_t index)>;
+
+    OctreeTraversal(const std::vector<uint32_t>& nodes, AccessCallback onAccess);
+
+    // Ray in the octree's unit cube, returns the packed colour of the first leaf hit
+    std::optional<uint32_t> trace(glm::vec3 origin, glm::vec3 direction);
+
+  private:
+    std::optional<uint32_t> visit(size_t index, glm::vec3 minimum, float size);
+
+    uint32_t read(size_t index);
+
+  private:
+    const std::vector<uint32_t>& m_Nodes;
+    AccessCallback m_OnAccess;
+
+    glm::vec3 m_Origin;
+    glm::vec3 m_InverseDirection;
+};
@@ -0,0 +1,118 @@
+#include "block_stream.hpp"
+#include "task_scheduler.hpp"
+
+#include "morton/morton_code.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace Generators {
+// Blocks sampled together before being sent in order
+static constexpr size_t ScanBatch = 64;
+
+BlockStream::BlockStream(glm::uvec3 dimensions, size_t capacity)
+    : m_Dimensions(dimensions), m_Capacity(capacity)
+{
+}
+
+uint64_t BlockStream::getBlockCount() const
+{
+    glm::uvec3 blocks = blockGridDimensions(m_Dimensions);
+    return (uint64_t)blocks.x * blocks.y * blocks.z;
+}
+
+bool BlockStream::push(std::shared_ptr<const VoxelBlock> block)
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Changed.wait(lock, [this]() { return m_Closed || m_Blocks.size() < m_Capacity; });
+    if (m_Closed)
+        return false;
+
+    m_Blocks.push_back(std::move(block));
+    m_Changed.notify_all();
+    return true;
+}
+
+std::shared_ptr<const VoxelBlock> BlockStream::pop()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Changed.wait(lock, [this]() { return m_Closed || !m_Blocks.empty(); });
+    if (m_Blocks.empty())
+        return nullptr;
+
+    std::shared_ptr<const VoxelBlock> block = std::move(m_Blocks.front());
+    m_Blocks.pop_front();
+    m_Changed.notify_all();
+    return block;
+}
+
+void BlockStream::close()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Closed = true;
+    m_Changed.notify_all();
+}
+
+glm::uvec3 blockGridDimensions(glm::uvec3 dimensions)
+{
+    return (dimensions + VoxelBlock::Edge - 1u) / VoxelBlock::Edge;
+}
+
+static void sampleBlock(Loader& loader, VoxelBlock& block)
+{
+    memset(block.occupancy, 0, sizeof(block.occupancy));
+
+    const glm::uvec3 origin = block.position * VoxelBlock::Edge;
+    for (uint32_t z = 0; z < VoxelBlock::Edge; z++) {
+        for (uint32_t y = 0; y < VoxelBlock::Edge; y++) {
+            for (uint32_t x = 0; x < VoxelBlock::Edge; x++) {
+                auto voxel = loader.getVoxel(origin + glm::uvec3(x, y, z));
+                if (!voxel.has_value())
+                    continue;
+
+                uint32_t index = VoxelBlock::localIndex({ x, y, z });
+                block.occupancy[index / 64] |= 1ull << (index % 64);
+                block.colours[index] = voxel.value();
+            }
+        }
+    }
+}
+
+void scanBlocks(std::stop_token stoken, Loader& loader, const std::vector<BlockStream*>& streams)
+{
+    const glm::uvec3 blocks = blockGridDimensions(loader.getDimensions());
+
+    uint32_t side = 1;
+    while (side < blocks.x || side < blocks.y || side < blocks.z)
+        side *= 2;
+    const uint64_t finalCode = (uint64_t)side * side * side;
+
+    // Morton codes of the blocks inside the volume
+    std::vector<uint64_t> codes;
+    codes.reserve((uint64_t)blocks.x * blocks.y * blocks.z);
+    for (uint64_t code = 0; code < finalCode; code++) {
+        if (!glm::any(glm::greaterThanEqual(MortonCode::decode(code), blocks)))
+            codes.push_back(code);
+    }
+
+    std::vector<std::shared_ptr<VoxelBlock>> batch(ScanBatch);
+    for (size_t start = 0; start < codes.size() && !stoken.stop_requested(); start += ScanBatch) {
+        const size_t count = std::min(ScanBatch, codes.size() - start);
+
+        TaskScheduler::getInstance().parallelFor(count, 1, [&](size_t i) {
+            batch[i] = std::make_shared<VoxelBlock>();
+            batch[i]->position = MortonCode::decode(codes[start + i]);
+            sampleBlock(loader, *batch[i]);
+        });
+
+        for (size_t i = 0; i < count; i++) {
+            for (BlockStream* stream : streams)
+                stream->push(batch[i]);
+            batch[i] = nullptr;
+        }
+    }
+
+    for (BlockStream* stream : streams)
+        stream->close();
+}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <vector>
+
+#include "loaders/loader.hpp"
+
+namespace Generators {
+// Cube of voxels read once from a loader and shared between every generator.
+// The edge is a power of 4 so blocks line up with octree and contree subtrees, and a multiple of
+// every brick size.
+struct VoxelBlock {
+    static constexpr uint32_t Edge = 16;
+    static constexpr uint32_t Voxels = Edge * Edge * Edge;
+
+    // Block coordinates, multiply by Edge for the first voxel
+    glm::uvec3 position;
+
+    uint64_t occupancy[Voxels / 64];
+    std::array<glm::vec3, Voxels> colours;
+
+    static uint32_t localIndex(glm::uvec3 local)
+    {
+        return local.x + local.y * Edge + local.z * Edge * Edge;
+    }
+
+    std::optional<glm::vec3> getVoxel(glm::uvec3 local) const
+    {
+        uint32_t index = localIndex(local);
+        if ((occupancy[index / 64] & (1ull << (index % 64))) == 0)
+            return {};
+
+        return colours[index];
+    }
+
+    bool empty() const
+    {
+        for (uint64_t word : occupancy) {
+            if (word != 0)
+                return false;
+        }
+        return true;
+    }
+};
+
+// Bounded single producer, single consumer queue of blocks.
+// Either side may close the stream, the producer once every block is sent and the consumer when
+// it stops early so the producer never blocks on a stream nobody reads.
+class BlockStream {
+  public:
+    BlockStream(glm::uvec3 dimensions, size_t capacity = 64);
+
+    // Loader dimensions of the scanned volume
+    glm::uvec3 getDimensions() const { return m_Dimensions; }
+    // Number of blocks the producer will send
+    uint64_t getBlockCount() const;
+
+    // Returns false once the stream is closed
+    bool push(std::shared_ptr<const VoxelBlock> block);
+    // Returns nullptr once the stream is closed and drained
+    std::shared_ptr<const VoxelBlock> pop();
+
+    void close();
+
+  private:
+    glm::uvec3 m_Dimensions;
+    size_t m_Capacity;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_Changed;
+    std::deque<std::shared_ptr<const VoxelBlock>> m_Blocks;
+    bool m_Closed = false;
+};
+
+glm::uvec3 blockGridDimensions(glm::uvec3 dimensions);
+
+// Reads every voxel of the loader once, a block at a time in Morton order, and sends each block
+// to all of the streams. Closes the streams when done.
+void scanBlocks(std::stop_token stoken, Loader& loader, const std::vector<BlockStream*>& streams);
+}
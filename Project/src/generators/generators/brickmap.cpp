@@ -1,28 +1,122 @@
 #include "brickmap.hpp"
+#include "memory.hpp"
+#include "task_scheduler.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <memory_resource>
 #include <optional>
+#include <unordered_map>
 
 namespace Generators {
-uint32_t getOffset(uint32_t type)
+template <uint32_t Size> using BrickColours = std::array<uint8_t, SizedBrickmap<Size>::Voxels * 3>;
+
+static_assert(BrickgridTile == 4, "Tile Morton codes interleave two bits per axis");
+static constexpr uint32_t TileBricks = BrickgridTile * BrickgridTile * BrickgridTile;
+
+size_t brickgridSize(glm::uvec3 dimensions, BrickgridLayout layout)
 {
-    switch (type) {
-    case 2:
-        return 8;
-    case 1:
-        return 64;
-    case 0:
-        return 512;
-    default:
-        assert(false && "Type out of range");
+    switch (layout) {
+    case BrickgridLayout::LINEAR:
+        return (size_t)dimensions.x * dimensions.y * dimensions.z;
+    case BrickgridLayout::TILED: {
+        glm::uvec3 tiles = (dimensions + BrickgridTile - 1u) / BrickgridTile;
+        return (size_t)tiles.x * tiles.y * tiles.z * TileBricks;
+    }
+    case BrickgridLayout::PAGED:
+        return brickgridPageTableSize(dimensions, layout);
     }
+
+    assert(false && "Unknown brickgrid layout");
+    return 0;
+}
+
+size_t brickgridPageTableSize(glm::uvec3 dimensions, BrickgridLayout layout)
+{
+    if (layout != BrickgridLayout::PAGED)
+        return 0;
+
+    glm::uvec3 pages = (dimensions + BrickgridPage - 1u) / BrickgridPage;
+    return (size_t)pages.x * pages.y * pages.z;
+}
+
+static size_t pageTableIndex(glm::uvec3 brick, glm::uvec3 dimensions)
+{
+    glm::uvec3 pages = (dimensions + BrickgridPage - 1u) / BrickgridPage;
+    glm::uvec3 page = brick / BrickgridPage;
+
+    return page.x + (size_t)page.z * pages.x + (size_t)page.y * pages.x * pages.z;
+}
+
+static uint32_t pageOffset(glm::uvec3 brick)
+{
+    glm::uvec3 local = brick % BrickgridPage;
+    return local.x + local.z * BrickgridPage + local.y * BrickgridPage * BrickgridPage;
+}
+
+std::optional<size_t> pagedBrickgridIndex(
+    const std::vector<BrickgridPtr>& brickgrid, glm::uvec3 brick, glm::uvec3 dimensions)
+{
+    BrickgridPtr page = brickgrid[pageTableIndex(brick, dimensions)];
+    if (page == 0)
+        return {};
+
+    return page + pageOffset(brick);
+}
+
+size_t allocateBrickgridPage(
+    std::vector<BrickgridPtr>& brickgrid, glm::uvec3 brick, glm::uvec3 dimensions)
+{
+    const size_t table = pageTableIndex(brick, dimensions);
+    if (brickgrid[table] == 0) {
+        brickgrid[table] = brickgrid.size();
+        brickgrid.resize(brickgrid.size() + BrickgridPageEntries, 0x1);
+    }
+
+    return brickgrid[table] + pageOffset(brick);
 }
 
-uint32_t getFreeColour(std::array<uint8_t, 8 * 8 * 8 * 3>& brickColours, uint32_t usedColours,
+// Interleaves the two low bits of each axis, x lowest
+static uint32_t tileMorton(glm::uvec3 local)
+{
+    uint32_t code = 0;
+    for (uint32_t bit = 0; bit < 2; bit++) {
+        code |= ((local.x >> bit) & 1) << (bit * 3 + 0);
+        code |= ((local.y >> bit) & 1) << (bit * 3 + 1);
+        code |= ((local.z >> bit) & 1) << (bit * 3 + 2);
+    }
+    return code;
+}
+
+size_t brickgridIndex(glm::uvec3 brick, glm::uvec3 dimensions, BrickgridLayout layout)
+{
+    assert(layout != BrickgridLayout::PAGED && "Paged entries depend on the allocated pages");
+
+    if (layout == BrickgridLayout::TILED) {
+        glm::uvec3 tiles = (dimensions + BrickgridTile - 1u) / BrickgridTile;
+        glm::uvec3 tile = brick / BrickgridTile;
+
+        size_t tileIndex = tile.x + (size_t)tile.z * tiles.x + (size_t)tile.y * tiles.x * tiles.z;
+        return tileIndex * TileBricks + tileMorton(brick % BrickgridTile);
+    }
+
+    return brick.x + (size_t)brick.z * dimensions.x + (size_t)brick.y * dimensions.x * dimensions.z;
+}
+
+template <uint32_t Size> uint32_t getOffset(uint32_t type)
+{
+    assert(type <= 2 && "Type out of range");
+    return SizedBrickmap<Size>::Voxels >> (3 * type);
+}
+
+template <uint32_t Size>
+uint32_t getFreeColour(const BrickColours<Size>& brickColours, uint32_t usedColours,
     std::vector<BrickmapColour>& colours, uint32_t start_index = 0)
 {
     uint32_t type;
-    if (usedColours <= 2 * 2 * 2) {
+    if (usedColours <= getOffset<Size>(2)) {
         type = 2;
-    } else if (usedColours <= 4 * 4 * 4) {
+    } else if (usedColours <= getOffset<Size>(1)) {
         type = 1;
     } else {
         type = 0;
@@ -31,7 +125,7 @@ uint32_t getFreeColour(std::array<uint8_t, 8 * 8 * 8 * 3>& brickColours, uint32_
     // Traverse colours
     for (uint32_t i = start_index; i < colours.size();) {
         if (colours[i].getType() > type) {
-            int skip = getOffset(colours[i].getType());
+            int skip = getOffset<Size>(colours[i].getType());
             // Can improve by skipping based on the parent index to skip over entire block
 
             i += skip;
@@ -39,7 +133,7 @@ uint32_t getFreeColour(std::array<uint8_t, 8 * 8 * 8 * 3>& brickColours, uint32_
         }
 
         if (colours[i].getUsed()) {
-            i += getOffset(colours[i].getType());
+            i += getOffset<Size>(colours[i].getType());
             continue;
         }
 
@@ -55,7 +149,7 @@ uint32_t getFreeColour(std::array<uint8_t, 8 * 8 * 8 * 3>& brickColours, uint32_
             return i;
         } else if (colours[i].getType() < type) { // Split node
             uint32_t newType = colours[i].getType() + 1;
-            uint32_t offset = getOffset(newType);
+            uint32_t offset = getOffset<Size>(newType);
             colours[i].setType(newType);
             for (int j = 0; j < 8; j++) {
                 colours[i + j * offset].setType(newType);
@@ -67,100 +161,536 @@ uint32_t getFreeColour(std::array<uint8_t, 8 * 8 * 8 * 3>& brickColours, uint32_
 
     // Didn't find anything free so resize
     uint32_t end = colours.size();
-    colours.resize(end + 512);
+    colours.resize(end + SizedBrickmap<Size>::Voxels);
     colours[end].setType(0);
     colours[end].setUsed(false);
-    return getFreeColour(brickColours, usedColours, colours, end);
+    return getFreeColour<Size>(brickColours, usedColours, colours, end);
+}
+
+// Copies the brick's colours out of the pool, returns the number of colours
+template <uint32_t Size>
+static uint32_t readBrickColours(const SizedBrickmap<Size>& brick,
+    const std::vector<BrickmapColour>& colours, BrickColours<Size>& brickColours)
+{
+    uint32_t usedColours = 0;
+    for (uint32_t i = 0; i < SizedBrickmap<Size>::Words; i++)
+        usedColours += std::popcount(brick.occupancy[i]);
+
+    for (uint32_t i = 0; i < usedColours; i++) {
+        const BrickmapColour& colour = colours[brick.colourPtr + i];
+        brickColours[i * 3 + 0] = colour.r;
+        brickColours[i * 3 + 1] = colour.g;
+        brickColours[i * 3 + 2] = colour.b;
+    }
+
+    return usedColours;
+}
+
+template <uint32_t Size>
+static uint64_t hashBrick(
+    const uint64_t* occupancy, const BrickColours<Size>& brickColours, uint32_t usedColours)
+{
+    // FNV-1a over the occupancy followed by the packed colours
+    uint64_t hash = 0xcbf29ce484222325;
+    auto combine = [&](uint8_t byte) {
+        hash ^= byte;
+        hash *= 0x100000001b3;
+    };
+
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(occupancy);
+    for (size_t i = 0; i < sizeof(uint64_t) * SizedBrickmap<Size>::Words; i++)
+        combine(bytes[i]);
+
+    for (uint32_t i = 0; i < usedColours * 3; i++)
+        combine(brickColours[i]);
+
+    return hash;
 }
 
-std::tuple<std::vector<BrickgridPtr>, std::vector<Brickmap>, std::vector<BrickmapColour>>
+template <uint32_t Size>
+static bool brickEqual(const SizedBrickmap<Size>& brick, const std::vector<BrickmapColour>& colours,
+    const uint64_t* occupancy, const BrickColours<Size>& brickColours, uint32_t usedColours)
+{
+    if (memcmp(brick.occupancy, occupancy, sizeof(brick.occupancy)) != 0)
+        return false;
+
+    for (uint32_t i = 0; i < usedColours; i++) {
+        const BrickmapColour& colour = colours[brick.colourPtr + i];
+        if (colour.r != brickColours[i * 3 + 0] || colour.g != brickColours[i * 3 + 1]
+            || colour.b != brickColours[i * 3 + 2])
+            return false;
+    }
+
+    return true;
+}
+
+template <uint32_t Size> struct SampledBrick {
+    uint64_t occupancy[SizedBrickmap<Size>::Words];
+    BrickColours<Size> colours;
+    uint32_t usedColours;
+};
+
+// Voxels sampled per batch of bricks, bounds the memory held between sampling and placement
+static constexpr size_t BatchVoxels = 1 << 22;
+
+// voxel(local) returns the voxel at the given offset from the first voxel of the brick
+template <uint32_t Size, typename Source>
+static void sampleBrick(Source&& voxel, SampledBrick<Size>& brick)
+{
+    using Brick = SizedBrickmap<Size>;
+
+    memset(brick.occupancy, 0, sizeof(brick.occupancy));
+    brick.usedColours = 0;
+
+    for (uint32_t y = 0; y < Size; y++) {
+        for (uint32_t z = 0; z < Size; z++) {
+            for (uint32_t x = 0; x < Size; x++) {
+                std::optional<glm::vec3> value = voxel(glm::uvec3(x, y, z));
+
+                if (value.has_value()) {
+                    uint32_t bit = Brick::bitIndex(x, y, z);
+                    brick.occupancy[bit / 64] |= ((uint64_t)1) << (bit % 64);
+
+                    glm::vec3 colour = value.value();
+
+                    brick.colours[brick.usedColours * 3 + 0] = std::ceil(colour.r * 255);
+                    brick.colours[brick.usedColours * 3 + 1] = std::ceil(colour.g * 255);
+                    brick.colours[brick.usedColours * 3 + 2] = std::ceil(colour.b * 255);
+                    brick.usedColours++;
+                }
+            }
+        }
+    }
+}
+
+template <uint32_t Size>
+static void orderBricks(std::vector<BrickgridPtr>& grid,
+    std::vector<SizedBrickmap<Size>>& brickmaps, std::vector<BrickmapColour>& colours,
+    size_t pageTableSize);
+
+// Places sampled bricks into the brickgrid, allocating colours and sharing duplicates
+template <uint32_t Size> struct BrickmapBuilder {
+    using Brick = SizedBrickmap<Size>;
+
+    std::vector<BrickgridPtr> brickgrid;
+    std::vector<Brick> brickmaps;
+    std::vector<BrickmapColour> colours;
+
+    // Scratch memory of the builder, the outputs above use the global heap as they outlive it
+    TrackingResource memory;
+    // Many small candidate lists, pooled rather than each taking its own heap allocation
+    std::pmr::unsynchronized_pool_resource sharedPool { &memory };
+    // Hash -> indices of bricks with that hash
+    std::pmr::unordered_map<uint64_t, std::pmr::vector<uint32_t>> sharedBricks { &sharedPool };
+    bool deduplicate;
+
+    glm::uvec3 brickgridDim;
+    // Paged grids are built directly, pages are allocated as their first brick is placed. Every
+    // other layout is built linearly and rearranged once finished.
+    bool paged;
+
+    uint64_t voxelCount = 0;
+    // Set once a brick could not be placed without passing MaxBricks
+    bool overflowed = false;
+
+    BrickmapBuilder(glm::uvec3 brickgridDim, bool deduplicate, BrickgridLayout layout,
+        std::pmr::memory_resource* resource)
+        : memory(resource), deduplicate(deduplicate), brickgridDim(brickgridDim),
+          paged(layout == BrickgridLayout::PAGED)
+    {
+        colours = emptyColourPool();
+
+        if (paged) {
+            brickgrid.assign(brickgridPageTableSize(brickgridDim, layout), 0);
+        } else {
+            brickgrid.assign(brickgridSize(brickgridDim, BrickgridLayout::LINEAR), 0x1);
+        }
+    }
+
+    static std::vector<BrickmapColour> emptyColourPool()
+    {
+        std::vector<BrickmapColour> pool(Brick::Voxels);
+        pool[0].setUsed(false);
+        pool[0].setType(0);
+        return pool;
+    }
+
+    void place(glm::uvec3 brick, const SampledBrick<Size>& sampled)
+    {
+        const uint64_t* occupancy = sampled.occupancy;
+        const BrickColours<Size>& brickColours = sampled.colours;
+        const uint32_t usedColours = sampled.usedColours;
+
+        // Empty bricks keep their default entry, so never allocate a page. Once overflowed the
+        // result is discarded, so stop touching the grid and the dedup table.
+        if (usedColours == 0 || overflowed)
+            return;
+
+        const size_t index = paged
+            ? allocateBrickgridPage(brickgrid, brick, brickgridDim)
+            : brickgridIndex(brick, brickgridDim, BrickgridLayout::LINEAR);
+
+        std::pmr::vector<uint32_t>* candidates = nullptr;
+        if (deduplicate) {
+            uint64_t hash = hashBrick<Size>(occupancy, brickColours, usedColours);
+            candidates = &sharedBricks[hash];
+
+            std::optional<uint32_t> existing;
+            for (uint32_t candidate : *candidates) {
+                if (brickEqual<Size>(
+                        brickmaps[candidate], colours, occupancy, brickColours, usedColours)) {
+                    existing = candidate;
+                    break;
+                }
+            }
+
+            if (existing.has_value()) {
+                brickgrid[index] = 0x1 | ((existing.value() + 1) << 2);
+                voxelCount += Brick::Voxels;
+                return;
+            }
+        }
+
+        // Checked before recording the candidate so the dedup table never holds an index past
+        // the end of brickmaps
+        if (brickmaps.size() >= MaxBricks) {
+            overflowed = true;
+            return;
+        }
+
+        if (candidates != nullptr)
+            candidates->push_back(brickmaps.size());
+
+        Brick placed;
+        placed.colourPtr = getFreeColour<Size>(brickColours, usedColours, colours);
+        memcpy(&placed.occupancy, occupancy, sizeof(placed.occupancy));
+        brickmaps.push_back(placed);
+        brickgrid[index] = 0x1 | (brickmaps.size() << 2);
+        voxelCount += Brick::Voxels;
+    }
+
+    void finish(BrickgridLayout layout)
+    {
+        if (paged) {
+            orderBricks<Size>(brickgrid, brickmaps, colours,
+                brickgridPageTableSize(brickgridDim, BrickgridLayout::PAGED));
+        } else {
+            layoutBrickmap<Size>(brickgrid, brickmaps, colours, brickgridDim, layout);
+        }
+    }
+
+    std::tuple<std::vector<BrickgridPtr>, std::vector<Brick>, std::vector<BrickmapColour>> take()
+    {
+        return { std::move(brickgrid), std::move(brickmaps), std::move(colours) };
+    }
+};
+
+template <uint32_t Size>
+std::tuple<std::vector<BrickgridPtr>, std::vector<SizedBrickmap<Size>>,
+    std::vector<BrickmapColour>>
 generateBrickmap(std::stop_token stoken, std::unique_ptr<Loader>&& loader, GenerationInfo& info,
-    glm::uvec3& brickgridDim, bool& finished)
+    glm::uvec3& brickgridDim, bool& finished, bool deduplicate, BrickgridLayout layout,
+    std::pmr::memory_resource* resource)
 {
+    using Brick = SizedBrickmap<Size>;
+
     std::chrono::steady_clock timer;
     auto start = timer.now();
 
     glm::uvec3 dimensions = loader->getDimensions();
-    brickgridDim = glm::uvec3(glm::ceil(glm::vec3(dimensions) / 8.f));
+    brickgridDim = glm::uvec3(glm::ceil(glm::vec3(dimensions) / (float)Size));
 
-    size_t totalNodes = brickgridDim.x * brickgridDim.y * brickgridDim.z;
+    size_t totalNodes = (size_t)brickgridDim.x * brickgridDim.y * brickgridDim.z;
 
-    std::vector<BrickgridPtr> brickgrid;
-    std::vector<Brickmap> brickmaps;
-    std::vector<BrickmapColour> colours;
+    BrickmapBuilder<Size> builder(brickgridDim, deduplicate, layout, resource);
 
-    colours.resize(512);
-    colours[0].setUsed(false);
-    colours[0].setType(0);
+    info.voxelCount = 0;
 
-    brickgrid.assign(totalNodes, 0x1);
+    // Bricks are sampled in parallel a batch at a time, then placed in grid order so the output
+    // matches a sequential pass
+    const size_t batchSize = std::max(BatchVoxels / Brick::Voxels, (size_t)1);
+    std::vector<SampledBrick<Size>> batch(std::min(batchSize, totalNodes));
 
-    info.voxelCount = 0;
+    TaskScheduler& scheduler = TaskScheduler::getInstance();
 
-    size_t index = 0;
-    std::array<uint8_t, 8 * 8 * 8 * 3> brickColours;
-    for (uint32_t bY = 0; bY < brickgridDim.y; bY++) {
-        for (uint32_t bZ = 0; bZ < brickgridDim.z; bZ++) {
-            for (uint32_t bX = 0; bX < brickgridDim.x; bX++) {
-                if (stoken.stop_requested())
-                    return { brickgrid, brickmaps, colours };
+    for (size_t batchStart = 0; batchStart < totalNodes; batchStart += batchSize) {
+        const size_t batchCount = std::min(batchSize, totalNodes - batchStart);
 
-                glm::ivec3 brickWorld = glm::ivec3(bX, bY, bZ) * 8;
+        scheduler.parallelFor(batchCount, 16, [&](size_t i) {
+            if (stoken.stop_requested())
+                return;
 
-                uint32_t usedColours = 0;
-                uint64_t occupancy[8];
+            size_t index = batchStart + i;
+            glm::uvec3 brick = {
+                index % brickgridDim.x,
+                index / (brickgridDim.x * brickgridDim.z),
+                (index / brickgridDim.x) % brickgridDim.z,
+            };
 
-                {
-                    info.completionPercent = (index + 1) / (float)totalNodes;
-                    auto current = timer.now();
-                    std::chrono::duration<float, std::milli> difference = current - start;
-                    info.generationTime = difference.count() / 1000.0f;
-                }
+            glm::uvec3 brickWorld = brick * Size;
+            sampleBrick<Size>(
+                [&](glm::uvec3 local) { return loader->getVoxel(brickWorld + local); }, batch[i]);
+        });
 
-                for (uint64_t y = 0; y < 8; y++) {
-                    occupancy[y] = 0;
-                    for (uint64_t z = 0; z < 8; z++) {
-                        for (uint64_t x = 0; x < 8; x++) {
-                            glm::ivec3 coordinates = brickWorld + glm::ivec3(x, y, z);
+        if (stoken.stop_requested())
+            return builder.take();
 
-                            auto voxel = loader->getVoxel(coordinates);
+        for (size_t i = 0; i < batchCount; i++) {
+            size_t index = batchStart + i;
+            glm::uvec3 brick = {
+                index % brickgridDim.x,
+                index / (brickgridDim.x * brickgridDim.z),
+                (index / brickgridDim.x) % brickgridDim.z,
+            };
 
-                            if (voxel.has_value()) {
-                                occupancy[y] |= ((uint64_t)1) << ((z * 8) + x);
+            builder.place(brick, batch[i]);
+        }
 
-                                glm::vec3 colour = voxel.value();
+        if (builder.overflowed)
+            return builder.take();
 
-                                brickColours[usedColours * 3 + 0] = std::ceil(colour.r * 255);
-                                brickColours[usedColours * 3 + 1] = std::ceil(colour.g * 255);
-                                brickColours[usedColours * 3 + 2] = std::ceil(colour.b * 255);
-                                usedColours++;
-                            }
-                        }
-                    }
-                }
+        info.voxelCount = builder.voxelCount;
+        info.completionPercent = (batchStart + batchCount) / (float)totalNodes;
+        auto current = timer.now();
+        std::chrono::duration<float, std::milli> difference = current - start;
+        info.generationTime = difference.count() / 1000.0f;
+    }
 
-                if (usedColours > 0) {
-                    Brickmap brick;
-                    brick.colourPtr = getFreeColour(brickColours, usedColours, colours);
-                    memcpy(&brick.occupancy, occupancy, sizeof(uint64_t) * 8);
-                    brickmaps.push_back(brick);
-                    brickgrid[index] = 0x1 | (brickmaps.size() << 2);
-                    info.voxelCount += 8 * 8 * 8;
-                }
+    auto end = timer.now();
+    std::chrono::duration<float, std::milli> difference = end - start;
+    info.generationTime = difference.count() / 1000.0f;
+
+    builder.finish(layout);
 
-                index++;
+    info.nodes = builder.brickgrid.size() + builder.brickmaps.size();
+    builder.memory.report(info);
+
+    finished = true;
+
+    return builder.take();
+}
+
+template <uint32_t Size>
+std::tuple<std::vector<BrickgridPtr>, std::vector<SizedBrickmap<Size>>,
+    std::vector<BrickmapColour>>
+generateBrickmap(std::stop_token stoken, BlockStream& stream, GenerationInfo& info,
+    glm::uvec3& brickgridDim, bool& finished, bool deduplicate, BrickgridLayout layout,
+    std::pmr::memory_resource* resource)
+{
+    static_assert(VoxelBlock::Edge % Size == 0, "Blocks must hold whole bricks");
+    constexpr uint32_t BricksPerEdge = VoxelBlock::Edge / Size;
+
+    std::chrono::steady_clock timer;
+    auto start = timer.now();
+
+    glm::uvec3 dimensions = stream.getDimensions();
+    brickgridDim = glm::uvec3(glm::ceil(glm::vec3(dimensions) / (float)Size));
+
+    BrickmapBuilder<Size> builder(brickgridDim, deduplicate, layout, resource);
+
+    info.voxelCount = 0;
+
+    const uint64_t blockCount = stream.getBlockCount();
+    uint64_t received = 0;
+
+    // Bricks are placed in block order rather than grid order
+    SampledBrick<Size> sampled;
+    while (std::shared_ptr<const VoxelBlock> block = stream.pop()) {
+        if (stoken.stop_requested()) {
+            stream.close();
+            return builder.take();
+        }
+
+        received++;
+        if (block->empty())
+            continue;
+
+        for (uint32_t y = 0; y < BricksPerEdge; y++) {
+            for (uint32_t z = 0; z < BricksPerEdge; z++) {
+                for (uint32_t x = 0; x < BricksPerEdge; x++) {
+                    glm::uvec3 brick = block->position * BricksPerEdge + glm::uvec3(x, y, z);
+                    if (glm::any(glm::greaterThanEqual(brick, brickgridDim)))
+                        continue;
+
+                    glm::uvec3 offset = glm::uvec3(x, y, z) * Size;
+                    sampleBrick<Size>(
+                        [&](glm::uvec3 local) { return block->getVoxel(offset + local); },
+                        sampled);
+
+                    builder.place(brick, sampled);
+                }
             }
         }
+
+        if (builder.overflowed) {
+            stream.close();
+            return builder.take();
+        }
+
+        info.voxelCount = builder.voxelCount;
+        info.completionPercent = received / (float)blockCount;
+        auto current = timer.now();
+        std::chrono::duration<float, std::milli> difference = current - start;
+        info.generationTime = difference.count() / 1000.0f;
     }
 
+    if (received != blockCount)
+        return builder.take();
+
     auto end = timer.now();
     std::chrono::duration<float, std::milli> difference = end - start;
     info.generationTime = difference.count() / 1000.0f;
 
-    info.nodes = brickgrid.size() + brickmaps.size();
+    builder.finish(layout);
+
+    info.nodes = builder.brickgrid.size() + builder.brickmaps.size();
+    builder.memory.report(info);
 
     finished = true;
 
-    return { brickgrid, brickmaps, colours };
+    return builder.take();
+}
+
+bool hasSharedBricks(
+    const std::vector<BrickgridPtr>& brickgrid, size_t brickCount, size_t pageTableSize)
+{
+    size_t referenced = 0;
+    for (size_t i = pageTableSize; i < brickgrid.size(); i++) {
+        if ((brickgrid[i] >> 2) != 0)
+            referenced++;
+    }
+
+    return referenced > brickCount;
+}
+
+template <uint32_t Size>
+size_t uniqueBricks(std::vector<BrickgridPtr>& brickgrid,
+    std::vector<SizedBrickmap<Size>>& brickmaps, std::vector<BrickmapColour>& colours,
+    size_t pageTableSize)
+{
+    std::vector<bool> claimed(brickmaps.size(), false);
+    BrickColours<Size> brickColours;
+    size_t copies = 0;
+
+    for (size_t i = pageTableSize; i < brickgrid.size(); i++) {
+        BrickgridPtr& ptr = brickgrid[i];
+        uint32_t brickIndex = ptr >> 2;
+        if (brickIndex == 0)
+            continue;
+        brickIndex--;
+
+        if (!claimed[brickIndex]) {
+            claimed[brickIndex] = true;
+            continue;
+        }
+
+        SizedBrickmap<Size> brick = brickmaps[brickIndex];
+        uint32_t usedColours = readBrickColours<Size>(brick, colours, brickColours);
+
+        brick.colourPtr = getFreeColour<Size>(brickColours, usedColours, colours);
+        brickmaps.push_back(brick);
+        claimed.push_back(true);
+
+        ptr = (ptr & 0x3) | (brickmaps.size() << 2);
+        copies++;
+    }
+
+    return copies;
+}
+
+template <uint32_t Size>
+void layoutBrickmap(std::vector<BrickgridPtr>& brickgrid,
+    std::vector<SizedBrickmap<Size>>& brickmaps, std::vector<BrickmapColour>& colours,
+    glm::uvec3 brickgridDim, BrickgridLayout layout)
+{
+    if (layout == BrickgridLayout::LINEAR)
+        return;
+
+    const bool paged = layout == BrickgridLayout::PAGED;
+
+    std::vector<BrickgridPtr> grid(brickgridSize(brickgridDim, layout), paged ? 0 : 0x1);
+    for (uint32_t y = 0; y < brickgridDim.y; y++) {
+        for (uint32_t z = 0; z < brickgridDim.z; z++) {
+            for (uint32_t x = 0; x < brickgridDim.x; x++) {
+                glm::uvec3 brick(x, y, z);
+                BrickgridPtr ptr
+                    = brickgrid[brickgridIndex(brick, brickgridDim, BrickgridLayout::LINEAR)];
+
+                if (!paged) {
+                    grid[brickgridIndex(brick, brickgridDim, layout)] = ptr;
+                } else if ((ptr >> 2) != 0) {
+                    grid[allocateBrickgridPage(grid, brick, brickgridDim)] = ptr;
+                }
+            }
+        }
+    }
+
+    brickgrid = std::move(grid);
+    orderBricks<Size>(
+        brickgrid, brickmaps, colours, brickgridPageTableSize(brickgridDim, layout));
+}
+
+// Bricks and their colours are renumbered in the order the grid first references them
+template <uint32_t Size>
+static void orderBricks(std::vector<BrickgridPtr>& grid,
+    std::vector<SizedBrickmap<Size>>& brickmaps, std::vector<BrickmapColour>& colours,
+    size_t pageTableSize)
+{
+    std::vector<uint32_t> remap(brickmaps.size(), 0);
+    std::vector<SizedBrickmap<Size>> ordered;
+    ordered.reserve(brickmaps.size());
+    std::vector<BrickmapColour> orderedColours = BrickmapBuilder<Size>::emptyColourPool();
+
+    BrickColours<Size> brickColours;
+    for (size_t i = pageTableSize; i < grid.size(); i++) {
+        BrickgridPtr& ptr = grid[i];
+        uint32_t brickIndex = ptr >> 2;
+        if (brickIndex == 0)
+            continue;
+        brickIndex--;
+
+        if (remap[brickIndex] == 0) {
+            SizedBrickmap<Size> brick = brickmaps[brickIndex];
+            uint32_t usedColours = readBrickColours<Size>(brick, colours, brickColours);
+
+            brick.colourPtr = getFreeColour<Size>(brickColours, usedColours, orderedColours);
+            ordered.push_back(brick);
+            remap[brickIndex] = ordered.size();
+        }
+
+        ptr = (ptr & 0x3) | (remap[brickIndex] << 2);
+    }
+
+    brickmaps = std::move(ordered);
+    colours = std::move(orderedColours);
+}
+
+template <uint32_t Size>
+void compactBrickmap(std::vector<BrickgridPtr>& brickgrid,
+    std::vector<SizedBrickmap<Size>>& brickmaps, std::vector<BrickmapColour>& colours,
+    size_t pageTableSize)
+{
+    orderBricks<Size>(brickgrid, brickmaps, colours, pageTableSize);
 }
+
+#define INSTANTIATE_BRICKMAP(SIZE)                                                                 \
+    template std::tuple<std::vector<BrickgridPtr>, std::vector<SizedBrickmap<SIZE>>,              \
+        std::vector<BrickmapColour>>                                                               \
+    generateBrickmap<SIZE>(std::stop_token, std::unique_ptr<Loader>&&, GenerationInfo&,           \
+        glm::uvec3&, bool&, bool, BrickgridLayout, std::pmr::memory_resource*);                    \
+    template std::tuple<std::vector<BrickgridPtr>, std::vector<SizedBrickmap<SIZE>>,              \
+        std::vector<BrickmapColour>>                                                               \
+    generateBrickmap<SIZE>(std::stop_token, BlockStream&, GenerationInfo&, glm::uvec3&, bool&,    \
+        bool, BrickgridLayout, std::pmr::memory_resource*);                                        \
+    template size_t uniqueBricks<SIZE>(std::vector<BrickgridPtr>&,                                 \
+        std::vector<SizedBrickmap<SIZE>>&, std::vector<BrickmapColour>&, size_t);                 \
+    template void layoutBrickmap<SIZE>(std::vector<BrickgridPtr>&,                                 \
+        std::vector<SizedBrickmap<SIZE>>&, std::vector<BrickmapColour>&, glm::uvec3,              \
+        BrickgridLayout);                                                                          \
+    template void compactBrickmap<SIZE>(std::vector<BrickgridPtr>&,                                \
+        std::vector<SizedBrickmap<SIZE>>&, std::vector<BrickmapColour>&, size_t);
+
+INSTANTIATE_BRICKMAP(4)
+INSTANTIATE_BRICKMAP(8)
+INSTANTIATE_BRICKMAP(16)
 };
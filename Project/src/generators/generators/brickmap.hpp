@@ -3,26 +3,91 @@
 #include <glm/glm.hpp>
 
 #include <memory>
+#include <memory_resource>
+#include <optional>
 #include <thread>
 #include <vector>
 
+#include "block_stream.hpp"
 #include "common.hpp"
 #include "loaders/loader.hpp"
 
+// Edge length of the bricks used by the renderer, set through CMake
+#ifndef BRICKMAP_BRICK_SIZE
+#define BRICKMAP_BRICK_SIZE 8
+#endif
+
+// Only lowered by the large scene test, so refusing an oversized brickmap can be reached
+#ifndef BRICKMAP_MAX_BRICKS
+#define BRICKMAP_MAX_BRICKS ((1u << 30) - 1)
+#endif
+
 namespace Generators {
 // Lowest bit marks loaded
 // Second lowest marks requested
 using BrickgridPtr = uint32_t;
 
-struct Brickmap {
+// Pointers hold the brick number above their two flag bits, brickmaps needing more bricks are not
+// generated
+constexpr size_t MaxBricks = BRICKMAP_MAX_BRICKS;
+
+// Occupancy bits are indexed x + z * Size + y * Size * Size
+template <uint32_t Size> struct SizedBrickmap {
+    static_assert(Size == 4 || Size == 8 || Size == 16, "Brick size must be 4, 8 or 16");
+
+    static constexpr uint32_t Voxels = Size * Size * Size;
+    static constexpr uint32_t Words = Voxels / 64;
+
     uint64_t colourPtr;
-    uint64_t occupancy[8];
+    uint64_t occupancy[Words];
+
+    static constexpr uint32_t bitIndex(uint32_t x, uint32_t y, uint32_t z)
+    {
+        return x + z * Size + y * Size * Size;
+    }
+};
+
+constexpr uint32_t BrickSize = BRICKMAP_BRICK_SIZE;
+using Brickmap = SizedBrickmap<BrickSize>;
+
+// Order of the brickgrid entries. The brick and colour pools follow the order bricks are first
+// referenced by the grid, so neighbouring bricks sit close together in every buffer.
+enum class BrickgridLayout : uint32_t {
+    // x + z * X + y * X * Z
+    LINEAR = 0,
+    // Tiles of BrickgridTile^3 bricks in linear order, Morton order within each tile. The grid is
+    // padded to whole tiles with empty entries.
+    TILED = 1,
+    // Page table over pages of BrickgridPage^3 bricks in linear order, followed by the pages that
+    // hold at least one brick. Table entries hold the first entry of their page, or 0 when the
+    // page was never allocated. Entries within a page are in linear order.
+    PAGED = 2,
 };
 
-// Types:
-//  0 -> 8x8x8
-//  1 -> 4x4x4
-//  2 -> 2x2x2
+constexpr uint32_t BrickgridTile = 4;
+constexpr uint32_t BrickgridPage = 8;
+constexpr uint32_t BrickgridPageEntries = BrickgridPage * BrickgridPage * BrickgridPage;
+
+// Number of entries in a brickgrid of the given dimensions, in bricks. Paged grids only count
+// their page table, each allocated page adds BrickgridPageEntries more.
+size_t brickgridSize(glm::uvec3 dimensions, BrickgridLayout layout);
+// Entries at the start of the brickgrid holding the page table, zero unless paged
+size_t brickgridPageTableSize(glm::uvec3 dimensions, BrickgridLayout layout);
+// Paged grids depend on which pages are allocated, see pagedBrickgridIndex
+size_t brickgridIndex(glm::uvec3 brick, glm::uvec3 dimensions, BrickgridLayout layout);
+
+// Entry of the brick in a paged grid, empty when its page was never allocated
+std::optional<size_t> pagedBrickgridIndex(
+    const std::vector<BrickgridPtr>& brickgrid, glm::uvec3 brick, glm::uvec3 dimensions);
+// Allocates the page holding the brick when missing, with every entry empty. Returns the entry of
+// the brick.
+size_t allocateBrickgridPage(
+    std::vector<BrickgridPtr>& brickgrid, glm::uvec3 brick, glm::uvec3 dimensions);
+
+// Types, relative to a brick of V voxels:
+//  0 -> V
+//  1 -> V / 8
+//  2 -> V / 64
 struct BrickmapColour {
     uint8_t data;
     uint8_t r;
@@ -51,7 +116,46 @@ struct BrickmapColour {
     }
 };
 
-std::tuple<std::vector<BrickgridPtr>, std::vector<Brickmap>, std::vector<BrickmapColour>>
+// When deduplicate is set, bricks with identical occupancy and colours are stored once and
+// shared between brickgrid entries. Call uniqueBricks before editing shared bricks. Generation
+// stops without finishing once the bricks would exceed MaxBricks. The dedup table is allocated
+// from resource, the returned vectors always use the global heap.
+template <uint32_t Size = BrickSize>
+std::tuple<std::vector<BrickgridPtr>, std::vector<SizedBrickmap<Size>>,
+    std::vector<BrickmapColour>>
 generateBrickmap(std::stop_token stoken, std::unique_ptr<Loader>&& loader, GenerationInfo& info,
-    glm::uvec3& brickgridDim, bool& finished);
+    glm::uvec3& brickgridDim, bool& finished, bool deduplicate = false,
+    BrickgridLayout layout = BrickgridLayout::LINEAR,
+    std::pmr::memory_resource* resource = std::pmr::new_delete_resource());
+template <uint32_t Size = BrickSize>
+std::tuple<std::vector<BrickgridPtr>, std::vector<SizedBrickmap<Size>>,
+    std::vector<BrickmapColour>>
+generateBrickmap(std::stop_token stoken, BlockStream& stream, GenerationInfo& info,
+    glm::uvec3& brickgridDim, bool& finished, bool deduplicate = false,
+    BrickgridLayout layout = BrickgridLayout::LINEAR,
+    std::pmr::memory_resource* resource = std::pmr::new_delete_resource());
+
+// Rewrites a linear brickmap into the given layout, shared bricks stay shared
+template <uint32_t Size = BrickSize>
+void layoutBrickmap(std::vector<BrickgridPtr>& brickgrid,
+    std::vector<SizedBrickmap<Size>>& brickmaps, std::vector<BrickmapColour>& colours,
+    glm::uvec3 brickgridDim, BrickgridLayout layout);
+
+// The page table of paged grids is skipped, see brickgridPageTableSize
+bool hasSharedBricks(
+    const std::vector<BrickgridPtr>& brickgrid, size_t brickCount, size_t pageTableSize = 0);
+
+// Renumbers the bricks and repacks their colours in the order the grid first references them,
+// dropping bricks and colour blocks no entry references. Defragments the pools after edits,
+// shared bricks stay shared.
+template <uint32_t Size = BrickSize>
+void compactBrickmap(std::vector<BrickgridPtr>& brickgrid,
+    std::vector<SizedBrickmap<Size>>& brickmaps, std::vector<BrickmapColour>& colours,
+    size_t pageTableSize = 0);
+
+// Gives every brickgrid entry its own brick and colour block, returns the number of copies made
+template <uint32_t Size = BrickSize>
+size_t uniqueBricks(std::vector<BrickgridPtr>& brickgrid,
+    std::vector<SizedBrickmap<Size>>& brickmaps, std::vector<BrickmapColour>& colours,
+    size_t pageTableSize = 0);
 }
@@ -0,0 +1,295 @@
+#include "column_rle.hpp"
+#include "palette.hpp"
+#include "task_scheduler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+namespace Generators {
+// Columns sampled together before their spans are added to the pool
+static constexpr size_t SampleBatch = 4096;
+
+std::optional<glm::vec3> ColumnRLE::getVoxel(glm::uvec3 position) const
+{
+    if (glm::any(glm::greaterThanEqual(position, dimensions)))
+        return {};
+
+    const size_t column = columnIndex(position.x, position.z);
+    auto first = spans.begin() + offsets[column];
+    auto last = spans.begin() + offsets[column + 1];
+
+    // First span ending above the voxel
+    auto span = std::upper_bound(first, last, position.y,
+        [](uint32_t y, const ColumnSpan& span) { return y < span.end(); });
+    if (span == last || span->start > position.y)
+        return {};
+
+    return unpackUnitColour(span->colour);
+}
+
+// Extends the last span when the voxel continues its run
+static void appendVoxel(std::vector<ColumnSpan>& spans, uint32_t y, uint32_t colour)
+{
+    if (!spans.empty() && spans.back().end() == y && spans.back().colour == colour) {
+        spans.back().length++;
+        return;
+    }
+
+    spans.push_back(ColumnSpan { .start = y, .length = 1, .colour = colour });
+}
+
+static void sampleColumn(
+    Loader& loader, glm::uvec3 dimensions, uint32_t x, uint32_t z, std::vector<ColumnSpan>& spans)
+{
+    spans.clear();
+
+    for (uint32_t y = 0; y < dimensions.y; y++) {
+        auto voxel = loader.getVoxel({ x, y, z });
+        if (voxel.has_value())
+            appendVoxel(spans, y, packUnitColour(voxel.value()));
+    }
+}
+
+static void finishColumns(ColumnRLE& columns, GenerationInfo& info, bool& finished)
+{
+    uint64_t voxelCount = 0;
+    for (const ColumnSpan& span : columns.spans)
+        voxelCount += span.length;
+
+    info.voxelCount = voxelCount;
+    info.nodes = columns.spans.size();
+    info.completionPercent = 1.f;
+
+    finished = true;
+}
+
+ColumnRLE generateColumnRLE(std::stop_token stoken, std::unique_ptr<Loader>&& loader,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished)
+{
+    std::chrono::steady_clock timer;
+    auto start = timer.now();
+
+    dimensions = loader->getDimensions();
+
+    ColumnRLE columns;
+    columns.dimensions = dimensions;
+
+    const size_t columnCount = (size_t)dimensions.x * dimensions.z;
+    columns.offsets.reserve(columnCount + 1);
+
+    std::vector<std::vector<ColumnSpan>> batch(SampleBatch);
+    for (size_t first = 0; first < columnCount; first += SampleBatch) {
+        if (stoken.stop_requested())
+            return {};
+
+        const size_t count = std::min(SampleBatch, columnCount - first);
+        TaskScheduler::getInstance().parallelFor(count, 16, [&](size_t i) {
+            size_t column = first + i;
+            sampleColumn(*loader, dimensions, column % dimensions.x, column / dimensions.x,
+                batch[i]);
+        });
+
+        for (size_t i = 0; i < count; i++) {
+            columns.offsets.push_back(columns.spans.size());
+            columns.spans.insert(columns.spans.end(), batch[i].begin(), batch[i].end());
+        }
+
+        std::chrono::duration<float, std::milli> difference = timer.now() - start;
+        info.completionPercent = (float)(first + count) / (float)columnCount;
+        info.generationTime = difference.count() / 1000.0f;
+    }
+    columns.offsets.push_back(columns.spans.size());
+
+    finishColumns(columns, info, finished);
+
+    return columns;
+}
+
+ColumnRLE generateColumnRLE(std::stop_token stoken, BlockStream& stream, GenerationInfo& info,
+    glm::uvec3& dimensions, bool& finished)
+{
+    std::chrono::steady_clock timer;
+    auto start = timer.now();
+
+    dimensions = stream.getDimensions();
+
+    ColumnRLE columns;
+    columns.dimensions = dimensions;
+
+    // Blocks arrive in Morton order, so each column collects the runs of every block it passes
+    // through and they are joined once the volume has been scanned
+    const size_t columnCount = (size_t)dimensions.x * dimensions.z;
+    std::vector<std::vector<ColumnSpan>> pieces(columnCount);
+
+    const uint64_t blockCount = stream.getBlockCount();
+    uint64_t received = 0;
+
+    while (std::shared_ptr<const VoxelBlock> block = stream.pop()) {
+        if (stoken.stop_requested()) {
+            stream.close();
+            return {};
+        }
+
+        received++;
+        if (block->empty())
+            continue;
+
+        const glm::uvec3 origin = block->position * VoxelBlock::Edge;
+        const glm::uvec3 end = glm::min(origin + VoxelBlock::Edge, dimensions);
+        for (uint32_t z = origin.z; z < end.z; z++) {
+            for (uint32_t x = origin.x; x < end.x; x++) {
+                std::vector<ColumnSpan>& column = pieces[columns.columnIndex(x, z)];
+
+                for (uint32_t y = origin.y; y < end.y; y++) {
+                    auto voxel = block->getVoxel(glm::uvec3(x, y, z) - origin);
+                    if (voxel.has_value())
+                        appendVoxel(column, y, packUnitColour(voxel.value()));
+                }
+            }
+        }
+
+        std::chrono::duration<float, std::milli> difference = timer.now() - start;
+        info.completionPercent = ((float)received / (float)blockCount);
+        info.generationTime = difference.count() / 1000.0f;
+    }
+
+    // Producer stopped before sending every block
+    if (received != blockCount)
+        return {};
+
+    columns.offsets.reserve(columnCount + 1);
+    for (std::vector<ColumnSpan>& column : pieces) {
+        std::sort(column.begin(), column.end(),
+            [](const ColumnSpan& a, const ColumnSpan& b) { return a.start < b.start; });
+
+        columns.offsets.push_back(columns.spans.size());
+
+        // Runs split at block boundaries are merged back together
+        const size_t first = columns.spans.size();
+        for (const ColumnSpan& span : column) {
+            if (columns.spans.size() > first && columns.spans.back().end() == span.start
+                && columns.spans.back().colour == span.colour) {
+                columns.spans.back().length += span.length;
+            } else {
+                columns.spans.push_back(span);
+            }
+        }
+
+        std::vector<ColumnSpan>().swap(column);
+    }
+    columns.offsets.push_back(columns.spans.size());
+
+    finishColumns(columns, info, finished);
+
+    return columns;
+}
+
+// Earliest hit against the spans of one column while the ray is inside it between tEnter and tExit
+static std::optional<ColumnHit> marchColumn(const ColumnRLE& columns, glm::uvec2 column,
+    glm::vec3 origin, glm::vec3 direction, float tEnter, float tExit)
+{
+    const size_t index = columns.columnIndex(column.x, column.y);
+    const uint32_t first = columns.offsets[index];
+    const uint32_t last = columns.offsets[index + 1];
+    const uint32_t count = last - first;
+
+    // Spans are visited in the order the ray reaches them
+    for (uint32_t i = 0; i < count; i++) {
+        const ColumnSpan& span = columns.spans[direction.y < 0 ? last - 1 - i : first + i];
+
+        float lower = tEnter;
+        float upper = tExit;
+        if (direction.y == 0) {
+            if (origin.y < span.start || origin.y >= span.end())
+                continue;
+        } else {
+            float ta = (span.start - origin.y) / direction.y;
+            float tb = (span.end() - origin.y) / direction.y;
+            lower = std::max(lower, std::min(ta, tb));
+            upper = std::min(upper, std::max(ta, tb));
+        }
+
+        if (lower >= upper)
+            continue;
+
+        const float y = std::floor(origin.y + direction.y * lower);
+        return ColumnHit {
+            .voxel = glm::uvec3(column.x,
+                std::clamp(y, (float)span.start, (float)(span.end() - 1)), column.y),
+            .colour = unpackUnitColour(span.colour),
+            .distance = lower,
+        };
+    }
+
+    return {};
+}
+
+std::optional<ColumnHit> marchColumns(
+    const ColumnRLE& columns, glm::vec3 origin, glm::vec3 direction)
+{
+    constexpr float Infinity = std::numeric_limits<float>::infinity();
+
+    const glm::vec3 size(columns.dimensions);
+    if (glm::any(glm::equal(columns.dimensions, glm::uvec3(0))))
+        return {};
+
+    // Clip the ray to the volume
+    float tMin = 0;
+    float tMax = Infinity;
+    for (int axis = 0; axis < 3; axis++) {
+        if (direction[axis] == 0) {
+            if (origin[axis] < 0 || origin[axis] >= size[axis])
+                return {};
+            continue;
+        }
+
+        float t0 = -origin[axis] / direction[axis];
+        float t1 = (size[axis] - origin[axis]) / direction[axis];
+        tMin = std::max(tMin, std::min(t0, t1));
+        tMax = std::min(tMax, std::max(t0, t1));
+    }
+
+    if (tMin >= tMax)
+        return {};
+
+    const glm::vec3 entry = origin + direction * tMin;
+    glm::ivec2 column(std::clamp((int)std::floor(entry.x), 0, (int)columns.dimensions.x - 1),
+        std::clamp((int)std::floor(entry.z), 0, (int)columns.dimensions.z - 1));
+
+    const glm::ivec2 step(direction.x < 0 ? -1 : 1, direction.z < 0 ? -1 : 1);
+    const glm::vec2 delta(direction.x == 0 ? Infinity : std::abs(1.f / direction.x),
+        direction.z == 0 ? Infinity : std::abs(1.f / direction.z));
+
+    glm::vec2 next(Infinity);
+    if (direction.x != 0)
+        next.x = (column.x + (step.x > 0) - origin.x) / direction.x;
+    if (direction.z != 0)
+        next.y = (column.y + (step.y > 0) - origin.z) / direction.z;
+
+    float t = tMin;
+    while (t < tMax) {
+        const float tExit = std::min({ next.x, next.y, tMax });
+
+        auto hit = marchColumn(columns, column, origin, direction, t, tExit);
+        if (hit.has_value())
+            return hit;
+
+        if (next.x < next.y) {
+            column.x += step.x;
+            t = next.x;
+            next.x += delta.x;
+        } else {
+            column.y += step.y;
+            t = next.y;
+            next.y += delta.y;
+        }
+
+        if (column.x < 0 || column.y < 0 || column.x >= (int)columns.dimensions.x
+            || column.y >= (int)columns.dimensions.z)
+            break;
+    }
+
+    return {};
+}
+}
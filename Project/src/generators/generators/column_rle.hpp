@@ -0,0 +1,53 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "block_stream.hpp"
+#include "common.hpp"
+#include "loaders/loader.hpp"
+
+namespace Generators {
+// Vertical run of identically coloured voxels covering y in [start, start + length)
+struct ColumnSpan {
+    uint32_t start;
+    uint32_t length;
+    // 0x00RRGGBB
+    uint32_t colour;
+
+    uint32_t end() const { return start + length; }
+};
+
+// Each (x, z) column is a list of spans sorted by start, kept in one pool. Spans of column
+// x + z * dimensions.x are spans[offsets[column]] up to spans[offsets[column + 1]].
+struct ColumnRLE {
+    glm::uvec3 dimensions;
+    std::vector<uint32_t> offsets;
+    std::vector<ColumnSpan> spans;
+
+    size_t columnIndex(uint32_t x, uint32_t z) const { return x + (size_t)z * dimensions.x; }
+
+    std::optional<glm::vec3> getVoxel(glm::uvec3 position) const;
+};
+
+struct ColumnHit {
+    glm::uvec3 voxel;
+    glm::vec3 colour;
+    // Ray parameter of the hit, in multiples of the direction
+    float distance;
+};
+
+// Reference traversal, steps through the columns crossed by the ray in 2D and tests the spans of
+// each against the height range the ray covers inside it
+std::optional<ColumnHit> marchColumns(
+    const ColumnRLE& columns, glm::vec3 origin, glm::vec3 direction);
+
+ColumnRLE generateColumnRLE(std::stop_token stoken, std::unique_ptr<Loader>&& loader,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished);
+ColumnRLE generateColumnRLE(std::stop_token stoken, BlockStream& stream, GenerationInfo& info,
+    glm::uvec3& dimensions, bool& finished);
+}
@@ -9,5 +9,9 @@ struct GenerationInfo {
 
     uint64_t voxelCount = 0;
     uint64_t nodes = 0;
+
+    // Scratch memory of the generator, set once it finishes
+    uint64_t peakBytes = 0;
+    uint64_t allocatedBytes = 0;
 };
 }
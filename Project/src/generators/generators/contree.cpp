@@ -1,6 +1,12 @@
 #include "contree.hpp"
+#include "memory.hpp"
+#include "palette.hpp"
+#include "tree_builder.hpp"
+
 #include "loaders/loader.hpp"
+#include "morton/morton_code.hpp"
 
+#include <bit>
 #include <cstdlib>
 
 #include <cstring>
@@ -8,15 +14,21 @@
 #include <iterator>
 
 namespace Generators {
-struct ContreeIntNode {
-    glm::vec3 colour;
-    bool visible;
-    bool parent;
-    uint64_t childMask;
-    uint32_t childStartIndex = 0;
-    uint32_t childCount = 0;
+struct ContreeTraits {
+    using Colour = glm::vec3;
+
+    static constexpr uint32_t MaxDepth = 11;
+    static constexpr bool ReverseChildren = true;
+
+    static glm::uvec3 decode(uint64_t code) { return MortonCode::decode2(code); }
+    static uint64_t encode(glm::uvec3 index) { return MortonCode::encode2(index); }
+    static Colour leafColour(glm::vec3 colour) { return colour; }
+    static Colour parentColour() { return glm::vec3(0.f); }
 };
 
+using ContreeBuilder = TreeBuilder<64, ContreeTraits>;
+using ContreeIntNode = ContreeBuilder::IntNode;
+
 ContreeNode::ContreeNode(uint64_t childMask, uint32_t offset, uint8_t r, uint8_t g, uint8_t b)
 {
     uint32_t colour = (uint32_t)r << 16 | (uint32_t)g << 8 | (uint32_t)b;
@@ -68,166 +80,336 @@ std::array<uint64_t, 2> ContreeNode::getData() const
     return data;
 }
 
-static ContreeIntNode convert(const std::optional<glm::vec3> v)
+static std::vector<ContreeNode> writeContree(std::stop_token stoken,
+    const std::pmr::vector<ContreeIntNode>& intermediaryNodes, GenerationInfo& info, bool& finished,
+    std::chrono::steady_clock timer, const std::chrono::steady_clock::time_point start)
 {
-    if (v.has_value()) {
-        glm::vec3 colour = v.value();
-        return ContreeIntNode {
-            .colour = colour,
-            .visible = true,
-            .parent = false,
-            .childMask = 0,
-        };
-    } else {
-        return ContreeIntNode {
-            .visible = false,
-        };
-    }
-};
+    // Offsets never exceed the intermediary nodes, which bound the written nodes too
+    if (intermediaryNodes.size() > MaxContreeNodes)
+        return {};
 
-static std::optional<ContreeIntNode> allEqual(const std::array<ContreeIntNode, 64>& nodes)
-{
-    assert(nodes.size() == 64);
-    bool allVisible = nodes.at(0).visible;
-    glm::vec3 colour = nodes.at(0).colour;
-    uint32_t count = 0;
-
-    for (uint32_t i = 0; i < 64; i++) {
-        if (nodes.at(i).parent || nodes.at(i).visible != allVisible
-            || nodes.at(i).colour != colour) {
-            return std::optional<ContreeIntNode> {};
+    std::vector<ContreeNode> nodes;
+    nodes.reserve(intermediaryNodes.size());
+
+    size_t index = intermediaryNodes.size() - 1;
+    for (auto it = intermediaryNodes.rbegin(); it != intermediaryNodes.rend(); it++) {
+        if (stoken.stop_requested())
+            return nodes;
+
+        if (it->parent) {
+            glm::vec3 c = it->colour * 255.f;
+            glm::u8vec3 colour = glm::u8vec3(c.r, c.g, c.b);
+            uint32_t targetOffset = index - it->childStartIndex;
+            nodes.push_back(ContreeNode(it->childMask, targetOffset, colour.r, colour.g, colour.b));
+        } else if (it->visible) {
+            nodes.push_back(ContreeNode(it->colour.r, it->colour.g, it->colour.b));
         }
-        count += nodes.at(i).childCount + 1;
+        index--;
     }
 
-    return std::optional<ContreeIntNode>(ContreeIntNode {
-        .colour = colour,
-        .visible = allVisible,
-        .parent = false,
-        .childMask = 0,
-        .childCount = count,
-    });
-};
+    auto end = timer.now();
+    std::chrono::duration<float, std::milli> difference = end - start;
+    info.generationTime = difference.count() / 1000.0f;
+    info.completionPercent = 1.f;
+
+    info.nodes = nodes.size();
+
+    finished = true;
+
+    return nodes;
+}
 
 std::vector<ContreeNode> generateContree(std::stop_token stoken, std::unique_ptr<Loader>&& loader,
-    GenerationInfo& info, glm::uvec3& dimensions, bool& finished)
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished,
+    std::pmr::memory_resource* resource)
 {
     std::chrono::steady_clock timer;
 
-    dimensions = Loader::cubeDimensions(loader->getDimensionsDiv4());
+    dimensions = ContreeBuilder::dimensions(*loader);
 
     auto start = timer.now();
 
-    uint64_t currentCode = 0;
+    TrackingResource memory(resource);
+    auto built = ContreeBuilder::build(stoken, *loader, info, dimensions, &memory);
+    if (!built.has_value())
+        return {};
+    memory.report(info);
+
+    return writeContree(stoken, built.value(), info, finished, timer, start);
+}
 
-    uint64_t finalCode = dimensions.x * dimensions.y * dimensions.z;
+std::vector<ContreeNode> generateContree(std::stop_token stoken, BlockStream& stream,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished,
+    std::pmr::memory_resource* resource)
+{
+    std::chrono::steady_clock timer;
 
-    const uint32_t maxDepth = 11;
-    uint32_t currentDepth = maxDepth;
+    dimensions = ContreeBuilder::dimensions(stream.getDimensions());
 
-    std::array<size_t, maxDepth> queueSizes;
-    for (uint32_t i = 0; i < maxDepth; i++)
-        queueSizes[i] = 0;
+    auto start = timer.now();
 
-    std::array<std::array<ContreeIntNode, 64>, maxDepth> queues;
-    std::vector<ContreeIntNode> intermediaryNodes;
+    TrackingResource memory(resource);
+    auto built = ContreeBuilder::build(stoken, stream, info, dimensions, &memory);
+    if (!built.has_value())
+        return {};
+    memory.report(info);
 
-    std::vector<ContreeNode> nodes;
+    return writeContree(stoken, built.value(), info, finished, timer, start);
+}
 
-    info.voxelCount = 0;
+std::vector<ContreeNode> generateContree(std::stop_token stoken, PrimitiveLoader& loader,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished,
+    std::pmr::memory_resource* resource)
+{
+    std::chrono::steady_clock timer;
 
-    while (currentCode != finalCode) {
-        if (stoken.stop_requested())
-            return nodes;
+    dimensions = ContreeBuilder::dimensions(loader);
 
-        const auto currentVoxel = loader->getVoxelMorton2(currentCode);
-        currentCode++;
+    auto start = timer.now();
+
+    TrackingResource memory(resource);
+    auto built = ContreeBuilder::build(stoken, loader, info, dimensions, &memory);
+    if (!built.has_value())
+        return {};
+    memory.report(info);
+
+    return writeContree(stoken, built.value(), info, finished, timer, start);
+}
 
-        currentDepth = maxDepth - 1;
-        queues[currentDepth][queueSizes[currentDepth]] = convert(currentVoxel);
-        queueSizes[currentDepth]++;
+std::function<bool(glm::uvec3)> contreePartialFilter(
+    glm::uvec3 loaderDimensions, uint32_t worker, uint32_t workers)
+{
+    return ContreeBuilder::partialFilter(loaderDimensions, worker, workers);
+}
+
+std::optional<PartialTree> generateContreePartial(std::stop_token stoken,
+    std::unique_ptr<Loader>&& loader, GenerationInfo& info, uint32_t worker, uint32_t workers,
+    std::pmr::memory_resource* resource)
+{
+    glm::uvec3 dimensions = ContreeBuilder::dimensions(*loader);
+    TrackingResource memory(resource);
+    auto partial
+        = ContreeBuilder::buildPartial(stoken, *loader, info, dimensions, worker, workers, &memory);
+    memory.report(info);
+    return partial;
+}
 
-        auto current = timer.now();
-        std::chrono::duration<float, std::milli> difference = current - start;
-        info.completionPercent = ((float)currentCode / (float)finalCode);
-        info.generationTime = difference.count() / 1000.0f;
+std::optional<std::vector<ContreeNode>> mergeContreePartials(std::stop_token stoken,
+    std::function<std::optional<PartialTree>(uint32_t)> loadPartial, uint32_t workers,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished,
+    std::pmr::memory_resource* resource)
+{
+    std::chrono::steady_clock timer;
+    auto start = timer.now();
 
-        while (currentDepth > 0 && queueSizes[currentDepth] == 64) {
-            if (stoken.stop_requested())
-                return nodes;
+    TrackingResource memory(resource);
+    auto built
+        = ContreeBuilder::mergePartials(stoken, loadPartial, workers, info, dimensions, &memory);
+    if (!built.has_value())
+        return {};
+    memory.report(info);
 
-            ContreeIntNode node;
+    return writeContree(stoken, built.value(), info, finished, timer, start);
+}
 
-            const auto& possibleParentNode = allEqual(queues[currentDepth]);
+static bool isSolid(const std::array<uint64_t, 2>& data) { return ((data[0] >> 56) & 0x1) != 0; }
 
-            if (possibleParentNode.has_value()) {
-                queues[currentDepth - 1][queueSizes[currentDepth - 1]] = possibleParentNode.value();
-                queueSizes[currentDepth - 1]++;
-            } else {
-                uint64_t childMask = 0;
-                uint32_t childCount = 0;
-                for (int8_t i = 63; i >= 0; i--) {
-                    if (queues[currentDepth].at(i).visible) {
-                        childMask |= (1ull << i);
-                        intermediaryNodes.push_back(queues[currentDepth].at(i));
-                        if (!queues[currentDepth].at(i).parent) {
-                            info.voxelCount += pow(64, 10 - currentDepth);
-                        }
-                        childCount += queues[currentDepth].at(i).childCount + 1;
-                    }
-                }
+static uint32_t leafColour(const std::array<uint64_t, 2>& data)
+{
+    auto channel = [](uint64_t value) {
+        return (uint8_t)std::round(std::min<uint64_t>(value, 0xFFFF) * 255.f / (float)0xFFFF);
+    };
+
+    uint8_t r = channel(data[0] & 0xFFFFFFFF);
+    uint8_t g = channel(data[1] >> 32);
+    uint8_t b = channel(data[1] & 0xFFFFFFFF);
+    return packColour({ r, g, b });
+}
+
+CompactContree compactContree(const std::vector<ContreeNode>& nodes)
+{
+    CompactContree contree;
+
+    if (nodes.empty()) {
+        contree.nodes.push_back({ .childMask = 0, .leafMask = 0 });
+        contree.offsets.push_back({ .child = 0, .colour = 0 });
+        return contree;
+    }
+
+    // A solid root becomes a node whose children are all solid
+    const std::array<uint64_t, 2> root = nodes[0].getData();
+    if (isSolid(root)) {
+        contree.nodes.push_back({ .childMask = 0, .leafMask = ~0ull });
+        contree.offsets.push_back({ .child = 0, .colour = 0 });
+        contree.colours.assign(64, leafColour(root));
+        return contree;
+    }
 
-                ContreeIntNode parent = {
-                    .colour = glm::vec3(0.f),
-                    .visible = childMask != 0,
-                    .parent = true,
-                    .childMask = childMask,
-                    .childStartIndex = (uint32_t)(intermediaryNodes.size() - 1),
-                    .childCount = childCount,
-                };
-
-                queues[currentDepth - 1][queueSizes[currentDepth - 1]] = parent;
-                queueSizes[currentDepth - 1]++;
+    // Breadth first so the interior children of each node are contiguous
+    std::deque<size_t> queue = { 0 };
+    uint32_t nextChild = 1;
+    while (!queue.empty()) {
+        const size_t index = queue.front();
+        queue.pop_front();
+
+        const std::array<uint64_t, 2> data = nodes[index].getData();
+        const size_t childStart = index + (data[0] & 0xFFFFFFFF);
+
+        CompactContreeNode node { .childMask = 0, .leafMask = 0 };
+        CompactContreeOffset offset {
+            .child = nextChild,
+            .colour = (uint32_t)contree.colours.size(),
+        };
+
+        size_t child = childStart;
+        for (uint64_t mask = data[1]; mask != 0; mask &= mask - 1, child++) {
+            const uint64_t bit = 1ull << std::countr_zero(mask);
+            const std::array<uint64_t, 2> childData = nodes[child].getData();
+
+            if (isSolid(childData)) {
+                node.leafMask |= bit;
+                contree.colours.push_back(leafColour(childData));
+            } else {
+                node.childMask |= bit;
+                queue.push_back(child);
+                nextChild++;
             }
+        }
 
-            queueSizes[currentDepth] = 0;
-            currentDepth--;
+        contree.nodes.push_back(node);
+        contree.offsets.push_back(offset);
+    }
+
+    return contree;
+}
+
+std::vector<ContreeBlock> contreeChildBlocks(
+    const std::vector<ContreeNode>& nodes, const std::vector<ContreeBlock>& blocks)
+{
+    std::vector<ContreeBlock> children;
+    for (auto [start, count] : blocks) {
+        for (uint32_t j = 0; j < count; j++) {
+            const std::array<uint64_t, 2> data = nodes.at(start + j).getData();
+            if (isSolid(data) || data[1] == 0)
+                continue;
+
+            children.push_back({ start + j + (data[0] & 0xFFFFFFFF), std::popcount(data[1]) });
         }
     }
-    assert(queueSizes[currentDepth] == 1);
-    intermediaryNodes.push_back(queues[currentDepth].at(0));
-    if (!queues[currentDepth].at(0).parent && queues[currentDepth].at(0).visible) {
-        info.voxelCount += pow(64, 10 - currentDepth);
+
+    return children;
+}
+
+std::pair<std::vector<ContreeNode>, std::vector<uint64_t>> progressiveContree(
+    const std::vector<ContreeNode>& nodes)
+{
+    if (nodes.empty())
+        return {};
+
+    std::vector<std::vector<ContreeBlock>> levelBlocks = { { { 0, 1 } } };
+    while (true) {
+        std::vector<ContreeBlock> children = contreeChildBlocks(nodes, levelBlocks.back());
+        if (children.empty())
+            break;
+        levelBlocks.push_back(std::move(children));
     }
 
-    nodes.reserve(intermediaryNodes.size());
+    // Average colour of every interior node per level, from the deepest level up. Sums are
+    // weighted by the share of the volume each voxel covers, alpha holds the weight. Entry i of
+    // below is the sum under the i-th interior node of the level above.
+    std::vector<std::vector<uint32_t>> averages(levelBlocks.size());
+    std::vector<glm::dvec4> below;
+    for (size_t l = levelBlocks.size(); l-- > 0;) {
+        const double weight = std::pow(1.0 / 64.0, (double)l);
+
+        std::vector<glm::dvec4> sums(levelBlocks[l].size(), glm::dvec4(0.0));
+        size_t interior = 0;
+        for (size_t b = 0; b < levelBlocks[l].size(); b++) {
+            auto [start, count] = levelBlocks[l][b];
+            for (uint32_t j = 0; j < count; j++) {
+                const std::array<uint64_t, 2> data = nodes[start + j].getData();
+
+                if (isSolid(data)) {
+                    glm::dvec3 colour = glm::dvec3(unpackColour(leafColour(data)));
+                    sums[b] += glm::dvec4(colour * weight, weight);
+                } else if (data[1] != 0) {
+                    const glm::dvec4 sum = below.at(interior++);
+                    sums[b] += sum;
+
+                    glm::dvec3 average = glm::round(glm::dvec3(sum) / sum.w);
+                    averages[l].push_back(packColour(glm::u8vec3(average)));
+                }
+            }
+        }
 
-    size_t index = intermediaryNodes.size() - 1;
-    for (auto it = intermediaryNodes.rbegin(); it != intermediaryNodes.rend(); it++) {
-        if (stoken.stop_requested())
-            return nodes;
+        below = std::move(sums);
+    }
 
-        if (it->parent) {
-            glm::vec3 c = it->colour * 255.f;
-            glm::u8vec3 colour = glm::u8vec3(c.r, c.g, c.b);
-            uint32_t targetOffset = index - it->childStartIndex;
-            nodes.push_back(ContreeNode(it->childMask, targetOffset, colour.r, colour.g, colour.b));
-        } else if (it->visible) {
-            nodes.push_back(ContreeNode(it->colour.r, it->colour.g, it->colour.b));
+    std::vector<ContreeNode> ordered;
+    ordered.reserve(nodes.size());
+    std::vector<uint64_t> levelEnds;
+
+    // Children blocks are written in the order of their parents straight after the level
+    uint64_t nextChild = 1;
+    for (size_t l = 0; l < levelBlocks.size(); l++) {
+        size_t interior = 0;
+        for (auto [start, count] : levelBlocks[l]) {
+            for (uint32_t j = 0; j < count; j++) {
+                const std::array<uint64_t, 2> data = nodes[start + j].getData();
+                if (isSolid(data) || data[1] == 0) {
+                    ordered.push_back(ContreeNode(data[0], data[1]));
+                    continue;
+                }
+
+                const glm::u8vec3 average = unpackColour(averages[l][interior++]);
+                ordered.push_back(ContreeNode(data[1], nextChild - ordered.size(), average.r,
+                    average.g, average.b));
+                nextChild += std::popcount(data[1]);
+            }
         }
-        index--;
+
+        levelEnds.push_back(ordered.size());
     }
 
-    auto end = timer.now();
-    std::chrono::duration<float, std::milli> difference = end - start;
-    info.generationTime = difference.count() / 1000.0f;
-    info.completionPercent = 1.f;
+    return { ordered, levelEnds };
+}
 
-    info.nodes = nodes.size();
+std::vector<ContreeNode> expandContree(const CompactContree& contree)
+{
+    std::vector<ContreeNode> nodes;
+    if (contree.nodes.empty())
+        return nodes;
 
-    finished = true;
+    // Compact node index and the wide node it is written to, children are reserved in blocks
+    std::deque<std::pair<uint32_t, size_t>> queue = { { 0, 0 } };
+    nodes.push_back(ContreeNode(0ull, 0ull));
+
+    while (!queue.empty()) {
+        const auto [index, target] = queue.front();
+        queue.pop_front();
+
+        const CompactContreeNode& node = contree.nodes[index];
+        const CompactContreeOffset& offset = contree.offsets[index];
+
+        const uint64_t childMask = node.childMask | node.leafMask;
+        const size_t childStart = nodes.size();
+        nodes[target] = ContreeNode(childMask, childStart - target, 0, 0, 0);
+
+        uint32_t child = offset.child;
+        uint32_t colour = offset.colour;
+        for (uint64_t mask = childMask; mask != 0; mask &= mask - 1) {
+            const uint64_t bit = 1ull << std::countr_zero(mask);
+
+            if (node.leafMask & bit) {
+                glm::vec3 c = glm::vec3(unpackColour(contree.colours[colour++])) / 255.f;
+                nodes.push_back(ContreeNode(c.r, c.g, c.b));
+            } else {
+                queue.push_back({ child++, nodes.size() });
+                nodes.push_back(ContreeNode(0ull, 0ull));
+            }
+        }
+    }
 
     return nodes;
 }
-
 }
@@ -2,14 +2,29 @@
 
 #include <glm/glm.hpp>
 
+#include <functional>
 #include <memory>
+#include <memory_resource>
+#include <optional>
 #include <thread>
 #include <vector>
 
+#include "block_stream.hpp"
 #include "common.hpp"
 #include "loaders/loader.hpp"
+#include "loaders/primitive_loader.hpp"
+#include "partial_tree.hpp"
+
+// Only lowered by the large scene test, so refusing an oversized contree can be reached
+#ifndef CONTREE_MAX_NODES
+#define CONTREE_MAX_NODES 0xFFFFFFFF
+#endif
 
 namespace Generators {
+// Child offsets and the shaders' node indices are 32 bit, contrees with more nodes are not
+// generated
+static constexpr uint64_t MaxContreeNodes = CONTREE_MAX_NODES;
+
 class ContreeNode {
   public:
     ContreeNode(uint64_t childMask, uint32_t offset, uint8_t r, uint8_t g, uint8_t b);
@@ -41,6 +56,75 @@ class ContreeNode {
     std::variant<NodeType, LeafType, std::pair<uint64_t, uint64_t>> m_CurrentType;
 };
 
+// Node encoding written to files and uploaded to the GPU
+enum class ContreeFormat : uint32_t {
+    // 128 bit nodes, leaves hold 16 bit colour channels
+    WIDE = 0,
+    // Only interior nodes are stored, as masks plus a separate offset array. Solid leaves are
+    // RGB8 colours found by the popcount of the leaf mask.
+    COMPACT = 1,
+};
+
+// Interior node of a compact contree. childMask marks children which are interior nodes and
+// leafMask children which are solid, both indexed like the wide child mask.
+struct CompactContreeNode {
+    uint64_t childMask;
+    uint64_t leafMask;
+};
+
+// First interior child and first leaf colour of a node, the rest follow in child index order
+struct CompactContreeOffset {
+    uint32_t child;
+    uint32_t colour;
+};
+
+struct CompactContree {
+    std::vector<CompactContreeNode> nodes;
+    std::vector<CompactContreeOffset> offsets;
+    // 0x00RRGGBB per solid leaf
+    std::vector<uint32_t> colours;
+};
+
+// Empty without finishing if the contree could have more than MaxContreeNodes nodes. Scratch
+// memory comes from resource, as for generateOctree.
 std::vector<ContreeNode> generateContree(std::stop_token stoken, std::unique_ptr<Loader>&& loader,
-    GenerationInfo& info, glm::uvec3& dimensions, bool& finished);
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished,
+    std::pmr::memory_resource* resource = std::pmr::new_delete_resource());
+std::vector<ContreeNode> generateContree(std::stop_token stoken, BlockStream& stream,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished,
+    std::pmr::memory_resource* resource = std::pmr::new_delete_resource());
+// Built from the root down over the loader's primitives, the same nodes as from its voxels
+std::vector<ContreeNode> generateContree(std::stop_token stoken, PrimitiveLoader& loader,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished,
+    std::pmr::memory_resource* resource = std::pmr::new_delete_resource());
+
+// Distributed generation, matching generateOctreePartial and mergeOctreePartials
+std::function<bool(glm::uvec3)> contreePartialFilter(
+    glm::uvec3 loaderDimensions, uint32_t worker, uint32_t workers);
+std::optional<PartialTree> generateContreePartial(std::stop_token stoken,
+    std::unique_ptr<Loader>&& loader, GenerationInfo& info, uint32_t worker, uint32_t workers,
+    std::pmr::memory_resource* resource = std::pmr::new_delete_resource());
+std::optional<std::vector<ContreeNode>> mergeContreePartials(std::stop_token stoken,
+    std::function<std::optional<PartialTree>(uint32_t)> loadPartial, uint32_t workers,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished,
+    std::pmr::memory_resource* resource = std::pmr::new_delete_resource());
+
+// Sibling nodes as the index of the first node and the node count
+using ContreeBlock = std::pair<uint64_t, uint32_t>;
+
+// Blocks holding the children of the given blocks' interior nodes, in the order of their parents.
+// The root is the only node of the first level's block { 0, 1 }.
+std::vector<ContreeBlock> contreeChildBlocks(
+    const std::vector<ContreeNode>& nodes, const std::vector<ContreeBlock>& blocks);
+
+// Reorders the nodes breadth first so every depth is contiguous and can be loaded coarse levels
+// first. Interior nodes hold the average colour of the voxels below them, drawn in their place
+// while their children are not loaded. Also returns the node count at the end of each level.
+std::pair<std::vector<ContreeNode>, std::vector<uint64_t>> progressiveContree(
+    const std::vector<ContreeNode>& nodes);
+
+// Converts between encodings. Interior nodes of the compact tree are in breadth first order and
+// leaf colours are reduced to 8 bits per channel.
+CompactContree compactContree(const std::vector<ContreeNode>& nodes);
+std::vector<ContreeNode> expandContree(const CompactContree& contree);
 }
@@ -0,0 +1,129 @@
+#include "distance_field.hpp"
+#include "task_scheduler.hpp"
+
+#include <algorithm>
+
+namespace Generators {
+// Neighbouring lines transformed together, and the minimum number of cells given to a task
+static constexpr size_t TileLines = 64;
+static constexpr size_t TaskCells = 1 << 16;
+
+// out[i] = min over j <= i of max(i - j, in[j]). Candidates are kept with increasing positions
+// and strictly increasing values, so the best one is found by dropping from the front and each
+// is pushed and popped at most once.
+static void sweepLine(const uint8_t* in, uint8_t* out, uint32_t count, uint32_t* candidates)
+{
+    uint32_t head = 0;
+    uint32_t tail = 0;
+    for (uint32_t k = 0; k < count; k++) {
+        const uint32_t current = in[k];
+        while (tail > head && in[candidates[tail - 1]] >= current)
+            tail--;
+        candidates[tail++] = k;
+
+        uint32_t best = std::max(k - candidates[head], (uint32_t)in[candidates[head]]);
+        while (tail - head > 1) {
+            uint32_t next = std::max(k - candidates[head + 1], (uint32_t)in[candidates[head + 1]]);
+            if (next > best)
+                break;
+
+            best = next;
+            head++;
+        }
+
+        out[k] = std::min<uint32_t>(best, MaxDistance);
+    }
+}
+
+// Same result for lines holding only 0 and MaxDistance, where it reduces to the distance to the
+// nearest 0
+static void sweepSeeds(const uint8_t* in, uint8_t* out, uint32_t count, uint32_t*)
+{
+    uint32_t distance = MaxDistance;
+    for (uint32_t k = 0; k < count; k++) {
+        distance = in[k] == 0 ? 0 : std::min<uint32_t>(distance + 1, MaxDistance);
+        out[k] = distance;
+    }
+}
+
+// Applies the 1D transform to the lines starting at x + outer * outerStride for every x < width
+// and outer < outerCount, each holding count cells stride apart. Neighbouring lines are copied
+// into a tile together so the strided reads cover whole cache lines.
+template <auto Sweep>
+static void transformAxis(std::vector<uint8_t>& distances, size_t width, size_t outerCount,
+    size_t outerStride, size_t count, size_t stride)
+{
+    const size_t tilesPerRow = (width + TileLines - 1) / TileLines;
+    const size_t tileCount = outerCount * tilesPerRow;
+
+    // Short lines are batched so each task still covers a reasonable number of cells
+    const size_t tileCells = std::min(TileLines, width) * count;
+    const size_t tilesPerTask = std::max<size_t>(TaskCells / std::max<size_t>(tileCells, 1), 1);
+    const size_t taskCount = (tileCount + tilesPerTask - 1) / tilesPerTask;
+
+    TaskScheduler::getInstance().parallelFor(taskCount, 1, [&](size_t task) {
+        std::vector<uint8_t> tile(TileLines * count);
+
+        // The backward sweep runs forwards over a reversed copy of the line
+        std::vector<uint8_t> reversed(count);
+        std::vector<uint8_t> forward(count);
+        std::vector<uint8_t> backward(count);
+        std::vector<uint32_t> candidates(count);
+
+        const size_t end = std::min((task + 1) * tilesPerTask, tileCount);
+        for (size_t index = task * tilesPerTask; index < end; index++) {
+            const size_t x = (index % tilesPerRow) * TileLines;
+            const size_t lines = std::min(TileLines, width - x);
+            const size_t base = x + (index / tilesPerRow) * outerStride;
+
+            for (size_t i = 0; i < count; i++) {
+                const uint8_t* row = &distances[base + i * stride];
+                for (size_t j = 0; j < lines; j++)
+                    tile[j * count + i] = row[j];
+            }
+
+            for (size_t j = 0; j < lines; j++) {
+                uint8_t* line = &tile[j * count];
+                std::reverse_copy(line, line + count, reversed.begin());
+
+                Sweep(line, forward.data(), count, candidates.data());
+                Sweep(reversed.data(), backward.data(), count, candidates.data());
+
+                for (size_t i = 0; i < count; i++)
+                    line[i] = std::min(forward[i], backward[count - 1 - i]);
+            }
+
+            for (size_t i = 0; i < count; i++) {
+                uint8_t* row = &distances[base + i * stride];
+                for (size_t j = 0; j < lines; j++)
+                    row[j] = tile[j * count + i];
+            }
+        }
+    });
+}
+
+void transformDistanceField(std::vector<uint8_t>& distances, glm::uvec3 dimensions)
+{
+    const size_t width = dimensions.x;
+    const size_t height = dimensions.y;
+    const size_t depth = dimensions.z;
+
+    // max(|dx|, |dy|, |dz|) separates into one pass per axis, each pass taking the cone of the
+    // previous result along its own axis
+    transformAxis<sweepSeeds>(distances, 1, depth * height, width, width, 1);
+    transformAxis<sweepLine>(distances, width, height, width * depth, depth, width);
+    transformAxis<sweepLine>(distances, width, depth, width, height, width * depth);
+}
+
+std::vector<uint8_t> generateDistanceField(
+    const std::vector<GridVoxel>& voxels, glm::uvec3 dimensions)
+{
+    std::vector<uint8_t> distances(voxels.size());
+    for (size_t i = 0; i < voxels.size(); i++)
+        distances[i] = voxels[i].visible ? 0 : MaxDistance;
+
+    transformDistanceField(distances, dimensions);
+
+    return distances;
+}
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "grid.hpp"
+
+namespace Generators {
+// Largest stored distance, further cells are clamped to it
+static constexpr uint8_t MaxDistance = 0xFF;
+
+// Chebyshev distance from every cell to the nearest occupied voxel, 0 for occupied voxels.
+// A cell holding d has no occupied voxel within d - 1 cells along any axis. Uses the grid
+// index order, x + z * width + y * width * depth.
+std::vector<uint8_t> generateDistanceField(
+    const std::vector<GridVoxel>& voxels, glm::uvec3 dimensions);
+
+// In place transform of distances seeded with 0 for occupied and MaxDistance for empty cells.
+// Runs one exact 1D pass per axis on the task scheduler.
+void transformDistanceField(std::vector<uint8_t>& distances, glm::uvec3 dimensions);
+}
@@ -1,6 +1,29 @@
 #include "grid.hpp"
+#include "task_scheduler.hpp"
+
+#include <atomic>
 
 namespace Generators {
+static GridVoxel toGridVoxel(const std::optional<glm::vec3>& v)
+{
+    if (v.has_value()) {
+        glm::vec3 colour = v.value();
+        return GridVoxel {
+            .visible = true,
+            .colour = glm::u8vec3 {
+                (uint8_t)(colour.r * 255.f),
+                (uint8_t)(colour.g * 255.f),
+                (uint8_t)(colour.b * 255.f),
+            }
+        };
+    } else {
+        return GridVoxel {
+            .visible = false,
+            .colour = glm::u8vec3(0),
+        };
+    }
+}
+
 std::vector<GridVoxel> generateGrid(std::stop_token stoken, std::unique_ptr<Loader>&& loader,
     GenerationInfo& info, glm::uvec3& dimensions, bool& finished)
 {
@@ -9,49 +32,97 @@ std::vector<GridVoxel> generateGrid(std::stop_token stoken, std::unique_ptr<Load
 
     dimensions = loader->getDimensions();
 
-    const size_t totalNodes = dimensions.x * dimensions.y * dimensions.z;
+    const size_t totalNodes = (size_t)dimensions.x * dimensions.y * dimensions.z;
 
     std::vector<GridVoxel> voxels;
 
-    voxels.resize(dimensions.x * dimensions.y * dimensions.z);
-    for (size_t y = 0; y < dimensions.y; y++) {
+    voxels.resize(totalNodes);
+
+    std::atomic<size_t> completed = 0;
+    TaskScheduler::getInstance().parallelFor(dimensions.y, 1, [&](size_t y) {
         for (size_t z = 0; z < dimensions.z; z++) {
             for (size_t x = 0; x < dimensions.x; x++) {
                 if (stoken.stop_requested())
-                    return voxels;
+                    return;
 
                 size_t index = x + z * dimensions.x + y * dimensions.x * dimensions.z;
 
-                {
-                    info.completionPercent = (index + 1) / (float)totalNodes;
+                voxels[index] = toGridVoxel(loader->getVoxel({ x, y, z }));
+            }
+        }
 
-                    auto current = timer.now();
-                    std::chrono::duration<float, std::milli> difference = current - start;
-                    info.generationTime = difference.count() / 1000.0f;
-                }
+        {
+            size_t slices = completed.fetch_add(1) + 1;
+            info.completionPercent = (slices * dimensions.x * dimensions.z) / (float)totalNodes;
+
+            auto current = timer.now();
+            std::chrono::duration<float, std::milli> difference = current - start;
+            info.generationTime = difference.count() / 1000.0f;
+        }
+    });
+
+    if (stoken.stop_requested())
+        return voxels;
+
+    auto end = timer.now();
+    std::chrono::duration<float, std::milli> difference = end - start;
+    info.generationTime = difference.count() / 1000.0f;
+
+    finished = true;
+
+    info.voxelCount = voxels.size();
+    info.nodes = voxels.size();
+
+    return voxels;
+}
+
+std::vector<GridVoxel> generateGrid(std::stop_token stoken, BlockStream& stream,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished)
+{
+    std::chrono::steady_clock timer;
+    auto start = timer.now();
 
-                auto v = loader->getVoxel({ x, y, z });
-
-                if (v.has_value()) {
-                    glm::vec3 colour = v.value();
-                    voxels[index] = GridVoxel {
-                        .visible = true,
-                        .colour = glm::u8vec3 {
-                            (uint8_t)(colour.r * 255.f),
-                            (uint8_t)(colour.g * 255.f),
-                            (uint8_t)(colour.b * 255.f),
-                        }
-                    };
-                } else {
-                    voxels[index] = GridVoxel {
-                        .visible = false,
-                        .colour = glm::u8vec3(0),
-                    };
+    dimensions = stream.getDimensions();
+
+    std::vector<GridVoxel> voxels((size_t)dimensions.x * dimensions.y * dimensions.z,
+        GridVoxel { .visible = false, .colour = glm::u8vec3(0) });
+
+    const uint64_t blockCount = stream.getBlockCount();
+    uint64_t received = 0;
+
+    while (std::shared_ptr<const VoxelBlock> block = stream.pop()) {
+        if (stoken.stop_requested()) {
+            stream.close();
+            return voxels;
+        }
+
+        received++;
+        if (block->empty())
+            continue;
+
+        const glm::uvec3 origin = block->position * VoxelBlock::Edge;
+        const glm::uvec3 end = glm::min(origin + VoxelBlock::Edge, dimensions);
+        for (size_t y = origin.y; y < end.y; y++) {
+            for (size_t z = origin.z; z < end.z; z++) {
+                for (size_t x = origin.x; x < end.x; x++) {
+                    size_t index = x + z * dimensions.x + y * dimensions.x * dimensions.z;
+                    voxels[index] = toGridVoxel(block->getVoxel(glm::uvec3(x, y, z) - origin));
                 }
             }
         }
+
+        {
+            info.completionPercent = received / (float)blockCount;
+
+            auto current = timer.now();
+            std::chrono::duration<float, std::milli> difference = current - start;
+            info.generationTime = difference.count() / 1000.0f;
+        }
     }
 
+    if (received != blockCount)
+        return voxels;
+
     auto end = timer.now();
     std::chrono::duration<float, std::milli> difference = end - start;
     info.generationTime = difference.count() / 1000.0f;
@@ -6,6 +6,7 @@
 #include <thread>
 #include <vector>
 
+#include "block_stream.hpp"
 #include "common.hpp"
 #include "loaders/loader.hpp"
 
@@ -17,4 +18,6 @@ struct GridVoxel {
 
 std::vector<GridVoxel> generateGrid(std::stop_token stoken, std::unique_ptr<Loader>&& loader,
     GenerationInfo& info, glm::uvec3& dimensions, bool& finished);
+std::vector<GridVoxel> generateGrid(std::stop_token stoken, BlockStream& stream,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished);
 }
@@ -0,0 +1,243 @@
+#include "hybrid.hpp"
+#include "memory.hpp"
+#include "palette.hpp"
+#include "tree_builder.hpp"
+
+#include "morton/morton_code.hpp"
+
+#include <algorithm>
+#include <bit>
+
+namespace Generators {
+struct HybridTraits {
+    using Colour = glm::u8vec3;
+
+    static constexpr uint32_t MaxDepth = 23;
+    static constexpr bool ReverseChildren = false;
+
+    static glm::uvec3 decode(uint64_t code) { return MortonCode::decode(code); }
+    static uint64_t encode(glm::uvec3 index) { return MortonCode::encode(index); }
+    static Colour leafColour(glm::vec3 colour)
+    {
+        return glm::u8vec3 { colour.x * 255, colour.y * 255, colour.z * 255 };
+    }
+    static Colour parentColour() { return glm::u8vec3(1); }
+};
+
+using HybridBuilder = TreeBuilder<8, HybridTraits>;
+using HybridIntNode = HybridBuilder::IntNode;
+
+HybridNode HybridNode::interior(uint8_t childMask, uint32_t firstChild)
+{
+    return HybridNode {
+        .data = (INTERIOR << 30) | ((uint32_t)childMask << 22),
+        .index = firstChild,
+    };
+}
+
+HybridNode HybridNode::solid(glm::u8vec3 colour)
+{
+    return HybridNode {
+        .data = (SOLID << 30) | packColour(colour),
+        .index = 0,
+    };
+}
+
+HybridNode HybridNode::brick(uint32_t colourPtr, uint32_t brickIndex, bool uniform)
+{
+    assert(colourPtr <= HybridColourPtrMask && "Colour pointer out of range");
+
+    uint32_t flags = (BRICK << 30) | (uniform ? HybridUniformBrick : 0);
+    return HybridNode {
+        .data = flags | (colourPtr & HybridColourPtrMask),
+        .index = brickIndex,
+    };
+}
+
+struct HybridWriter {
+    const std::pmr::vector<HybridIntNode>& intNodes;
+    uint32_t brickSize;
+    // Depth below the root of nodes covering a single brick
+    uint32_t brickDepth;
+    HybridOctree& hybrid;
+};
+
+// Expands the subtree of an intermediary node into the voxels of a brick
+static void fillBrick(const HybridWriter& writer, size_t index, glm::uvec3 origin, uint32_t size,
+    uint64_t* occupancy, uint32_t* colours)
+{
+    const HybridIntNode& node = writer.intNodes[index];
+    const uint32_t edge = writer.brickSize;
+
+    if (!node.parent) {
+        if (!node.visible)
+            return;
+
+        for (uint32_t y = origin.y; y < origin.y + size; y++) {
+            for (uint32_t z = origin.z; z < origin.z + size; z++) {
+                for (uint32_t x = origin.x; x < origin.x + size; x++) {
+                    uint32_t bit = x + z * edge + y * edge * edge;
+                    occupancy[bit / 64] |= 1ull << (bit % 64);
+                    colours[bit] = packColour(node.colour);
+                }
+            }
+        }
+        return;
+    }
+
+    const uint32_t half = size / 2;
+    for (uint32_t octant = 0; octant < 8; octant++) {
+        if (((node.childMask >> octant) & 1) == 0)
+            continue;
+
+        size_t child = node.childStartIndex - std::popcount(node.childMask >> (octant + 1));
+        glm::uvec3 offset((octant >> 0) & 1, (octant >> 2) & 1, (octant >> 1) & 1);
+
+        fillBrick(writer, child, origin + offset * half, half, occupancy, colours);
+    }
+}
+
+static HybridNode writeBrick(const HybridWriter& writer, size_t index)
+{
+    const uint32_t words = hybridBrickWords(writer.brickSize);
+    const uint32_t voxels = words * 64;
+
+    std::vector<uint64_t> occupancy(words, 0);
+    std::vector<uint32_t> colours(voxels, 0);
+    fillBrick(writer, index, glm::uvec3(0), writer.brickSize, occupancy.data(), colours.data());
+
+    HybridOctree& hybrid = writer.hybrid;
+    const uint32_t brickIndex = hybrid.occupancy.size() / words;
+    const uint32_t colourPtr = hybrid.colours.size();
+
+    hybrid.occupancy.insert(hybrid.occupancy.end(), occupancy.begin(), occupancy.end());
+    for (uint32_t bit = 0; bit < voxels; bit++) {
+        if ((occupancy[bit / 64] >> (bit % 64)) & 1)
+            hybrid.colours.push_back(colours[bit]);
+    }
+
+    // Bricks are never empty, keep only the first colour when every voxel shares it
+    const bool uniform = std::all_of(hybrid.colours.begin() + colourPtr, hybrid.colours.end(),
+        [&](uint32_t colour) { return colour == hybrid.colours[colourPtr]; });
+    if (uniform)
+        hybrid.colours.resize(colourPtr + 1);
+
+    return HybridNode::brick(colourPtr, brickIndex, uniform);
+}
+
+// Writes the node and its subtree, children of each node are kept together after it
+static HybridNode writeNode(
+    std::stop_token stoken, const HybridWriter& writer, size_t index, uint32_t depth)
+{
+    const HybridIntNode& node = writer.intNodes[index];
+
+    if (!node.parent) {
+        // Only the root of an empty volume is an invisible leaf
+        if (!node.visible)
+            return HybridNode::interior(0, 0);
+
+        return HybridNode::solid(node.colour);
+    }
+
+    // The subtree has reached brick size
+    if (depth == writer.brickDepth)
+        return writeBrick(writer, index);
+
+    std::vector<HybridNode>& nodes = writer.hybrid.nodes;
+    const uint32_t firstChild = nodes.size();
+    const uint32_t childCount = std::popcount(node.childMask);
+    nodes.resize(firstChild + childCount);
+
+    for (uint32_t i = 0; i < childCount && !stoken.stop_requested(); i++) {
+        HybridNode child = writeNode(stoken, writer, node.childStartIndex - i, depth + 1);
+        nodes[firstChild + i] = child;
+    }
+
+    return HybridNode::interior(node.childMask, firstChild);
+}
+
+static HybridOctree writeHybrid(std::stop_token stoken,
+    const std::pmr::vector<HybridIntNode>& intermediaryNodes, GenerationInfo& info,
+    glm::uvec3 dimensions, bool& finished, uint32_t brickSize, std::chrono::steady_clock timer,
+    const std::chrono::steady_clock::time_point start)
+{
+    HybridOctree hybrid;
+    hybrid.brickSize = brickSize;
+
+    const uint32_t brickLevels = std::countr_zero(brickSize);
+    const HybridWriter writer {
+        .intNodes = intermediaryNodes,
+        .brickSize = brickSize,
+        .brickDepth = HybridBuilder::levelCount(dimensions) - brickLevels,
+        .hybrid = hybrid,
+    };
+
+    hybrid.nodes.resize(1);
+    hybrid.nodes[0] = writeNode(stoken, writer, intermediaryNodes.size() - 1, 0);
+
+    // Indices are only truncated past these sizes, so checking once written is enough
+    const size_t bricks = hybrid.occupancy.size() / hybridBrickWords(brickSize);
+    if (hybrid.nodes.size() > 0xFFFFFFFF || bricks > 0xFFFFFFFF
+        || hybrid.colours.size() > (size_t)HybridColourPtrMask + 1)
+        return {};
+
+    auto end = timer.now();
+    std::chrono::duration<float, std::milli> difference = end - start;
+
+    info.generationTime = difference.count() / 1000.0f;
+    info.completionPercent = 1.f;
+
+    info.nodes = hybrid.nodes.size();
+
+    finished = true;
+
+    return hybrid;
+}
+
+// Cube of the octree, never smaller than a single brick
+static glm::uvec3 hybridDimensions(glm::uvec3 loaderDimensions, uint32_t brickSize)
+{
+    return glm::max(HybridBuilder::dimensions(loaderDimensions), glm::uvec3(brickSize));
+}
+
+HybridOctree generateHybrid(std::stop_token stoken, std::unique_ptr<Loader>&& loader,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished, uint32_t brickSize,
+    std::pmr::memory_resource* resource)
+{
+    assert((brickSize == 4 || brickSize == 8) && "Hybrid bricks must be 4 or 8 voxels across");
+
+    std::chrono::steady_clock timer;
+
+    dimensions = hybridDimensions(loader->getDimensions(), brickSize);
+
+    auto start = timer.now();
+
+    TrackingResource memory(resource);
+    auto built = HybridBuilder::build(stoken, *loader, info, dimensions, &memory);
+    if (!built.has_value())
+        return {};
+    memory.report(info);
+
+    return writeHybrid(stoken, built.value(), info, dimensions, finished, brickSize, timer, start);
+}
+
+HybridOctree generateHybrid(std::stop_token stoken, BlockStream& stream, GenerationInfo& info,
+    glm::uvec3& dimensions, bool& finished, uint32_t brickSize, std::pmr::memory_resource* resource)
+{
+    assert((brickSize == 4 || brickSize == 8) && "Hybrid bricks must be 4 or 8 voxels across");
+
+    std::chrono::steady_clock timer;
+
+    dimensions = hybridDimensions(stream.getDimensions(), brickSize);
+
+    auto start = timer.now();
+
+    TrackingResource memory(resource);
+    auto built = HybridBuilder::build(stoken, stream, info, dimensions, &memory);
+    if (!built.has_value())
+        return {};
+    memory.report(info);
+
+    return writeHybrid(stoken, built.value(), info, dimensions, finished, brickSize, timer, start);
+}
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <memory_resource>
+#include <thread>
+#include <vector>
+
+#include "block_stream.hpp"
+#include "common.hpp"
+#include "loaders/loader.hpp"
+
+namespace Generators {
+static constexpr uint32_t HybridColourPtrMask = (1u << 29) - 1;
+// Set on bricks whose voxels share one colour, only that colour is stored
+static constexpr uint32_t HybridUniformBrick = 1u << 29;
+
+// Octree whose bottom levels are replaced by occupancy bitmask bricks.
+//  data:  Type in the top 2 bits. Interior nodes hold the child mask in bits 22-29, solid leaves
+//         0xRRGGBB and bricks the index of their first colour below HybridUniformBrick.
+//  index: First child of interior nodes, children are stored from the highest octant down as in
+//         the octree. Bricks hold their brick number, their occupancy starts at
+//         index * hybridBrickWords(brickSize).
+struct HybridNode {
+    enum Type : uint32_t {
+        INTERIOR = 0,
+        SOLID = 1,
+        BRICK = 2,
+    };
+
+    uint32_t data;
+    uint32_t index;
+
+    static HybridNode interior(uint8_t childMask, uint32_t firstChild);
+    static HybridNode solid(glm::u8vec3 colour);
+    static HybridNode brick(uint32_t colourPtr, uint32_t brickIndex, bool uniform);
+
+    Type getType() const { return static_cast<Type>(data >> 30); }
+    uint8_t getChildMask() const { return (data >> 22) & 0xFF; }
+    uint32_t getColour() const { return data & 0xFFFFFF; }
+    uint32_t getColourPtr() const { return data & HybridColourPtrMask; }
+    bool isUniform() const { return (data & HybridUniformBrick) != 0; }
+};
+
+// Brick edge used when none is given, bricks may be 4 or 8 voxels across
+constexpr uint32_t HybridBrickSize = 4;
+
+// Occupancy words per brick, bits are indexed x + z * Size + y * Size * Size like the brickmap
+constexpr uint32_t hybridBrickWords(uint32_t brickSize)
+{
+    return brickSize * brickSize * brickSize / 64;
+}
+
+struct HybridOctree {
+    uint32_t brickSize = HybridBrickSize;
+    // The root is the first node
+    std::vector<HybridNode> nodes;
+    // hybridBrickWords(brickSize) words per brick
+    std::vector<uint64_t> occupancy;
+    // 0x00RRGGBB per occupied brick voxel in bit order, starting at the brick's colour pointer.
+    // Uniform bricks store a single colour.
+    std::vector<uint32_t> colours;
+};
+
+// Empty without finishing when the node, brick or colour indices would not fit their fields.
+// Scratch memory comes from resource, as for generateOctree.
+HybridOctree generateHybrid(std::stop_token stoken, std::unique_ptr<Loader>&& loader,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished,
+    uint32_t brickSize = HybridBrickSize,
+    std::pmr::memory_resource* resource = std::pmr::new_delete_resource());
+HybridOctree generateHybrid(std::stop_token stoken, BlockStream& stream, GenerationInfo& info,
+    glm::uvec3& dimensions, bool& finished, uint32_t brickSize = HybridBrickSize,
+    std::pmr::memory_resource* resource = std::pmr::new_delete_resource());
+}
@@ -0,0 +1,24 @@
+#include "memory.hpp"
+
+namespace Generators {
+void* TrackingResource::do_allocate(size_t bytes, size_t alignment)
+{
+    void* pointer = m_Upstream->allocate(bytes, alignment);
+
+    const uint64_t current = m_Current.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    m_Allocated.fetch_add(bytes, std::memory_order_relaxed);
+    m_Allocations.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t peak = m_Peak.load(std::memory_order_relaxed);
+    while (current > peak
+        && !m_Peak.compare_exchange_weak(peak, current, std::memory_order_relaxed)) { }
+
+    return pointer;
+}
+
+void TrackingResource::do_deallocate(void* pointer, size_t bytes, size_t alignment)
+{
+    m_Upstream->deallocate(pointer, bytes, alignment);
+    m_Current.fetch_sub(bytes, std::memory_order_relaxed);
+}
+}
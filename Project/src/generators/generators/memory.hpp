@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory_resource>
+
+#include "common.hpp"
+
+namespace Generators {
+// Forwards to an upstream resource while counting what passes through it. Safe to share between
+// threads whenever the upstream resource is, so it sits under the per task arenas of a stage.
+class TrackingResource : public std::pmr::memory_resource {
+  public:
+    explicit TrackingResource(
+        std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+        : m_Upstream(upstream)
+    {
+    }
+
+    TrackingResource(const TrackingResource&) = delete;
+    TrackingResource& operator=(const TrackingResource&) = delete;
+
+    // Most bytes held at once
+    uint64_t getPeakBytes() const { return m_Peak.load(std::memory_order_relaxed); }
+    // Every byte ever allocated, including those since released
+    uint64_t getAllocatedBytes() const { return m_Allocated.load(std::memory_order_relaxed); }
+    uint64_t getAllocations() const { return m_Allocations.load(std::memory_order_relaxed); }
+
+    // Copies the totals into the info shown once the stage finishes
+    void report(GenerationInfo& info) const
+    {
+        info.peakBytes = getPeakBytes();
+        info.allocatedBytes = getAllocatedBytes();
+    }
+
+  private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+  private:
+    std::pmr::memory_resource* m_Upstream;
+
+    std::atomic<uint64_t> m_Current = 0;
+    std::atomic<uint64_t> m_Peak = 0;
+    std::atomic<uint64_t> m_Allocated = 0;
+    std::atomic<uint64_t> m_Allocations = 0;
+};
+}
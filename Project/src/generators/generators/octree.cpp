@@ -1,17 +1,34 @@
 #include "octree.hpp"
+#include "memory.hpp"
+#include "palette.hpp"
+#include "task_scheduler.hpp"
+#include "tree_builder.hpp"
 
+#include "morton/morton_code.hpp"
+
+#include <atomic>
 #include <deque>
+#include <unordered_map>
 
 namespace Generators {
-struct OctreeIntNode {
-    glm::u8vec3 colour;
-    bool visible;
-    bool parent;
-    uint8_t childMask;
-    uint32_t childStartIndex = 0;
-    uint32_t childCount = 0;
+struct OctreeTraits {
+    using Colour = glm::u8vec3;
+
+    static constexpr uint32_t MaxDepth = 23;
+    static constexpr bool ReverseChildren = false;
+
+    static glm::uvec3 decode(uint64_t code) { return MortonCode::decode(code); }
+    static uint64_t encode(glm::uvec3 index) { return MortonCode::encode(index); }
+    static Colour leafColour(glm::vec3 colour)
+    {
+        return glm::u8vec3 { colour.x * 255, colour.y * 255, colour.z * 255 };
+    }
+    static Colour parentColour() { return glm::u8vec3(1); }
 };
 
+using OctreeBuilder = TreeBuilder<8, OctreeTraits>;
+using OctreeIntNode = OctreeBuilder::IntNode;
+
 OctreeNode::OctreeNode(uint32_t ptr) { m_CurrentType = ptr; }
 
 OctreeNode::OctreeNode(uint8_t childMask, uint32_t offset)
@@ -54,56 +71,7 @@ uint32_t OctreeNode::getData() const
     }
 }
 
-static OctreeIntNode convert(const std::optional<glm::vec3> v)
-{
-    if (v.has_value()) {
-        glm::vec3 colour = v.value();
-        return OctreeIntNode {
-            .colour = glm::u8vec3 { colour.x * 255, colour.y * 255, colour.z * 255 },
-            .visible = 1,
-            .parent = false,
-            .childMask = 0,
-            .childCount = 0,
-        };
-    } else
-        return OctreeIntNode { .visible = false };
-}
-
-static std::optional<OctreeIntNode> allEqual(const std::array<OctreeIntNode, 8>& nodes)
-{
-    assert(nodes.size() == 8);
-    if (nodes.at(0).parent)
-        return std::optional<OctreeIntNode> {};
-
-    bool allVisible = nodes.at(0).visible;
-    glm::u8vec3 colour = nodes.at(0).colour;
-    uint32_t count = 0;
-    for (uint32_t i = 1; i < 8; i++) {
-        if (nodes.at(i).parent) {
-            return std::optional<OctreeIntNode> {};
-        }
-
-        if (nodes.at(i).visible != allVisible) {
-            return std::optional<OctreeIntNode> {};
-        }
-
-        if (nodes.at(i).colour != colour) {
-            return std::optional<OctreeIntNode> {};
-        }
-
-        count += nodes.at(i).childCount + 1;
-    }
-
-    return std::optional<OctreeIntNode>(OctreeIntNode {
-        .colour = colour,
-        .visible = allVisible,
-        .parent = false,
-        .childMask = 0,
-        .childCount = count,
-    });
-};
-
-void writeChildrenNodes(std::stop_token stoken, const std::vector<OctreeIntNode>& intNodes,
+void writeChildrenNodes(std::stop_token stoken, const std::pmr::vector<OctreeIntNode>& intNodes,
     size_t index, std::chrono::steady_clock clock,
     const std::chrono::steady_clock::time_point startTime, std::vector<OctreeNode>& nodes)
 {
@@ -147,6 +115,10 @@ void writeChildrenNodes(std::stop_token stoken, const std::vector<OctreeIntNode>
             size_t offset = childStartingIndex - (startingIndex + i);
             writeChildrenNodes(stoken, intNodes, childIndex, clock, startTime, nodes);
 
+            // Abandoned like a stop, the caller checks the final size
+            if (nodes.size() > MaxOctreeNodes)
+                return;
+
             if (offset >= 0x200000) {
                 size_t farPointerIndex = startingIndex + childrenCount + currentFarPointer;
                 assert(childStartingIndex - farPointerIndex <= 0xFFFFFFFF);
@@ -163,98 +135,299 @@ void writeChildrenNodes(std::stop_token stoken, const std::vector<OctreeIntNode>
     assert(farPointerCount >= currentFarPointer && "Pointers should match");
 }
 
-std::vector<OctreeNode> generateOctree(std::stop_token stoken, std::unique_ptr<Loader>&& loader,
-    GenerationInfo& info, glm::uvec3& dimensions, bool& finished)
+// Sibling nodes which must stay contiguous, the root is held on its own in block 0
+struct LayoutBlock {
+    std::vector<uint32_t> nodes;
+    // Block holding each node's children, -1 for leaves
+    std::vector<int64_t> children;
+    uint32_t depth;
+};
+
+// Block of the node's children, nothing for leaves
+static std::optional<OctreeBlock> findChildBlock(const std::vector<OctreeNode>& nodes, size_t index)
 {
-    std::chrono::steady_clock timer;
+    uint32_t data = nodes.at(index).getData();
 
-    dimensions = Loader::cubeDimensions(loader->getDimensionsDiv2());
+    bool solid = ((data >> 30) & 0x1) != 0;
+    uint8_t childMask = (data >> 22) & 0xFF;
+    if (solid || childMask == 0)
+        return {};
 
-    auto start = timer.now();
+    size_t childStart = index + (data & 0x1FFFFF);
+    if ((data & 0x200000) != 0)
+        childStart += nodes.at(childStart).getData();
+
+    return OctreeBlock { childStart, (uint32_t)glm::bitCount(childMask) };
+}
 
-    uint64_t currentCode = 0;
-    uint64_t finalCode = dimensions.x * dimensions.y * dimensions.z;
+static std::vector<LayoutBlock> splitBlocks(const std::vector<OctreeNode>& nodes)
+{
+    std::vector<LayoutBlock> blocks;
+    // First node and node count of each block
+    std::vector<std::pair<size_t, uint32_t>> ranges;
 
-    const uint32_t maxDepth = 23;
-    uint32_t currentDepth = maxDepth - 1;
+    blocks.push_back({ .nodes = {}, .children = {}, .depth = 0 });
+    ranges.push_back({ 0, 1 });
 
-    std::array<size_t, maxDepth> queueSizes;
-    for (uint32_t i = 0; i < maxDepth; i++)
-        queueSizes[i] = 0;
+    // Blocks are discovered breadth first so children always have a higher index
+    for (size_t b = 0; b < blocks.size(); b++) {
+        auto [start, count] = ranges[b];
 
-    std::array<std::array<OctreeIntNode, 8>, maxDepth> queues;
-    std::vector<OctreeIntNode> intermediaryNodes;
+        for (uint32_t j = 0; j < count; j++) {
+            blocks[b].nodes.push_back(nodes.at(start + j).getData());
 
-    std::vector<OctreeNode> nodes;
+            auto childBlock = findChildBlock(nodes, start + j);
+            if (!childBlock.has_value()) {
+                blocks[b].children.push_back(-1);
+                continue;
+            }
 
-    info.voxelCount = 0;
+            blocks[b].children.push_back(blocks.size());
+            blocks.push_back({ .nodes = {}, .children = {}, .depth = blocks[b].depth + 1 });
+            ranges.push_back(childBlock.value());
+        }
+    }
 
-    while (currentCode != finalCode) {
-        if (stoken.stop_requested())
-            return nodes;
+    return blocks;
+}
 
-        const auto currentVoxel = loader->getVoxelMorton(currentCode);
-        currentCode++;
+static void depthFirstOrder(
+    const std::vector<LayoutBlock>& blocks, size_t block, std::vector<size_t>& order)
+{
+    order.push_back(block);
+    for (int64_t child : blocks[block].children) {
+        if (child >= 0)
+            depthFirstOrder(blocks, child, order);
+    }
+}
 
-        currentDepth = maxDepth - 1;
-        queues[currentDepth][queueSizes[currentDepth]] = convert(currentVoxel);
-        queueSizes[currentDepth]++;
+static void collectFrontier(const std::vector<LayoutBlock>& blocks, size_t root, uint32_t levels,
+    std::vector<size_t>& frontier)
+{
+    if (levels == 0) {
+        frontier.push_back(root);
+        return;
+    }
 
-        auto current = timer.now();
+    for (int64_t child : blocks[root].children) {
+        if (child >= 0)
+            collectFrontier(blocks, child, levels - 1, frontier);
+    }
+}
 
-        std::chrono::duration<float, std::milli> difference = current - start;
-        info.completionPercent = ((float)currentCode / (float)finalCode);
-        info.generationTime = difference.count() / 1000.0f;
+static void vanEmdeBoasOrder(const std::vector<LayoutBlock>& blocks, size_t root, uint32_t levels,
+    std::vector<size_t>& order)
+{
+    if (levels <= 1) {
+        order.push_back(root);
+        return;
+    }
 
-        while (currentDepth > 0 && queueSizes[currentDepth] == 8) {
-            if (stoken.stop_requested())
-                return nodes;
+    uint32_t top = levels / 2;
+    vanEmdeBoasOrder(blocks, root, top, order);
 
-            OctreeIntNode node;
+    std::vector<size_t> frontier;
+    collectFrontier(blocks, root, top, frontier);
+    for (size_t subtree : frontier) {
+        vanEmdeBoasOrder(blocks, subtree, levels - top, order);
+    }
+}
 
-            const auto& possible_parent_node = allEqual(queues[currentDepth]);
+// Writes blocks in the given order, each followed by far pointer slots for the children that
+// are out of reach of a 21 bit offset
+static std::vector<OctreeNode> emitBlocks(const std::vector<LayoutBlock>& blocks,
+    const std::vector<size_t>& order, std::vector<size_t>* blockPositions = nullptr)
+{
+    std::vector<std::vector<bool>> far(blocks.size());
+    std::vector<uint32_t> farCount(blocks.size(), 0);
+    for (size_t b = 0; b < blocks.size(); b++) {
+        far[b].assign(blocks[b].nodes.size(), false);
+    }
 
-            if (possible_parent_node.has_value()) {
-                queues[currentDepth - 1][queueSizes[currentDepth - 1]]
-                    = possible_parent_node.value();
-                queueSizes[currentDepth - 1]++;
-            } else {
-                uint8_t childMask = 0;
-                uint32_t childCount = 0;
-                for (int8_t i = 0; i < 8; i++) {
-                    if (queues[currentDepth].at(i).visible) {
-                        childMask |= (1 << i);
-                        intermediaryNodes.push_back(queues[currentDepth].at(i));
-                        if (!queues[currentDepth].at(i).parent
-                            && queues[currentDepth].at(i).visible) {
-                            info.voxelCount += pow(8, 22 - currentDepth);
-                        }
-                        childCount += queues[currentDepth].at(i).childCount + 1;
-                    }
+    // Adding far slots only moves blocks further apart so this settles once nothing new is far
+    std::vector<size_t> position(blocks.size());
+    size_t total = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        total = 0;
+        for (size_t b : order) {
+            position[b] = total;
+            total += blocks[b].nodes.size() + farCount[b];
+        }
+
+        for (size_t b = 0; b < blocks.size(); b++) {
+            for (size_t j = 0; j < blocks[b].nodes.size(); j++) {
+                int64_t child = blocks[b].children[j];
+                if (child < 0 || far[b][j])
+                    continue;
+
+                if (position[child] - (position[b] + j) >= 0x200000) {
+                    far[b][j] = true;
+                    farCount[b]++;
+                    changed = true;
                 }
+            }
+        }
+    }
 
-                OctreeIntNode parent = {
-                    .colour = glm::u8vec3(1),
-                    .visible = childMask != 0,
-                    .parent = true,
-                    .childMask = childMask,
-                    .childStartIndex = (uint32_t)(intermediaryNodes.size() - 1),
-                    .childCount = childCount,
-                };
-                queues[currentDepth - 1][queueSizes[currentDepth - 1]] = parent;
-                queueSizes[currentDepth - 1]++;
+    if (total > MaxOctreeNodes)
+        return {};
+
+    if (blockPositions != nullptr)
+        *blockPositions = position;
+
+    std::vector<OctreeNode> nodes;
+    nodes.reserve(total);
+
+    for (size_t b : order) {
+        const LayoutBlock& block = blocks[b];
+        size_t slot = position[b] + block.nodes.size();
+
+        std::vector<uint32_t> farPointers;
+        for (size_t j = 0; j < block.nodes.size(); j++) {
+            int64_t child = block.children[j];
+            if (child < 0) {
+                nodes.push_back(OctreeNode(block.nodes[j]));
+                continue;
+            }
+
+            uint8_t childMask = (block.nodes[j] >> 22) & 0xFF;
+            size_t index = position[b] + j;
+
+            if (far[b][j]) {
+                assert(position[child] - slot <= 0xFFFFFFFF);
+                farPointers.push_back(position[child] - slot);
+
+                nodes.push_back(OctreeNode(childMask, 0x200000 + slot - index));
+                slot++;
+            } else {
+                nodes.push_back(OctreeNode(childMask, position[child] - index));
             }
+        }
+
+        for (uint32_t pointer : farPointers) {
+            nodes.push_back(OctreeNode(pointer));
+        }
+    }
+
+    return nodes;
+}
 
-            queueSizes[currentDepth] = 0;
-            currentDepth--;
+std::vector<OctreeBlock> octreeChildBlocks(
+    const std::vector<OctreeNode>& nodes, const std::vector<OctreeBlock>& blocks)
+{
+    std::vector<OctreeBlock> children;
+    for (auto [start, count] : blocks) {
+        for (uint32_t j = 0; j < count; j++) {
+            auto childBlock = findChildBlock(nodes, start + j);
+            if (childBlock.has_value())
+                children.push_back(childBlock.value());
         }
     }
-    assert(queueSizes[currentDepth] == 1);
-    intermediaryNodes.push_back(queues[currentDepth].at(0));
-    if (!queues[currentDepth].at(0).parent && queues[currentDepth].at(0).visible) {
-        info.voxelCount += pow(8, 22 - currentDepth);
+
+    return children;
+}
+
+std::vector<OctreeLevel> splitOctreeLevels(const std::vector<OctreeNode>& nodes)
+{
+    if (nodes.empty())
+        return {};
+
+    std::vector<std::vector<OctreeBlock>> levelBlocks = { { { 0, 1 } } };
+    while (true) {
+        std::vector<OctreeBlock> children = octreeChildBlocks(nodes, levelBlocks.back());
+        if (children.empty())
+            break;
+        levelBlocks.push_back(std::move(children));
     }
 
+    std::vector<OctreeLevel> levels(levelBlocks.size());
+
+    // Colour sums weighted by the share of the volume each voxel covers, alpha holds the weight.
+    // Entry i is the sum below the i-th interior node of the level above.
+    std::vector<glm::dvec4> below;
+    for (size_t l = levelBlocks.size(); l-- > 0;) {
+        const double weight = std::pow(0.125, (double)l);
+
+        std::vector<glm::dvec4> sums(levelBlocks[l].size(), glm::dvec4(0.0));
+        OctreeLevel& level = levels[l];
+        level.end = 0;
+
+        size_t interior = 0;
+        for (size_t b = 0; b < levelBlocks[l].size(); b++) {
+            auto [start, count] = levelBlocks[l][b];
+
+            uint32_t farPointers = 0;
+            for (uint32_t j = 0; j < count; j++) {
+                uint32_t data = nodes[start + j].getData();
+
+                if (((data >> 30) & 0x1) != 0) {
+                    glm::dvec3 colour((data >> 16) & 0xFF, (data >> 8) & 0xFF, data & 0xFF);
+                    sums[b] += glm::dvec4(colour * weight, weight);
+                } else if (((data >> 22) & 0xFF) != 0) {
+                    const glm::dvec4 sum = below.at(interior++);
+                    sums[b] += sum;
+
+                    glm::dvec3 average = glm::round(glm::dvec3(sum) / sum.w);
+                    level.averages.push_back(packColour(glm::u8vec3(average)));
+
+                    if ((data & 0x200000) != 0)
+                        farPointers++;
+                }
+            }
+
+            level.end = std::max<uint64_t>(level.end, start + count + farPointers);
+        }
+
+        below = std::move(sums);
+    }
+
+    return levels;
+}
+
+std::vector<OctreeNode> layoutOctree(const std::vector<OctreeNode>& nodes, OctreeLayout layout)
+{
+    if (nodes.empty())
+        return nodes;
+
+    std::vector<LayoutBlock> blocks = splitBlocks(nodes);
+
+    std::vector<size_t> order;
+    order.reserve(blocks.size());
+
+    switch (layout) {
+    case OctreeLayout::DEPTH_FIRST:
+        depthFirstOrder(blocks, 0, order);
+        break;
+    case OctreeLayout::BREADTH_FIRST:
+        for (size_t b = 0; b < blocks.size(); b++) {
+            order.push_back(b);
+        }
+        break;
+    case OctreeLayout::VAN_EMDE_BOAS: {
+        uint32_t levels = 0;
+        for (const LayoutBlock& block : blocks) {
+            levels = std::max(levels, block.depth + 1);
+        }
+
+        vanEmdeBoasOrder(blocks, 0, levels, order);
+        break;
+    }
+    default:
+        assert(false && "Unknown octree layout");
+    }
+
+    return emitBlocks(blocks, order);
+}
+
+static std::vector<OctreeNode> writeOctree(std::stop_token stoken,
+    const std::pmr::vector<OctreeIntNode>& intermediaryNodes, GenerationInfo& info, bool& finished,
+    OctreeLayout layout, std::chrono::steady_clock timer,
+    const std::chrono::steady_clock::time_point start)
+{
+    std::vector<OctreeNode> nodes;
     nodes.reserve(intermediaryNodes.size());
 
     {
@@ -264,6 +437,15 @@ std::vector<OctreeNode> generateOctree(std::stop_token stoken, std::unique_ptr<L
 
     writeChildrenNodes(
         stoken, intermediaryNodes, intermediaryNodes.size() - 1, timer, start, nodes);
+    if (nodes.size() > MaxOctreeNodes)
+        return {};
+
+    // Nodes are already written depth first
+    if (layout != OctreeLayout::DEPTH_FIRST && !stoken.stop_requested()) {
+        nodes = layoutOctree(nodes, layout);
+        if (nodes.empty())
+            return {};
+    }
 
     auto end = timer.now();
     std::chrono::duration<float, std::milli> difference = end - start;
@@ -277,4 +459,397 @@ std::vector<OctreeNode> generateOctree(std::stop_token stoken, std::unique_ptr<L
 
     return nodes;
 }
+
+std::vector<OctreeNode> generateOctree(std::stop_token stoken, std::unique_ptr<Loader>&& loader,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished, OctreeLayout layout,
+    std::pmr::memory_resource* resource)
+{
+    std::chrono::steady_clock timer;
+
+    dimensions = OctreeBuilder::dimensions(*loader);
+
+    auto start = timer.now();
+
+    TrackingResource memory(resource);
+    auto built = OctreeBuilder::build(stoken, *loader, info, dimensions, &memory);
+    if (!built.has_value())
+        return {};
+    memory.report(info);
+
+    return writeOctree(stoken, built.value(), info, finished, layout, timer, start);
+}
+
+std::vector<OctreeNode> generateOctree(std::stop_token stoken, BlockStream& stream,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished, OctreeLayout layout,
+    std::pmr::memory_resource* resource)
+{
+    std::chrono::steady_clock timer;
+
+    dimensions = OctreeBuilder::dimensions(stream.getDimensions());
+
+    auto start = timer.now();
+
+    TrackingResource memory(resource);
+    auto built = OctreeBuilder::build(stoken, stream, info, dimensions, &memory);
+    if (!built.has_value())
+        return {};
+    memory.report(info);
+
+    return writeOctree(stoken, built.value(), info, finished, layout, timer, start);
+}
+
+std::vector<OctreeNode> generateOctree(std::stop_token stoken, PrimitiveLoader& loader,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished, OctreeLayout layout,
+    std::pmr::memory_resource* resource)
+{
+    std::chrono::steady_clock timer;
+
+    dimensions = OctreeBuilder::dimensions(loader);
+
+    auto start = timer.now();
+
+    TrackingResource memory(resource);
+    auto built = OctreeBuilder::build(stoken, loader, info, dimensions, &memory);
+    if (!built.has_value())
+        return {};
+    memory.report(info);
+
+    return writeOctree(stoken, built.value(), info, finished, layout, timer, start);
+}
+
+std::function<bool(glm::uvec3)> octreePartialFilter(
+    glm::uvec3 loaderDimensions, uint32_t worker, uint32_t workers)
+{
+    return OctreeBuilder::partialFilter(loaderDimensions, worker, workers);
+}
+
+std::optional<PartialTree> generateOctreePartial(std::stop_token stoken,
+    std::unique_ptr<Loader>&& loader, GenerationInfo& info, uint32_t worker, uint32_t workers,
+    std::pmr::memory_resource* resource)
+{
+    glm::uvec3 dimensions = OctreeBuilder::dimensions(*loader);
+    TrackingResource memory(resource);
+    auto partial
+        = OctreeBuilder::buildPartial(stoken, *loader, info, dimensions, worker, workers, &memory);
+    memory.report(info);
+    return partial;
+}
+
+std::optional<std::vector<OctreeNode>> mergeOctreePartials(std::stop_token stoken,
+    std::function<std::optional<PartialTree>(uint32_t)> loadPartial, uint32_t workers,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished,
+    OctreeLayout layout, std::pmr::memory_resource* resource)
+{
+    std::chrono::steady_clock timer;
+    auto start = timer.now();
+
+    TrackingResource memory(resource);
+    auto built
+        = OctreeBuilder::mergePartials(stoken, loadPartial, workers, info, dimensions, &memory);
+    if (!built.has_value())
+        return {};
+    memory.report(info);
+
+    return writeOctree(stoken, built.value(), info, finished, layout, timer, start);
+}
+
+// Blocks shared between every frame of a temporal octree. Parent nodes only keep their child
+// mask, offsets are recomputed once the final order is known.
+class TemporalBlocks {
+  public:
+    // Adds the blocks of one frame's octree, returning the shared block of its root
+    size_t addFrame(const std::vector<OctreeNode>& nodes)
+    {
+        std::vector<LayoutBlock> frame = splitBlocks(nodes);
+        std::vector<size_t> shared(frame.size());
+
+        // Children always follow their parent so are interned first
+        for (size_t b = frame.size(); b-- > 0;) {
+            LayoutBlock& block = frame[b];
+            for (size_t j = 0; j < block.nodes.size(); j++) {
+                if (block.children[j] < 0)
+                    continue;
+
+                block.nodes[j] &= 0xFFu << 22;
+                block.children[j] = shared[block.children[j]];
+            }
+
+            shared[b] = intern(std::move(block));
+        }
+
+        return shared[0];
+    }
+
+    const std::vector<LayoutBlock>& getBlocks() const { return m_Blocks; }
+
+  private:
+    size_t intern(LayoutBlock&& block)
+    {
+        // FNV-1a over the depth, nodes and shared children
+        uint64_t hash = 0xcbf29ce484222325;
+        auto combine = [&](uint64_t value) {
+            hash ^= value;
+            hash *= 0x100000001b3;
+        };
+
+        combine(block.depth);
+        for (size_t j = 0; j < block.nodes.size(); j++) {
+            combine(block.nodes[j]);
+            combine(block.children[j]);
+        }
+
+        auto& candidates = m_Shared[hash];
+        for (size_t candidate : candidates) {
+            const LayoutBlock& existing = m_Blocks[candidate];
+            if (existing.depth == block.depth && existing.nodes == block.nodes
+                && existing.children == block.children)
+                return candidate;
+        }
+
+        candidates.push_back(m_Blocks.size());
+        m_Blocks.push_back(std::move(block));
+        return m_Blocks.size() - 1;
+    }
+
+  private:
+    std::vector<LayoutBlock> m_Blocks;
+    // Hash -> indices of blocks with that hash
+    std::unordered_map<uint64_t, std::vector<size_t>> m_Shared;
+};
+
+TemporalOctree generateTemporalOctree(std::stop_token stoken, size_t frameCount,
+    std::function<std::unique_ptr<Loader>(size_t)> loadFrame, GenerationInfo& info,
+    glm::uvec3& dimensions, bool& finished, std::pmr::memory_resource* resource)
+{
+    std::chrono::steady_clock timer;
+    auto start = timer.now();
+
+    TemporalBlocks blocks;
+    std::vector<size_t> rootBlocks;
+    // Shared by every frame's build, each frame's nodes are released before the next is built
+    TrackingResource memory(resource);
+
+    for (size_t frame = 0; frame < frameCount; frame++) {
+        std::unique_ptr<Loader> loader = loadFrame(frame);
+        dimensions = OctreeBuilder::dimensions(*loader);
+
+        GenerationInfo frameInfo {};
+        auto built = OctreeBuilder::build(stoken, *loader, frameInfo, dimensions, &memory);
+        if (!built.has_value())
+            return {};
+
+        const std::pmr::vector<OctreeIntNode>& intermediaryNodes = built.value();
+
+        std::vector<OctreeNode> nodes;
+        nodes.reserve(intermediaryNodes.size());
+        nodes.push_back(OctreeNode(intermediaryNodes.back().childMask, 1));
+        writeChildrenNodes(
+            stoken, intermediaryNodes, intermediaryNodes.size() - 1, timer, start, nodes);
+        if (stoken.stop_requested() || nodes.size() > MaxOctreeNodes)
+            return {};
+
+        rootBlocks.push_back(blocks.addFrame(nodes));
+
+        // The header holds the voxels of the frame shown first
+        if (frame == 0)
+            info.voxelCount = frameInfo.voxelCount;
+
+        std::chrono::duration<float, std::milli> difference = timer.now() - start;
+        info.completionPercent = (float)(frame + 1) / (float)frameCount;
+        info.generationTime = difference.count() / 1000.0f;
+    }
+
+    // Breadth first from the roots, every block is one level below the blocks pointing to it so
+    // children still follow all of their parents. The first frame's root stays at node 0.
+    const std::vector<LayoutBlock>& shared = blocks.getBlocks();
+    std::vector<size_t> order;
+    std::vector<bool> visited(shared.size(), false);
+    for (size_t root : rootBlocks) {
+        if (!visited[root]) {
+            visited[root] = true;
+            order.push_back(root);
+        }
+    }
+
+    for (size_t head = 0; head < order.size(); head++) {
+        for (int64_t child : shared[order[head]].children) {
+            if (child >= 0 && !visited[child]) {
+                visited[child] = true;
+                order.push_back(child);
+            }
+        }
+    }
+
+    TemporalOctree octree;
+
+    std::vector<size_t> positions;
+    octree.nodes = emitBlocks(shared, order, &positions);
+    if (octree.nodes.empty())
+        return {};
+    for (size_t root : rootBlocks) {
+        octree.roots.push_back(positions[root]);
+    }
+
+    std::chrono::duration<float, std::milli> difference = timer.now() - start;
+    info.generationTime = difference.count() / 1000.0f;
+    info.completionPercent = 1.f;
+    info.nodes = octree.nodes.size();
+    memory.report(info);
+
+    finished = true;
+
+    return octree;
+}
+
+// Octant bit of each axis, matching the child index used by traversal
+static constexpr uint8_t AxisOctant[3] = { 1, 4, 2 };
+
+// Index of the child in the given octant, -1 if it is not stored
+static int64_t childIndex(const std::vector<OctreeNode>& nodes, size_t index, uint32_t octant)
+{
+    uint32_t data = nodes[index].getData();
+
+    bool solid = ((data >> 30) & 0x1) != 0;
+    uint8_t childMask = (data >> 22) & 0xFF;
+    if (solid || ((childMask >> octant) & 1) == 0)
+        return -1;
+
+    size_t childStart = index + (data & 0x1FFFFF);
+    if ((data & 0x200000) != 0)
+        childStart += nodes[childStart].getData();
+
+    return childStart + glm::bitCount((uint32_t)childMask >> (octant + 1));
+}
+
+std::optional<std::vector<uint32_t>> generateOctreeRopes(const std::vector<OctreeNode>& nodes)
+{
+    if (nodes.size() > RopeIndexMask)
+        return {};
+
+    std::vector<uint32_t> ropes(nodes.size() * RopeFaces, NoRope);
+    if (nodes.empty())
+        return ropes;
+
+    // Parents are visited before their children so their ropes are already known
+    std::vector<size_t> queue = { 0 };
+    for (size_t head = 0; head < queue.size(); head++) {
+        size_t parent = queue[head];
+
+        for (uint32_t octant = 0; octant < 8; octant++) {
+            int64_t child = childIndex(nodes, parent, octant);
+            if (child < 0)
+                continue;
+
+            queue.push_back(child);
+
+            for (uint32_t face = 0; face < RopeFaces; face++) {
+                uint8_t bit = AxisOctant[face / 2];
+                bool positive = face % 2 == 1;
+                uint32_t sibling = octant ^ bit;
+
+                uint32_t rope;
+                if (((octant & bit) != 0) != positive) {
+                    // The neighbour is a sibling, or empty space inside the parent
+                    int64_t neighbour = childIndex(nodes, parent, sibling);
+                    rope = neighbour >= 0 ? neighbour : (1u << RopeIndexBits) | parent;
+                } else {
+                    // Step into the parent's neighbour, which is at least the parent's size
+                    rope = ropes[parent * RopeFaces + face];
+                    if (rope != NoRope && (rope >> RopeIndexBits) == 0) {
+                        int64_t neighbour = childIndex(nodes, rope, sibling);
+                        if (neighbour >= 0)
+                            rope = neighbour;
+                        else
+                            rope += 1u << RopeIndexBits;
+                    } else if (rope != NoRope) {
+                        rope += 1u << RopeIndexBits;
+                    }
+                }
+
+                ropes[child * RopeFaces + face] = rope;
+            }
+        }
+    }
+
+    return ropes;
+}
+
+bool validateOctreeRopes(const std::vector<OctreeNode>& nodes, const std::vector<uint32_t>& ropes)
+{
+    if (ropes.size() != nodes.size() * RopeFaces)
+        return false;
+    if (nodes.empty())
+        return true;
+
+    struct Cell {
+        size_t index;
+        glm::uvec3 position;
+        uint32_t depth;
+    };
+
+    std::vector<Cell> cells = { { .index = 0, .position = glm::uvec3(0), .depth = 0 } };
+    std::vector<bool> isNode(nodes.size(), false);
+    for (size_t i = 0; i < cells.size(); i++) {
+        const Cell cell = cells[i];
+        isNode[cell.index] = true;
+
+        for (uint32_t octant = 0; octant < 8; octant++) {
+            int64_t child = childIndex(nodes, cell.index, octant);
+            if (child < 0)
+                continue;
+
+            glm::uvec3 offset((octant & AxisOctant[0]) != 0, (octant & AxisOctant[1]) != 0,
+                (octant & AxisOctant[2]) != 0);
+            cells.push_back({ .index = (size_t)child,
+                .position = cell.position * 2u + offset,
+                .depth = cell.depth + 1 });
+        }
+    }
+
+    // Far pointer slots are not nodes and have no neighbours
+    for (size_t i = 0; i < nodes.size(); i++) {
+        for (uint32_t face = 0; face < RopeFaces && !isNode[i]; face++) {
+            if (ropes[i * RopeFaces + face] != NoRope)
+                return false;
+        }
+    }
+
+    std::atomic<bool> valid = true;
+    TaskScheduler::getInstance().parallelFor(cells.size(), 4096, [&](size_t i) {
+        const Cell& cell = cells[i];
+        const int64_t side = 1ll << cell.depth;
+
+        for (uint32_t face = 0; face < RopeFaces; face++) {
+            glm::i64vec3 neighbour = glm::i64vec3(cell.position);
+            neighbour[face / 2] += face % 2 == 1 ? 1 : -1;
+
+            uint32_t expected = NoRope;
+            if (glm::all(glm::greaterThanEqual(neighbour, glm::i64vec3(0)))
+                && glm::all(glm::lessThan(neighbour, glm::i64vec3(side)))) {
+                // Descend towards the neighbour until it or empty space is reached
+                size_t current = 0;
+                uint32_t depth = 0;
+                while (depth < cell.depth) {
+                    glm::i64vec3 bits = (neighbour >> (int64_t)(cell.depth - depth - 1)) & 1ll;
+                    uint32_t octant = bits.x * AxisOctant[0] + bits.y * AxisOctant[1]
+                        + bits.z * AxisOctant[2];
+
+                    int64_t child = childIndex(nodes, current, octant);
+                    if (child < 0)
+                        break;
+
+                    current = child;
+                    depth++;
+                }
+
+                expected = ((cell.depth - depth) << RopeIndexBits) | current;
+            }
+
+            if (ropes[cell.index * RopeFaces + face] != expected)
+                valid = false;
+        }
+    });
+
+    return valid;
+}
 }
@@ -2,14 +2,29 @@
 
 #include <glm/glm.hpp>
 
+#include <functional>
 #include <memory>
+#include <memory_resource>
+#include <optional>
 #include <thread>
 #include <vector>
 
+#include "block_stream.hpp"
 #include "common.hpp"
 #include "loaders/loader.hpp"
+#include "loaders/primitive_loader.hpp"
+#include "partial_tree.hpp"
+
+// Only lowered by the large scene test, so refusing an oversized octree can be reached
+#ifndef OCTREE_MAX_NODES
+#define OCTREE_MAX_NODES 0xFFFFFFFF
+#endif
 
 namespace Generators {
+// Offsets, far pointers and the shaders' node indices are 32 bit, octrees with more nodes are not
+// generated
+static constexpr uint64_t MaxOctreeNodes = OCTREE_MAX_NODES;
+
 class OctreeNode {
   public:
     OctreeNode(uint32_t offset);
@@ -38,6 +53,98 @@ class OctreeNode {
     std::variant<NodeType, LeafType, uint32_t> m_CurrentType;
 };
 
+// Order in which sibling blocks are written. Every layout keeps the root first and children
+// after their parent so the node format and traversal are unchanged.
+enum class OctreeLayout : uint32_t {
+    DEPTH_FIRST = 0,
+    BREADTH_FIRST = 1,
+    // Recursively places the top half of each subtree's levels before its bottom subtrees so
+    // nearby levels share cache lines and pages
+    VAN_EMDE_BOAS = 2,
+};
+
+// Empty without finishing if the octree would have more than MaxOctreeNodes nodes. Scratch
+// memory comes from resource, which the builder's tasks share so it must be thread safe.
 std::vector<OctreeNode> generateOctree(std::stop_token stoken, std::unique_ptr<Loader>&& loader,
-    GenerationInfo& info, glm::uvec3& dimensions, bool& finished);
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished,
+    OctreeLayout layout = OctreeLayout::DEPTH_FIRST,
+    std::pmr::memory_resource* resource = std::pmr::new_delete_resource());
+std::vector<OctreeNode> generateOctree(std::stop_token stoken, BlockStream& stream,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished,
+    OctreeLayout layout = OctreeLayout::DEPTH_FIRST,
+    std::pmr::memory_resource* resource = std::pmr::new_delete_resource());
+// Built from the root down over the loader's primitives, the same nodes as from its voxels
+std::vector<OctreeNode> generateOctree(std::stop_token stoken, PrimitiveLoader& loader,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished,
+    OctreeLayout layout = OctreeLayout::DEPTH_FIRST,
+    std::pmr::memory_resource* resource = std::pmr::new_delete_resource());
+
+// Distributed generation, see PartialTree. Each worker builds its share of the subtrees from
+// its own loader, which only needs the voxels passing octreePartialFilter, and the coordinator
+// merges them into the nodes generateOctree would give. The dimensions are read from the partial
+// trees. Merging is empty if a partial tree is missing or does not match.
+std::function<bool(glm::uvec3)> octreePartialFilter(
+    glm::uvec3 loaderDimensions, uint32_t worker, uint32_t workers);
+std::optional<PartialTree> generateOctreePartial(std::stop_token stoken,
+    std::unique_ptr<Loader>&& loader, GenerationInfo& info, uint32_t worker, uint32_t workers,
+    std::pmr::memory_resource* resource = std::pmr::new_delete_resource());
+std::optional<std::vector<OctreeNode>> mergeOctreePartials(std::stop_token stoken,
+    std::function<std::optional<PartialTree>(uint32_t)> loadPartial, uint32_t workers,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished,
+    OctreeLayout layout = OctreeLayout::DEPTH_FIRST,
+    std::pmr::memory_resource* resource = std::pmr::new_delete_resource());
+
+// One octree per animation frame in a single node array, with identical sibling blocks stored
+// once and shared between frames. Frame i starts at node roots[i] and the first frame's root is
+// node 0, so the nodes read as a plain octree of that frame.
+struct TemporalOctree {
+    std::vector<OctreeNode> nodes;
+    std::vector<uint32_t> roots;
+};
+
+// Frames are loaded one at a time, the octree grows only by the blocks each frame changes
+TemporalOctree generateTemporalOctree(std::stop_token stoken, size_t frameCount,
+    std::function<std::unique_ptr<Loader>(size_t)> loadFrame, GenerationInfo& info,
+    glm::uvec3& dimensions, bool& finished,
+    std::pmr::memory_resource* resource = std::pmr::new_delete_resource());
+
+// Rewrites the nodes of any valid octree into the given layout. Empty if the far pointers the
+// layout needs take it past MaxOctreeNodes.
+std::vector<OctreeNode> layoutOctree(const std::vector<OctreeNode>& nodes, OctreeLayout layout);
+
+// Sibling nodes as the index of the first node and the node count
+using OctreeBlock = std::pair<uint64_t, uint32_t>;
+
+// Blocks holding the children of the given blocks' interior nodes, in the order of their parents.
+// The root is the only node of the first level's block { 0, 1 }.
+std::vector<OctreeBlock> octreeChildBlocks(
+    const std::vector<OctreeNode>& nodes, const std::vector<OctreeBlock>& blocks);
+
+// One depth of a breadth first octree, the level's nodes start where the previous level ends
+struct OctreeLevel {
+    // Node count once the level is included, far pointer slots of its blocks included
+    uint64_t end;
+    // 0x00RRGGBB average colour of the voxels below each interior node of the level, in order.
+    // Drawn in place of a node whose children are not loaded yet.
+    std::vector<uint32_t> averages;
+};
+
+// Splits nodes in OctreeLayout::BREADTH_FIRST order into levels, so they can be loaded and drawn
+// coarse levels first
+std::vector<OctreeLevel> splitOctreeLevels(const std::vector<OctreeNode>& nodes);
+
+// Face neighbours of each node for stackless traversal, RopeFaces per node in the order -x, +x,
+// -y, +y, -z, +z. A rope holds the index of the neighbour of the same size or, where that is
+// not stored, of the smallest node containing it. The top bits hold how many levels coarser
+// the target is. Far pointer slots and faces on the edge of the volume hold NoRope.
+static constexpr uint32_t RopeFaces = 6;
+static constexpr uint32_t RopeIndexBits = 27;
+static constexpr uint32_t RopeIndexMask = (1u << RopeIndexBits) - 1;
+static constexpr uint32_t NoRope = 0xFFFFFFFF;
+
+// Empty if the octree has too many nodes to address with RopeIndexBits
+std::optional<std::vector<uint32_t>> generateOctreeRopes(const std::vector<OctreeNode>& nodes);
+
+// Checks every rope against a search from the root for the neighbouring cell
+bool validateOctreeRopes(const std::vector<OctreeNode>& nodes, const std::vector<uint32_t>& ropes);
 }
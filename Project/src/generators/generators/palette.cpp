@@ -0,0 +1,178 @@
+#include "palette.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace Generators {
+struct PaletteEntry {
+    glm::u8vec3 colour;
+    uint32_t count;
+};
+
+struct PaletteBox {
+    size_t start;
+    size_t end;
+
+    uint32_t axis = 0;
+    uint32_t range = 0;
+};
+
+static void measureBox(PaletteBox& box, const std::vector<PaletteEntry>& entries)
+{
+    glm::u8vec3 minimum(255);
+    glm::u8vec3 maximum(0);
+    for (size_t i = box.start; i < box.end; i++) {
+        minimum = glm::min(minimum, entries[i].colour);
+        maximum = glm::max(maximum, entries[i].colour);
+    }
+
+    glm::uvec3 extent = glm::uvec3(maximum) - glm::uvec3(minimum);
+    box.axis = 0;
+    if (extent.g > extent[box.axis])
+        box.axis = 1;
+    if (extent.b > extent[box.axis])
+        box.axis = 2;
+    box.range = extent[box.axis];
+}
+
+static glm::u8vec3 averageBox(const PaletteBox& box, const std::vector<PaletteEntry>& entries)
+{
+    glm::dvec3 total(0);
+    double weight = 0;
+    for (size_t i = box.start; i < box.end; i++) {
+        total += glm::dvec3(entries[i].colour) * (double)entries[i].count;
+        weight += entries[i].count;
+    }
+
+    return glm::u8vec3(glm::round(total / weight));
+}
+
+Palette buildPalette(const std::vector<glm::u8vec3>& colours, uint32_t maxColours)
+{
+    assert(maxColours > 0 && "Palette must hold at least one colour");
+
+    std::unordered_map<uint32_t, uint32_t> histogram;
+    for (const glm::u8vec3& colour : colours)
+        histogram[packColour(colour)]++;
+
+    std::vector<PaletteEntry> entries;
+    entries.reserve(histogram.size());
+    for (const auto& [packed, count] : histogram)
+        entries.push_back({ .colour = unpackColour(packed), .count = count });
+
+    // Sorted so the same input always gives the same palette
+    std::sort(entries.begin(), entries.end(), [](const PaletteEntry& a, const PaletteEntry& b) {
+        return packColour(a.colour) < packColour(b.colour);
+    });
+
+    Palette palette;
+
+    if (entries.size() <= maxColours) {
+        for (uint32_t i = 0; i < entries.size(); i++) {
+            palette.colours.push_back(entries[i].colour);
+            palette.lookup[packColour(entries[i].colour)] = i;
+        }
+        return palette;
+    }
+
+    std::vector<PaletteBox> boxes;
+    boxes.push_back({ .start = 0, .end = entries.size() });
+    measureBox(boxes[0], entries);
+
+    while (boxes.size() < maxColours) {
+        auto widest = std::max_element(boxes.begin(), boxes.end(),
+            [](const PaletteBox& a, const PaletteBox& b) { return a.range < b.range; });
+
+        if (widest->range == 0)
+            break;
+
+        PaletteBox box = *widest;
+        uint32_t axis = box.axis;
+        std::sort(entries.begin() + box.start, entries.begin() + box.end,
+            [axis](const PaletteEntry& a, const PaletteEntry& b) {
+                return a.colour[axis] < b.colour[axis];
+            });
+
+        uint64_t total = 0;
+        for (size_t i = box.start; i < box.end; i++)
+            total += entries[i].count;
+
+        // Split at the weighted median, keeping at least one entry on each side
+        size_t split = box.start + 1;
+        uint64_t running = entries[box.start].count;
+        while (split < box.end - 1 && running * 2 < total) {
+            running += entries[split].count;
+            split++;
+        }
+
+        PaletteBox lower { .start = box.start, .end = split };
+        PaletteBox upper { .start = split, .end = box.end };
+        measureBox(lower, entries);
+        measureBox(upper, entries);
+
+        *widest = lower;
+        boxes.push_back(upper);
+    }
+
+    for (uint32_t i = 0; i < boxes.size(); i++) {
+        palette.colours.push_back(averageBox(boxes[i], entries));
+
+        for (size_t j = boxes[i].start; j < boxes[i].end; j++)
+            palette.lookup[packColour(entries[j].colour)] = i;
+    }
+
+    return palette;
+}
+
+uint32_t paletteIndex(const Palette& palette, glm::u8vec3 colour)
+{
+    auto found = palette.lookup.find(packColour(colour));
+    if (found != palette.lookup.end())
+        return found->second;
+
+    uint32_t best = 0;
+    int32_t bestDistance = INT32_MAX;
+    for (uint32_t i = 0; i < palette.colours.size(); i++) {
+        glm::ivec3 difference = glm::ivec3(palette.colours[i]) - glm::ivec3(colour);
+        int32_t distance = glm::dot(difference, difference);
+        if (distance < bestDistance) {
+            best = i;
+            bestDistance = distance;
+        }
+    }
+
+    return best;
+}
+
+uint32_t paletteBits(size_t entries)
+{
+    assert(entries <= 256 && "Palette indices are limited to 8 bits");
+
+    uint32_t bits = 1;
+    while ((1ull << bits) < entries)
+        bits *= 2;
+
+    return bits;
+}
+
+std::vector<uint32_t> packIndices(const std::vector<uint32_t>& indices, uint32_t bits)
+{
+    const uint32_t perWord = 32 / bits;
+
+    std::vector<uint32_t> packed((indices.size() + perWord - 1) / perWord, 0);
+    for (size_t i = 0; i < indices.size(); i++) {
+        assert(indices[i] < (1u << bits) && "Index does not fit");
+        packed[i / perWord] |= indices[i] << ((i % perWord) * bits);
+    }
+
+    return packed;
+}
+
+uint32_t unpackIndex(const std::vector<uint32_t>& packed, size_t index, uint32_t bits)
+{
+    const uint32_t perWord = 32 / bits;
+    const uint32_t mask = (uint32_t)((1ull << bits) - 1);
+
+    return (packed[index / perWord] >> ((index % perWord) * bits)) & mask;
+}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace Generators {
+struct Palette {
+    std::vector<glm::u8vec3> colours;
+
+    // Packed 0x00RRGGBB input colour -> palette index
+    std::unordered_map<uint32_t, uint32_t> lookup;
+};
+
+// Builds a palette of at most maxColours entries. When the input has more distinct colours than
+// that they are reduced with a count weighted median cut.
+Palette buildPalette(const std::vector<glm::u8vec3>& colours, uint32_t maxColours = 256);
+
+// Exact match for colours used to build the palette, nearest entry otherwise
+uint32_t paletteIndex(const Palette& palette, glm::u8vec3 colour);
+
+// Smallest of 1, 2, 4 or 8 bits able to index the given number of entries. Power of 2 widths
+// keep every index inside a single 32 bit word.
+uint32_t paletteBits(size_t entries);
+
+std::vector<uint32_t> packIndices(const std::vector<uint32_t>& indices, uint32_t bits);
+uint32_t unpackIndex(const std::vector<uint32_t>& packed, size_t index, uint32_t bits);
+
+inline uint32_t packColour(glm::u8vec3 colour)
+{
+    return ((uint32_t)colour.r << 16) | ((uint32_t)colour.g << 8) | ((uint32_t)colour.b << 0);
+}
+
+inline glm::u8vec3 unpackColour(uint32_t colour)
+{
+    return glm::u8vec3 { (colour >> 16) & 0xFF, (colour >> 8) & 0xFF, (colour >> 0) & 0xFF };
+}
+
+// Same packing for loader colours, whose channels are in [0, 1]
+inline uint32_t packUnitColour(glm::vec3 colour)
+{
+    return packColour(glm::u8vec3 { colour.x * 255, colour.y * 255, colour.z * 255 });
+}
+
+inline glm::vec3 unpackUnitColour(uint32_t colour)
+{
+    return glm::vec3(unpackColour(colour)) / 255.f;
+}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace Generators {
+// Intermediary node in a form shared by every tree, colours of any tree convert to and from
+// glm::vec3 without loss
+struct PartialNode {
+    glm::vec3 colour;
+    bool visible;
+    bool parent;
+    uint64_t childMask;
+    uint64_t childStartIndex;
+    uint64_t childCount;
+};
+
+struct PartialSubtree {
+    // Morton order of the subtree among all subtrees of the tree
+    uint64_t index;
+    std::vector<PartialNode> nodes;
+    PartialNode root;
+    uint64_t voxelCount;
+};
+
+// Subtrees built by one worker of a distributed generation. The tree is split into equal
+// subtrees of subtreeLevels levels and each worker builds the indices in [first, last) which lie
+// inside the volume, the coordinator merges every worker's subtrees in index order.
+struct PartialTree {
+    // Dimensions of the loader the worker read, every worker of a generation reads the same
+    glm::uvec3 loaderDimensions;
+    uint32_t subtreeLevels;
+    uint64_t first;
+    uint64_t last;
+    std::vector<PartialSubtree> subtrees;
+};
+}
@@ -0,0 +1,545 @@
+#include "scene_analysis.hpp"
+
+#include "brickmap.hpp"
+#include "column_rle.hpp"
+#include "grid.hpp"
+#include "hybrid.hpp"
+#include "palette.hpp"
+#include "task_scheduler.hpp"
+#include "texture.hpp"
+#include "voxel_hash.hpp"
+
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+
+namespace Generators {
+// Relative cost of one step of each traversal, a grid DDA step being 1. They follow the work per
+// step of the shaders in res/shaders and the CPU traversals of the structures without one.
+// Recalibrate against the mean frametimes PerformanceLogger writes to res/perf_output when a
+// traversal changes: across structures of one scene, frametime / traversalCost should be equal.
+static constexpr float GridStep = 1.0f;
+// Neighbouring voxels share texture cache lines
+static constexpr float TextureStep = 0.6f;
+// Node fetch plus a push or pop of the traversal stack
+static constexpr float OctreeStep = 1.6f;
+// Wider node and a 64 bit mask, but half the levels
+static constexpr float ContreeStep = 2.2f;
+static constexpr float BrickgridStep = 1.2f;
+// Occupancy bit test within a brick already fetched
+static constexpr float BrickStep = 0.4f;
+// Hash and probe sequence per block
+static constexpr float HashStep = 2.5f;
+// Column step before testing its spans
+static constexpr float ColumnStep = 1.5f;
+static constexpr float SpanStep = 0.5f;
+
+// Generators read every voxel once through the loader, which costs about as much as the analysis
+// does per voxel. On top of that each node, brick or span has a serial cost of assembling and
+// laying it out. Compare against the generation times the voxelizer prints when recalibrating.
+static constexpr float GridNodeSeconds = 2e-9f;
+static constexpr float OctreeNodeSeconds = 4e-8f;
+static constexpr float ContreeNodeSeconds = 6e-8f;
+static constexpr float BrickSeconds = 2e-6f;
+static constexpr float HybridNodeSeconds = 5e-8f;
+static constexpr float HashBlockSeconds = 1e-6f;
+static constexpr float SpanSeconds = 2e-8f;
+
+// Weight of memory against traversal cost when ranking
+static constexpr float MemoryWeight = 0.5f;
+
+static constexpr uint32_t Edge = AnalysisBrick;
+static constexpr uint32_t Voxels = Edge * Edge * Edge;
+// Brick with a voxel of its face neighbours on every side
+static constexpr uint32_t Halo = Edge + 2;
+
+// Set on every sampled voxel so black stays distinct from empty
+static constexpr uint32_t Occupied = 1u << 24;
+static constexpr uint32_t ColourBins = 1u << 15;
+
+static uint16_t colourBin(uint32_t colour)
+{
+    return (((colour >> 19) & 0x1F) << 10) | (((colour >> 11) & 0x1F) << 5)
+        | ((colour >> 3) & 0x1F);
+}
+
+const char* structureTypeName(StructureType type)
+{
+    switch (type) {
+    case StructureType::GRID:
+        return "Grid";
+    case StructureType::TEXTURE:
+        return "Texture";
+    case StructureType::OCTREE:
+        return "Octree";
+    case StructureType::CONTREE:
+        return "Contree";
+    case StructureType::BRICKMAP:
+        return "Brickmap";
+    case StructureType::HYBRID:
+        return "Hybrid";
+    case StructureType::VOXEL_HASH:
+        return "Hash";
+    case StructureType::COLUMN_RLE:
+        return "Columns";
+    default:
+        return "Unknown";
+    }
+}
+
+// Totals of the bricks analysed so far, shared between tasks
+struct BrickTotals {
+    std::atomic<uint64_t> voxelCount = 0;
+    std::atomic<uint64_t> surfaceVoxels = 0;
+    std::atomic<uint64_t> columnRuns = 0;
+    // Cells of edge 1, 2, 4 and 8, which never cross a brick
+    std::array<std::atomic<uint64_t>, 4> cells {};
+    std::array<std::atomic<uint64_t>, BrickFillBuckets> brickFill {};
+    std::vector<std::atomic<uint64_t>> histogram = std::vector<std::atomic<uint64_t>>(ColourBins);
+};
+
+// Adds the brick to the totals, false if it is empty
+static bool analyzeBrick(
+    Loader& loader, glm::uvec3 dimensions, glm::uvec3 brick, BrickTotals& totals)
+{
+    const glm::ivec3 origin = glm::ivec3(brick * Edge) - 1;
+
+    // Packed colours with Occupied set, zero outside the volume. Halo edges and corners are never
+    // read and left empty.
+    std::array<uint32_t, Halo * Halo * Halo> region {};
+    for (uint32_t z = 0; z < Halo; z++) {
+        for (uint32_t y = 0; y < Halo; y++) {
+            for (uint32_t x = 0; x < Halo; x++) {
+                const uint32_t border = (x == 0 || x == Halo - 1) + (y == 0 || y == Halo - 1)
+                    + (z == 0 || z == Halo - 1);
+                const glm::ivec3 position = origin + glm::ivec3(x, y, z);
+                if (border > 1 || glm::any(glm::lessThan(position, glm::ivec3(0)))
+                    || glm::any(glm::greaterThanEqual(glm::uvec3(position), dimensions)))
+                    continue;
+
+                auto voxel = loader.getVoxel(glm::uvec3(position));
+                if (voxel.has_value()) {
+                    region[x + y * Halo + z * Halo * Halo]
+                        = packUnitColour(voxel.value()) | Occupied;
+                }
+            }
+        }
+    }
+
+    auto at = [&](uint32_t x, uint32_t y, uint32_t z) {
+        return region[x + y * Halo + z * Halo * Halo];
+    };
+
+    uint32_t count = 0;
+    uint32_t surface = 0;
+    uint32_t runs = 0;
+    bool halves[(Edge / 2) * (Edge / 2) * (Edge / 2)] {};
+    bool quarters[(Edge / 4) * (Edge / 4) * (Edge / 4)] {};
+    std::array<uint16_t, Voxels> bins;
+
+    for (uint32_t z = 1; z <= Edge; z++) {
+        for (uint32_t y = 1; y <= Edge; y++) {
+            for (uint32_t x = 1; x <= Edge; x++) {
+                const uint32_t voxel = at(x, y, z);
+                if ((voxel & Occupied) == 0)
+                    continue;
+
+                if (!(at(x - 1, y, z) & at(x + 1, y, z) & at(x, y - 1, z) & at(x, y + 1, z)
+                        & at(x, y, z - 1) & at(x, y, z + 1) & Occupied))
+                    surface++;
+                if (at(x, y - 1, z) != voxel)
+                    runs++;
+
+                const glm::uvec3 local(x - 1, y - 1, z - 1);
+                const glm::uvec3 half = local / 2u;
+                const glm::uvec3 quarter = local / 4u;
+                halves[half.x + half.y * (Edge / 2) + half.z * (Edge / 2) * (Edge / 2)] = true;
+                quarters[quarter.x + quarter.y * (Edge / 4) + quarter.z * (Edge / 4) * (Edge / 4)]
+                    = true;
+
+                bins[count++] = colourBin(voxel);
+            }
+        }
+    }
+
+    if (count == 0)
+        return false;
+
+    totals.voxelCount += count;
+    totals.surfaceVoxels += surface;
+    totals.columnRuns += runs;
+
+    totals.cells[0] += count;
+    totals.cells[1] += std::count(std::begin(halves), std::end(halves), true);
+    totals.cells[2] += std::count(std::begin(quarters), std::end(quarters), true);
+    totals.cells[3]++;
+
+    totals.brickFill[std::min((count - 1) * BrickFillBuckets / Voxels, BrickFillBuckets - 1)]++;
+
+    // Equal bins are added together to keep contention on the shared histogram down
+    std::sort(bins.begin(), bins.begin() + count);
+    for (uint32_t first = 0; first < count;) {
+        uint32_t last = first;
+        while (last < count && bins[last] == bins[first])
+            last++;
+
+        totals.histogram[bins[first]] += last - first;
+        first = last;
+    }
+
+    return true;
+}
+
+// Levels of the contree's cube, whose edge is the power of 4 at or above the longest side and so
+// never smaller than the octree's
+static uint32_t analysisLevels(glm::uvec3 dimensions)
+{
+    const uint32_t longestSide = std::max({ dimensions.x, dimensions.y, dimensions.z });
+    uint32_t levels = 0;
+    while ((1ull << levels) < longestSide)
+        levels++;
+    return levels + levels % 2;
+}
+
+// Fills everything but the levels above a brick, counts are multiplied by scale
+static SceneStatistics brickStatistics(
+    glm::uvec3 dimensions, const BrickTotals& totals, double scale)
+{
+    auto scaled = [&](uint64_t value) { return (uint64_t)std::llround(value * scale); };
+
+    SceneStatistics statistics {};
+    statistics.dimensions = dimensions;
+    statistics.voxelCount = scaled(totals.voxelCount);
+    statistics.surfaceVoxels = scaled(totals.surfaceVoxels);
+    statistics.columnRuns = scaled(totals.columnRuns);
+    for (uint32_t i = 0; i < BrickFillBuckets; i++)
+        statistics.brickFill[i] = scaled(totals.brickFill[i]);
+
+    const uint32_t levels = analysisLevels(dimensions);
+    statistics.occupiedCells.resize(levels + 1);
+    for (uint32_t level = 0; level <= std::min(levels, 3u); level++)
+        statistics.occupiedCells[level] = scaled(totals.cells[level]);
+
+    // The distribution of the sample stands in for the whole scene
+    float entropy = 0.f;
+    for (const std::atomic<uint64_t>& bin : totals.histogram) {
+        if (bin == 0)
+            continue;
+
+        const double p = (double)bin / (double)totals.voxelCount;
+        entropy -= p * std::log2(p);
+    }
+    statistics.colourEntropy = entropy;
+
+    return statistics;
+}
+
+// Cells of 2^3 cells of the grid that hold an occupied cell, sizes are in cells
+static std::vector<uint8_t> mergeCells(const std::vector<uint8_t>& cells, glm::uvec3& size)
+{
+    const glm::uvec3 coarseSize = (size + 1u) / 2u;
+    std::vector<uint8_t> coarse((size_t)coarseSize.x * coarseSize.y * coarseSize.z, 0);
+
+    for (uint32_t z = 0; z < size.z; z++) {
+        for (uint32_t y = 0; y < size.y; y++) {
+            for (uint32_t x = 0; x < size.x; x++) {
+                if (cells[x + (size_t)y * size.x + (size_t)z * size.x * size.y])
+                    coarse[x / 2 + (size_t)(y / 2) * coarseSize.x
+                        + (size_t)(z / 2) * coarseSize.x * coarseSize.y]
+                        = 1;
+            }
+        }
+    }
+
+    size = coarseSize;
+    return coarse;
+}
+
+SceneStatistics analyzeScene(std::stop_token stoken, Loader& loader)
+{
+    std::chrono::steady_clock timer;
+    auto start = timer.now();
+
+    const glm::uvec3 dimensions = loader.getDimensions();
+    const glm::uvec3 bricks = (dimensions + Edge - 1u) / Edge;
+    const size_t brickCount = (size_t)bricks.x * bricks.y * bricks.z;
+
+    BrickTotals totals;
+    std::vector<uint8_t> occupiedBricks(brickCount, 0);
+
+    TaskScheduler::getInstance().parallelFor(brickCount, 4, [&](size_t index) {
+        if (stoken.stop_requested())
+            return;
+
+        const glm::uvec3 brick(index % bricks.x, (index / bricks.x) % bricks.y,
+            index / ((size_t)bricks.x * bricks.y));
+        occupiedBricks[index] = analyzeBrick(loader, dimensions, brick, totals);
+    });
+
+    if (stoken.stop_requested())
+        return {};
+
+    SceneStatistics statistics = brickStatistics(dimensions, totals, 1.0);
+
+    // Coarser levels merge 2^3 cells of the previous one, starting from the bricks
+    glm::uvec3 size = bricks;
+    std::vector<uint8_t> cells = std::move(occupiedBricks);
+    for (uint32_t level = 4; level < statistics.occupiedCells.size(); level++) {
+        cells = mergeCells(cells, size);
+        statistics.occupiedCells[level] = std::count(cells.begin(), cells.end(), 1);
+    }
+
+    std::chrono::duration<float> difference = timer.now() - start;
+    statistics.secondsPerVoxel = difference.count() / (float)((uint64_t)brickCount * Voxels);
+
+    return statistics;
+}
+
+SceneStatistics sampleScene(std::stop_token stoken, Loader& loader)
+{
+    constexpr uint32_t UnitBricks = EstimateUnit / Edge;
+    constexpr uint32_t BricksPerUnit = UnitBricks * UnitBricks * UnitBricks;
+
+    const glm::uvec3 dimensions = loader.getDimensions();
+    const glm::uvec3 units = (dimensions + EstimateUnit - 1u) / EstimateUnit;
+    const size_t unitCount = (size_t)units.x * units.y * units.z;
+
+    if (unitCount <= EstimateUnits)
+        return analyzeScene(stoken, loader);
+
+    std::chrono::steady_clock timer;
+    auto start = timer.now();
+
+    // Units are picked by a hash of their index rather than a stride, so a sample never lines up
+    // with regular structure in the scene
+    std::vector<glm::uvec3> sample;
+    for (size_t index = 0; index < unitCount; index++) {
+        uint64_t hash = index * 0x9E3779B97F4A7C15ull;
+        hash = (hash ^ (hash >> 31)) * 0xBF58476D1CE4E5B9ull;
+        hash ^= hash >> 29;
+
+        if (hash % unitCount < EstimateUnits)
+            sample.push_back(glm::uvec3(index % units.x, (index / units.x) % units.y,
+                index / ((size_t)units.x * units.y)));
+    }
+
+    if (sample.empty())
+        return {};
+
+    BrickTotals totals;
+    std::vector<uint8_t> occupiedBricks(sample.size() * BricksPerUnit, 0);
+
+    TaskScheduler::getInstance().parallelFor(occupiedBricks.size(), 4, [&](size_t index) {
+        if (stoken.stop_requested())
+            return;
+
+        const uint32_t local = index % BricksPerUnit;
+        const glm::uvec3 brick = sample[index / BricksPerUnit] * UnitBricks
+            + glm::uvec3(local % UnitBricks, (local / UnitBricks) % UnitBricks,
+                local / (UnitBricks * UnitBricks));
+        occupiedBricks[index] = analyzeBrick(loader, dimensions, brick, totals);
+    });
+
+    if (stoken.stop_requested())
+        return {};
+
+    const double scale = (double)unitCount / (double)sample.size();
+    SceneStatistics statistics = brickStatistics(dimensions, totals, scale);
+
+    // Levels up to a unit are merged within each sampled unit
+    const uint32_t unitLevel = std::countr_zero(EstimateUnit);
+    const uint32_t levels = statistics.occupiedCells.size() - 1;
+    for (uint32_t level = 4; level <= std::min(levels, unitLevel); level++) {
+        uint64_t occupied = 0;
+        for (size_t unit = 0; unit < sample.size(); unit++) {
+            glm::uvec3 size(UnitBricks);
+            std::vector<uint8_t> cells(occupiedBricks.begin() + unit * BricksPerUnit,
+                occupiedBricks.begin() + (unit + 1) * BricksPerUnit);
+            for (uint32_t merged = 4; merged <= level; merged++)
+                cells = mergeCells(cells, size);
+
+            occupied += std::count(cells.begin(), cells.end(), 1);
+        }
+        statistics.occupiedCells[level] = std::llround(occupied * scale);
+    }
+
+    // Above a unit the sample says nothing about how occupied cells cluster, so each level is
+    // bounded by the level below and by the cells it has
+    for (uint32_t level = unitLevel + 1; level <= levels; level++) {
+        const glm::uvec3 size = (dimensions + (1u << level) - 1u) >> level;
+        statistics.occupiedCells[level] = std::min((uint64_t)size.x * size.y * size.z,
+            statistics.occupiedCells[level - 1]);
+    }
+
+    std::chrono::duration<float> difference = timer.now() - start;
+    statistics.secondsPerVoxel
+        = difference.count() / (float)((uint64_t)occupiedBricks.size() * Voxels);
+
+    return statistics;
+}
+
+// Levels below the root of a tree over the cube of edge 2^bits per level
+static uint32_t treeLevels(glm::uvec3 dimensions, uint32_t bits)
+{
+    const uint32_t longestSide = std::max({ dimensions.x, dimensions.y, dimensions.z });
+    uint32_t levels = 0;
+    while ((1ull << (levels * bits)) < longestSide)
+        levels++;
+    return levels;
+}
+
+// Nodes of a tree whose children are the occupied cells one level of bits down, from the leaves
+// of edge 2^leafLevel up to and including the root
+static uint64_t treeNodes(const SceneStatistics& statistics, uint32_t bits, uint32_t leafLevel)
+{
+    const uint32_t rootLevel = treeLevels(statistics.dimensions, bits) * bits;
+
+    uint64_t nodes = 1;
+    for (uint32_t level = leafLevel; level < rootLevel; level += bits)
+        nodes += statistics.cellsAt(level);
+    return nodes;
+}
+
+// Nodes visited descending levels of a tree, plus the siblings stepped across while the ray
+// passes through empty space. Empty cells grow geometrically away from the surface, so the
+// distance costs steps logarithmically.
+static float treeSteps(uint32_t levels, uint32_t bits, float freePath)
+{
+    const float siblings = (float)((1u << bits) + 1);
+    return (float)levels + siblings * std::log2(1.f + freePath) / (float)bits;
+}
+
+StructureCost predictCost(StructureType type, const SceneStatistics& statistics)
+{
+    const glm::uvec3 dimensions = statistics.dimensions;
+    const uint64_t volume = (uint64_t)dimensions.x * dimensions.y * dimensions.z;
+    const uint32_t longestSide = std::max({ dimensions.x, dimensions.y, dimensions.z });
+
+    // Voxels a ray crosses before reaching a surface, the volume per surface voxel for a
+    // scattered surface but never more than crossing the volume
+    const float freePath = statistics.surfaceVoxels == 0
+        ? (float)longestSide
+        : std::min((float)longestSide, (float)volume / (float)statistics.surfaceVoxels);
+
+    StructureCost cost {};
+    cost.type = type;
+
+    switch (type) {
+    case StructureType::GRID:
+        cost.nodes = volume;
+        cost.bytes = volume * sizeof(GridVoxel);
+        cost.traversalCost = freePath * GridStep;
+        cost.buildSeconds = cost.nodes * GridNodeSeconds;
+        break;
+    case StructureType::TEXTURE:
+        cost.nodes = volume;
+        cost.bytes = volume * sizeof(TextureVoxel);
+        cost.traversalCost = freePath * TextureStep;
+        cost.buildSeconds = cost.nodes * GridNodeSeconds;
+        break;
+    case StructureType::OCTREE:
+        cost.nodes = treeNodes(statistics, 1, 0);
+        cost.bytes = cost.nodes * sizeof(uint32_t);
+        cost.traversalCost
+            = treeSteps(treeLevels(dimensions, 1), 1, freePath) * OctreeStep;
+        cost.buildSeconds = cost.nodes * OctreeNodeSeconds;
+        break;
+    case StructureType::CONTREE:
+        cost.nodes = treeNodes(statistics, 2, 0);
+        cost.bytes = cost.nodes * 2 * sizeof(uint64_t);
+        cost.traversalCost
+            = treeSteps(treeLevels(dimensions, 2), 2, freePath) * ContreeStep;
+        cost.buildSeconds = cost.nodes * ContreeNodeSeconds;
+        break;
+    case StructureType::BRICKMAP: {
+        const uint64_t bricks = statistics.cellsAt(std::countr_zero(BrickSize));
+        const glm::uvec3 grid = (dimensions + BrickSize - 1u) / BrickSize;
+
+        cost.nodes = bricks;
+        cost.bytes = (uint64_t)grid.x * grid.y * grid.z * sizeof(BrickgridPtr)
+            + bricks * (sizeof(Brickmap) + Brickmap::Voxels * sizeof(BrickmapColour));
+        cost.traversalCost = freePath / BrickSize * BrickgridStep
+            + std::min(freePath, (float)BrickSize) * BrickStep;
+        cost.buildSeconds = bricks * BrickSeconds;
+        break;
+    }
+    case StructureType::HYBRID: {
+        const uint32_t brickLevel = std::countr_zero(HybridBrickSize);
+        const uint64_t bricks = statistics.cellsAt(brickLevel);
+        const uint32_t levels = treeLevels(dimensions, 1);
+
+        cost.nodes = treeNodes(statistics, 1, brickLevel);
+        cost.bytes = cost.nodes * sizeof(HybridNode)
+            + bricks * hybridBrickWords(HybridBrickSize) * sizeof(uint64_t)
+            + statistics.voxelCount * sizeof(uint32_t);
+        cost.traversalCost
+            = treeSteps(levels > brickLevel ? levels - brickLevel : 0, 1,
+                  freePath / HybridBrickSize)
+                * OctreeStep
+            + std::min(freePath, (float)HybridBrickSize) * BrickStep;
+        cost.buildSeconds = cost.nodes * HybridNodeSeconds;
+        break;
+    }
+    case StructureType::VOXEL_HASH: {
+        const uint64_t blocks = statistics.cellsAt(std::countr_zero(HashBlock::Edge));
+
+        cost.nodes = blocks;
+        cost.bytes = blocks * sizeof(HashBlock)
+            + std::bit_ceil(std::max<uint64_t>(blocks * 2, 64)) * sizeof(uint32_t);
+        cost.traversalCost = freePath / HashBlock::Edge * HashStep
+            + std::min(freePath, (float)HashBlock::Edge) * BrickStep;
+        cost.buildSeconds = blocks * HashBlockSeconds;
+        break;
+    }
+    case StructureType::COLUMN_RLE: {
+        const uint64_t columns = (uint64_t)dimensions.x * dimensions.z;
+        const float spansPerColumn
+            = columns == 0 ? 0.f : (float)statistics.columnRuns / (float)columns;
+
+        cost.nodes = statistics.columnRuns;
+        cost.bytes = statistics.columnRuns * sizeof(ColumnSpan) + (columns + 1) * sizeof(uint32_t);
+        cost.traversalCost = freePath * (ColumnStep + spansPerColumn * SpanStep);
+        cost.buildSeconds = cost.nodes * SpanSeconds;
+        break;
+    }
+    default:
+        break;
+    }
+
+    cost.buildSeconds += volume * statistics.secondsPerVoxel;
+
+    return cost;
+}
+
+StructureCost estimate(StructureType type, Loader& loader)
+{
+    return predictCost(type, sampleScene(std::stop_token {}, loader));
+}
+
+std::vector<StructureCost> rankStructures(const SceneStatistics& statistics)
+{
+    std::vector<StructureCost> costs;
+    for (uint32_t type = 0; type <= (uint32_t)StructureType::HYBRID; type++)
+        costs.push_back(predictCost((StructureType)type, statistics));
+
+    float bestTraversal = costs[0].traversalCost;
+    uint64_t bestBytes = costs[0].bytes;
+    for (const StructureCost& cost : costs) {
+        bestTraversal = std::min(bestTraversal, cost.traversalCost);
+        bestBytes = std::min(bestBytes, cost.bytes);
+    }
+
+    for (StructureCost& cost : costs) {
+        cost.score
+            = std::log2(std::max(cost.traversalCost, 1e-3f) / std::max(bestTraversal, 1e-3f))
+            + MemoryWeight * std::log2((float)std::max<uint64_t>(cost.bytes, 1)
+                / (float)std::max<uint64_t>(bestBytes, 1));
+    }
+
+    std::stable_sort(costs.begin(), costs.end(),
+        [](const StructureCost& a, const StructureCost& b) { return a.score < b.score; });
+
+    return costs;
+}
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "loaders/loader.hpp"
+
+namespace Generators {
+// Every structure the generators produce, in the order of the voxelizer's outputs
+enum class StructureType : uint32_t {
+    GRID = 0,
+    TEXTURE = 1,
+    OCTREE = 2,
+    CONTREE = 3,
+    BRICKMAP = 4,
+    HYBRID = 5,
+    VOXEL_HASH = 6,
+    COLUMN_RLE = 7,
+    COUNT = 8,
+};
+
+const char* structureTypeName(StructureType type);
+
+// Edge of the bricks the scene is scanned in
+constexpr uint32_t AnalysisBrick = 8;
+constexpr uint32_t BrickFillBuckets = 8;
+
+// sampleScene analyses at most about EstimateUnits regions of EstimateUnit^3 voxels
+constexpr uint32_t EstimateUnit = 32;
+constexpr uint32_t EstimateUnits = 256;
+
+struct SceneStatistics {
+    glm::uvec3 dimensions;
+    uint64_t voxelCount;
+    // Voxels with an empty face neighbour, faces on the volume boundary count as empty
+    uint64_t surfaceVoxels;
+    // Voxels whose lower neighbour is empty or differently coloured, the spans of a ColumnRLE
+    uint64_t columnRuns;
+    // Entry k counts the occupied cells of edge 2^k aligned to the origin, up to the cell
+    // enclosing the contree's cube
+    std::vector<uint64_t> occupiedCells;
+    // Shannon entropy in bits of the colours, quantised to 5 bits per channel
+    float colourEntropy;
+    // Non empty bricks of AnalysisBrick^3 voxels, bucket i holds those with more than
+    // i / BrickFillBuckets and at most (i + 1) / BrickFillBuckets of their voxels set
+    std::array<uint64_t, BrickFillBuckets> brickFill;
+    // Wall time of the pass per voxel analysed, the loader's cost dominates build times
+    float secondsPerVoxel;
+
+    float surfaceRatio() const
+    {
+        return voxelCount == 0 ? 0.f : (float)surfaceVoxels / (float)voxelCount;
+    }
+
+    // Occupied cells of edge 2^level, cells larger than the volume hold every voxel
+    uint64_t cellsAt(uint32_t level) const
+    {
+        if (occupiedCells.empty())
+            return 0;
+        return occupiedCells[std::min<size_t>(level, occupiedCells.size() - 1)];
+    }
+};
+
+struct StructureCost {
+    StructureType type;
+    uint64_t nodes;
+    uint64_t bytes;
+    // Predicted work per primary ray in grid steps, only comparable within one scene
+    float traversalCost;
+    // Predicted generation time with the scheduler's threads
+    float buildSeconds;
+    // Set by rankStructures, lower is better
+    float score = 0.f;
+};
+
+// One parallel pass over every voxel of the loader. Returns empty statistics when stopped.
+SceneStatistics analyzeScene(std::stop_token stoken, Loader& loader);
+
+// Statistics extrapolated from a hashed sample of the scene's regions, the same as analyzeScene
+// when the volume has no more than EstimateUnits of them. Occupied cells above a region are upper
+// bounds.
+SceneStatistics sampleScene(std::stop_token stoken, Loader& loader);
+
+// Predicted size and traversal cost of the structure built with its default arguments
+StructureCost predictCost(StructureType type, const SceneStatistics& statistics);
+
+// Samples the loader and predicts the structure before anything is generated
+StructureCost estimate(StructureType type, Loader& loader);
+
+// Structures the renderer can draw, best first. Scores combine the relative traversal cost with
+// the relative memory, both on a log scale against the best structure.
+std::vector<StructureCost> rankStructures(const SceneStatistics& statistics);
+}
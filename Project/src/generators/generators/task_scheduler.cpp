@@ -0,0 +1,174 @@
+#include "task_scheduler.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <optional>
+
+namespace Generators {
+// Index of the worker owning the current thread, -1 on threads outside the pool
+static thread_local int32_t s_WorkerIndex = -1;
+
+TaskScheduler& TaskScheduler::getInstance()
+{
+    static TaskScheduler scheduler;
+    return scheduler;
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_SleepMutex);
+        m_Stopping = true;
+    }
+    m_Wake.notify_all();
+
+    for (std::thread& thread : m_Threads)
+        thread.join();
+}
+
+void TaskScheduler::init(uint32_t threadCount)
+{
+    std::lock_guard<std::mutex> lock(m_InitMutex);
+    if (m_Running.load(std::memory_order_acquire))
+        return;
+
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+    for (uint32_t i = 0; i < threadCount; i++)
+        m_Workers.push_back(std::make_unique<Worker>());
+
+    for (uint32_t i = 0; i < threadCount; i++)
+        m_Threads.emplace_back([this, i]() { workerLoop(i); });
+
+    m_Running.store(true, std::memory_order_release);
+}
+
+uint32_t TaskScheduler::getThreadCount()
+{
+    if (!m_Running.load(std::memory_order_acquire))
+        init(0);
+
+    return m_Workers.size();
+}
+
+void TaskScheduler::submit(TaskGroup& group, Task task)
+{
+    if (!m_Running.load(std::memory_order_acquire))
+        init(0);
+
+    group.m_Pending.fetch_add(1, std::memory_order_relaxed);
+
+    // Tasks spawned by a worker stay local, everything else is spread round robin
+    uint32_t target = s_WorkerIndex >= 0
+        ? s_WorkerIndex
+        : m_NextWorker.fetch_add(1, std::memory_order_relaxed) % m_Workers.size();
+
+    // Counted before the push so a thief taking the task never decrements past zero. Taking the
+    // sleep lock orders the increment against a worker checking before it sleeps.
+    {
+        std::lock_guard<std::mutex> lock(m_SleepMutex);
+        m_Queued.fetch_add(1, std::memory_order_release);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_Workers[target]->mutex);
+        m_Workers[target]->tasks.push_back({ .task = std::move(task), .group = &group });
+    }
+    m_Wake.notify_one();
+}
+
+void TaskScheduler::wait(TaskGroup& group)
+{
+    while (!group.done()) {
+        if (runTask(s_WorkerIndex))
+            continue;
+
+        // With nothing left to steal the group's tasks are running elsewhere, sleep until one
+        // of them finishes and look for work again
+        std::unique_lock<std::mutex> lock(group.m_Mutex);
+        const size_t pending = group.m_Pending.load(std::memory_order_acquire);
+        if (pending == 0)
+            break;
+        group.m_Finished.wait(lock, [&]() {
+            return group.m_Pending.load(std::memory_order_acquire) != pending;
+        });
+    }
+
+    // The last task signals under the lock, so holding it once ensures the group is released
+    std::lock_guard<std::mutex> lock(group.m_Mutex);
+}
+
+void TaskScheduler::parallelFor(
+    size_t count, size_t grain, const std::function<void(size_t)>& function)
+{
+    assert(grain > 0 && "Grain must be at least 1");
+
+    TaskGroup group;
+    for (size_t start = 0; start < count; start += grain) {
+        size_t end = std::min(start + grain, count);
+        submit(group, [start, end, &function]() {
+            for (size_t i = start; i < end; i++)
+                function(i);
+        });
+    }
+
+    wait(group);
+}
+
+void TaskScheduler::workerLoop(uint32_t index)
+{
+    s_WorkerIndex = index;
+
+    while (true) {
+        if (runTask(index))
+            continue;
+
+        std::unique_lock<std::mutex> lock(m_SleepMutex);
+        m_Wake.wait(lock, [this]() { return m_Stopping || m_Queued.load() > 0; });
+        if (m_Stopping)
+            return;
+    }
+}
+
+bool TaskScheduler::runTask(int32_t worker)
+{
+    std::optional<QueuedTask> task;
+
+    if (worker >= 0) {
+        Worker& own = *m_Workers[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+        }
+    }
+
+    // Steal the oldest task from the next non empty worker
+    const size_t workerCount = m_Workers.size();
+    const size_t first = worker >= 0 ? worker + 1 : 0;
+    for (size_t i = 0; i < workerCount && !task.has_value(); i++) {
+        Worker& victim = *m_Workers[(first + i) % workerCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+    }
+
+    if (!task.has_value())
+        return false;
+
+    m_Queued.fetch_sub(1, std::memory_order_relaxed);
+
+    task->task();
+    {
+        // Notifying under the lock keeps the group alive until the waiter can take it
+        std::lock_guard<std::mutex> lock(task->group->m_Mutex);
+        task->group->m_Pending.fetch_sub(1, std::memory_order_acq_rel);
+        task->group->m_Finished.notify_all();
+    }
+
+    return true;
+}
+}
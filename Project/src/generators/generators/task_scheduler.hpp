@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Generators {
+// Number of tasks submitted against the group which have not finished yet
+class TaskGroup {
+  public:
+    bool done() const { return m_Pending.load(std::memory_order_acquire) == 0; }
+
+  private:
+    std::atomic<size_t> m_Pending = 0;
+
+    // Signalled as tasks finish so waiters with nothing to steal can sleep
+    std::mutex m_Mutex;
+    std::condition_variable m_Finished;
+
+    friend class TaskScheduler;
+};
+
+// Process wide work stealing pool shared by every generator.
+// Each worker owns a deque, pushing and popping its own tasks from the back while idle workers
+// steal from the front of the others. Threads waiting on a group run queued tasks in the
+// meantime, so tasks may submit and wait on further tasks without deadlocking.
+class TaskScheduler {
+  public:
+    using Task = std::function<void()>;
+
+    static TaskScheduler& getInstance();
+
+    ~TaskScheduler();
+
+    // 0 uses the hardware concurrency. Only the first call (or first submit) starts workers.
+    void init(uint32_t threadCount);
+    uint32_t getThreadCount();
+
+    void submit(TaskGroup& group, Task task);
+    void wait(TaskGroup& group);
+
+    // Calls function(i) for every i in [0, count), grain indices per task
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t)>& function);
+
+  private:
+    TaskScheduler() { }
+
+    struct QueuedTask {
+        Task task;
+        TaskGroup* group;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<QueuedTask> tasks;
+    };
+
+    void workerLoop(uint32_t index);
+    bool runTask(int32_t worker);
+
+  private:
+    std::mutex m_InitMutex;
+    std::vector<std::unique_ptr<Worker>> m_Workers;
+    std::vector<std::thread> m_Threads;
+
+    std::mutex m_SleepMutex;
+    std::condition_variable m_Wake;
+
+    std::atomic<size_t> m_Queued = 0;
+    std::atomic<uint32_t> m_NextWorker = 0;
+    std::atomic<bool> m_Running = false;
+    bool m_Stopping = false;
+};
+}
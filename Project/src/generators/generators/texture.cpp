@@ -1,4 +1,7 @@
 #include "texture.hpp"
+#include "task_scheduler.hpp"
+
+#include <atomic>
 
 namespace Generators {
 std::vector<TextureVoxel> generateTexture(std::stop_token stoken, std::unique_ptr<Loader>&& loader,
@@ -10,27 +13,20 @@ std::vector<TextureVoxel> generateTexture(std::stop_token stoken, std::unique_pt
 
     dimensions = loader->getDimensions();
 
-    const size_t totalNodes = dimensions.x * dimensions.y * dimensions.z;
+    const size_t totalNodes = (size_t)dimensions.x * dimensions.y * dimensions.z;
 
     std::vector<TextureVoxel> voxels;
-    voxels.resize(dimensions.x * dimensions.y * dimensions.z);
+    voxels.resize(totalNodes);
 
-    for (size_t z = 0; z < dimensions.z; z++) {
+    std::atomic<size_t> completed = 0;
+    TaskScheduler::getInstance().parallelFor(dimensions.z, 1, [&](size_t z) {
         for (size_t y = 0; y < dimensions.y; y++) {
             for (size_t x = 0; x < dimensions.x; x++) {
                 if (stoken.stop_requested())
-                    return voxels;
+                    return;
 
                 size_t index = x + y * dimensions.x + z * dimensions.x * dimensions.y;
 
-                {
-                    info.completionPercent = (index + 1) / (float)totalNodes;
-
-                    auto current = timer.now();
-                    std::chrono::duration<float, std::milli> difference = current - start;
-                    info.generationTime = difference.count() / 1000.0f;
-                }
-
                 auto v = loader->getVoxel({ x, y, z });
 
                 glm::vec3 colour = v.value_or(glm::vec3(0));
@@ -42,8 +38,89 @@ std::vector<TextureVoxel> generateTexture(std::stop_token stoken, std::unique_pt
                 };
             }
         }
+
+        {
+            size_t slices = completed.fetch_add(1) + 1;
+            info.completionPercent = (slices * dimensions.x * dimensions.y) / (float)totalNodes;
+
+            auto current = timer.now();
+            std::chrono::duration<float, std::milli> difference = current - start;
+            info.generationTime = difference.count() / 1000.0f;
+        }
+    });
+
+    if (stoken.stop_requested())
+        return voxels;
+
+    auto end = timer.now();
+    std::chrono::duration<float, std::milli> difference = end - start;
+    info.generationTime = difference.count() / 1000.0f;
+
+    info.voxelCount = totalNodes;
+    info.nodes = totalNodes;
+
+    finished = true;
+
+    return voxels;
+}
+
+std::vector<TextureVoxel> generateTexture(std::stop_token stoken, BlockStream& stream,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished)
+{
+    std::chrono::steady_clock timer;
+    auto start = timer.now();
+
+    dimensions = stream.getDimensions();
+
+    const size_t totalNodes = (size_t)dimensions.x * dimensions.y * dimensions.z;
+
+    std::vector<TextureVoxel> voxels(totalNodes, TextureVoxel(0));
+
+    const uint64_t blockCount = stream.getBlockCount();
+    uint64_t received = 0;
+
+    while (std::shared_ptr<const VoxelBlock> block = stream.pop()) {
+        if (stoken.stop_requested()) {
+            stream.close();
+            return voxels;
+        }
+
+        received++;
+        if (block->empty())
+            continue;
+
+        const glm::uvec3 origin = block->position * VoxelBlock::Edge;
+        const glm::uvec3 end = glm::min(origin + VoxelBlock::Edge, dimensions);
+        for (size_t z = origin.z; z < end.z; z++) {
+            for (size_t y = origin.y; y < end.y; y++) {
+                for (size_t x = origin.x; x < end.x; x++) {
+                    size_t index = x + y * dimensions.x + z * dimensions.x * dimensions.y;
+
+                    auto v = block->getVoxel(glm::uvec3(x, y, z) - origin);
+
+                    glm::vec3 colour = v.value_or(glm::vec3(0));
+                    voxels[index] = glm::u8vec4 {
+                        colour.r * 255,
+                        colour.g * 255,
+                        colour.b * 255,
+                        v.has_value(),
+                    };
+                }
+            }
+        }
+
+        {
+            info.completionPercent = received / (float)blockCount;
+
+            auto current = timer.now();
+            std::chrono::duration<float, std::milli> difference = current - start;
+            info.generationTime = difference.count() / 1000.0f;
+        }
     }
 
+    if (received != blockCount)
+        return voxels;
+
     auto end = timer.now();
     std::chrono::duration<float, std::milli> difference = end - start;
     info.generationTime = difference.count() / 1000.0f;
@@ -6,6 +6,7 @@
 #include <thread>
 #include <vector>
 
+#include "generators/block_stream.hpp"
 #include "generators/common.hpp"
 #include "loaders/loader.hpp"
 
@@ -14,4 +15,6 @@ using TextureVoxel = glm::u8vec4;
 
 std::vector<TextureVoxel> generateTexture(std::stop_token stoken, std::unique_ptr<Loader>&& loader,
     GenerationInfo& info, glm::uvec3& dimensions, bool& finished);
+std::vector<TextureVoxel> generateTexture(std::stop_token stoken, BlockStream& stream,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished);
 }
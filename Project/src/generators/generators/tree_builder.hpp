@@ -0,0 +1,935 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <set>
+#include <stop_token>
+#include <vector>
+
+#include "block_stream.hpp"
+#include "common.hpp"
+#include "partial_tree.hpp"
+#include "task_scheduler.hpp"
+#include "loaders/loader.hpp"
+#include "loaders/primitive_loader.hpp"
+
+namespace Generators {
+template <typename Colour> struct TreeIntNode {
+    Colour colour;
+    bool visible;
+    bool parent;
+    uint64_t childMask;
+    // Wide enough for trees of more than 2^32 intermediary nodes
+    uint64_t childStartIndex = 0;
+    uint64_t childCount = 0;
+};
+
+// Level queue collapse shared by every Morton ordered tree.
+// Voxels are consumed in Morton order and pushed onto the deepest queue. Once a queue holds
+// Branching nodes it is either merged into a single leaf (all children equal) or turned into
+// a parent whose children are appended to the intermediary list.
+//
+// NodeTraits requirements:
+//   Colour                     Colour stored on intermediary nodes
+//   MaxDepth                   Number of levels including the root
+//   ReverseChildren            Append children from the highest index down
+//   decode(uint64_t)           Morton decode matching the branching factor
+//   encode(glm::uvec3)         Inverse of decode
+//   leafColour(glm::vec3)      Conversion of a loader colour
+//   parentColour()             Colour assigned to interior nodes
+template <uint32_t Branching, typename NodeTraits> class TreeBuilder {
+  public:
+    using Colour = typename NodeTraits::Colour;
+    using IntNode = TreeIntNode<Colour>;
+
+  private:
+    static constexpr uint32_t cubeRoot(uint32_t value)
+    {
+        uint32_t edge = 1;
+        while (edge * edge * edge < value)
+            edge++;
+        return edge;
+    }
+
+  public:
+    static constexpr uint32_t Edge = cubeRoot(Branching);
+    static constexpr uint32_t MaxDepth = NodeTraits::MaxDepth;
+    static constexpr uint32_t LeafDepth = MaxDepth - 1;
+    static constexpr uint64_t FullMask = Branching == 64 ? ~0ull : ((1ull << Branching) - 1);
+
+    static_assert(Branching > 1 && Branching <= 64, "Child masks are limited to 64 bits");
+    static_assert(Edge * Edge * Edge == Branching, "Branching factor must be a cube");
+    static_assert((Edge & (Edge - 1)) == 0, "Morton codes require a power of 2 edge");
+
+  private:
+    // Level queues of a tree being built, parents index into intermediaryNodes
+    struct BuildState {
+        explicit BuildState(std::pmr::memory_resource* resource) : intermediaryNodes(resource) { }
+
+        std::array<size_t, MaxDepth> queueSizes {};
+        std::array<std::array<IntNode, Branching>, MaxDepth> queues;
+        std::pmr::vector<IntNode> intermediaryNodes;
+        uint64_t voxelCount = 0;
+    };
+
+  public:
+    static glm::uvec3 dimensions(const Loader& loader)
+    {
+        return dimensions(loader.getDimensions());
+    }
+
+    static glm::uvec3 dimensions(glm::uvec3 loaderDimensions)
+    {
+        return Loader::cubeDimensions(Loader::getDimensionsDivN(loaderDimensions, Edge));
+    }
+
+    // Levels below the root of a tree with the given cube dimensions
+    static uint32_t levelCount(glm::uvec3 dimensions)
+    {
+        const uint64_t finalCode = (uint64_t)dimensions.x * dimensions.y * dimensions.z;
+
+        uint32_t levels = 0;
+        for (uint64_t codes = 1; codes < finalCode; codes *= Branching)
+            levels++;
+
+        return levels;
+    }
+
+    // Tree covering a contiguous, aligned range of Morton codes. Parent nodes index into nodes,
+    // the root is kept aside so it can be collapsed with its siblings.
+    struct Subtree {
+        // Holds every allocation of nodes, released at once after the subtree is merged. Arenas
+        // are per subtree so the threads building them never share an allocator.
+        std::unique_ptr<std::pmr::monotonic_buffer_resource> arena;
+        std::pmr::vector<IntNode> nodes;
+        IntNode root;
+        uint64_t voxelCount = 0;
+    };
+
+    // Builds a subtree of the given number of levels. voxel(i) returns the voxel at local code i
+    // and progress(n) is called as codes are consumed. The subtree's arena allocates from
+    // resource, which must be thread safe when subtrees are built in parallel.
+    template <typename Source, typename Progress>
+    static std::optional<Subtree> buildSubtree(std::stop_token stoken, uint32_t levels,
+        Source&& voxel, Progress&& progress, std::pmr::memory_resource* resource)
+    {
+        uint64_t codeCount = 1;
+        for (uint32_t i = 0; i < levels; i++)
+            codeCount *= Branching;
+
+        auto arena = std::make_unique<std::pmr::monotonic_buffer_resource>(resource);
+        auto state = std::make_unique<BuildState>(arena.get());
+        for (uint64_t i = 0; i < codeCount; i++) {
+            if (stoken.stop_requested())
+                return {};
+
+            if (!push(stoken, *state, LeafDepth, convert(voxel(i))))
+                return {};
+
+            if ((i + 1) % ProgressStep == 0)
+                progress(ProgressStep);
+        }
+
+        progress(codeCount % ProgressStep);
+
+        const uint32_t subtreeDepth = LeafDepth - levels;
+        assert(state->queueSizes[subtreeDepth] == 1 && "Subtree did not fully collapse");
+
+        return Subtree {
+            .arena = std::move(arena),
+            .nodes = std::move(state->intermediaryNodes),
+            .root = state->queues[subtreeDepth][0],
+            .voxelCount = state->voxelCount,
+        };
+    }
+
+    // Merges equally sized subtrees in Morton order as they arrive, subtrees may be added out of
+    // order and are held until every earlier one is merged. Subtrees lying entirely outside the
+    // loader dimensions are empty and may be left out. The merged nodes are allocated from
+    // resource, the subtrees waiting to be merged from a pool over it.
+    class Assembler {
+      public:
+        Assembler(glm::uvec3 dimensions, glm::uvec3 loaderDimensions, uint32_t subtreeLevels,
+            std::pmr::memory_resource* resource)
+            : m_LoaderDimensions(loaderDimensions), m_Levels(levelCount(dimensions)),
+              m_SubtreeLevels(subtreeLevels), m_Resource(resource),
+              m_Merged(std::make_unique<BuildState>(resource)), m_PendingPool(resource),
+              m_Pending(&m_PendingPool), m_Empties(&m_PendingPool)
+        {
+            assert(subtreeLevels <= m_Levels && "Subtree larger than the tree");
+
+            m_SubtreeCount = 1;
+            for (uint32_t i = subtreeLevels; i < m_Levels; i++)
+                m_SubtreeCount *= Branching;
+
+            m_SubtreeEdge = 1;
+            for (uint32_t i = 0; i < subtreeLevels; i++)
+                m_SubtreeEdge *= Edge;
+        }
+
+        uint64_t getSubtreeCount() const { return m_SubtreeCount; }
+
+        // Subtrees outside the loader dimensions are empty and need not be added
+        bool outside(uint64_t index) const
+        {
+            glm::uvec3 position = NodeTraits::decode(index) * m_SubtreeEdge;
+            return glm::any(glm::greaterThanEqual(position, m_LoaderDimensions));
+        }
+
+        bool add(std::stop_token stoken, uint64_t index, Subtree&& subtree)
+        {
+            assert(index >= m_Next && index < m_SubtreeCount && "Subtree index out of range");
+
+            m_Pending.emplace(index, std::move(subtree));
+            return mergeReady(stoken);
+        }
+
+        // Same as adding a subtree built from no voxels
+        bool addEmpty(std::stop_token stoken, uint64_t index)
+        {
+            assert(index >= m_Next && index < m_SubtreeCount && "Subtree index out of range");
+
+            m_Empties.insert(index);
+            return mergeReady(stoken);
+        }
+
+        // Returns the intermediary nodes with the root as the final entry
+        std::optional<std::pmr::vector<IntNode>> finish(
+            std::stop_token stoken, GenerationInfo& info)
+        {
+            if (!mergeReady(stoken))
+                return {};
+
+            assert(m_Next == m_SubtreeCount && "Subtrees missing inside the loader dimensions");
+
+            const uint32_t rootDepth = LeafDepth - m_Levels;
+            assert(m_Merged->queueSizes[rootDepth] == 1);
+            const IntNode& root = m_Merged->queues[rootDepth].at(0);
+            m_Merged->intermediaryNodes.push_back(root);
+            if (!root.parent && root.visible) {
+                m_Merged->voxelCount += pow(Branching, LeafDepth - rootDepth);
+            }
+
+            info.voxelCount = m_Merged->voxelCount;
+
+            return std::move(m_Merged->intermediaryNodes);
+        }
+
+      private:
+        bool mergeReady(std::stop_token stoken)
+        {
+            while (m_Next < m_SubtreeCount) {
+                auto pending = m_Pending.find(m_Next);
+
+                if (pending != m_Pending.end()) {
+                    if (!merge(stoken, pending->second))
+                        return false;
+                    m_Pending.erase(pending);
+                } else if (outside(m_Next) || m_Empties.erase(m_Next) != 0) {
+                    const Subtree* empty = emptySubtree(stoken);
+                    if (empty == nullptr || !merge(stoken, *empty))
+                        return false;
+                } else {
+                    break;
+                }
+
+                m_Next++;
+            }
+
+            return true;
+        }
+
+        const Subtree* emptySubtree(std::stop_token stoken)
+        {
+            if (!m_Empty.has_value()) {
+                m_Empty = buildSubtree(
+                    stoken, m_SubtreeLevels, [](uint64_t) { return std::nullopt; },
+                    [](uint64_t) { }, m_Resource);
+            }
+
+            return m_Empty.has_value() ? &m_Empty.value() : nullptr;
+        }
+
+        bool merge(std::stop_token stoken, const Subtree& subtree)
+        {
+            const uint64_t offset = m_Merged->intermediaryNodes.size();
+            for (IntNode node : subtree.nodes) {
+                if (node.parent)
+                    node.childStartIndex += offset;
+                m_Merged->intermediaryNodes.push_back(node);
+            }
+
+            IntNode root = subtree.root;
+            if (root.parent)
+                root.childStartIndex += offset;
+
+            m_Merged->voxelCount += subtree.voxelCount;
+
+            return push(stoken, *m_Merged, LeafDepth - m_SubtreeLevels, root);
+        }
+
+      private:
+        glm::uvec3 m_LoaderDimensions;
+        uint32_t m_Levels;
+        uint32_t m_SubtreeLevels;
+        uint64_t m_SubtreeCount;
+        uint32_t m_SubtreeEdge;
+        std::pmr::memory_resource* m_Resource;
+
+        std::unique_ptr<BuildState> m_Merged;
+        std::pmr::unsynchronized_pool_resource m_PendingPool;
+        std::pmr::map<uint64_t, Subtree> m_Pending;
+        // Indices added by addEmpty which are not merged yet
+        std::pmr::set<uint64_t> m_Empties;
+        std::optional<Subtree> m_Empty;
+        uint64_t m_Next = 0;
+    };
+
+    // Returns the intermediary nodes with the root as the final entry, or nothing if stopped.
+    // The Morton range is split into equal subtrees built on the task scheduler, so
+    // Loader::getVoxel is called from several threads at once. Subtrees are merged in Morton
+    // order which gives exactly the same nodes as a single sequential pass. Every allocation
+    // comes from resource, which must be thread safe.
+    static std::optional<std::pmr::vector<IntNode>> build(std::stop_token stoken, Loader& loader,
+        GenerationInfo& info, glm::uvec3 dimensions, std::pmr::memory_resource* resource)
+    {
+        std::chrono::steady_clock timer;
+        auto start = timer.now();
+
+        const uint64_t finalCode = (uint64_t)dimensions.x * dimensions.y * dimensions.z;
+        const uint32_t levels = levelCount(dimensions);
+        const glm::uvec3 loaderDimensions = loader.getDimensions();
+
+        info.voxelCount = 0;
+
+        TaskScheduler& scheduler = TaskScheduler::getInstance();
+
+        const uint32_t subtreeLevels = levels - splitLevels(levels);
+        uint64_t subtrees = 1;
+        for (uint32_t i = subtreeLevels; i < levels; i++)
+            subtrees *= Branching;
+
+        const uint64_t subtreeCodes = finalCode / subtrees;
+
+        std::atomic<uint64_t> processed = 0;
+        auto progress = [&](uint64_t codes) {
+            uint64_t current = processed.fetch_add(codes) + codes;
+
+            std::chrono::duration<float, std::milli> difference = timer.now() - start;
+            info.completionPercent = ((float)current / (float)finalCode);
+            info.generationTime = difference.count() / 1000.0f;
+        };
+
+        Assembler assembler(dimensions, loaderDimensions, subtreeLevels, resource);
+
+        std::vector<std::optional<Subtree>> built(subtrees);
+        scheduler.parallelFor(subtrees, 1, [&](size_t subtree) {
+            if (assembler.outside(subtree)) {
+                progress(subtreeCodes);
+                return;
+            }
+
+            const uint64_t firstCode = subtree * subtreeCodes;
+            auto voxel = [&](uint64_t code) -> std::optional<glm::vec3> {
+                glm::uvec3 index = NodeTraits::decode(firstCode + code);
+                if (glm::any(glm::greaterThanEqual(index, loaderDimensions)))
+                    return {};
+
+                return loader.getVoxel(index);
+            };
+
+            built[subtree] = buildSubtree(stoken, subtreeLevels, voxel, progress, resource);
+        });
+
+        if (stoken.stop_requested())
+            return {};
+
+        for (uint64_t subtree = 0; subtree < subtrees; subtree++) {
+            if (!built[subtree].has_value())
+                continue;
+
+            if (!assembler.add(stoken, subtree, std::move(built[subtree].value())))
+                return {};
+            built[subtree].reset();
+        }
+
+        return assembler.finish(stoken, info);
+    }
+
+    // Builds from the primitives of loader, subdividing from the root only the cells some
+    // primitive overlaps. Work and memory follow the size of the tree rather than the volume,
+    // and the nodes are exactly those of build over the loader's voxels. The top levels narrow
+    // the primitives down to each subtree, which are built on the task scheduler and merged in
+    // Morton order.
+    static std::optional<std::pmr::vector<IntNode>> build(std::stop_token stoken,
+        PrimitiveLoader& loader, GenerationInfo& info, glm::uvec3 dimensions,
+        std::pmr::memory_resource* resource)
+    {
+        std::chrono::steady_clock timer;
+        auto start = timer.now();
+
+        const uint32_t levels = levelCount(dimensions);
+        const glm::uvec3 loaderDimensions = loader.getDimensions();
+
+        info.voxelCount = 0;
+
+        const uint32_t subtreeLevels = levels - splitLevels(levels);
+        Assembler assembler(dimensions, loaderDimensions, subtreeLevels, resource);
+
+        uint32_t subtreeEdge = 1;
+        for (uint32_t i = 0; i < subtreeLevels; i++)
+            subtreeEdge *= Edge;
+
+        TaskScheduler& scheduler = TaskScheduler::getInstance();
+
+        // Candidates of every cell one level at a time, down to the subtrees
+        std::vector<std::vector<uint32_t>> cells(1);
+        cells[0].resize(loader.getPrimitiveCount());
+        for (uint32_t i = 0; i < cells[0].size(); i++)
+            cells[0][i] = i;
+
+        for (uint32_t level = levels; level > subtreeLevels; level--) {
+            uint32_t cellEdge = 1;
+            for (uint32_t i = 1; i < level; i++)
+                cellEdge *= Edge;
+
+            std::vector<std::vector<uint32_t>> children(cells.size() * Branching);
+            scheduler.parallelFor(children.size(), 1, [&](size_t cell) {
+                const glm::uvec3 origin = NodeTraits::decode(cell) * cellEdge;
+                if (glm::any(glm::greaterThanEqual(origin, loaderDimensions)))
+                    return;
+
+                loader.overlapping(cells[cell / Branching], origin, cellEdge, children[cell]);
+            });
+
+            if (stoken.stop_requested())
+                return {};
+
+            cells = std::move(children);
+        }
+
+        const uint64_t subtrees = cells.size();
+        std::atomic<uint64_t> processed = 0;
+
+        std::vector<std::optional<Subtree>> built(subtrees);
+        scheduler.parallelFor(subtrees, 1, [&](size_t subtree) {
+            if (!assembler.outside(subtree) && !cells[subtree].empty()) {
+                auto arena = std::make_unique<std::pmr::monotonic_buffer_resource>(resource);
+                auto state = std::make_unique<BuildState>(arena.get());
+
+                const glm::uvec3 origin = NodeTraits::decode(subtree) * subtreeEdge;
+                auto root
+                    = buildCell(stoken, loader, cells[subtree], origin, subtreeLevels, *state);
+
+                if (root.has_value()) {
+                    built[subtree] = Subtree {
+                        .arena = std::move(arena),
+                        .nodes = std::move(state->intermediaryNodes),
+                        .root = root.value(),
+                        .voxelCount = state->voxelCount,
+                    };
+                }
+            }
+
+            cells[subtree] = {};
+
+            const uint64_t current = processed.fetch_add(1) + 1;
+            std::chrono::duration<float, std::milli> difference = timer.now() - start;
+            info.completionPercent = ((float)current / (float)subtrees);
+            info.generationTime = difference.count() / 1000.0f;
+        });
+
+        if (stoken.stop_requested())
+            return {};
+
+        for (uint64_t subtree = 0; subtree < subtrees; subtree++) {
+            if (assembler.outside(subtree))
+                continue;
+
+            bool added = built[subtree].has_value()
+                ? assembler.add(stoken, subtree, std::move(built[subtree].value()))
+                : assembler.addEmpty(stoken, subtree);
+            if (!added)
+                return {};
+            built[subtree].reset();
+        }
+
+        return assembler.finish(stoken, info);
+    }
+
+    // Builds from the blocks sent by scanBlocks, each block being a complete subtree. Blocks
+    // arrive in octree Morton order and are merged once every earlier subtree has arrived.
+    static std::optional<std::pmr::vector<IntNode>> build(std::stop_token stoken,
+        BlockStream& stream, GenerationInfo& info, glm::uvec3 dimensions,
+        std::pmr::memory_resource* resource)
+    {
+        std::chrono::steady_clock timer;
+        auto start = timer.now();
+
+        info.voxelCount = 0;
+
+        uint32_t subtreeLevels = 0;
+        for (uint32_t edge = 1; edge < VoxelBlock::Edge; edge *= Edge)
+            subtreeLevels++;
+
+        assert(levelCount(dimensions) >= subtreeLevels && "Tree smaller than a block");
+
+        Assembler assembler(dimensions, stream.getDimensions(), subtreeLevels, resource);
+
+        const uint64_t blockCount = stream.getBlockCount();
+        uint64_t received = 0;
+
+        while (std::shared_ptr<const VoxelBlock> block = stream.pop()) {
+            if (stoken.stop_requested()) {
+                stream.close();
+                return {};
+            }
+
+            const uint64_t index = NodeTraits::encode(block->position);
+
+            bool added;
+            if (block->empty()) {
+                added = assembler.addEmpty(stoken, index);
+            } else {
+                auto voxel = [&](uint64_t code) {
+                    return block->getVoxel(NodeTraits::decode(code));
+                };
+                auto subtree
+                    = buildSubtree(stoken, subtreeLevels, voxel, [](uint64_t) { }, resource);
+
+                added = subtree.has_value() && assembler.add(stoken, index, std::move(*subtree));
+            }
+
+            if (!added) {
+                stream.close();
+                return {};
+            }
+
+            received++;
+
+            std::chrono::duration<float, std::milli> difference = timer.now() - start;
+            info.completionPercent = ((float)received / (float)blockCount);
+            info.generationTime = difference.count() / 1000.0f;
+        }
+
+        // Producer stopped before sending every block
+        if (received != blockCount)
+            return {};
+
+        return assembler.finish(stoken, info);
+    }
+
+    // Levels above the subtrees built in parallel. Enough subtrees for stealing to balance sparse
+    // regions, while keeping at least one level inside each subtree.
+    static uint32_t splitLevels(uint32_t levels)
+    {
+        const uint32_t threads = TaskScheduler::getInstance().getThreadCount();
+        const uint64_t wantedSubtrees = (uint64_t)threads * 8;
+
+        uint32_t split = 0;
+        uint64_t subtrees = 1;
+        while (threads > 1 && split + 1 < levels && subtrees < wantedSubtrees) {
+            split++;
+            subtrees *= Branching;
+        }
+
+        return split;
+    }
+
+    // Subtree levels used when the tree is split between workers. Only depends on the
+    // dimensions and worker count so every process agrees on the split, and leaves several
+    // subtrees per worker to balance across its own threads.
+    static uint32_t partitionLevels(glm::uvec3 dimensions, uint32_t workers)
+    {
+        const uint32_t levels = levelCount(dimensions);
+        const uint64_t wantedSubtrees = (uint64_t)workers * PartitionSubtrees;
+
+        uint32_t splitLevels = 0;
+        uint64_t subtrees = 1;
+        while (splitLevels + 1 < levels && subtrees < wantedSubtrees) {
+            splitLevels++;
+            subtrees *= Branching;
+        }
+
+        return levels - splitLevels;
+    }
+
+    // Builds one worker's share of the subtrees. Merging the partial trees of every worker
+    // with mergePartials gives exactly the nodes of build.
+    static std::optional<PartialTree> buildPartial(std::stop_token stoken, Loader& loader,
+        GenerationInfo& info, glm::uvec3 dimensions, uint32_t worker, uint32_t workers,
+        std::pmr::memory_resource* resource)
+    {
+        std::chrono::steady_clock timer;
+        auto start = timer.now();
+
+        const uint64_t finalCode = (uint64_t)dimensions.x * dimensions.y * dimensions.z;
+        const glm::uvec3 loaderDimensions = loader.getDimensions();
+
+        const uint32_t subtreeLevels = partitionLevels(dimensions, workers);
+        const Assembler assembler(dimensions, loaderDimensions, subtreeLevels, resource);
+        const uint64_t subtreeCount = assembler.getSubtreeCount();
+        const uint64_t subtreeCodes = finalCode / subtreeCount;
+
+        PartialTree partial {
+            .loaderDimensions = loaderDimensions,
+            .subtreeLevels = subtreeLevels,
+            .first = subtreeCount * worker / workers,
+            .last = subtreeCount * (worker + 1) / workers,
+            .subtrees = {},
+        };
+        const uint64_t count = partial.last - partial.first;
+
+        info.voxelCount = 0;
+
+        std::atomic<uint64_t> processed = 0;
+        auto progress = [&](uint64_t codes) {
+            uint64_t current = processed.fetch_add(codes) + codes;
+
+            std::chrono::duration<float, std::milli> difference = timer.now() - start;
+            info.completionPercent = ((float)current / (float)(count * subtreeCodes));
+            info.generationTime = difference.count() / 1000.0f;
+        };
+
+        std::vector<std::optional<Subtree>> built(count);
+        TaskScheduler::getInstance().parallelFor(count, 1, [&](size_t i) {
+            const uint64_t index = partial.first + i;
+            if (assembler.outside(index)) {
+                progress(subtreeCodes);
+                return;
+            }
+
+            const uint64_t firstCode = index * subtreeCodes;
+            auto voxel = [&](uint64_t code) -> std::optional<glm::vec3> {
+                glm::uvec3 position = NodeTraits::decode(firstCode + code);
+                if (glm::any(glm::greaterThanEqual(position, loaderDimensions)))
+                    return {};
+
+                return loader.getVoxel(position);
+            };
+
+            built[i] = buildSubtree(stoken, subtreeLevels, voxel, progress, resource);
+        });
+
+        if (stoken.stop_requested())
+            return {};
+
+        for (uint64_t i = 0; i < count; i++) {
+            if (!built[i].has_value())
+                continue;
+
+            Subtree& subtree = built[i].value();
+            PartialSubtree& added = partial.subtrees.emplace_back();
+            added.index = partial.first + i;
+            added.root = toPartial(subtree.root);
+            added.voxelCount = subtree.voxelCount;
+            added.nodes.reserve(subtree.nodes.size());
+            for (const IntNode& node : subtree.nodes)
+                added.nodes.push_back(toPartial(node));
+
+            info.voxelCount += subtree.voxelCount;
+            built[i].reset();
+        }
+
+        info.completionPercent = 1.f;
+
+        return partial;
+    }
+
+    // Whether buildPartial of the worker reads the voxel at position, a worker's loader only needs
+    // the voxels passing this filter
+    static std::function<bool(glm::uvec3)> partialFilter(
+        glm::uvec3 loaderDimensions, uint32_t worker, uint32_t workers)
+    {
+        const glm::uvec3 dimensions = TreeBuilder::dimensions(loaderDimensions);
+        const uint32_t levels = levelCount(dimensions);
+        const uint32_t subtreeLevels = partitionLevels(dimensions, workers);
+
+        uint64_t subtreeCount = 1;
+        for (uint32_t i = subtreeLevels; i < levels; i++)
+            subtreeCount *= Branching;
+
+        uint32_t subtreeEdge = 1;
+        for (uint32_t i = 0; i < subtreeLevels; i++)
+            subtreeEdge *= Edge;
+
+        const uint64_t first = subtreeCount * worker / workers;
+        const uint64_t last = subtreeCount * (worker + 1) / workers;
+        return [=](glm::uvec3 position) {
+            const uint64_t index = NodeTraits::encode(position / subtreeEdge);
+            return index >= first && index < last;
+        };
+    }
+
+    // Merges the partial trees of every worker in order. loadPartial(worker) returns the worker's
+    // partial tree, or nothing if it failed. The dimensions are taken from the first partial tree,
+    // later ones read from other dimensions or split for another worker count are rejected.
+    template <typename LoadPartial>
+    static std::optional<std::pmr::vector<IntNode>> mergePartials(std::stop_token stoken,
+        LoadPartial&& loadPartial, uint32_t workers, GenerationInfo& info, glm::uvec3& dimensions,
+        std::pmr::memory_resource* resource)
+    {
+        std::chrono::steady_clock timer;
+        auto start = timer.now();
+
+        info.voxelCount = 0;
+
+        std::optional<PartialTree> partial = loadPartial(0);
+        if (!partial.has_value() || stoken.stop_requested())
+            return {};
+
+        const glm::uvec3 loaderDimensions = partial->loaderDimensions;
+        dimensions = TreeBuilder::dimensions(loaderDimensions);
+
+        const uint32_t subtreeLevels = partitionLevels(dimensions, workers);
+        Assembler assembler(dimensions, loaderDimensions, subtreeLevels, resource);
+        const uint64_t subtreeCount = assembler.getSubtreeCount();
+
+        for (uint32_t worker = 0; worker < workers; worker++) {
+            if (worker > 0)
+                partial = loadPartial(worker);
+            if (!partial.has_value() || stoken.stop_requested())
+                return {};
+
+            if (partial->loaderDimensions != loaderDimensions
+                || partial->subtreeLevels != subtreeLevels
+                || partial->first != subtreeCount * worker / workers
+                || partial->last != subtreeCount * (worker + 1) / workers)
+                return {};
+
+            // Every subtree inside the volume must be present, in order
+            size_t next = 0;
+            for (uint64_t index = partial->first; index < partial->last; index++) {
+                if (assembler.outside(index))
+                    continue;
+
+                if (next >= partial->subtrees.size() || partial->subtrees[next].index != index)
+                    return {};
+
+                auto subtree = fromPartial(partial->subtrees[next], resource);
+                if (!subtree.has_value() || !assembler.add(stoken, index, std::move(*subtree)))
+                    return {};
+
+                next++;
+            }
+
+            if (next != partial->subtrees.size())
+                return {};
+
+            std::chrono::duration<float, std::milli> difference = timer.now() - start;
+            info.completionPercent = ((float)(worker + 1) / (float)workers);
+            info.generationTime = difference.count() / 1000.0f;
+        }
+
+        return assembler.finish(stoken, info);
+    }
+
+  private:
+    // Codes between progress reports, keeps the shared counter off the per voxel path
+    static constexpr uint64_t ProgressStep = 4096;
+    // Subtrees wanted per worker when the tree is split between processes
+    static constexpr uint64_t PartitionSubtrees = 64;
+
+    // Adds a node to the queue at depth, collapsing every queue which becomes full
+    static bool push(std::stop_token& stoken, BuildState& state, uint32_t depth, IntNode node)
+    {
+        state.queues[depth][state.queueSizes[depth]] = node;
+        state.queueSizes[depth]++;
+
+        while (depth > 0 && state.queueSizes[depth] == Branching) {
+            if (stoken.stop_requested())
+                return false;
+
+            state.queues[depth - 1][state.queueSizes[depth - 1]]
+                = collapse(state, state.queues[depth], LeafDepth - depth);
+            state.queueSizes[depth - 1]++;
+
+            state.queueSizes[depth] = 0;
+            depth--;
+        }
+
+        return true;
+    }
+
+    // Node covering a full set of children, each of Branching^childLevel voxels. Either a leaf
+    // when every child is the same leaf or a parent whose children are appended to state.
+    static IntNode collapse(
+        BuildState& state, const std::array<IntNode, Branching>& children, uint32_t childLevel)
+    {
+        const auto possibleParentNode = allEqual(children);
+        if (possibleParentNode.has_value())
+            return possibleParentNode.value();
+
+        uint64_t childMask = 0;
+        uint64_t childCount = 0;
+        for (uint32_t c = 0; c < Branching; c++) {
+            uint32_t i = NodeTraits::ReverseChildren ? Branching - 1 - c : c;
+
+            if (children[i].visible) {
+                childMask |= (1ull << i);
+                state.intermediaryNodes.push_back(children[i]);
+                if (!children[i].parent) {
+                    state.voxelCount += pow(Branching, childLevel);
+                }
+                childCount += children[i].childCount + 1;
+            }
+        }
+
+        return IntNode {
+            .colour = NodeTraits::parentColour(),
+            .visible = childMask != 0,
+            .parent = true,
+            .childMask = childMask,
+            .childStartIndex = state.intermediaryNodes.size() - 1,
+            .childCount = childCount,
+        };
+    }
+
+    // Node of the cube of Edge^level voxels at origin, built from the primitives in candidates.
+    // Cells no primitive overlaps become the leaf the level queues collapse empty space into.
+    static std::optional<IntNode> buildCell(std::stop_token& stoken, PrimitiveLoader& loader,
+        const std::vector<uint32_t>& candidates, glm::uvec3 origin, uint32_t level,
+        BuildState& state)
+    {
+        if (stoken.stop_requested())
+            return {};
+
+        if (glm::any(glm::greaterThanEqual(origin, loader.getDimensions())) || candidates.empty())
+            return emptyCell(level);
+
+        if (level == 0)
+            return convert(loader.getVoxel(candidates, origin));
+
+        uint32_t childEdge = 1;
+        for (uint32_t i = 1; i < level; i++)
+            childEdge *= Edge;
+
+        std::array<IntNode, Branching> children;
+        std::vector<uint32_t> overlaps;
+        for (uint32_t c = 0; c < Branching; c++) {
+            const glm::uvec3 childOrigin = origin + NodeTraits::decode(c) * childEdge;
+
+            // Voxels test the candidates themselves, narrowing them first would test twice
+            overlaps.clear();
+            if (level > 1 && glm::all(glm::lessThan(childOrigin, loader.getDimensions())))
+                loader.overlapping(candidates, childOrigin, childEdge, overlaps);
+
+            const std::vector<uint32_t>& childCandidates = level > 1 ? overlaps : candidates;
+            auto child
+                = buildCell(stoken, loader, childCandidates, childOrigin, level - 1, state);
+            if (!child.has_value())
+                return {};
+            children[c] = child.value();
+        }
+
+        return collapse(state, children, level - 1);
+    }
+
+    // Leaf the level queues produce for Branching^level empty voxels
+    static IntNode emptyCell(uint32_t level)
+    {
+        IntNode node = convert(std::nullopt);
+        for (uint32_t i = 0; i < level; i++)
+            node.childCount = (Branching - 1) * (node.childCount + 1);
+
+        return node;
+    }
+
+    static PartialNode toPartial(const IntNode& node)
+    {
+        return PartialNode {
+            .colour = glm::vec3(node.colour),
+            .visible = node.visible,
+            .parent = node.parent,
+            .childMask = node.childMask,
+            .childStartIndex = node.childStartIndex,
+            .childCount = node.childCount,
+        };
+    }
+
+    static IntNode fromPartial(const PartialNode& node)
+    {
+        return IntNode {
+            .colour = Colour(node.colour),
+            .visible = node.visible,
+            .parent = node.parent,
+            .childMask = node.childMask,
+            .childStartIndex = node.childStartIndex,
+            .childCount = node.childCount,
+        };
+    }
+
+    // Empty if a parent points outside of the subtree's nodes
+    static std::optional<Subtree> fromPartial(
+        const PartialSubtree& partial, std::pmr::memory_resource* resource)
+    {
+        auto arena = std::make_unique<std::pmr::monotonic_buffer_resource>(resource);
+        std::pmr::vector<IntNode> nodes(arena.get());
+        nodes.reserve(partial.nodes.size());
+        for (const PartialNode& node : partial.nodes) {
+            if (node.parent && node.childStartIndex >= partial.nodes.size())
+                return {};
+            nodes.push_back(fromPartial(node));
+        }
+
+        if (partial.root.parent && partial.root.childStartIndex >= partial.nodes.size())
+            return {};
+
+        return Subtree {
+            .arena = std::move(arena),
+            .nodes = std::move(nodes),
+            .root = fromPartial(partial.root),
+            .voxelCount = partial.voxelCount,
+        };
+    }
+
+    static IntNode convert(const std::optional<glm::vec3>& v)
+    {
+        if (v.has_value()) {
+            return IntNode {
+                .colour = NodeTraits::leafColour(v.value()),
+                .visible = true,
+                .parent = false,
+                .childMask = 0,
+                .childCount = 0,
+            };
+        } else {
+            return IntNode { .visible = false };
+        }
+    }
+
+    static std::optional<IntNode> allEqual(const std::array<IntNode, Branching>& nodes)
+    {
+        const IntNode& first = nodes[0];
+        if (first.parent)
+            return {};
+
+        uint64_t count = 0;
+        for (uint32_t i = 1; i < Branching; i++) {
+            const IntNode& node = nodes[i];
+            if (node.parent || node.visible != first.visible || node.colour != first.colour)
+                return {};
+
+            count += node.childCount + 1;
+        }
+
+        return IntNode {
+            .colour = first.colour,
+            .visible = first.visible,
+            .parent = false,
+            .childMask = 0,
+            .childCount = count,
+        };
+    }
+};
+}
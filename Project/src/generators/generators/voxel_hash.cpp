@@ -0,0 +1,273 @@
+#include "voxel_hash.hpp"
+#include "palette.hpp"
+#include "task_scheduler.hpp"
+
+#include <bit>
+#include <chrono>
+#include <cstring>
+
+namespace Generators {
+// Blocks sampled together before being added to the table
+static constexpr size_t SampleBatch = 256;
+
+static constexpr size_t MinimumCapacity = 64;
+
+// Teschner et al. spatial hash, spread over the table with a Fibonacci multiply
+static size_t hashBlock(glm::ivec3 block, size_t capacity)
+{
+    uint32_t hash = ((uint32_t)block.x * 73856093u) ^ ((uint32_t)block.y * 19349663u)
+        ^ ((uint32_t)block.z * 83492791u);
+
+    uint64_t spread = (uint64_t)hash * 0x9E3779B97F4A7C15ull;
+    return (spread >> 32) & (capacity - 1);
+}
+
+VoxelHash::VoxelHash(size_t expectedBlocks)
+{
+    size_t capacity = std::bit_ceil(std::max(expectedBlocks * 2, MinimumCapacity));
+    m_Slots.assign(capacity, 0);
+    m_Blocks.reserve(expectedBlocks);
+}
+
+glm::ivec3 VoxelHash::blockOf(glm::ivec3 position)
+{
+    // Rounds towards negative infinity so negative coordinates get their own blocks
+    const glm::ivec3 edge(HashBlock::Edge);
+    return (position - glm::ivec3(glm::lessThan(position, glm::ivec3(0))) * (edge - 1)) / edge;
+}
+
+size_t VoxelHash::findSlot(glm::ivec3 block) const
+{
+    const size_t mask = m_Slots.size() - 1;
+
+    size_t slot = hashBlock(block, m_Slots.size());
+    while (m_Slots[slot] != 0 && m_Blocks[m_Slots[slot] - 1].position != block)
+        slot = (slot + 1) & mask;
+
+    return slot;
+}
+
+void VoxelHash::grow()
+{
+    m_Slots.assign(m_Slots.size() * 2, 0);
+
+    for (size_t i = 0; i < m_Blocks.size(); i++) {
+        m_Slots[findSlot(m_Blocks[i].position)] = i + 1;
+    }
+}
+
+const HashBlock* VoxelHash::findBlock(glm::ivec3 block) const
+{
+    size_t slot = findSlot(block);
+    if (m_Slots[slot] == 0)
+        return nullptr;
+
+    return &m_Blocks[m_Slots[slot] - 1];
+}
+
+HashBlock& VoxelHash::insertBlock(glm::ivec3 block)
+{
+    size_t slot = findSlot(block);
+    if (m_Slots[slot] != 0)
+        return m_Blocks[m_Slots[slot] - 1];
+
+    if ((m_Blocks.size() + 1) * 2 > m_Slots.size()) {
+        grow();
+        slot = findSlot(block);
+    }
+
+    HashBlock& added = m_Blocks.emplace_back();
+    added.position = block;
+    memset(added.occupancy, 0, sizeof(added.occupancy));
+    added.colours.fill(0);
+
+    m_Slots[slot] = m_Blocks.size();
+    return added;
+}
+
+std::optional<glm::vec3> VoxelHash::getVoxel(glm::ivec3 position) const
+{
+    const glm::ivec3 block = blockOf(position);
+    const HashBlock* found = findBlock(block);
+    if (found == nullptr)
+        return {};
+
+    uint32_t bit = HashBlock::bitIndex(position - block * (int32_t)HashBlock::Edge);
+    if (!found->occupied(bit))
+        return {};
+
+    return unpackUnitColour(found->colours[bit]);
+}
+
+void VoxelHash::setVoxel(glm::ivec3 position, glm::vec3 colour)
+{
+    const glm::ivec3 block = blockOf(position);
+    HashBlock& found = insertBlock(block);
+
+    uint32_t bit = HashBlock::bitIndex(position - block * (int32_t)HashBlock::Edge);
+    found.occupancy[bit / 64] |= 1ull << (bit % 64);
+    found.colours[bit] = packUnitColour(colour);
+}
+
+void VoxelHash::clearVoxel(glm::ivec3 position)
+{
+    const glm::ivec3 block = blockOf(position);
+    size_t slot = findSlot(block);
+    if (m_Slots[slot] == 0)
+        return;
+
+    HashBlock& found = m_Blocks[m_Slots[slot] - 1];
+    uint32_t bit = HashBlock::bitIndex(position - block * (int32_t)HashBlock::Edge);
+    found.occupancy[bit / 64] &= ~(1ull << (bit % 64));
+}
+
+uint64_t VoxelHash::getVoxelCount() const
+{
+    uint64_t count = 0;
+    for (const HashBlock& block : m_Blocks) {
+        for (uint64_t word : block.occupancy)
+            count += std::popcount(word);
+    }
+    return count;
+}
+
+static void sampleBlock(Loader& loader, glm::uvec3 dimensions, HashBlock& block)
+{
+    memset(block.occupancy, 0, sizeof(block.occupancy));
+
+    const glm::uvec3 origin = glm::uvec3(block.position) * HashBlock::Edge;
+    const glm::uvec3 end = glm::min(origin + HashBlock::Edge, dimensions);
+    for (uint32_t y = origin.y; y < end.y; y++) {
+        for (uint32_t z = origin.z; z < end.z; z++) {
+            for (uint32_t x = origin.x; x < end.x; x++) {
+                auto voxel = loader.getVoxel({ x, y, z });
+                if (!voxel.has_value())
+                    continue;
+
+                uint32_t bit = HashBlock::bitIndex(glm::uvec3(x, y, z) - origin);
+                block.occupancy[bit / 64] |= 1ull << (bit % 64);
+                block.colours[bit] = packUnitColour(voxel.value());
+            }
+        }
+    }
+}
+
+VoxelHash generateVoxelHash(std::stop_token stoken, std::unique_ptr<Loader>&& loader,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished)
+{
+    std::chrono::steady_clock timer;
+    auto start = timer.now();
+
+    dimensions = loader->getDimensions();
+
+    const glm::uvec3 blocks = (dimensions + HashBlock::Edge - 1u) / HashBlock::Edge;
+    const size_t blockCount = (size_t)blocks.x * blocks.y * blocks.z;
+
+    VoxelHash hash;
+
+    std::vector<HashBlock> batch(SampleBatch);
+    for (size_t first = 0; first < blockCount; first += SampleBatch) {
+        if (stoken.stop_requested())
+            return {};
+
+        const size_t count = std::min(SampleBatch, blockCount - first);
+        TaskScheduler::getInstance().parallelFor(count, 1, [&](size_t i) {
+            size_t index = first + i;
+            batch[i].position = glm::ivec3(index % blocks.x, (index / blocks.x) % blocks.y,
+                index / ((size_t)blocks.x * blocks.y));
+            sampleBlock(*loader, dimensions, batch[i]);
+        });
+
+        // Added in order so the block order does not depend on scheduling
+        for (size_t i = 0; i < count; i++) {
+            if (!batch[i].empty())
+                hash.insertBlock(batch[i].position) = batch[i];
+        }
+
+        std::chrono::duration<float, std::milli> difference = timer.now() - start;
+        info.completionPercent = (float)(first + count) / (float)blockCount;
+        info.generationTime = difference.count() / 1000.0f;
+    }
+
+    info.voxelCount = hash.getVoxelCount();
+    info.nodes = hash.getBlocks().size();
+    info.completionPercent = 1.f;
+
+    finished = true;
+
+    return hash;
+}
+
+VoxelHash generateVoxelHash(std::stop_token stoken, BlockStream& stream, GenerationInfo& info,
+    glm::uvec3& dimensions, bool& finished)
+{
+    static_assert(VoxelBlock::Edge % HashBlock::Edge == 0, "Scan blocks must split into blocks");
+    constexpr uint32_t Split = VoxelBlock::Edge / HashBlock::Edge;
+
+    std::chrono::steady_clock timer;
+    auto start = timer.now();
+
+    dimensions = stream.getDimensions();
+
+    VoxelHash hash;
+
+    const uint64_t blockCount = stream.getBlockCount();
+    uint64_t received = 0;
+
+    while (std::shared_ptr<const VoxelBlock> block = stream.pop()) {
+        if (stoken.stop_requested()) {
+            stream.close();
+            return {};
+        }
+
+        received++;
+        if (block->empty())
+            continue;
+
+        for (uint32_t by = 0; by < Split; by++) {
+            for (uint32_t bz = 0; bz < Split; bz++) {
+                for (uint32_t bx = 0; bx < Split; bx++) {
+                    const glm::uvec3 offset = glm::uvec3(bx, by, bz) * HashBlock::Edge;
+
+                    HashBlock split;
+                    split.position = glm::ivec3(block->position * Split + glm::uvec3(bx, by, bz));
+                    memset(split.occupancy, 0, sizeof(split.occupancy));
+
+                    for (uint32_t y = 0; y < HashBlock::Edge; y++) {
+                        for (uint32_t z = 0; z < HashBlock::Edge; z++) {
+                            for (uint32_t x = 0; x < HashBlock::Edge; x++) {
+                                auto voxel = block->getVoxel(offset + glm::uvec3(x, y, z));
+                                if (!voxel.has_value())
+                                    continue;
+
+                                uint32_t bit = HashBlock::bitIndex({ x, y, z });
+                                split.occupancy[bit / 64] |= 1ull << (bit % 64);
+                                split.colours[bit] = packUnitColour(voxel.value());
+                            }
+                        }
+                    }
+
+                    if (!split.empty())
+                        hash.insertBlock(split.position) = split;
+                }
+            }
+        }
+
+        std::chrono::duration<float, std::milli> difference = timer.now() - start;
+        info.completionPercent = ((float)received / (float)blockCount);
+        info.generationTime = difference.count() / 1000.0f;
+    }
+
+    // Producer stopped before sending every block
+    if (received != blockCount)
+        return {};
+
+    info.voxelCount = hash.getVoxelCount();
+    info.nodes = hash.getBlocks().size();
+    info.completionPercent = 1.f;
+
+    finished = true;
+
+    return hash;
+}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "block_stream.hpp"
+#include "common.hpp"
+#include "loaders/loader.hpp"
+
+namespace Generators {
+// Dense block of voxels, only created once a voxel inside it is set.
+// Occupancy bits are indexed x + z * Edge + y * Edge * Edge like the brickmap.
+struct HashBlock {
+    static constexpr uint32_t Edge = 8;
+    static constexpr uint32_t Voxels = Edge * Edge * Edge;
+    static constexpr uint32_t Words = Voxels / 64;
+
+    // Block coordinates, multiply by Edge for the first voxel
+    glm::ivec3 position;
+
+    uint64_t occupancy[Words];
+    // 0x00RRGGBB, only meaningful for occupied voxels
+    std::array<uint32_t, Voxels> colours;
+
+    static constexpr uint32_t bitIndex(glm::uvec3 local)
+    {
+        return local.x + local.z * Edge + local.y * Edge * Edge;
+    }
+
+    bool occupied(uint32_t bit) const { return ((occupancy[bit / 64] >> (bit % 64)) & 1) != 0; }
+
+    bool empty() const
+    {
+        for (uint64_t word : occupancy) {
+            if (word != 0)
+                return false;
+        }
+        return true;
+    }
+};
+
+// Open addressing hash table of blocks keyed by block coordinate. Coordinates are signed and
+// unbounded, so memory grows with the occupied blocks rather than a bounding cube, and setting a
+// voxel costs O(1) on average.
+class VoxelHash {
+  public:
+    VoxelHash() : VoxelHash(0) { }
+    explicit VoxelHash(size_t expectedBlocks);
+
+    std::optional<glm::vec3> getVoxel(glm::ivec3 position) const;
+    void setVoxel(glm::ivec3 position, glm::vec3 colour);
+    // Blocks are kept once created, even if every voxel is cleared
+    void clearVoxel(glm::ivec3 position);
+
+    const HashBlock* findBlock(glm::ivec3 block) const;
+    // Returns the block, adding an empty one when missing. The reference is only valid until the
+    // next block is added.
+    HashBlock& insertBlock(glm::ivec3 block);
+
+    // Blocks in the order they were added
+    const std::vector<HashBlock>& getBlocks() const { return m_Blocks; }
+    size_t getCapacity() const { return m_Slots.size(); }
+    uint64_t getVoxelCount() const;
+
+    static glm::ivec3 blockOf(glm::ivec3 position);
+
+  private:
+    // Slot holding the block, or the free slot it would be placed in
+    size_t findSlot(glm::ivec3 block) const;
+    void grow();
+
+  private:
+    // Index of the block plus one, zero for free slots. Always a power of 2 in size and at most
+    // half full so probe sequences stay short.
+    std::vector<uint32_t> m_Slots;
+    std::vector<HashBlock> m_Blocks;
+};
+
+// Both generators store voxels at their loader index, dimensions are left unpadded
+VoxelHash generateVoxelHash(std::stop_token stoken, std::unique_ptr<Loader>&& loader,
+    GenerationInfo& info, glm::uvec3& dimensions, bool& finished);
+VoxelHash generateVoxelHash(std::stop_token stoken, BlockStream& stream, GenerationInfo& info,
+    glm::uvec3& dimensions, bool& finished);
+}
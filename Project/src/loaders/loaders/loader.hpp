@@ -49,12 +49,14 @@ class Loader {
     glm::uvec3 getDimensionsDiv4() const { return getDimensionsDivN(4); }
     glm::uvec3 getDimensionsDiv8() const { return getDimensionsDivN(8); }
 
-    glm::uvec3 getDimensionsDivN(uint32_t n) const
+    glm::uvec3 getDimensionsDivN(uint32_t n) const { return getDimensionsDivN(p_Dimensions, n); }
+
+    static glm::uvec3 getDimensionsDivN(glm::uvec3 dimensions, uint32_t n)
     {
-        assert(p_Dimensions.x != 1 && p_Dimensions.y != 1 && p_Dimensions.z != 1
+        assert(dimensions.x != 1 && dimensions.y != 1 && dimensions.z != 1
             && "Breaks when only single voxel");
 
-        glm::vec3 dim = p_Dimensions;
+        glm::vec3 dim = dimensions;
 
         dim = glm::log(dim) / glm::log(glm::vec3(n));
 
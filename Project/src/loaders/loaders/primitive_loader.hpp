@@ -0,0 +1,35 @@
+#pragma once
+
+#include "loader.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Loader over geometric primitives rather than stored voxels, letting trees be built from the
+// root down by only subdividing the cells some primitive overlaps. Primitives are referred to by
+// their index, candidate lists are always in increasing order. Every method may be called from
+// several threads at once.
+class PrimitiveLoader : public Loader {
+  public:
+    PrimitiveLoader(glm::uvec3 dimensions) : Loader(dimensions) { }
+    virtual ~PrimitiveLoader() { }
+
+    virtual uint32_t getPrimitiveCount() const = 0;
+
+    // Appends the candidates which may set a voxel of the cube of edge voxels at origin. Allowed
+    // to keep primitives which do not, but never to drop one which does.
+    virtual void overlapping(const std::vector<uint32_t>& candidates, glm::uvec3 origin,
+        uint32_t edge, std::vector<uint32_t>& overlaps)
+        = 0;
+
+    // Voxel at index when only the candidates are considered, which must include every primitive
+    // overlapping it
+    virtual std::optional<glm::vec3> getVoxel(
+        const std::vector<uint32_t>& candidates, glm::uvec3 index)
+        = 0;
+
+    using Loader::getVoxel;
+};
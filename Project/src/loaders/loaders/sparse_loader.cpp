@@ -11,8 +11,10 @@ std::optional<glm::vec3> SparseLoader::getVoxel(glm::uvec3 index)
         return {};
     }
 
-    if (!m_Voxels.contains(glm::ivec3(index)))
+    // Lookup only, generators call this from several threads at once
+    auto voxel = m_Voxels.find(glm::ivec3(index));
+    if (voxel == m_Voxels.end())
         return {};
 
-    return m_Voxels[glm::ivec3(index)];
+    return voxel->second;
 }
@@ -3,7 +3,7 @@
 // https://forceflow.be/2013/10/07/morton-encodingdecoding-through-bit-interleaving-implementations/
 inline uint64_t splitBy3(uint32_t a)
 {
-    uint64_t x = a % 0x1FFFFF;
+    uint64_t x = a & 0x1FFFFF;
     // x = 0000000000000000000000000000000000000000000ABCDEFGHIJKLMNOPQRSTU
     x = (x | x << 32) & 0x1f00000000ffff;
     // x = 00000000000ABCDE00000000000000000000000000000000FGHIJKLMNOPQRSTU
@@ -37,7 +37,7 @@ inline uint32_t combineBy3(uint64_t a)
 
 inline uint64_t splitBy2x3(uint32_t a)
 {
-    uint64_t x = a % 0xFFFFF;
+    uint64_t x = a & 0xFFFFF;
     // x = 00000000000000000000000000000000000000000000BCDEFGHIJKLMNOPQRSTU
     x = (x | x << 32) & 0xf00000000ffff;
     // x = 000000000000BCDE00000000000000000000000000000000FGHIJKLMNOPQRSTU
@@ -68,9 +68,9 @@ inline uint32_t combineBy2x3(uint64_t a)
 namespace MortonCode {
 uint64_t encode(glm::uvec3 index)
 {
-    uint32_t x = splitBy3(index.x);
-    uint32_t y = splitBy3(index.y);
-    uint32_t z = splitBy3(index.z);
+    uint64_t x = splitBy3(index.x);
+    uint64_t y = splitBy3(index.y);
+    uint64_t z = splitBy3(index.z);
 
     return x | y << 2 | z << 1;
 }
@@ -86,11 +86,11 @@ glm::uvec3 decode(uint64_t code)
 
 uint64_t encode2(glm::uvec3 index)
 {
-    uint32_t x = splitBy2x3(index.x);
-    uint32_t y = splitBy2x3(index.y);
-    uint32_t z = splitBy2x3(index.z);
+    uint64_t x = splitBy2x3(index.x);
+    uint64_t y = splitBy2x3(index.y);
+    uint64_t z = splitBy2x3(index.z);
 
-    return x | y << 4 | z << 2;
+    return x | y << 2 | z << 4;
 }
 
 glm::uvec3 decode2(uint64_t code)
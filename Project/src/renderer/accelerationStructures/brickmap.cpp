@@ -18,6 +18,8 @@
 #include "serializers/brickmap.hpp"
 
 #include <algorithm>
+#include <cstring>
+#include <format>
 
 struct PushConstants {
     alignas(16) glm::vec3 cameraPosition;
@@ -34,6 +36,8 @@ struct ModPushConstants {
 BrickmapAS::BrickmapAS() { }
 BrickmapAS::~BrickmapAS()
 {
+    cancelCompaction();
+
     freeDescriptorSet();
     destroyDescriptorLayout();
 
@@ -51,6 +55,8 @@ BrickmapAS::~BrickmapAS()
     ShaderManager::getInstance()->removeModule("AS/brickmap_AS");
     ShaderManager::getInstance()->removeModule("AS/brickmap_AS_req");
     ShaderManager::getInstance()->removeModule("modification/brickmap");
+    ShaderManager::getInstance()->removeMacro("BRICKGRID_TILED");
+    ShaderManager::getInstance()->removeMacro("BRICKGRID_PAGED");
 }
 
 void BrickmapAS::init(ASStructInfo info)
@@ -60,6 +66,7 @@ void BrickmapAS::init(ASStructInfo info)
     createDescriptorLayout();
 
     ShaderManager::getInstance()->removeMacro("GENERATION_FINISHED");
+    ShaderManager::getInstance()->setMacro("BRICK_SIZE", std::format("{}", Generators::BrickSize));
 
     createRenderPipelineLayout();
     ShaderManager::getInstance()->addModule("AS/brickmap_AS",
@@ -86,6 +93,8 @@ void BrickmapAS::fromLoader(std::unique_ptr<Loader>&& loader)
 
     p_GenerationThread.request_stop();
 
+    m_SharedBricks = false;
+    m_BrickgridLayout = Generators::BrickgridLayout::LINEAR;
     p_Generating = true;
     p_GenerationThread
         = std::jthread([this, loader = std::move(loader)](std::stop_token stoken) mutable {
@@ -117,6 +126,25 @@ void BrickmapAS::fromRaw(const std::vector<uint8_t>& rawData)
         std::tie(info, m_Brickgrid, m_Brickmaps, m_Colours, p_AnimationFrames) = data.value();
 
         m_BrickgridSize = info.dimensions;
+        m_BrickgridLayout = static_cast<Generators::BrickgridLayout>(info.layout);
+        m_SharedBricks = Generators::hasSharedBricks(m_Brickgrid, m_Brickmaps.size(),
+            Generators::brickgridPageTableSize(m_BrickgridSize, m_BrickgridLayout));
+
+        // Edits cannot allocate pages on the GPU, so every page an animation touches is made up
+        // front
+        if (m_BrickgridLayout == Generators::BrickgridLayout::PAGED) {
+            const glm::ivec3 voxels(m_BrickgridSize * Generators::BrickSize);
+            for (const auto& frame : p_AnimationFrames) {
+                for (const auto& diff : frame) {
+                    if (glm::any(glm::lessThan(diff.first, glm::ivec3(0)))
+                        || glm::any(glm::greaterThanEqual(diff.first, voxels)))
+                        continue;
+
+                    Generators::allocateBrickgridPage(m_Brickgrid,
+                        glm::uvec3(diff.first) / Generators::BrickSize, m_BrickgridSize);
+                }
+            }
+        }
 
         p_GenerationInfo.voxelCount = info.voxels;
         p_GenerationInfo.nodes = info.nodes;
@@ -153,7 +181,8 @@ void BrickmapAS::render(
     mainRender(cmd, camera, renderSet, imageSize);
 
     if (p_FinishedGeneration) {
-        if (p_Mods.size() != 0) {
+        // Shared bricks are made unique in update before any edit is applied
+        if (p_Mods.size() != 0 && !m_SharedBricks && !m_Compacting) {
             modRender(cmd, camera);
         }
 
@@ -163,7 +192,8 @@ void BrickmapAS::render(
 
 void BrickmapAS::update(float dt)
 {
-    if (p_FinishedGeneration) {
+    // The pools are not resized while a compaction replaces them
+    if (p_FinishedGeneration && !m_Compacting) {
         if (m_MappedFreeBricks[0] > m_FreeBrickCount * 0.875) {
             m_DoubleFreeBricks = true;
         }
@@ -292,15 +322,38 @@ void BrickmapAS::update(float dt)
         }
     }
 
+    updateCompaction(dt);
+
+    if (p_FinishedGeneration && m_SharedBricks && p_Mods.size() != 0) {
+        size_t copies = Generators::uniqueBricks(m_Brickgrid, m_Brickmaps, m_Colours,
+            Generators::brickgridPageTableSize(m_BrickgridSize, m_BrickgridLayout));
+        LOG_INFO("Unshared {} bricks for editing", copies);
+
+        m_SharedBricks = false;
+        m_UpdateBuffers = true;
+    }
+
     if (m_UpdateBuffers) {
         {
             std::lock_guard lock(p_Info.graphicsQueue->getLock());
             vkQueueWaitIdle(p_Info.graphicsQueue->getQueue());
         }
 
+        cancelCompaction();
+
         freeBuffers();
         freeDescriptorSet();
 
+        if (m_BrickgridLayout == Generators::BrickgridLayout::TILED)
+            ShaderManager::getInstance()->defineMacro("BRICKGRID_TILED");
+        else
+            ShaderManager::getInstance()->removeMacro("BRICKGRID_TILED");
+
+        if (m_BrickgridLayout == Generators::BrickgridLayout::PAGED)
+            ShaderManager::getInstance()->defineMacro("BRICKGRID_PAGED");
+        else
+            ShaderManager::getInstance()->removeMacro("BRICKGRID_PAGED");
+
         ShaderManager::getInstance()->defineMacro("GENERATION_FINISHED");
         updateShaders();
 
@@ -322,6 +375,136 @@ void BrickmapAS::update(float dt)
     }
 }
 
+void BrickmapAS::updateCompaction(float dt)
+{
+    if (!p_FinishedGeneration)
+        return;
+
+    if (m_ReadReadback) {
+        {
+            std::lock_guard lock(p_Info.graphicsQueue->getLock());
+            vkQueueWaitIdle(p_Info.graphicsQueue->getQueue());
+        }
+
+        m_CompactBrickgrid.resize(m_ReadbackGrid.getSize() / sizeof(Generators::BrickgridPtr));
+        memcpy(m_CompactBrickgrid.data(), m_ReadbackGrid.mapMemory(), m_ReadbackGrid.getSize());
+
+        m_CompactBrickmaps.resize(m_ReadbackBricks.getSize() / sizeof(Generators::Brickmap));
+        memcpy(m_CompactBrickmaps.data(), m_ReadbackBricks.mapMemory(), m_ReadbackBricks.getSize());
+
+        m_CompactColours.resize(m_ReadbackColours.getSize() / sizeof(Generators::BrickmapColour));
+        memcpy(m_CompactColours.data(), m_ReadbackColours.mapMemory(), m_ReadbackColours.getSize());
+
+        m_ReadbackGrid.unmapMemory();
+        m_ReadbackBricks.unmapMemory();
+        m_ReadbackColours.unmapMemory();
+        m_ReadbackGrid.cleanup();
+        m_ReadbackBricks.cleanup();
+        m_ReadbackColours.cleanup();
+        m_ReadReadback = false;
+
+        const size_t pageTableSize
+            = Generators::brickgridPageTableSize(m_BrickgridSize, m_BrickgridLayout);
+        m_CompactionThread = std::jthread([this, pageTableSize](std::stop_token stoken) {
+            Generators::compactBrickmap(
+                m_CompactBrickgrid, m_CompactBrickmaps, m_CompactColours, pageTableSize);
+            m_Compacted = !stoken.stop_requested();
+        });
+        return;
+    }
+
+    if (m_Compacted) {
+        m_CompactionThread.join();
+
+        {
+            std::lock_guard lock(p_Info.graphicsQueue->getLock());
+            vkQueueWaitIdle(p_Info.graphicsQueue->getQueue());
+        }
+
+        const uint32_t previousBlocks = m_ColourBlockCount;
+
+        m_Brickgrid = std::move(m_CompactBrickgrid);
+        m_Brickmaps = std::move(m_CompactBrickmaps);
+        m_Colours = std::move(m_CompactColours);
+
+        // Every buffer is replaced between frames, the free lists are rebuilt past the live
+        // bricks and colour blocks
+        freeBuffers();
+        freeDescriptorSet();
+        createBuffers();
+        createDescriptorSet();
+
+        LOG_INFO("Compacted colour pool from {} to {} blocks", previousBlocks, m_ColourBlockCount);
+
+        m_Compacted = false;
+        m_Compacting = false;
+        m_IdleTime = 0.f;
+        return;
+    }
+
+    if (m_Compacting)
+        return;
+
+    m_IdleTime = p_Mods.empty() ? m_IdleTime + dt : 0.f;
+
+    const bool resizing = m_DoubleFreeBricks || m_DoubleBricks || m_DoubleFreeColours
+        || m_IncreaseColour || m_ReallocFreeBricks || m_ReallocBricks || m_ReallocFreeColours
+        || m_ReallocColour;
+
+    // Edits only ever grow the colour pool and its free list
+    const bool grown = m_ColourBlockCount > m_CompactedColourBlocks
+        || m_FreeColourCount > m_ColourBlockIncrease * 2;
+
+    if (grown && !resizing && !m_SharedBricks && m_IdleTime > m_CompactionDelay) {
+        m_Compacting = true;
+        m_StartReadback = true;
+    }
+}
+
+void BrickmapAS::readbackPools(VkCommandBuffer cmd)
+{
+    // Edits of earlier frames write the pools from compute shaders
+    VkMemoryBarrier barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+    };
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    auto readback = [&](Buffer& target, Buffer& source, const char* name) {
+        target.init(p_Info.device, p_Info.allocator, source.getSize(),
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+            VMA_MEMORY_USAGE_AUTO);
+        target.setDebugName(name);
+        target.copyFromBuffer(cmd, source, source.getSize(), 0, 0);
+    };
+
+    readback(m_ReadbackGrid, m_BrickgridBuffer, "Brickgrid readback");
+    readback(m_ReadbackBricks, m_BrickmapsBuffer, "Brickmap readback");
+    readback(m_ReadbackColours, m_ColourBuffer, "Colour readback");
+}
+
+void BrickmapAS::cancelCompaction()
+{
+    m_CompactionThread.request_stop();
+    if (m_CompactionThread.joinable())
+        m_CompactionThread.join();
+
+    if (m_ReadReadback) {
+        m_ReadbackGrid.cleanup();
+        m_ReadbackBricks.cleanup();
+        m_ReadbackColours.cleanup();
+    }
+
+    m_Compacting = false;
+    m_StartReadback = false;
+    m_ReadReadback = false;
+    m_Compacted = false;
+    m_IdleTime = 0.f;
+}
+
 void BrickmapAS::updateShaders()
 {
     ShaderManager::getInstance()->moduleUpdated("AS/brickmap_AS");
@@ -331,6 +514,12 @@ void BrickmapAS::updateShaders()
 void BrickmapAS::mainRender(
     VkCommandBuffer cmd, Camera camera, VkDescriptorSet renderSet, VkExtent2D imageSize)
 {
+    if (m_StartReadback) {
+        readbackPools(cmd);
+        m_StartReadback = false;
+        m_ReadReadback = true;
+    }
+
     if (m_DoubleFreeBricks) {
         resizeFree(cmd);
         m_DoubleFreeBricks = false;
@@ -523,16 +712,17 @@ void BrickmapAS::createBuffers()
 
 void BrickmapAS::createBrickgridBuffers()
 {
-    VkDeviceSize gridSize = m_BrickgridSize.x * m_BrickgridSize.y * m_BrickgridSize.z
-        * sizeof(Generators::BrickgridPtr);
+    // Paged grids also hold their allocated pages
+    VkDeviceSize gridSize = m_Brickgrid.size() * sizeof(Generators::BrickgridPtr);
     m_BrickgridBuffer.init(p_Info.device, p_Info.allocator, gridSize,
-        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0,
-        VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+            | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        0, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
     m_BrickgridBuffer.setDebugName("Brickgrid Buffer");
 
     m_BrickmapCount = std::max(std::pow(2, std::ceil(std::log2(m_Brickmaps.size()))), 64.);
 
-    VkDeviceSize brickmapSize = m_BrickmapCount * (sizeof(uint64_t) * 9);
+    VkDeviceSize brickmapSize = m_BrickmapCount * sizeof(Generators::Brickmap);
     m_BrickmapsBuffer.init(p_Info.device, p_Info.allocator, brickmapSize,
         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
             | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
@@ -540,13 +730,15 @@ void BrickmapAS::createBrickgridBuffers()
     m_BrickmapsBuffer.setDebugName("Brickmap Buffer");
 
     m_FreeColourCount = m_ColourBlockIncrease * 2;
-    m_ColourBlockCount = (m_Colours.size() / 512) + m_FreeColourCount;
-    VkDeviceSize colourSize = m_ColourBlockCount * 512 * sizeof(Generators::BrickmapColour);
+    m_ColourBlockCount = (m_Colours.size() / Generators::Brickmap::Voxels) + m_FreeColourCount;
+    VkDeviceSize colourSize
+        = m_ColourBlockCount * Generators::Brickmap::Voxels * sizeof(Generators::BrickmapColour);
     m_ColourBuffer.init(p_Info.device, p_Info.allocator, colourSize,
         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
             | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
         0, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
     m_ColourBuffer.setDebugName("Colour Buffer");
+    m_CompactedColourBlocks = m_ColourBlockCount;
 
     auto gridBufferIndex
         = FrameCommands::getInstance()->createStaging(gridSize, [=, this](void* ptr) {
@@ -569,10 +761,11 @@ void BrickmapAS::createBrickgridBuffers()
     auto mapBufferIndex
         = FrameCommands::getInstance()->createStaging(brickmapSize, [=, this](void* ptr) {
               uint64_t* data = (uint64_t*)ptr;
-              const uint64_t nodeSize = 9; // Number of uint64_t
+              const uint64_t nodeSize = 1 + Generators::Brickmap::Words; // Number of uint64_t
               for (size_t i = 0; i < m_Brickmaps.size(); i++) {
                   *(data + i * nodeSize) = m_Brickmaps[i].colourPtr;
-                  memcpy(data + i * nodeSize + 1, m_Brickmaps[i].occupancy, sizeof(uint64_t) * 8);
+                  memcpy(data + i * nodeSize + 1, m_Brickmaps[i].occupancy,
+                      sizeof(m_Brickmaps[i].occupancy));
               }
           });
 
@@ -589,7 +782,7 @@ void BrickmapAS::createBrickgridBuffers()
     auto colourBufferIndex
         = FrameCommands::getInstance()->createStaging(colourSize, [=, this](void* ptr) {
               uint8_t* data = (uint8_t*)ptr;
-              memset(ptr, 0, m_ColourBlockCount * 512 * sizeof(Generators::BrickmapColour));
+              memset(ptr, 0, colourSize);
               for (size_t i = 0; i < m_Colours.size(); i++) {
                   const auto& colour = m_Colours[i];
                   data[i * 4 + 0] = colour.data;
@@ -667,11 +860,10 @@ void BrickmapAS::createHelperBuffers()
 
               memset(ptr, 0, sizeof(uint32_t) * (m_FreeColourCount + 1));
 
-              uint32_t diff = m_ColourBlockCount - (m_Colours.size() / 512);
+              uint32_t start = m_Colours.size() / Generators::Brickmap::Voxels;
+              uint32_t diff = m_ColourBlockCount - start;
               data[0] = diff;
 
-              uint32_t start = m_Colours.size() / 512;
-
               for (size_t i = 0; i < diff; i++) {
                   data[i + 1] = (start + i) + 1;
               }
@@ -727,7 +919,8 @@ void BrickmapAS::resizeFree(VkCommandBuffer cmd)
 void BrickmapAS::resizeBricks(VkCommandBuffer cmd)
 {
     m_BrickmapCount *= 2;
-    m_TempBuffer.init(p_Info.device, p_Info.allocator, m_BrickmapCount * sizeof(uint64_t) * 9,
+    m_TempBuffer.init(p_Info.device, p_Info.allocator,
+        m_BrickmapCount * sizeof(Generators::Brickmap),
         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
             | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
         0, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
@@ -739,7 +932,7 @@ void BrickmapAS::resizeColour(VkCommandBuffer cmd)
 {
     m_ColourBlockCount += m_ColourBlockIncrease;
     m_TempBuffer.init(p_Info.device, p_Info.allocator,
-        m_ColourBlockCount * sizeof(Generators::BrickmapColour) * 512,
+        m_ColourBlockCount * sizeof(Generators::BrickmapColour) * Generators::Brickmap::Voxels,
         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
             | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
         0, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
@@ -7,6 +7,8 @@
 #include "../buffer.hpp"
 #include "generators/brickmap.hpp"
 
+#include <atomic>
+#include <thread>
 #include <vector>
 
 class BrickmapAS : public IAccelerationStructure {
@@ -32,7 +34,7 @@ class BrickmapAS : public IAccelerationStructure {
         return m_BrickgridBuffer.getSize() + m_BrickmapsBuffer.getSize() + m_ColourBuffer.getSize();
     }
 
-    glm::uvec3 getDimensions() override { return m_BrickgridSize * 8u; }
+    glm::uvec3 getDimensions() override { return m_BrickgridSize * Generators::BrickSize; }
 
     bool canAnimate() override { return true; }
 
@@ -57,6 +59,12 @@ class BrickmapAS : public IAccelerationStructure {
     void resizeColour(VkCommandBuffer cmd);
     void resizeFreeColour(VkCommandBuffer cmd);
 
+    // Reads back the pools once edits have been idle for a while after the colour pool grew,
+    // repacks them on another thread and swaps the compacted pools in between frames
+    void updateCompaction(float dt);
+    void readbackPools(VkCommandBuffer cmd);
+    void cancelCompaction();
+
     void createDescriptorSet();
     void freeDescriptorSet();
 
@@ -113,12 +121,14 @@ class BrickmapAS : public IAccelerationStructure {
     uint32_t* m_MappedFreeColours = nullptr;
 
     glm::uvec3 m_BrickgridSize;
+    Generators::BrickgridLayout m_BrickgridLayout = Generators::BrickgridLayout::LINEAR;
 
     std::vector<Generators::BrickgridPtr> m_Brickgrid;
     std::vector<Generators::Brickmap> m_Brickmaps;
     std::vector<Generators::BrickmapColour> m_Colours;
 
     bool m_UpdateBuffers = false;
+    bool m_SharedBricks = false;
 
     bool m_DoubleFreeBricks = false;
     bool m_DoubleFreeColours = false;
@@ -131,4 +141,26 @@ class BrickmapAS : public IAccelerationStructure {
     bool m_ReallocFreeColours = false;
     bool m_ReallocBricks = false;
     bool m_ReallocColour = false;
+
+    // Edits are held back from the readback until the compacted pools are swapped in, so none
+    // are lost
+    const float m_CompactionDelay = 2.f;
+    float m_IdleTime = 0.f;
+    uint32_t m_CompactedColourBlocks = 0;
+
+    bool m_Compacting = false;
+    bool m_StartReadback = false;
+    bool m_ReadReadback = false;
+    std::atomic<bool> m_Compacted = false;
+
+    Buffer m_ReadbackGrid;
+    Buffer m_ReadbackBricks;
+    Buffer m_ReadbackColours;
+
+    std::vector<Generators::BrickgridPtr> m_CompactBrickgrid;
+    std::vector<Generators::Brickmap> m_CompactBrickmaps;
+    std::vector<Generators::BrickmapColour> m_CompactColours;
+
+    // Last so it is joined before the members it writes are destroyed
+    std::jthread m_CompactionThread;
 };
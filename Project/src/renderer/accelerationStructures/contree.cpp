@@ -1,10 +1,13 @@
 #include "contree.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include <deque>
 #include <memory>
 
 #include <vulkan/vulkan_core.h>
 
+#include "logger/logger.hpp"
 #include "serializers/contree.hpp"
 
 #include <glm/ext/matrix_transform.hpp>
@@ -41,6 +44,8 @@ ContreeAS::~ContreeAS()
     destroyRenderPipelineLayout();
 
     ShaderManager::getInstance()->removeModule("AS/contree_AS");
+
+    ShaderManager::getInstance()->removeMacro("CONTREE_COMPACT");
 }
 
 void ContreeAS::init(ASStructInfo info)
@@ -68,6 +73,8 @@ void ContreeAS::fromLoader(std::unique_ptr<Loader>&& loader)
 
     p_GenerationThread.request_stop();
 
+    m_Format = Generators::ContreeFormat::WIDE;
+
     p_Generating = true;
     p_GenerationThread
         = std::jthread([this, loader = std::move(loader)](std::stop_token stoken) mutable {
@@ -99,6 +106,7 @@ void ContreeAS::fromRaw(const std::vector<uint8_t>& rawData)
         std::tie(info, m_Nodes) = data.value();
 
         m_Dimensions = info.dimensions;
+        m_Format = static_cast<Generators::ContreeFormat>(info.format);
 
         p_GenerationInfo.voxelCount = info.voxels;
         p_GenerationInfo.nodes = info.nodes;
@@ -122,10 +130,51 @@ void ContreeAS::fromFile(std::filesystem::path path)
     p_FileThread = std::jthread([this, path](std::stop_token stoken) {
         p_Loading = true;
 
-        std::ifstream inputStream = Serializers::loadContreeFile(path);
-        std::vector<uint8_t> data = Serializers::vectorFromStream(inputStream);
+        p_RawThread.request_stop();
+
+        reset();
 
-        fromRaw(data);
+        // Progressive files are streamed so the coarse levels are drawn while the rest is read
+        std::ifstream inputStream = Serializers::loadContreeFile(path);
+        bool loaded = Serializers::loadContree(
+            inputStream,
+            [&](Serializers::SerialInfo info, std::vector<Generators::ContreeNode> nodes) {
+                if (stoken.stop_requested())
+                    return false;
+
+                std::lock_guard lock(m_LevelLock);
+                m_PendingLevels = {};
+                m_LevelBlocks = {};
+                m_Provisional = {};
+                m_RemainingLevels = info.levels;
+
+                m_Dimensions = info.dimensions;
+                m_Format = static_cast<Generators::ContreeFormat>(info.format);
+
+                p_GenerationInfo.voxelCount = info.voxels;
+                p_GenerationInfo.nodes = info.nodes;
+                p_GenerationInfo.generationTime = 0;
+                p_GenerationInfo.completionPercent = 1;
+
+                m_Nodes = std::move(nodes);
+
+                if (info.levels == 0) {
+                    m_UpdateBuffers = true;
+                    p_Loading = false;
+                }
+                return true;
+            },
+            [&](std::vector<Generators::ContreeNode> nodes) {
+                if (stoken.stop_requested())
+                    return false;
+
+                std::lock_guard lock(m_LevelLock);
+                m_PendingLevels.push_back(std::move(nodes));
+                return true;
+            });
+
+        if (!loaded)
+            p_Loading = false;
     });
 }
 
@@ -170,6 +219,16 @@ void ContreeAS::render(
 
 void ContreeAS::update(float dt)
 {
+    {
+        std::lock_guard lock(m_LevelLock);
+        if (!m_PendingLevels.empty() && m_RemainingLevels > 0) {
+            std::vector<Generators::ContreeNode> nodes = std::move(m_PendingLevels.front());
+            m_PendingLevels.pop_front();
+
+            appendLevel(std::move(nodes));
+        }
+    }
+
     if (m_UpdateBuffers) {
         {
             std::lock_guard lock(p_Info.graphicsQueue->getLock());
@@ -179,6 +238,21 @@ void ContreeAS::update(float dt)
         freeDescriptorSet();
         destroyBuffers();
 
+        if (m_Format == Generators::ContreeFormat::COMPACT && !m_Provisional.empty()) {
+            std::vector<Generators::ContreeNode> nodes = m_Nodes;
+            for (const auto& [index, leaf] : m_Provisional)
+                nodes[index] = leaf;
+
+            m_Compact = Generators::compactContree(nodes);
+            ShaderManager::getInstance()->defineMacro("CONTREE_COMPACT");
+        } else if (m_Format == Generators::ContreeFormat::COMPACT) {
+            m_Compact = Generators::compactContree(m_Nodes);
+            ShaderManager::getInstance()->defineMacro("CONTREE_COMPACT");
+        } else {
+            m_Compact = {};
+            ShaderManager::getInstance()->removeMacro("CONTREE_COMPACT");
+        }
+
         ShaderManager::getInstance()->defineMacro("GENERATION_FINISHED");
         updateShaders();
 
@@ -190,12 +264,52 @@ void ContreeAS::update(float dt)
     }
 }
 
+void ContreeAS::appendLevel(std::vector<Generators::ContreeNode>&& nodes)
+{
+    std::vector<Generators::ContreeBlock> blocks = m_Nodes.empty()
+        ? std::vector<Generators::ContreeBlock> { { 0, 1 } }
+        : Generators::contreeChildBlocks(m_Nodes, m_LevelBlocks);
+
+    m_Nodes.insert(m_Nodes.end(), nodes.begin(), nodes.end());
+    m_RemainingLevels--;
+
+    m_Provisional = {};
+    for (auto [start, count] : blocks) {
+        if (start + count > m_Nodes.size()) {
+            LOG_ERROR("Contree level is missing node {}\n", m_Nodes.size());
+            m_PendingLevels = {};
+            m_RemainingLevels = 0;
+            p_Loading = false;
+            return;
+        }
+
+        for (uint32_t i = 0; i < count && m_RemainingLevels > 0; i++) {
+            const std::array<uint64_t, 2> data = m_Nodes[start + i].getData();
+            bool solid = ((data[0] >> 56) & 0x1) != 0;
+            if (solid || data[1] == 0)
+                continue;
+
+            // Interior nodes of a progressive file hold the average colour below them
+            auto channel = [&](uint32_t shift) { return ((data[0] >> shift) & 0xFF) / 255.f; };
+            m_Provisional.push_back(
+                { start + i, Generators::ContreeNode(channel(48), channel(40), channel(32)) });
+        }
+    }
+
+    m_LevelBlocks = std::move(blocks);
+    m_UpdateBuffers = true;
+    if (m_RemainingLevels == 0)
+        p_Loading = false;
+}
+
 void ContreeAS::updateShaders() { ShaderManager::getInstance()->moduleUpdated("AS/contree_AS"); }
 
 void ContreeAS::createDescriptorLayout()
 {
     m_BufferSetLayout = DescriptorLayoutGenerator::start(p_Info.device)
                             .addStorageBufferBinding(VK_SHADER_STAGE_COMPUTE_BIT, 0)
+                            .addStorageBufferBinding(VK_SHADER_STAGE_COMPUTE_BIT, 1)
+                            .addStorageBufferBinding(VK_SHADER_STAGE_COMPUTE_BIT, 2)
                             .setDebugName("Contree buffer set layout")
                             .build();
 }
@@ -207,19 +321,35 @@ void ContreeAS::destroyDescriptorLayout()
 
 void ContreeAS::createBuffers()
 {
-    VkDeviceSize size = sizeof(uint64_t) * 2 * m_Nodes.size();
+    const bool compact = m_Format == Generators::ContreeFormat::COMPACT;
+
+    VkDeviceSize size = compact ? sizeof(Generators::CompactContreeNode) * m_Compact.nodes.size()
+                                : sizeof(uint64_t) * 2 * m_Nodes.size();
     m_ContreeBuffer.init(p_Info.device, p_Info.allocator, size,
         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0,
         VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
     m_ContreeBuffer.setDebugName("Contree node buffer");
 
+    // Copied so a level appended before the staging buffer is filled does not change it
+    const size_t nodeCount = m_Nodes.size();
+    auto provisional = m_Provisional;
     auto bufferIndex = FrameCommands::getInstance()->createStaging(size, [=, this](void* ptr) {
+        if (compact) {
+            memcpy(ptr, m_Compact.nodes.data(), size);
+            return;
+        }
+
         uint64_t* data = (uint64_t*)ptr;
-        for (size_t i = 0; i < m_Nodes.size(); i++) {
+        for (size_t i = 0; i < nodeCount; i++) {
             const auto& node = m_Nodes[i].getData();
             data[i * 2] = node[0];
             data[i * 2 + 1] = node[1];
         }
+        for (const auto& [index, leaf] : provisional) {
+            const auto& node = leaf.getData();
+            data[index * 2] = node[0];
+            data[index * 2 + 1] = node[1];
+        }
     });
 
     FrameCommands::getInstance()->stagingEval(
@@ -231,15 +361,70 @@ void ContreeAS::createBuffers()
             };
             vkCmdCopyBuffer(cmd, buffer.buffer, m_ContreeBuffer.getBuffer(), 1, &region);
         });
+
+    // Always bound, hold a single unused entry outside of the compact format
+    VkDeviceSize offsetSize = sizeof(Generators::CompactContreeOffset)
+        * std::max<size_t>(m_Compact.offsets.size(), 1);
+    VkDeviceSize colourSize = sizeof(uint32_t) * std::max<size_t>(m_Compact.colours.size(), 1);
+
+    m_OffsetBuffer.init(p_Info.device, p_Info.allocator, offsetSize,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0,
+        VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+    m_OffsetBuffer.setDebugName("Contree offset buffer");
+
+    m_ColourBuffer.init(p_Info.device, p_Info.allocator, colourSize,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0,
+        VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+    m_ColourBuffer.setDebugName("Contree colour buffer");
+
+    auto offsetIndex
+        = FrameCommands::getInstance()->createStaging(offsetSize, [=, this](void* ptr) {
+              memset(ptr, 0, offsetSize);
+              memcpy(ptr, m_Compact.offsets.data(),
+                  sizeof(Generators::CompactContreeOffset) * m_Compact.offsets.size());
+          });
+
+    FrameCommands::getInstance()->stagingEval(
+        offsetIndex, [=, this](VkCommandBuffer cmd, FrameCommands::StagingBuffer buffer) {
+            VkBufferCopy region {
+                .srcOffset = buffer.offset,
+                .dstOffset = 0,
+                .size = offsetSize,
+            };
+            vkCmdCopyBuffer(cmd, buffer.buffer, m_OffsetBuffer.getBuffer(), 1, &region);
+        });
+
+    auto colourIndex
+        = FrameCommands::getInstance()->createStaging(colourSize, [=, this](void* ptr) {
+              memset(ptr, 0, colourSize);
+              memcpy(ptr, m_Compact.colours.data(), sizeof(uint32_t) * m_Compact.colours.size());
+          });
+
+    FrameCommands::getInstance()->stagingEval(
+        colourIndex, [=, this](VkCommandBuffer cmd, FrameCommands::StagingBuffer buffer) {
+            VkBufferCopy region {
+                .srcOffset = buffer.offset,
+                .dstOffset = 0,
+                .size = colourSize,
+            };
+            vkCmdCopyBuffer(cmd, buffer.buffer, m_ColourBuffer.getBuffer(), 1, &region);
+        });
 }
 
-void ContreeAS::destroyBuffers() { m_ContreeBuffer.cleanup(); }
+void ContreeAS::destroyBuffers()
+{
+    m_ColourBuffer.cleanup();
+    m_OffsetBuffer.cleanup();
+    m_ContreeBuffer.cleanup();
+}
 
 void ContreeAS::createDescriptorSet()
 {
     m_BufferSet
         = DescriptorSetGenerator::start(p_Info.device, p_Info.descriptorPool, m_BufferSetLayout)
               .addBufferDescriptor(0, m_ContreeBuffer)
+              .addBufferDescriptor(1, m_OffsetBuffer)
+              .addBufferDescriptor(2, m_ColourBuffer)
               .setDebugName("Contree buffer set")
               .build();
 }
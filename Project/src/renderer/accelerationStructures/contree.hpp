@@ -5,6 +5,9 @@
 #include "../buffer.hpp"
 #include <vulkan/vulkan_core.h>
 
+#include <deque>
+#include <mutex>
+
 #include "generators/contree.hpp"
 
 class ContreeAS : public IAccelerationStructure {
@@ -24,7 +27,10 @@ class ContreeAS : public IAccelerationStructure {
 
     void updateShaders() override;
 
-    uint64_t getMemoryUsage() override { return m_ContreeBuffer.getSize(); }
+    uint64_t getMemoryUsage() override
+    {
+        return m_ContreeBuffer.getSize() + m_OffsetBuffer.getSize() + m_ColourBuffer.getSize();
+    }
 
     glm::uvec3 getDimensions() override { return m_Dimensions; }
 
@@ -32,6 +38,10 @@ class ContreeAS : public IAccelerationStructure {
     void createDescriptorLayout();
     void destroyDescriptorLayout();
 
+    // Appends the next level of a progressive file, its interior nodes are drawn as leaves of
+    // their average colour until the level below them is appended
+    void appendLevel(std::vector<Generators::ContreeNode>&& nodes);
+
     void createBuffers();
     void destroyBuffers();
 
@@ -55,7 +65,22 @@ class ContreeAS : public IAccelerationStructure {
 
     std::vector<Generators::ContreeNode> m_Nodes;
 
+    Generators::ContreeFormat m_Format = Generators::ContreeFormat::WIDE;
+    Generators::CompactContree m_Compact;
+
+    // Levels of a progressive file read but not yet uploaded, one is appended per frame
+    std::mutex m_LevelLock;
+    std::deque<std::vector<Generators::ContreeNode>> m_PendingLevels;
+    uint32_t m_RemainingLevels = 0;
+    // Blocks of the last appended level
+    std::vector<Generators::ContreeBlock> m_LevelBlocks;
+    // Node index and the provisional leaf uploaded in its place
+    std::vector<std::pair<uint64_t, Generators::ContreeNode>> m_Provisional;
+
+    // Wide nodes, or compact masks along with the offset and colour buffers
     Buffer m_ContreeBuffer;
+    Buffer m_OffsetBuffer;
+    Buffer m_ColourBuffer;
 
     bool m_UpdateBuffers = false;
 };
@@ -1,5 +1,6 @@
 #include "grid.hpp"
 
+#include <format>
 #include <stop_token>
 #include <vector>
 
@@ -55,6 +56,9 @@ GridAS::~GridAS()
 
     ShaderManager::getInstance()->removeModule("AS/grid_AS");
     ShaderManager::getInstance()->removeModule("modification/grid");
+
+    ShaderManager::getInstance()->removeMacro("GRID_PALETTE");
+    ShaderManager::getInstance()->removeMacro("GRID_DISTANCE");
 }
 
 void GridAS::init(ASStructInfo info)
@@ -89,6 +93,9 @@ void GridAS::fromLoader(std::unique_ptr<Loader>&& loader)
 
     p_GenerationThread.request_stop();
 
+    m_UsePalette = false;
+    m_Distances.clear();
+
     p_Generating = true;
     p_GenerationThread
         = std::jthread([this, loader = std::move(loader)](std::stop_token stoken) mutable {
@@ -117,9 +124,10 @@ void GridAS::fromRaw(const std::vector<uint8_t>& rawData)
             return;
         }
 
-        std::tie(info, m_Voxels, p_AnimationFrames) = data.value();
+        std::tie(info, m_Voxels, p_AnimationFrames, m_Distances) = data.value();
 
         m_Dimensions = info.dimensions;
+        m_UsePalette = info.paletteColours != 0;
 
         p_GenerationInfo.voxelCount = info.voxels;
         p_GenerationInfo.nodes = info.nodes;
@@ -240,7 +248,10 @@ void GridAS::render(
             .size = VK_WHOLE_SIZE,
         };
 
-        std::vector<VkBufferMemoryBarrier> barriers = { occupancyMB, colourMB };
+        VkBufferMemoryBarrier distanceMB = colourMB;
+        distanceMB.buffer = m_DistanceBuffer.getBuffer();
+
+        std::vector<VkBufferMemoryBarrier> barriers = { occupancyMB, colourMB, distanceMB };
 
         vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, barriers.size(), barriers.data(),
@@ -265,6 +276,21 @@ void GridAS::update(float dt)
         freeBuffers();
         freeDescriptorSets();
 
+        createPalette();
+        if (m_UsePalette) {
+            ShaderManager::getInstance()->defineMacro("GRID_PALETTE");
+            ShaderManager::getInstance()->setMacro(
+                "PALETTE_BITS", std::format("{}", m_PaletteBits));
+        } else {
+            ShaderManager::getInstance()->removeMacro("GRID_PALETTE");
+        }
+
+        if (!m_Distances.empty()) {
+            ShaderManager::getInstance()->defineMacro("GRID_DISTANCE");
+        } else {
+            ShaderManager::getInstance()->removeMacro("GRID_DISTANCE");
+        }
+
         ShaderManager::getInstance()->defineMacro("GENERATION_FINISHED");
         updateShaders();
 
@@ -296,6 +322,8 @@ void GridAS::createDescriptorLayouts()
     m_BufferSetLayout = DescriptorLayoutGenerator::start(p_Info.device)
                             .addStorageBufferBinding(VK_SHADER_STAGE_COMPUTE_BIT, 0)
                             .addStorageBufferBinding(VK_SHADER_STAGE_COMPUTE_BIT, 1)
+                            .addStorageBufferBinding(VK_SHADER_STAGE_COMPUTE_BIT, 2)
+                            .addStorageBufferBinding(VK_SHADER_STAGE_COMPUTE_BIT, 3)
                             .setDebugName("Grid descriptor set layout")
                             .build();
 }
@@ -305,11 +333,49 @@ void GridAS::destroyDescriptorLayouts()
     vkDestroyDescriptorSetLayout(p_Info.device, m_BufferSetLayout, nullptr);
 }
 
+void GridAS::createPalette()
+{
+    m_Palette = {};
+    m_PaletteBits = 8;
+
+    if (!m_UsePalette)
+        return;
+
+    std::vector<glm::u8vec3> colours;
+    for (const auto& voxel : m_Voxels) {
+        if (voxel.visible)
+            colours.push_back(voxel.colour);
+    }
+
+    m_Palette = Generators::buildPalette(colours);
+    m_PaletteBits = Generators::paletteBits(m_Palette.colours.size());
+}
+
 void GridAS::createBuffer()
 {
     VkDeviceSize occupancyBufferSize
         = std::ceil(m_Voxels.size() / 32.) * sizeof(uint32_t); // Convert to bytes
+
+    std::vector<uint32_t> indices;
+    if (m_UsePalette) {
+        indices.reserve(m_Voxels.size());
+        for (const auto& voxel : m_Voxels) {
+            uint32_t index = voxel.visible ? Generators::paletteIndex(m_Palette, voxel.colour) : 0;
+            indices.push_back(index);
+        }
+        indices = Generators::packIndices(indices, m_PaletteBits);
+    }
+
     VkDeviceSize colourBufferSize = sizeof(uint32_t) * m_Voxels.size();
+    if (m_UsePalette)
+        colourBufferSize = sizeof(uint32_t) * std::max<size_t>(indices.size(), 1);
+
+    // Always bound, holds a single unused entry outside of palette mode
+    VkDeviceSize paletteBufferSize
+        = sizeof(uint32_t) * std::max<size_t>(m_Palette.colours.size(), 1);
+
+    // Valid flag followed by four distances per word, only the flag without a distance field
+    VkDeviceSize distanceBufferSize = sizeof(uint32_t) * (1 + (m_Distances.size() + 3) / 4);
 
     m_OccupancyBuffer.init(p_Info.device, p_Info.allocator, occupancyBufferSize,
         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0,
@@ -321,6 +387,16 @@ void GridAS::createBuffer()
         VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
     m_ColourBuffer.setDebugName("Grid colour buffer");
 
+    m_PaletteBuffer.init(p_Info.device, p_Info.allocator, paletteBufferSize,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0,
+        VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+    m_PaletteBuffer.setDebugName("Grid palette buffer");
+
+    m_DistanceBuffer.init(p_Info.device, p_Info.allocator, distanceBufferSize,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0,
+        VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+    m_DistanceBuffer.setDebugName("Grid distance buffer");
+
     auto occupancyIndex
         = FrameCommands::getInstance()->createStaging(occupancyBufferSize, [=, this](void* ptr) {
               uint32_t* dataOccupancy = (uint32_t*)ptr;
@@ -353,6 +429,11 @@ void GridAS::createBuffer()
     auto colourIndex
         = FrameCommands::getInstance()->createStaging(colourBufferSize, [=, this](void* ptr) {
               uint32_t* data = (uint32_t*)ptr;
+              if (m_UsePalette) {
+                  memcpy(data, indices.data(), sizeof(uint32_t) * indices.size());
+                  return;
+              }
+
               for (size_t i = 0; i < m_Voxels.size(); i++) {
                   uint32_t colour = 0;
                   colour |= (uint32_t)(m_Voxels.at(i).colour.r) << 16;
@@ -373,6 +454,45 @@ void GridAS::createBuffer()
             vkCmdCopyBuffer(cmd, buffer.buffer, m_ColourBuffer.getBuffer(), 1, &region);
         });
 
+    auto paletteIndex
+        = FrameCommands::getInstance()->createStaging(paletteBufferSize, [=, this](void* ptr) {
+              uint32_t* data = (uint32_t*)ptr;
+              data[0] = 0;
+              for (size_t i = 0; i < m_Palette.colours.size(); i++) {
+                  data[i] = Generators::packColour(m_Palette.colours[i]);
+              }
+          });
+
+    FrameCommands::getInstance()->stagingEval(
+        paletteIndex, [=, this](VkCommandBuffer cmd, FrameCommands::StagingBuffer buffer) {
+            VkBufferCopy region {
+                .srcOffset = buffer.offset,
+                .dstOffset = 0,
+                .size = paletteBufferSize,
+            };
+
+            vkCmdCopyBuffer(cmd, buffer.buffer, m_PaletteBuffer.getBuffer(), 1, &region);
+        });
+
+    auto distanceIndex
+        = FrameCommands::getInstance()->createStaging(distanceBufferSize, [=, this](void* ptr) {
+              uint32_t* data = (uint32_t*)ptr;
+              memset(data, 0, distanceBufferSize);
+              data[0] = m_Distances.empty() ? 0 : 1;
+              memcpy(data + 1, m_Distances.data(), m_Distances.size());
+          });
+
+    FrameCommands::getInstance()->stagingEval(
+        distanceIndex, [=, this](VkCommandBuffer cmd, FrameCommands::StagingBuffer buffer) {
+            VkBufferCopy region {
+                .srcOffset = buffer.offset,
+                .dstOffset = 0,
+                .size = distanceBufferSize,
+            };
+
+            vkCmdCopyBuffer(cmd, buffer.buffer, m_DistanceBuffer.getBuffer(), 1, &region);
+        });
+
     m_ModBuffer.init(p_Info.device, p_Info.allocator, sizeof(ModInfo) * 1,
         VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
         VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT, VMA_MEMORY_USAGE_AUTO);
@@ -382,6 +502,8 @@ void GridAS::freeBuffers()
 {
     m_ModBuffer.cleanup();
 
+    m_DistanceBuffer.cleanup();
+    m_PaletteBuffer.cleanup();
     m_ColourBuffer.cleanup();
     m_OccupancyBuffer.cleanup();
 }
@@ -392,6 +514,8 @@ void GridAS::createDescriptorSets()
         = DescriptorSetGenerator::start(p_Info.device, p_Info.descriptorPool, m_BufferSetLayout)
               .addBufferDescriptor(0, m_OccupancyBuffer)
               .addBufferDescriptor(1, m_ColourBuffer)
+              .addBufferDescriptor(2, m_PaletteBuffer)
+              .addBufferDescriptor(3, m_DistanceBuffer)
               .setDebugName("Grid descriptor set")
               .build();
 }
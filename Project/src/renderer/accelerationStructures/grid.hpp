@@ -4,6 +4,7 @@
 #include <vulkan/vulkan_core.h>
 
 #include "generators/grid.hpp"
+#include "generators/palette.hpp"
 
 #include "../buffer.hpp"
 #include "glm/fwd.hpp"
@@ -29,7 +30,8 @@ class GridAS : public IAccelerationStructure {
 
     uint64_t getMemoryUsage() override
     {
-        return m_OccupancyBuffer.getSize() + m_ColourBuffer.getSize();
+        return m_OccupancyBuffer.getSize() + m_ColourBuffer.getSize() + m_PaletteBuffer.getSize()
+            + m_DistanceBuffer.getSize();
     }
 
     glm::uvec3 getDimensions() override { return m_Dimensions; }
@@ -40,6 +42,8 @@ class GridAS : public IAccelerationStructure {
     void createDescriptorLayouts();
     void destroyDescriptorLayouts();
 
+    void createPalette();
+
     void createBuffer();
     void freeBuffers();
 
@@ -65,6 +69,19 @@ class GridAS : public IAccelerationStructure {
     Buffer m_OccupancyBuffer;
     Buffer m_ColourBuffer;
 
+    // Set when the loaded file stored palette colours, the colour buffer then holds packed
+    // indices into m_PaletteBuffer
+    bool m_UsePalette = false;
+    Generators::Palette m_Palette;
+    uint32_t m_PaletteBits = 8;
+    Buffer m_PaletteBuffer;
+
+    // Distance field from the loaded file, empty when it has none. The buffer starts with a
+    // valid flag cleared by the modification shader once a voxel is placed, as placed voxels
+    // would otherwise be skipped over.
+    std::vector<uint8_t> m_Distances;
+    Buffer m_DistanceBuffer;
+
     Buffer m_ModBuffer;
 
     VkDescriptorSetLayout m_BufferSetLayout;
@@ -0,0 +1,346 @@
+#include "hybrid.hpp"
+
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <stop_token>
+#include <unistd.h>
+#include <variant>
+#include <vulkan/vulkan_core.h>
+
+#include "serializers/hybrid.hpp"
+
+#include "glm/ext/matrix_transform.hpp"
+#include "glm/integer.hpp"
+#include "glm/matrix.hpp"
+#include <glm/glm.hpp>
+#include <glm/gtx/matrix_operation.hpp>
+
+#include "../compute_pipeline.hpp"
+#include "../debug_utils.hpp"
+#include "../descriptor_layout.hpp"
+#include "../descriptor_set.hpp"
+#include "../frame_commands.hpp"
+#include "../pipeline_layout.hpp"
+#include "../shader_manager.hpp"
+#include "acceleration_structure.hpp"
+
+struct PushConstants {
+    alignas(16) glm::vec3 cameraPosition;
+    alignas(16) glm::mat4 hybridWorld;
+    alignas(16) glm::mat4 hybridWorldInverse;
+    alignas(16) glm::mat4 hybridScaleInverse;
+    VkDeviceAddress hitDataAddress;
+};
+
+HybridAS::HybridAS() { }
+
+HybridAS::~HybridAS()
+{
+    p_GenerationThread.request_stop();
+    p_FileThread.request_stop();
+
+    freeDescriptorSet();
+    freeBuffers();
+
+    destroyDescriptorLayout();
+
+    destroyRenderPipeline();
+    destroyRenderPipelineLayout();
+
+    ShaderManager::getInstance()->removeModule("AS/hybrid_AS");
+    ShaderManager::getInstance()->removeMacro("HYBRID_BRICK_8");
+}
+
+void HybridAS::init(ASStructInfo info)
+{
+    IAccelerationStructure::init(info);
+
+    createDescriptorLayout();
+
+    createRenderPipelineLayout();
+
+    ShaderManager::getInstance()->removeMacro("GENERATION_FINISHED");
+    ShaderManager::getInstance()->addModule("AS/hybrid_AS",
+        std::bind(&HybridAS::createRenderPipeline, this),
+        std::bind(&HybridAS::destroyRenderPipeline, this));
+
+    createRenderPipeline();
+}
+
+void HybridAS::fromLoader(std::unique_ptr<Loader>&& loader)
+{
+    {
+        std::lock_guard lock(p_Info.graphicsQueue->getLock());
+        vkQueueWaitIdle(p_Info.graphicsQueue->getQueue());
+    }
+
+    reset();
+
+    p_GenerationThread.request_stop();
+
+    p_Generating = true;
+    p_GenerationThread
+        = std::jthread([this, loader = std::move(loader)](std::stop_token stoken) mutable {
+              m_Hybrid = Generators::generateHybrid(
+                  stoken, std::move(loader), p_GenerationInfo, m_Dimensions, m_UpdateBuffers);
+          });
+}
+
+void HybridAS::fromRaw(const std::vector<uint8_t>& rawData)
+{
+    {
+        std::lock_guard lock(p_Info.graphicsQueue->getLock());
+        vkQueueWaitIdle(p_Info.graphicsQueue->getQueue());
+    }
+
+    p_RawThread.request_stop();
+
+    reset();
+
+    p_RawThread = std::jthread([this, rawData](std::stop_token stoken) {
+        p_Loading = true;
+        Serializers::SerialInfo info;
+        auto data = Serializers::loadHybrid(rawData);
+
+        if (!data.has_value() || stoken.stop_requested()) {
+            return;
+        }
+
+        std::tie(info, m_Hybrid) = std::move(data.value());
+
+        m_Dimensions = info.dimensions;
+
+        p_GenerationInfo.voxelCount = info.voxels;
+        p_GenerationInfo.nodes = info.nodes;
+        p_GenerationInfo.generationTime = 0;
+        p_GenerationInfo.completionPercent = 1;
+
+        p_CurrentFrame = 0;
+
+        m_UpdateBuffers = true;
+        p_Loading = false;
+    });
+}
+
+void HybridAS::fromFile(std::filesystem::path path)
+{
+    {
+        std::lock_guard lock(p_Info.graphicsQueue->getLock());
+        vkQueueWaitIdle(p_Info.graphicsQueue->getQueue());
+    }
+
+    p_FileThread.request_stop();
+
+    p_FileThread = std::jthread([this, path](std::stop_token stoken) {
+        p_Loading = true;
+
+        std::ifstream inputStream = Serializers::loadHybridFile(path);
+        std::vector<uint8_t> data = Serializers::vectorFromStream(inputStream);
+
+        fromRaw(data);
+    });
+}
+
+void HybridAS::render(
+    VkCommandBuffer cmd, Camera camera, VkDescriptorSet renderSet, VkExtent2D imageSize)
+{
+    Debug::beginCmdDebugLabel(cmd, "Hybrid AS render", { 0.0f, 0.0f, 1.0f, 1.0f });
+
+    glm::mat4 hybridWorld = glm::mat4(1);
+    hybridWorld = glm::scale(hybridWorld, glm::vec3(m_Dimensions));
+    hybridWorld = glm::translate(hybridWorld, glm::vec3(-1));
+    glm::mat4 hybridWorldInverse = glm::inverse(hybridWorld);
+
+    glm::mat4 hybridScaleInverse = glm::inverse(glm::scale(glm::mat4(1), glm::vec3(m_Dimensions)));
+
+    PushConstants pushConstant = {
+        .cameraPosition = camera.getPosition(),
+        .hybridWorld = hybridWorld,
+        .hybridWorldInverse = hybridWorldInverse,
+        .hybridScaleInverse = hybridScaleInverse,
+        .hitDataAddress = p_Info.hitDataAddress,
+    };
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_RenderPipeline);
+    std::vector<VkDescriptorSet> descriptorSets = {
+        renderSet,
+    };
+    if (p_FinishedGeneration) {
+        descriptorSets.push_back(m_BufferSet);
+    }
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_RenderPipelineLayout, 0,
+        descriptorSets.size(), descriptorSets.data(), 0, nullptr);
+    vkCmdPushConstants(cmd, m_RenderPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+        sizeof(PushConstants), &pushConstant);
+
+    vkCmdDispatch(cmd, std::ceil(imageSize.width / 8.f), std::ceil(imageSize.height / 8.f), 1);
+
+    Debug::endCmdDebugLabel(cmd);
+}
+
+void HybridAS::update(float dt)
+{
+    if (m_UpdateBuffers) {
+        {
+            std::lock_guard lock(p_Info.graphicsQueue->getLock());
+            vkQueueWaitIdle(p_Info.graphicsQueue->getQueue());
+        }
+
+        freeBuffers();
+        freeDescriptorSet();
+
+        if (m_Hybrid.brickSize == 8)
+            ShaderManager::getInstance()->defineMacro("HYBRID_BRICK_8");
+        else
+            ShaderManager::getInstance()->removeMacro("HYBRID_BRICK_8");
+
+        ShaderManager::getInstance()->defineMacro("GENERATION_FINISHED");
+        updateShaders();
+
+        createBuffers();
+        createDescriptorSet();
+        p_FinishedGeneration = true;
+        m_UpdateBuffers = false;
+        p_Generating = false;
+    }
+}
+
+void HybridAS::updateShaders() { ShaderManager::getInstance()->moduleUpdated("AS/hybrid_AS"); }
+
+void HybridAS::createDescriptorLayout()
+{
+    m_BufferSetLayout = DescriptorLayoutGenerator::start(p_Info.device)
+                            .addStorageBufferBinding(VK_SHADER_STAGE_COMPUTE_BIT, 0)
+                            .addStorageBufferBinding(VK_SHADER_STAGE_COMPUTE_BIT, 1)
+                            .addStorageBufferBinding(VK_SHADER_STAGE_COMPUTE_BIT, 2)
+                            .setDebugName("Hybrid descriptor set layout")
+                            .build();
+}
+
+void HybridAS::destroyDescriptorLayout()
+{
+    vkDestroyDescriptorSetLayout(p_Info.device, m_BufferSetLayout, nullptr);
+}
+
+void HybridAS::createBuffers()
+{
+    VkDeviceSize size = sizeof(Generators::HybridNode) * m_Hybrid.nodes.size();
+    m_NodeBuffer.init(p_Info.device, p_Info.allocator, size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0,
+        VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+    m_NodeBuffer.setDebugName("Hybrid node buffer");
+
+    auto nodeIndex = FrameCommands::getInstance()->createStaging(size,
+        [=, this](void* ptr) { memcpy(ptr, m_Hybrid.nodes.data(), size); });
+
+    FrameCommands::getInstance()->stagingEval(
+        nodeIndex, [=, this](VkCommandBuffer cmd, FrameCommands::StagingBuffer buffer) {
+            VkBufferCopy region {
+                .srcOffset = buffer.offset,
+                .dstOffset = 0,
+                .size = size,
+            };
+            vkCmdCopyBuffer(cmd, buffer.buffer, m_NodeBuffer.getBuffer(), 1, &region);
+        });
+
+    // Always bound, hold a single unused entry when the volume has no bricks
+    VkDeviceSize occupancySize
+        = sizeof(uint64_t) * std::max<size_t>(m_Hybrid.occupancy.size(), 1);
+    m_OccupancyBuffer.init(p_Info.device, p_Info.allocator, occupancySize,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0,
+        VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+    m_OccupancyBuffer.setDebugName("Hybrid occupancy buffer");
+
+    auto occupancyIndex
+        = FrameCommands::getInstance()->createStaging(occupancySize, [=, this](void* ptr) {
+              memset(ptr, 0, occupancySize);
+              memcpy(ptr, m_Hybrid.occupancy.data(), sizeof(uint64_t) * m_Hybrid.occupancy.size());
+          });
+
+    FrameCommands::getInstance()->stagingEval(
+        occupancyIndex, [=, this](VkCommandBuffer cmd, FrameCommands::StagingBuffer buffer) {
+            VkBufferCopy region {
+                .srcOffset = buffer.offset,
+                .dstOffset = 0,
+                .size = occupancySize,
+            };
+            vkCmdCopyBuffer(cmd, buffer.buffer, m_OccupancyBuffer.getBuffer(), 1, &region);
+        });
+
+    VkDeviceSize colourSize = sizeof(uint32_t) * std::max<size_t>(m_Hybrid.colours.size(), 1);
+    m_ColourBuffer.init(p_Info.device, p_Info.allocator, colourSize,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0,
+        VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+    m_ColourBuffer.setDebugName("Hybrid colour buffer");
+
+    auto colourIndex
+        = FrameCommands::getInstance()->createStaging(colourSize, [=, this](void* ptr) {
+              memset(ptr, 0, colourSize);
+              memcpy(ptr, m_Hybrid.colours.data(), sizeof(uint32_t) * m_Hybrid.colours.size());
+          });
+
+    FrameCommands::getInstance()->stagingEval(
+        colourIndex, [=, this](VkCommandBuffer cmd, FrameCommands::StagingBuffer buffer) {
+            VkBufferCopy region {
+                .srcOffset = buffer.offset,
+                .dstOffset = 0,
+                .size = colourSize,
+            };
+            vkCmdCopyBuffer(cmd, buffer.buffer, m_ColourBuffer.getBuffer(), 1, &region);
+        });
+}
+
+void HybridAS::freeBuffers()
+{
+    m_NodeBuffer.cleanup();
+    m_OccupancyBuffer.cleanup();
+    m_ColourBuffer.cleanup();
+}
+
+void HybridAS::createDescriptorSet()
+{
+    m_BufferSet
+        = DescriptorSetGenerator::start(p_Info.device, p_Info.descriptorPool, m_BufferSetLayout)
+              .addBufferDescriptor(0, m_NodeBuffer)
+              .addBufferDescriptor(1, m_OccupancyBuffer)
+              .addBufferDescriptor(2, m_ColourBuffer)
+              .setDebugName("Hybrid descriptor set")
+              .build();
+}
+
+void HybridAS::freeDescriptorSet()
+{
+    if (m_BufferSet == VK_NULL_HANDLE)
+        return;
+
+    vkFreeDescriptorSets(p_Info.device, p_Info.descriptorPool, 1, &m_BufferSet);
+}
+
+void HybridAS::createRenderPipelineLayout()
+{
+    m_RenderPipelineLayout
+        = PipelineLayoutGenerator::start(p_Info.device)
+              .addDescriptorLayouts({ p_Info.renderDescriptorLayout, m_BufferSetLayout })
+              .addPushConstant(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants))
+              .setDebugName("Hybrid render pipeline layout")
+              .build();
+}
+
+void HybridAS::destroyRenderPipelineLayout()
+{
+    vkDestroyPipelineLayout(p_Info.device, m_RenderPipelineLayout, nullptr);
+}
+
+void HybridAS::createRenderPipeline()
+{
+    m_RenderPipeline = ComputePipelineGenerator::start(p_Info.device, m_RenderPipelineLayout)
+                           .setShader("AS/hybrid_AS")
+                           .setDebugName("Hybrid render pipeline")
+                           .build();
+}
+
+void HybridAS::destroyRenderPipeline()
+{
+    vkDestroyPipeline(p_Info.device, m_RenderPipeline, nullptr);
+}
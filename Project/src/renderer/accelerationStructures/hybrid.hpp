@@ -0,0 +1,68 @@
+#pragma once
+
+#include "acceleration_structure.hpp"
+
+#include "../buffer.hpp"
+
+#include <vulkan/vulkan_core.h>
+
+#include "generators/hybrid.hpp"
+
+class HybridAS : public IAccelerationStructure {
+
+  public:
+    HybridAS();
+    ~HybridAS();
+
+    void init(ASStructInfo info) override;
+
+    void fromLoader(std::unique_ptr<Loader>&& loader) override;
+    void fromRaw(const std::vector<uint8_t>& rawData) override;
+    void fromFile(std::filesystem::path path) override;
+
+    void render(VkCommandBuffer cmd, Camera camera, VkDescriptorSet renderSet,
+        VkExtent2D imageSize) override;
+    void update(float dt) override;
+
+    void updateShaders() override;
+
+    uint64_t getMemoryUsage() override
+    {
+        return m_NodeBuffer.getSize() + m_OccupancyBuffer.getSize() + m_ColourBuffer.getSize();
+    }
+
+    glm::uvec3 getDimensions() override { return m_Dimensions; }
+
+  private:
+    void createDescriptorLayout();
+    void destroyDescriptorLayout();
+
+    void createBuffers();
+    void freeBuffers();
+
+    void createDescriptorSet();
+    void freeDescriptorSet();
+
+    void createRenderPipelineLayout();
+    void destroyRenderPipelineLayout();
+
+    void createRenderPipeline();
+    void destroyRenderPipeline();
+
+  private:
+    VkDescriptorSetLayout m_BufferSetLayout;
+    VkDescriptorSet m_BufferSet = VK_NULL_HANDLE;
+
+    VkPipelineLayout m_RenderPipelineLayout;
+    VkPipeline m_RenderPipeline;
+
+    glm::uvec3 m_Dimensions;
+
+    Generators::HybridOctree m_Hybrid;
+
+    Buffer m_NodeBuffer;
+    Buffer m_OccupancyBuffer;
+    Buffer m_ColourBuffer;
+
+    bool m_UpdateBuffers = false;
+};
@@ -1,5 +1,6 @@
 #include "octree.hpp"
 
+#include <cstring>
 #include <deque>
 #include <memory>
 #include <stop_token>
@@ -7,6 +8,7 @@
 #include <variant>
 #include <vulkan/vulkan_core.h>
 
+#include "logger/logger.hpp"
 #include "serializers/octree.hpp"
 
 #include "glm/ext/matrix_transform.hpp"
@@ -30,6 +32,7 @@ struct PushConstants {
     alignas(16) glm::mat4 octreeWorldInverse;
     alignas(16) glm::mat4 octreeScaleInverse;
     VkDeviceAddress hitDataAddress;
+    uint32_t rootIndex;
 };
 
 OctreeAS::OctreeAS() { }
@@ -48,6 +51,7 @@ OctreeAS::~OctreeAS()
     destroyRenderPipelineLayout();
 
     ShaderManager::getInstance()->removeModule("AS/octree_AS");
+    ShaderManager::getInstance()->removeMacro("ROPES");
 }
 
 void OctreeAS::init(ASStructInfo info)
@@ -77,6 +81,11 @@ void OctreeAS::fromLoader(std::unique_ptr<Loader>&& loader)
 
     p_GenerationThread.request_stop();
 
+    m_Ropes = {};
+    m_FrameRoots = {};
+    p_CurrentFrame = 0;
+    p_TargetFrame = 0;
+
     p_Generating = true;
     p_GenerationThread
         = std::jthread([this, loader = std::move(loader)](std::stop_token stoken) mutable {
@@ -105,7 +114,7 @@ void OctreeAS::fromRaw(const std::vector<uint8_t>& rawData)
             return;
         }
 
-        std::tie(info, m_Nodes) = data.value();
+        std::tie(info, m_Nodes, m_Ropes, m_FrameRoots) = data.value();
 
         m_Dimensions = info.dimensions;
 
@@ -115,6 +124,7 @@ void OctreeAS::fromRaw(const std::vector<uint8_t>& rawData)
         p_GenerationInfo.completionPercent = 1;
 
         p_CurrentFrame = 0;
+        p_TargetFrame = 0;
 
         m_UpdateBuffers = true;
         p_Loading = false;
@@ -133,10 +143,56 @@ void OctreeAS::fromFile(std::filesystem::path path)
     p_FileThread = std::jthread([this, path](std::stop_token stoken) {
         p_Loading = true;
 
-        std::ifstream inputStream = Serializers::loadOctreeFile(path);
-        std::vector<uint8_t> data = Serializers::vectorFromStream(inputStream);
+        p_RawThread.request_stop();
+
+        reset();
 
-        fromRaw(data);
+        // Progressive files are streamed so the coarse levels are drawn while the rest is read
+        std::ifstream inputStream = Serializers::loadOctreeFile(path);
+        bool loaded = Serializers::loadOctree(
+            inputStream,
+            [&](Serializers::SerialInfo info, std::vector<Generators::OctreeNode> nodes,
+                std::vector<uint32_t> ropes, std::vector<uint32_t> frameRoots) {
+                if (stoken.stop_requested())
+                    return false;
+
+                std::lock_guard lock(m_LevelLock);
+                m_PendingLevels = {};
+                m_LevelBlocks = {};
+                m_Provisional = {};
+                m_RemainingLevels = info.levels;
+
+                m_Dimensions = info.dimensions;
+
+                p_GenerationInfo.voxelCount = info.voxels;
+                p_GenerationInfo.nodes = info.nodes;
+                p_GenerationInfo.generationTime = 0;
+                p_GenerationInfo.completionPercent = 1;
+
+                p_CurrentFrame = 0;
+                p_TargetFrame = 0;
+
+                m_Nodes = std::move(nodes);
+                m_Ropes = std::move(ropes);
+                m_FrameRoots = std::move(frameRoots);
+
+                if (info.levels == 0) {
+                    m_UpdateBuffers = true;
+                    p_Loading = false;
+                }
+                return true;
+            },
+            [&](std::vector<Generators::OctreeNode> nodes, std::vector<uint32_t> averages) {
+                if (stoken.stop_requested())
+                    return false;
+
+                std::lock_guard lock(m_LevelLock);
+                m_PendingLevels.push_back({ std::move(nodes), std::move(averages) });
+                return true;
+            });
+
+        if (!loaded)
+            p_Loading = false;
     });
 }
 
@@ -158,6 +214,7 @@ void OctreeAS::render(
         .octreeWorldInverse = octreeWorldInverse,
         .octreeScaleInverse = octreeScaleInverse,
         .hitDataAddress = p_Info.hitDataAddress,
+        .rootIndex = m_FrameRoots.empty() ? 0 : m_FrameRoots[p_CurrentFrame],
     };
 
     vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_RenderPipeline);
@@ -179,6 +236,16 @@ void OctreeAS::render(
 
 void OctreeAS::update(float dt)
 {
+    {
+        std::lock_guard lock(m_LevelLock);
+        if (!m_PendingLevels.empty() && m_RemainingLevels > 0) {
+            auto [nodes, averages] = std::move(m_PendingLevels.front());
+            m_PendingLevels.pop_front();
+
+            appendLevel(std::move(nodes), std::move(averages));
+        }
+    }
+
     if (m_UpdateBuffers) {
         {
             std::lock_guard lock(p_Info.graphicsQueue->getLock());
@@ -188,6 +255,11 @@ void OctreeAS::update(float dt)
         freeBuffers();
         freeDescriptorSet();
 
+        if (!m_Ropes.empty())
+            ShaderManager::getInstance()->defineMacro("ROPES");
+        else
+            ShaderManager::getInstance()->removeMacro("ROPES");
+
         ShaderManager::getInstance()->defineMacro("GENERATION_FINISHED");
         updateShaders();
 
@@ -197,6 +269,59 @@ void OctreeAS::update(float dt)
         m_UpdateBuffers = false;
         p_Generating = false;
     }
+
+    if (p_CurrentFrame != p_TargetFrame && p_TargetFrame < m_FrameRoots.size())
+        p_CurrentFrame = p_TargetFrame;
+}
+
+void OctreeAS::appendLevel(
+    std::vector<Generators::OctreeNode>&& nodes, std::vector<uint32_t>&& averages)
+{
+    std::vector<Generators::OctreeBlock> blocks = m_Nodes.empty()
+        ? std::vector<Generators::OctreeBlock> { { 0, 1 } }
+        : Generators::octreeChildBlocks(m_Nodes, m_LevelBlocks);
+
+    m_Nodes.insert(m_Nodes.end(), nodes.begin(), nodes.end());
+    m_RemainingLevels--;
+
+    m_Provisional = {};
+    size_t interior = 0;
+    for (auto [start, count] : blocks) {
+        if (start + count > m_Nodes.size()) {
+            LOG_ERROR("Octree level is missing node {}\n", m_Nodes.size());
+            m_PendingLevels = {};
+            m_RemainingLevels = 0;
+            p_Loading = false;
+            return;
+        }
+
+        for (uint32_t i = 0; i < count && m_RemainingLevels > 0; i++) {
+            uint32_t data = m_Nodes[start + i].getData();
+            bool solid = ((data >> 30) & 0x1) != 0;
+            if (solid || ((data >> 22) & 0xFF) == 0)
+                continue;
+
+            if (interior >= averages.size()) {
+                LOG_ERROR("Octree level has {} averages for more interior nodes\n",
+                    averages.size());
+                m_PendingLevels = {};
+                m_RemainingLevels = 0;
+                p_Loading = false;
+                return;
+            }
+
+            uint32_t average = averages[interior++];
+            m_Provisional.push_back({ start + i,
+                Generators::OctreeNode((average >> 16) & 0xFF, (average >> 8) & 0xFF,
+                    average & 0xFF)
+                    .getData() });
+        }
+    }
+
+    m_LevelBlocks = std::move(blocks);
+    m_UpdateBuffers = true;
+    if (m_RemainingLevels == 0)
+        p_Loading = false;
 }
 
 void OctreeAS::updateShaders() { ShaderManager::getInstance()->moduleUpdated("AS/octree_AS"); }
@@ -205,6 +330,7 @@ void OctreeAS::createDescriptorLayout()
 {
     m_BufferSetLayout = DescriptorLayoutGenerator::start(p_Info.device)
                             .addStorageBufferBinding(VK_SHADER_STAGE_COMPUTE_BIT, 0)
+                            .addStorageBufferBinding(VK_SHADER_STAGE_COMPUTE_BIT, 1)
                             .setDebugName("Octree descriptor set layout")
                             .build();
 }
@@ -222,11 +348,16 @@ void OctreeAS::createBuffers()
         VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
     m_OctreeBuffer.setDebugName("Octree node buffer");
 
+    // Copied so a level appended before the staging buffer is filled does not change it
+    const size_t nodeCount = m_Nodes.size();
+    auto provisional = m_Provisional;
     auto bufferIndex = FrameCommands::getInstance()->createStaging(size, [=, this](void* ptr) {
         uint32_t* data = (uint32_t*)ptr;
-        for (size_t i = 0; i < m_Nodes.size(); i++) {
+        for (size_t i = 0; i < nodeCount; i++) {
             data[i] = m_Nodes[i].getData();
         }
+        for (auto [index, leaf] : provisional)
+            data[index] = leaf;
     });
 
     FrameCommands::getInstance()->stagingEval(
@@ -238,15 +369,42 @@ void OctreeAS::createBuffers()
             };
             vkCmdCopyBuffer(cmd, buffer.buffer, m_OctreeBuffer.getBuffer(), 1, &region);
         });
+
+    // Always bound, holds a single unused entry when the octree has no ropes
+    VkDeviceSize ropeSize = sizeof(uint32_t) * std::max<size_t>(m_Ropes.size(), 1);
+    m_RopeBuffer.init(p_Info.device, p_Info.allocator, ropeSize,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0,
+        VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+    m_RopeBuffer.setDebugName("Octree rope buffer");
+
+    auto ropeIndex = FrameCommands::getInstance()->createStaging(ropeSize, [=, this](void* ptr) {
+        memset(ptr, 0, ropeSize);
+        memcpy(ptr, m_Ropes.data(), sizeof(uint32_t) * m_Ropes.size());
+    });
+
+    FrameCommands::getInstance()->stagingEval(
+        ropeIndex, [=, this](VkCommandBuffer cmd, FrameCommands::StagingBuffer buffer) {
+            VkBufferCopy region {
+                .srcOffset = buffer.offset,
+                .dstOffset = 0,
+                .size = ropeSize,
+            };
+            vkCmdCopyBuffer(cmd, buffer.buffer, m_RopeBuffer.getBuffer(), 1, &region);
+        });
 }
 
-void OctreeAS::freeBuffers() { m_OctreeBuffer.cleanup(); }
+void OctreeAS::freeBuffers()
+{
+    m_OctreeBuffer.cleanup();
+    m_RopeBuffer.cleanup();
+}
 
 void OctreeAS::createDescriptorSet()
 {
     m_BufferSet
         = DescriptorSetGenerator::start(p_Info.device, p_Info.descriptorPool, m_BufferSetLayout)
               .addBufferDescriptor(0, m_OctreeBuffer)
+              .addBufferDescriptor(1, m_RopeBuffer)
               .setDebugName("Octree descriptor set")
               .build();
 }
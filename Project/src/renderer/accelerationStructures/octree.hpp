@@ -6,6 +6,9 @@
 
 #include <vulkan/vulkan_core.h>
 
+#include <deque>
+#include <mutex>
+
 #include "generators/octree.hpp"
 
 class OctreeAS : public IAccelerationStructure {
@@ -26,14 +29,25 @@ class OctreeAS : public IAccelerationStructure {
 
     void updateShaders() override;
 
-    uint64_t getMemoryUsage() override { return m_OctreeBuffer.getSize(); }
+    uint64_t getMemoryUsage() override
+    {
+        return m_OctreeBuffer.getSize() + m_RopeBuffer.getSize();
+    }
 
     glm::uvec3 getDimensions() override { return m_Dimensions; }
 
+    // Frames of an animated octree share one node buffer, changing frame only moves the root
+    bool canAnimate() override { return m_FrameRoots.size() > 1; }
+    size_t getAnimationFrames() override { return m_FrameRoots.size(); }
+
   private:
     void createDescriptorLayout();
     void destroyDescriptorLayout();
 
+    // Appends the next level of a progressive file, its interior nodes are drawn as leaves of
+    // their average colour until the level below them is appended
+    void appendLevel(std::vector<Generators::OctreeNode>&& nodes, std::vector<uint32_t>&& averages);
+
     void createBuffers();
     void freeBuffers();
 
@@ -56,8 +70,23 @@ class OctreeAS : public IAccelerationStructure {
     glm::uvec3 m_Dimensions;
 
     std::vector<Generators::OctreeNode> m_Nodes;
+    // Empty unless the loaded octree was stored with ropes
+    std::vector<uint32_t> m_Ropes;
+    // Root node of each frame, empty for an octree with a single frame
+    std::vector<uint32_t> m_FrameRoots;
+
+    // Levels of a progressive file read but not yet uploaded, one is appended per frame
+    std::mutex m_LevelLock;
+    std::deque<std::pair<std::vector<Generators::OctreeNode>, std::vector<uint32_t>>>
+        m_PendingLevels;
+    uint32_t m_RemainingLevels = 0;
+    // Blocks of the last appended level
+    std::vector<Generators::OctreeBlock> m_LevelBlocks;
+    // Node index and the provisional leaf uploaded in its place
+    std::vector<std::pair<uint64_t, uint32_t>> m_Provisional;
 
     Buffer m_OctreeBuffer;
+    Buffer m_RopeBuffer;
 
     bool m_UpdateBuffers = false;
 };
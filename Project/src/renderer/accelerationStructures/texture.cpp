@@ -42,6 +42,8 @@ TextureAS::~TextureAS()
     destroyRenderPipelineLayout();
     ShaderManager::getInstance()->removeModule("AS/texture_AS");
     ShaderManager::getInstance()->removeModule("modification/texture");
+
+    ShaderManager::getInstance()->removeMacro("TEXTURE_PALETTE");
 }
 
 void TextureAS::init(ASStructInfo info)
@@ -78,6 +80,8 @@ void TextureAS::fromLoader(std::unique_ptr<Loader>&& loader)
 
     p_GenerationThread.request_stop();
 
+    m_UsePalette = false;
+
     p_Generating = true;
     p_GenerationThread
         = std::jthread([this, loader = std::move(loader)](std::stop_token stoken) mutable {
@@ -109,6 +113,7 @@ void TextureAS::fromRaw(const std::vector<uint8_t>& rawData)
         std::tie(info, m_Voxels, p_AnimationFrames) = data.value();
 
         m_Dimensions = info.dimensions;
+        m_UsePalette = info.paletteColours != 0;
 
         p_GenerationInfo.voxelCount = info.voxels;
         p_GenerationInfo.nodes = info.nodes;
@@ -249,6 +254,12 @@ void TextureAS::update(float dt)
         destroyImages();
         freeDescriptorSets();
 
+        if (m_UsePalette) {
+            ShaderManager::getInstance()->defineMacro("TEXTURE_PALETTE");
+        } else {
+            ShaderManager::getInstance()->removeMacro("TEXTURE_PALETTE");
+        }
+
         ShaderManager::getInstance()->defineMacro("GENERATION_FINISHED");
         updateShaders();
 
@@ -279,6 +290,7 @@ void TextureAS::createDescriptorLayouts()
 {
     m_ImageSetLayout = DescriptorLayoutGenerator::start(p_Info.device)
                            .addStorageImageBinding(VK_SHADER_STAGE_COMPUTE_BIT, 0)
+                           .addStorageBufferBinding(VK_SHADER_STAGE_COMPUTE_BIT, 1)
                            .setDebugName("Texture descriptor set layout")
                            .build();
 }
@@ -291,7 +303,19 @@ void TextureAS::destroyDescriptorLayouts()
 void TextureAS::createImages()
 {
     VkExtent3D extent = { m_Dimensions.x, m_Dimensions.y, m_Dimensions.z };
-    VkFormat format = VK_FORMAT_B8G8R8A8_UNORM;
+    VkFormat format = m_UsePalette ? VK_FORMAT_R8_UINT : VK_FORMAT_B8G8R8A8_UNORM;
+
+    m_Palette = {};
+    if (m_UsePalette) {
+        std::vector<glm::u8vec3> colours;
+        for (const auto& voxel : m_Voxels) {
+            if (voxel.a != 0)
+                colours.push_back(glm::u8vec3(voxel));
+        }
+
+        // Index 0 is reserved for empty voxels
+        m_Palette = Generators::buildPalette(colours, 255);
+    }
 
     m_DataImage.init(p_Info.device, p_Info.allocator, p_Info.graphicsQueue->getFamily(), extent,
         format, VK_IMAGE_TYPE_3D, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_STORAGE_BIT);
@@ -300,11 +324,19 @@ void TextureAS::createImages()
     m_DataImage.createView(VK_IMAGE_VIEW_TYPE_3D);
     m_DataImage.setDebugNameView("Texture Data Image View");
 
-    VkDeviceSize imageSize
-        = sizeof(Generators::TextureVoxel) * m_Dimensions.x * m_Dimensions.y * m_Dimensions.z;
+    VkDeviceSize texelSize = m_UsePalette ? sizeof(uint8_t) : sizeof(Generators::TextureVoxel);
+    VkDeviceSize imageSize = texelSize * m_Dimensions.x * m_Dimensions.y * m_Dimensions.z;
 
     auto bufferIndex = FrameCommands::getInstance()->createStaging(imageSize, [=, this](void* ptr) {
         uint8_t* data = (uint8_t*)ptr;
+        if (m_UsePalette) {
+            for (size_t i = 0; i < m_Voxels.size(); i++) {
+                glm::u8vec3 colour = glm::u8vec3(m_Voxels[i]);
+                data[i] = m_Voxels[i].a != 0 ? Generators::paletteIndex(m_Palette, colour) + 1 : 0;
+            }
+            return;
+        }
+
         for (size_t i = 0; i < m_Voxels.size(); i++) {
             data[i * 4 + 0] = m_Voxels[i].b;
             data[i * 4 + 1] = m_Voxels[i].g;
@@ -336,9 +368,41 @@ void TextureAS::createImages()
             vkCmdCopyBufferToImage(cmd, buffer.buffer, m_DataImage.getImage(),
                 VK_IMAGE_LAYOUT_GENERAL, 1, &bufferImageCopy);
         });
+
+    // Always bound, holds a single unused entry outside of palette mode
+    VkDeviceSize paletteSize = sizeof(uint32_t) * std::max<size_t>(m_Palette.colours.size(), 1);
+
+    m_PaletteBuffer.init(p_Info.device, p_Info.allocator, paletteSize,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0,
+        VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+    m_PaletteBuffer.setDebugName("Texture palette buffer");
+
+    auto paletteIndex
+        = FrameCommands::getInstance()->createStaging(paletteSize, [=, this](void* ptr) {
+              uint32_t* data = (uint32_t*)ptr;
+              data[0] = 0;
+              for (size_t i = 0; i < m_Palette.colours.size(); i++) {
+                  data[i] = Generators::packColour(m_Palette.colours[i]);
+              }
+          });
+
+    FrameCommands::getInstance()->stagingEval(
+        paletteIndex, [=, this](VkCommandBuffer cmd, FrameCommands::StagingBuffer buffer) {
+            VkBufferCopy region {
+                .srcOffset = buffer.offset,
+                .dstOffset = 0,
+                .size = paletteSize,
+            };
+
+            vkCmdCopyBuffer(cmd, buffer.buffer, m_PaletteBuffer.getBuffer(), 1, &region);
+        });
 }
 
-void TextureAS::destroyImages() { m_DataImage.cleanup(); }
+void TextureAS::destroyImages()
+{
+    m_PaletteBuffer.cleanup();
+    m_DataImage.cleanup();
+}
 
 void TextureAS::createBuffers()
 {
@@ -354,6 +418,7 @@ void TextureAS::createDescriptorSets()
     m_ImageSet
         = DescriptorSetGenerator::start(p_Info.device, p_Info.descriptorPool, m_ImageSetLayout)
               .addImageDescriptor(0, m_DataImage, VK_IMAGE_LAYOUT_GENERAL)
+              .addBufferDescriptor(1, m_PaletteBuffer)
               .setDebugName("Texture descriptor set")
               .build();
 }
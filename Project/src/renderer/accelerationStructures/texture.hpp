@@ -5,6 +5,7 @@
 #include "acceleration_structure.hpp"
 #include <vulkan/vulkan_core.h>
 
+#include "generators/palette.hpp"
 #include "generators/texture.hpp"
 
 class TextureAS : public IAccelerationStructure {
@@ -26,7 +27,9 @@ class TextureAS : public IAccelerationStructure {
 
     uint64_t getMemoryUsage() override
     {
-        return m_Dimensions.x * m_Dimensions.y * m_Dimensions.z * 4 * sizeof(uint8_t);
+        uint64_t texelSize = m_UsePalette ? sizeof(uint8_t) : 4 * sizeof(uint8_t);
+        return texelSize * m_Dimensions.x * m_Dimensions.y * m_Dimensions.z
+            + m_PaletteBuffer.getSize();
     }
 
     glm::uvec3 getDimensions() override { return m_Dimensions; }
@@ -73,6 +76,12 @@ class TextureAS : public IAccelerationStructure {
 
     Image m_DataImage;
 
+    // Set when the loaded file stored palette colours, the image then holds 8 bit indices with 0
+    // marking empty voxels and i + 1 selecting m_PaletteBuffer[i]
+    bool m_UsePalette = false;
+    Generators::Palette m_Palette;
+    Buffer m_PaletteBuffer;
+
     Buffer m_ModBuffer;
 
     bool m_UpdateBuffers = false;
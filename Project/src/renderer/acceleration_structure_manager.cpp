@@ -1,9 +1,11 @@
 #include "acceleration_structure_manager.hpp"
 
 #include <GLFW/glfw3.h>
+#include <algorithm>
 #include <cassert>
 #include <format>
 #include <memory>
+#include <optional>
 
 #include "network/loop.hpp"
 #include "network_proto/header.pb.h"
@@ -14,6 +16,7 @@
 #include "accelerationStructures/brickmap.hpp"
 #include "accelerationStructures/contree.hpp"
 #include "accelerationStructures/grid.hpp"
+#include "accelerationStructures/hybrid.hpp"
 #include "accelerationStructures/octree.hpp"
 #include "accelerationStructures/texture.hpp"
 
@@ -27,6 +30,7 @@
 
 #include "logger/logger.hpp"
 
+#include "generators/scene_analysis.hpp"
 #include "loaders/equation_loader.hpp"
 
 #include "glm/common.hpp"
@@ -142,6 +146,9 @@ void ASManager::setAS(ASType type)
         case ASType::BRICKMAP:
             m_CurrentAS = std::make_unique<BrickmapAS>();
             break;
+        case ASType::HYBRID:
+            m_CurrentAS = std::make_unique<HybridAS>();
+            break;
         default:
             assert(false && "Invalid Type provided");
         }
@@ -175,6 +182,80 @@ void ASManager::loadAS(
     }
 }
 
+static_assert(static_cast<uint8_t>(ASType::MAX_TYPE)
+        == static_cast<uint32_t>(Generators::StructureType::HYBRID) + 1,
+    "ASType must match the renderable Generators::StructureType values");
+
+// Largest amount of device local memory still free under the heap budgets
+static uint64_t availableDeviceMemory(VmaAllocator allocator)
+{
+    const VkPhysicalDeviceMemoryProperties* properties;
+    vmaGetMemoryProperties(allocator, &properties);
+
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+    vmaGetHeapBudgets(allocator, budgets);
+
+    uint64_t available = 0;
+    for (uint32_t i = 0; i < properties->memoryHeapCount; i++) {
+        if (!(properties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+            continue;
+
+        if (budgets[i].budget > budgets[i].usage)
+            available = std::max(available, budgets[i].budget - budgets[i].usage);
+    }
+
+    return available;
+}
+
+void ASManager::loadFromLoader(std::unique_ptr<Loader>&& loader)
+{
+    if (m_InitInfo.netInfo.enableClientSide) {
+        LOG_ERROR("Structures can only be built from a loader where they are rendered");
+        return;
+    }
+
+    assert(m_CurrentAS);
+
+    Generators::SceneStatistics statistics = Generators::sampleScene(std::stop_token {}, *loader);
+
+    // The current structure is released before the new one is built
+    const uint64_t available
+        = availableDeviceMemory(m_InitInfo.allocator) + m_CurrentAS->getMemoryUsage();
+    const uint64_t mebibyte = 1024 * 1024;
+
+    Generators::StructureCost cost = Generators::predictCost(
+        static_cast<Generators::StructureType>(m_CurrentType), statistics);
+    if (cost.bytes > available) {
+        std::optional<Generators::StructureCost> fallback;
+        for (const Generators::StructureCost& candidate : Generators::rankStructures(statistics)) {
+            if (candidate.bytes <= available) {
+                fallback = candidate;
+                break;
+            }
+        }
+
+        if (!fallback.has_value()) {
+            LOG_ERROR("{} needs about {} MiB but only {} MiB are free, no structure fits",
+                structTypeToStringMap[m_CurrentType], cost.bytes / mebibyte,
+                available / mebibyte);
+            return;
+        }
+
+        LOG_INFO("{} needs about {} MiB but only {} MiB are free, using {}",
+            structTypeToStringMap[m_CurrentType], cost.bytes / mebibyte, available / mebibyte,
+            Generators::structureTypeName(fallback->type));
+
+        cost = fallback.value();
+        setAS(static_cast<ASType>(cost.type));
+    }
+
+    LOG_INFO("Building {}: about {} nodes, {} MiB and {:.1f}s",
+        structTypeToStringMap[m_CurrentType], cost.nodes, cost.bytes / mebibyte,
+        cost.buildSeconds);
+
+    m_CurrentAS->fromLoader(std::move(loader));
+}
+
 void ASManager::updateShaders()
 {
     if (m_InitInfo.netInfo.enableClientSide)
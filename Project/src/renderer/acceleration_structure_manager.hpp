@@ -20,6 +20,7 @@ enum class ASType : uint8_t {
     OCTREE = 2,
     CONTREE = 3,
     BRICKMAP = 4,
+    HYBRID = 5,
     MAX_TYPE,
 };
 
@@ -43,6 +44,7 @@ inline static std::map<ASType, const char*> structTypeToStringMap {
     { ASType::CONTREE,  "Contree"  },
     { ASType::BRICKMAP, "Brickmap" },
     { ASType::TEXTURE,  "Texture"  },
+    { ASType::HYBRID,   "Hybrid"   },
 };
 
 class ASManager {
@@ -63,6 +65,10 @@ class ASManager {
     void setAS(ASType type);
     void loadAS(
         std::filesystem::path, bool validStructures[static_cast<uint8_t>(ASType::MAX_TYPE)]);
+    // Estimates the current structure from a sample of the loader before building it. Builds
+    // larger than the free device memory switch to the best ranked structure that fits, or are
+    // refused when none does.
+    void loadFromLoader(std::unique_ptr<Loader>&& loader);
 
     void updateShaders();
 
@@ -319,6 +319,8 @@ PerformanceLogger::PerfEntry PerformanceLogger::parseEntry(
             entry.structure = ASType::CONTREE;
         } else if (structure == "Brickmap") {
             entry.structure = ASType::BRICKMAP;
+        } else if (structure == "Hybrid") {
+            entry.structure = ASType::HYBRID;
         } else {
             LOG_ERROR("Unknown structure: {}", structure);
         }
@@ -463,6 +465,9 @@ void PerformanceLogger::savePerf()
         case ASType::BRICKMAP:
             structure = "Brickmap";
             break;
+        case ASType::HYBRID:
+            structure = "Hybrid";
+            break;
         default:
             structure = "unknown";
             break;
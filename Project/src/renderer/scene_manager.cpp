@@ -128,6 +128,7 @@ void SceneManager::UI(const Event& event)
                 addText("Octree", ASType::OCTREE);
                 addText("Contree", ASType::CONTREE);
                 addText("Brickmap", ASType::BRICKMAP);
+                addText("Hybrid", ASType::HYBRID);
             }
         }
         ImGui::End();
@@ -216,6 +217,7 @@ void SceneManager::updateValidStructures()
         { ".voxoctree",  ASType::OCTREE   },
         { ".voxcontree", ASType::CONTREE  },
         { ".voxbrick",   ASType::BRICKMAP },
+        { ".voxhybrid",  ASType::HYBRID   },
     };
 
     for (const auto& pair : points) {
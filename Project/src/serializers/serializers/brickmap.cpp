@@ -2,10 +2,12 @@
 
 #include "common.hpp"
 #include "generators/brickmap.hpp"
+#include "generators/palette.hpp"
 #include "modification/diff.hpp"
 
 #include "as_proto/brickmap.pb.h"
 
+#include <cassert>
 #include <fstream>
 #include <tuple>
 
@@ -25,24 +27,62 @@ std::ifstream loadBrickmapFile(std::filesystem::path directory)
 
     return inputStream;
 }
-std::optional<
-    std::tuple<SerialInfo, std::vector<Generators::BrickgridPtr>, std::vector<Generators::Brickmap>,
-        std::vector<Generators::BrickmapColour>, Modification::AnimationFrames>>
-loadBrickmap(ASProto::Brickmap& brickmap)
+
+// Paged grids also hold every allocated page, each page table entry must point at one
+static bool validBrickgridSize(
+    const ASProto::Brickgrid& grid, glm::uvec3 dimensions, Generators::BrickgridLayout layout)
 {
-    SerialInfo serialInfo = readHeader(brickmap.header());
+    const size_t size = grid.pointers_size();
+    const size_t expected = Generators::brickgridSize(dimensions, layout);
+    if (layout != Generators::BrickgridLayout::PAGED)
+        return size == expected;
+
+    if (size < expected || (size - expected) % Generators::BrickgridPageEntries != 0)
+        return false;
+
+    for (size_t i = 0; i < expected; i++) {
+        uint32_t page = grid.pointers(i);
+        if (page == 0)
+            continue;
+
+        if (page < expected || page >= size
+            || (page - expected) % Generators::BrickgridPageEntries != 0)
+            return false;
+    }
+
+    return true;
+}
+
+template <uint32_t Size> static BrickmapData<Size> loadBrickmap(ASProto::Brickmap& brickmap)
+{
+    uint32_t brickSize = brickmap.brick_size() == 0 ? 8 : brickmap.brick_size();
+    if (brickSize != Size) {
+        LOG_ERROR("Brickmap uses {}^3 bricks but {}^3 were expected\n", brickSize, Size);
+        return {};
+    }
+
+    auto header = readHeader(brickmap.header());
+    if (!header.has_value())
+        return {};
+    SerialInfo serialInfo = header.value();
 
     size_t brickgridSize = brickmap.grid().pointers_size();
+    auto layout = static_cast<Generators::BrickgridLayout>(serialInfo.layout);
+    if (!validBrickgridSize(brickmap.grid(), serialInfo.dimensions, layout)) {
+        LOG_ERROR("Brickgrid has {} entries which does not match its dimensions\n", brickgridSize);
+        return {};
+    }
+
     std::vector<Generators::BrickgridPtr> brickgrid;
     brickgrid.reserve(brickgridSize);
 
     size_t brickmapSize = brickmap.bricks_size();
-    std::vector<Generators::Brickmap> brickmaps;
+    std::vector<Generators::SizedBrickmap<Size>> brickmaps;
     brickmaps.reserve(brickmapSize);
 
     size_t coloursSize = brickmap.colours_size();
     std::vector<Generators::BrickmapColour> colours;
-    brickmaps.reserve(coloursSize);
+    colours.reserve(coloursSize);
 
     for (size_t i = 0; i < brickgridSize; i++) {
         brickgrid.push_back(brickmap.grid().pointers().at(i));
@@ -51,15 +91,48 @@ loadBrickmap(ASProto::Brickmap& brickmap)
     for (size_t i = 0; i < brickmapSize; i++) {
         ASProto::Brick protoBrick = brickmap.bricks().at(i);
 
-        Generators::Brickmap brickmap;
+        Generators::SizedBrickmap<Size> brickmap;
         brickmap.colourPtr = protoBrick.colour_ptr();
 
-        for (int j = 0; j < 8; j++) {
+        if (protoBrick.occupancy_size() != Generators::SizedBrickmap<Size>::Words) {
+            LOG_ERROR("Brick {} has malformed occupancy\n", i);
+            return {};
+        }
+
+        for (uint32_t j = 0; j < Generators::SizedBrickmap<Size>::Words; j++) {
             brickmap.occupancy[j] = protoBrick.occupancy().at(j);
         }
         brickmaps.push_back(brickmap);
     }
 
+    if (brickmap.has_palette()) {
+        // The colour pool grows a brick at a time so always fills whole data words
+        size_t entries = (size_t)brickmap.colour_data_size() * 4;
+
+        auto palette = readPalette(brickmap.palette(), entries);
+        if (!palette.has_value())
+            return {};
+
+        const auto& [paletteColours, indices] = palette.value();
+        serialInfo.paletteColours = paletteColours.size();
+
+        colours.reserve(entries);
+        for (size_t i = 0; i < entries; i++) {
+            if (indices[i] >= paletteColours.size()) {
+                LOG_ERROR("Brickmap palette index {} out of range\n", indices[i]);
+                return {};
+            }
+
+            Generators::BrickmapColour colour;
+            colour.data = (brickmap.colour_data().at(i / 4) >> ((i % 4) * 8)) & 0xFF;
+            colour.r = paletteColours[indices[i]].r;
+            colour.g = paletteColours[indices[i]].g;
+            colour.b = paletteColours[indices[i]].b;
+
+            colours.push_back(colour);
+        }
+    }
+
     for (size_t i = 0; i < coloursSize; i++) {
         ASProto::BrickColour protoColour = brickmap.colours().at(i);
 
@@ -81,34 +154,31 @@ loadBrickmap(ASProto::Brickmap& brickmap)
     return std::make_tuple(serialInfo, brickgrid, brickmaps, colours, animation);
 }
 
-std::optional<
-    std::tuple<SerialInfo, std::vector<Generators::BrickgridPtr>, std::vector<Generators::Brickmap>,
-        std::vector<Generators::BrickmapColour>, Modification::AnimationFrames>>
-loadBrickmap(std::filesystem::path directory)
+template <uint32_t Size> BrickmapData<Size> loadBrickmap(std::filesystem::path directory)
 {
     std::ifstream inputStream = loadBrickmapFile(directory);
 
     ASProto::Brickmap brickmap;
     brickmap.ParseFromIstream(&inputStream);
 
-    return loadBrickmap(brickmap);
+    return loadBrickmap<Size>(brickmap);
 }
 
-std::optional<
-    std::tuple<SerialInfo, std::vector<Generators::BrickgridPtr>, std::vector<Generators::Brickmap>,
-        std::vector<Generators::BrickmapColour>, Modification::AnimationFrames>>
-loadBrickmap(const std::vector<uint8_t>& data)
+template <uint32_t Size> BrickmapData<Size> loadBrickmap(const std::vector<uint8_t>& data)
 {
     ASProto::Brickmap brickmap;
     brickmap.ParseFromArray(data.data(), data.size());
 
-    return loadBrickmap(brickmap);
+    return loadBrickmap<Size>(brickmap);
 }
 
+template <uint32_t Size>
 void storeBrickmap(std::filesystem::path output, const std::string& name, glm::uvec3 dimensions,
-    std::vector<Generators::BrickgridPtr> brickgrid, std::vector<Generators::Brickmap> brickmaps,
+    std::vector<Generators::BrickgridPtr> brickgrid,
+    std::vector<Generators::SizedBrickmap<Size>> brickmaps,
     std::vector<Generators::BrickmapColour> colours, Generators::GenerationInfo generationInfo,
-    const Modification::AnimationFrames& animation)
+    const Modification::AnimationFrames& animation, bool palette,
+    Generators::BrickgridLayout layout)
 {
     std::filesystem::path target = output / name / (name + ".voxbrick");
 
@@ -122,26 +192,54 @@ void storeBrickmap(std::filesystem::path output, const std::string& name, glm::u
 
     writeHeader(
         brickmap.mutable_header(), dimensions, generationInfo.voxelCount, generationInfo.nodes);
+    brickmap.set_brick_size(Size);
+    brickmap.mutable_header()->set_layout(static_cast<uint32_t>(layout));
 
     for (const uint32_t& ptr : brickgrid) {
         brickmap.mutable_grid()->mutable_pointers()->Add(ptr);
     }
 
-    for (const Generators::Brickmap& brick : brickmaps) {
+    for (const Generators::SizedBrickmap<Size>& brick : brickmaps) {
         ASProto::Brick* protoBrick = brickmap.mutable_bricks()->Add();
 
         protoBrick->set_colour_ptr(brick.colourPtr);
 
-        for (uint8_t i = 0; i < 8; i++) {
+        for (uint32_t i = 0; i < Generators::SizedBrickmap<Size>::Words; i++) {
             protoBrick->mutable_occupancy()->Add(brick.occupancy[i]);
         }
     }
 
-    for (const Generators::BrickmapColour& colour : colours) {
-        ASProto::BrickColour* protoColour = brickmap.mutable_colours()->Add();
+    if (palette) {
+        assert(colours.size() % 4 == 0 && "Colour pool must fill whole data words");
+
+        std::vector<glm::u8vec3> entryColours;
+        entryColours.reserve(colours.size());
+        for (const Generators::BrickmapColour& colour : colours) {
+            entryColours.push_back({ colour.r, colour.g, colour.b });
+        }
+
+        Generators::Palette colourPalette = Generators::buildPalette(entryColours);
+
+        std::vector<uint32_t> indices;
+        std::vector<uint32_t> data(colours.size() / 4, 0);
+        indices.reserve(colours.size());
+        for (size_t i = 0; i < colours.size(); i++) {
+            indices.push_back(Generators::paletteIndex(colourPalette, entryColours[i]));
+            data[i / 4] |= ((uint32_t)colours[i].data) << ((i % 4) * 8);
+        }
+
+        for (uint32_t word : data) {
+            brickmap.add_colour_data(word);
+        }
+
+        writePalette(brickmap.mutable_palette(), colourPalette.colours, indices);
+    } else {
+        for (const Generators::BrickmapColour& colour : colours) {
+            ASProto::BrickColour* protoColour = brickmap.mutable_colours()->Add();
 
-        protoColour->set_data((((uint32_t)colour.data) << 24) | (((uint32_t)colour.r) << 16)
-            | (((uint32_t)colour.g) << 8) | (((uint32_t)colour.b) << 0));
+            protoColour->set_data((((uint32_t)colour.data) << 24) | (((uint32_t)colour.r) << 16)
+                | (((uint32_t)colour.g) << 8) | (((uint32_t)colour.b) << 0));
+        }
     }
 
     if (animation.size() != 0) {
@@ -152,4 +250,16 @@ void storeBrickmap(std::filesystem::path output, const std::string& name, glm::u
 
     outputStream.close();
 }
+
+#define INSTANTIATE_BRICKMAP(SIZE)                                                                 \
+    template BrickmapData<SIZE> loadBrickmap<SIZE>(std::filesystem::path);                        \
+    template BrickmapData<SIZE> loadBrickmap<SIZE>(const std::vector<uint8_t>&);                  \
+    template void storeBrickmap<SIZE>(std::filesystem::path, const std::string&, glm::uvec3,      \
+        std::vector<Generators::BrickgridPtr>, std::vector<Generators::SizedBrickmap<SIZE>>,      \
+        std::vector<Generators::BrickmapColour>, Generators::GenerationInfo,                       \
+        const Modification::AnimationFrames&, bool, Generators::BrickgridLayout);
+
+INSTANTIATE_BRICKMAP(4)
+INSTANTIATE_BRICKMAP(8)
+INSTANTIATE_BRICKMAP(16)
 }
@@ -10,20 +10,26 @@
 
 namespace Serializers {
 
+template <uint32_t Size>
+using BrickmapData = std::optional<std::tuple<SerialInfo, std::vector<Generators::BrickgridPtr>,
+    std::vector<Generators::SizedBrickmap<Size>>, std::vector<Generators::BrickmapColour>,
+    Modification::AnimationFrames>>;
+
 std::ifstream loadBrickmapFile(std::filesystem::path directory);
 
-std::optional<
-    std::tuple<SerialInfo, std::vector<Generators::BrickgridPtr>, std::vector<Generators::Brickmap>,
-        std::vector<Generators::BrickmapColour>, Modification::AnimationFrames>>
-loadBrickmap(std::filesystem::path directory);
+// Files with a different brick size than requested fail to load. The brickgrid is returned in
+// the layout recorded in the header.
+template <uint32_t Size = Generators::BrickSize>
+BrickmapData<Size> loadBrickmap(std::filesystem::path directory);
 
-std::optional<
-    std::tuple<SerialInfo, std::vector<Generators::BrickgridPtr>, std::vector<Generators::Brickmap>,
-        std::vector<Generators::BrickmapColour>, Modification::AnimationFrames>>
-loadBrickmap(const std::vector<uint8_t>& data);
+template <uint32_t Size = Generators::BrickSize>
+BrickmapData<Size> loadBrickmap(const std::vector<uint8_t>& data);
 
+template <uint32_t Size = Generators::BrickSize>
 void storeBrickmap(std::filesystem::path output, const std::string& name, glm::uvec3 dimensions,
-    std::vector<Generators::BrickgridPtr> brickgrid, std::vector<Generators::Brickmap> brickmap,
+    std::vector<Generators::BrickgridPtr> brickgrid,
+    std::vector<Generators::SizedBrickmap<Size>> brickmap,
     std::vector<Generators::BrickmapColour> colours, Generators::GenerationInfo generationInfo,
-    const Modification::AnimationFrames& animation);
+    const Modification::AnimationFrames& animation, bool palette = false,
+    Generators::BrickgridLayout layout = Generators::BrickgridLayout::LINEAR);
 }
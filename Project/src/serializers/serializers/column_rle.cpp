@@ -0,0 +1,139 @@
+#include "column_rle.hpp"
+
+#include "common.hpp"
+
+#include "as_proto/column_rle.pb.h"
+
+#include "generators/column_rle.hpp"
+#include "generators/common.hpp"
+
+namespace Serializers {
+
+std::ifstream loadColumnRLEFile(std::filesystem::path directory)
+{
+    std::string foldername = directory.filename();
+
+    std::filesystem::path file = directory / (foldername + ".voxcolumns");
+    std::ifstream inputStream(file.string(), std::ios::binary | std::ios::in);
+
+    if (!inputStream.is_open()) {
+        LOG_ERROR("Failed to open file: {}\n", file.string());
+        return {};
+    }
+
+    return inputStream;
+}
+
+std::optional<std::tuple<SerialInfo, Generators::ColumnRLE>> loadColumnRLE(
+    const ASProto::ColumnRLE& proto)
+{
+    auto header = readHeader(proto.header());
+    if (!header.has_value())
+        return {};
+    SerialInfo serialInfo = header.value();
+
+    Generators::ColumnRLE columns;
+    columns.dimensions = serialInfo.dimensions;
+
+    const uint64_t columnCount = (uint64_t)columns.dimensions.x * columns.dimensions.z;
+    if ((uint64_t)proto.span_counts_size() != columnCount
+        || proto.spans_size() != proto.colours_size() * 2) {
+        LOG_ERROR("Column arrays have invalid lengths\n");
+        return {};
+    }
+
+    columns.offsets.reserve(columnCount + 1);
+    columns.spans.reserve(proto.colours_size());
+
+    int span = 0;
+    for (uint64_t column = 0; column < columnCount; column++) {
+        columns.offsets.push_back(columns.spans.size());
+
+        const uint32_t count = proto.span_counts(column);
+        if (span + (uint64_t)count > (uint64_t)proto.colours_size()) {
+            LOG_ERROR("Column {} is missing spans\n", column);
+            return {};
+        }
+
+        // Spans must be sorted, disjoint and inside the volume
+        uint64_t previousEnd = 0;
+        for (uint32_t i = 0; i < count; i++, span++) {
+            Generators::ColumnSpan loaded {
+                .start = proto.spans(span * 2),
+                .length = proto.spans(span * 2 + 1),
+                .colour = proto.colours(span),
+            };
+
+            uint64_t end = (uint64_t)loaded.start + loaded.length;
+            if (loaded.length == 0 || loaded.start < previousEnd
+                || end > columns.dimensions.y) {
+                LOG_ERROR("Column {} has an invalid span\n", column);
+                return {};
+            }
+
+            previousEnd = end;
+            columns.spans.push_back(loaded);
+        }
+    }
+    columns.offsets.push_back(columns.spans.size());
+
+    if (span != proto.colours_size()) {
+        LOG_ERROR("Columns have {} unused spans\n", proto.colours_size() - span);
+        return {};
+    }
+
+    return std::make_tuple(serialInfo, std::move(columns));
+}
+
+std::optional<std::tuple<SerialInfo, Generators::ColumnRLE>> loadColumnRLE(
+    std::filesystem::path directory)
+{
+    std::ifstream inputStream = loadColumnRLEFile(directory);
+    ASProto::ColumnRLE columns;
+    columns.ParseFromIstream(&inputStream);
+
+    return loadColumnRLE(columns);
+}
+
+std::optional<std::tuple<SerialInfo, Generators::ColumnRLE>> loadColumnRLE(
+    const std::vector<uint8_t>& data)
+{
+    ASProto::ColumnRLE columns;
+    columns.ParseFromArray(data.data(), data.size());
+
+    return loadColumnRLE(columns);
+}
+
+void storeColumnRLE(std::filesystem::path output, const std::string& name, glm::uvec3 dimensions,
+    const Generators::ColumnRLE& columns, Generators::GenerationInfo generationInfo)
+{
+    std::filesystem::path target = output / name / (name + ".voxcolumns");
+
+    std::ofstream outputStream(target.string(), std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!outputStream.is_open()) {
+        fprintf(stderr, "Failed to open file %s\n", target.string().c_str());
+        exit(-1);
+    }
+
+    ASProto::ColumnRLE proto;
+
+    writeHeader(
+        proto.mutable_header(), dimensions, generationInfo.voxelCount, generationInfo.nodes);
+
+    proto.mutable_span_counts()->Reserve(columns.offsets.size() - 1);
+    for (size_t i = 0; i + 1 < columns.offsets.size(); i++)
+        proto.add_span_counts(columns.offsets[i + 1] - columns.offsets[i]);
+
+    proto.mutable_spans()->Reserve(columns.spans.size() * 2);
+    proto.mutable_colours()->Reserve(columns.spans.size());
+    for (const Generators::ColumnSpan& span : columns.spans) {
+        proto.add_spans(span.start);
+        proto.add_spans(span.length);
+        proto.add_colours(span.colour);
+    }
+
+    proto.SerializeToOstream(&outputStream);
+
+    outputStream.close();
+}
+}
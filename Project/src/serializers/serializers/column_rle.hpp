@@ -0,0 +1,23 @@
+#pragma once
+
+#include "common.hpp"
+
+#include "generators/column_rle.hpp"
+#include "generators/common.hpp"
+
+#include <filesystem>
+#include <fstream>
+
+namespace Serializers {
+
+std::ifstream loadColumnRLEFile(std::filesystem::path directory);
+
+std::optional<std::tuple<SerialInfo, Generators::ColumnRLE>> loadColumnRLE(
+    std::filesystem::path directory);
+
+std::optional<std::tuple<SerialInfo, Generators::ColumnRLE>> loadColumnRLE(
+    const std::vector<uint8_t>& data);
+
+void storeColumnRLE(std::filesystem::path output, const std::string& name, glm::uvec3 dimensions,
+    const Generators::ColumnRLE& columns, Generators::GenerationInfo generationInfo);
+}
@@ -2,8 +2,16 @@
 #include "modification/diff.hpp"
 #include "modification/mod_type.hpp"
 
+#include "generators/palette.hpp"
+#include "logger/logger.hpp"
+
 #include "as_proto/general.pb.h"
 
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/wire_format_lite.h>
+
 namespace Serializers {
 
 std::vector<uint8_t> vectorFromStream(std::istream& stream)
@@ -28,18 +36,91 @@ void writeHeader(
 
     header->set_voxelcount(voxelCount);
     header->set_nodecount(nodeCount);
+    header->set_version(FormatVersion);
 }
 
-SerialInfo readHeader(const ASProto::Header& header)
+std::optional<SerialInfo> readHeader(const ASProto::Header& header)
 {
+    if (header.version() > FormatVersion) {
+        LOG_ERROR("File has format version {}, only {} and older can be read\n", header.version(),
+            FormatVersion);
+        return {};
+    }
+
     return SerialInfo {
         .dimensions = glm::uvec3 { header.dimensions().x(), header.dimensions().y(),
                                   header.dimensions().z(), },
         .voxels = header.voxelcount(),
         .nodes = header.nodecount(),
+        .layout = header.layout(),
+        .version = header.version(),
+        .levels = header.levels(),
     };
 }
 
+bool readLevels(std::istream& stream, google::protobuf::Message& head, uint32_t levelsField,
+    std::function<bool()> onHead, std::function<bool(const std::string&)> onLevel)
+{
+    using google::protobuf::internal::WireFormatLite;
+
+    google::protobuf::io::IstreamInputStream input(&stream);
+
+    // Fields before the levels, re-encoded as they are skipped
+    std::string headBytes;
+    bool headRead = false;
+
+    auto readHead = [&]() {
+        headRead = true;
+        if (!head.ParseFromString(headBytes)) {
+            LOG_ERROR("Failed to parse the file's header fields\n");
+            return false;
+        }
+        headBytes = {};
+
+        return onHead();
+    };
+
+    while (true) {
+        // A coded stream per field so its byte limit applies to a single level, not the file.
+        // Unread buffered bytes are handed back to input when it is destroyed.
+        google::protobuf::io::CodedInputStream coded(&input);
+
+        const uint32_t tag = coded.ReadTag();
+        if (tag == 0)
+            break;
+
+        if (WireFormatLite::GetTagFieldNumber(tag) != (int)levelsField) {
+            if (headRead) {
+                LOG_ERROR("Field {} follows the levels\n", WireFormatLite::GetTagFieldNumber(tag));
+                return false;
+            }
+
+            google::protobuf::io::StringOutputStream output(&headBytes);
+            google::protobuf::io::CodedOutputStream codedOutput(&output);
+            if (!WireFormatLite::SkipField(&coded, tag, &codedOutput)) {
+                LOG_ERROR("File ended inside field {}\n", WireFormatLite::GetTagFieldNumber(tag));
+                return false;
+            }
+            continue;
+        }
+
+        if (!headRead && !readHead())
+            return false;
+
+        uint32_t length;
+        std::string level;
+        if (!coded.ReadVarint32(&length) || !coded.ReadString(&level, length)) {
+            LOG_ERROR("File ended inside a level\n");
+            return false;
+        }
+
+        if (!onLevel(level))
+            return false;
+    }
+
+    return headRead || readHead();
+}
+
 void writeDiff(ASProto::AnimationDiff* diff, glm::ivec3 position, Modification::DiffType diffType)
 {
     diff->set_type(static_cast<uint32_t>(diffType.first));
@@ -106,4 +187,55 @@ Modification::AnimationFrames readAnimation(const ASProto::Animation& animation)
     return frames;
 }
 
+void writePalette(ASProto::Palette* palette, const std::vector<glm::u8vec3>& colours,
+    const std::vector<uint32_t>& indices)
+{
+    for (const glm::u8vec3& colour : colours) {
+        palette->add_colours(Generators::packColour(colour));
+    }
+
+    uint32_t largest = 0;
+    for (uint32_t index : indices) {
+        largest = std::max(largest, index);
+    }
+
+    uint32_t bits = Generators::paletteBits(largest + 1);
+    palette->set_bits(bits);
+
+    for (uint32_t word : Generators::packIndices(indices, bits)) {
+        palette->add_indices(word);
+    }
+}
+
+std::optional<std::pair<std::vector<glm::u8vec3>, std::vector<uint32_t>>> readPalette(
+    const ASProto::Palette& palette, size_t count)
+{
+    uint32_t bits = palette.bits();
+    if (bits != 1 && bits != 2 && bits != 4 && bits != 8) {
+        LOG_ERROR("Palette uses unsupported index width {}\n", bits);
+        return {};
+    }
+
+    const uint32_t perWord = 32 / bits;
+    if ((size_t)palette.indices_size() < (count + perWord - 1) / perWord) {
+        LOG_ERROR("Palette holds fewer indices than the {} required\n", count);
+        return {};
+    }
+
+    std::vector<glm::u8vec3> colours;
+    colours.reserve(palette.colours_size());
+    for (uint32_t colour : palette.colours()) {
+        colours.push_back(Generators::unpackColour(colour));
+    }
+
+    std::vector<uint32_t> packed(palette.indices().begin(), palette.indices().end());
+
+    std::vector<uint32_t> indices;
+    indices.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        indices.push_back(Generators::unpackIndex(packed, i, bits));
+    }
+
+    return std::make_pair(colours, indices);
+}
 }
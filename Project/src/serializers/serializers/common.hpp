@@ -6,11 +6,36 @@
 
 #include <glm/glm.hpp>
 
+#include <functional>
+#include <istream>
+#include <optional>
+#include <string>
+#include <vector>
+
 namespace Serializers {
+// Written to every header. Version 1 widened the voxel and node counts to 64 bits, version 2
+// added trees split into levels.
+static constexpr uint32_t FormatVersion = 2;
+
 struct SerialInfo {
     glm::uvec3 dimensions;
     uint64_t voxels;
     uint64_t nodes;
+
+    // Node ordering for tree structures, see Generators::OctreeLayout, or brickgrid ordering, see
+    // Generators::BrickgridLayout
+    uint32_t layout = 0;
+
+    // Node encoding of contree files, see Generators::ContreeFormat
+    uint32_t format = 0;
+
+    // Number of palette colours when the file stored indexed colours, otherwise 0
+    uint32_t paletteColours = 0;
+
+    uint32_t version = FormatVersion;
+
+    // Levels the tree's nodes are split into, 0 when they are stored together
+    uint32_t levels = 0;
 };
 
 std::vector<uint8_t> vectorFromStream(std::istream& stream);
@@ -18,7 +43,15 @@ std::vector<uint8_t> vectorFromStream(std::istream& stream);
 void writeHeader(
     ASProto::Header* header, glm::uvec3 dimensions, size_t voxelCount, size_t nodeCount);
 
-SerialInfo readHeader(const ASProto::Header& header);
+// Empty if the file was written by a newer format version
+std::optional<SerialInfo> readHeader(const ASProto::Header& header);
+
+// Reads a message as the stream arrives rather than parsing it whole. Every field before the
+// first entry of levelsField is parsed into head and onHead is called, then the bytes of each
+// entry are passed to onLevel in order. Levels must be the message's last field. False if the
+// stream is malformed or a callback returned false.
+bool readLevels(std::istream& stream, google::protobuf::Message& head, uint32_t levelsField,
+    std::function<bool()> onHead, std::function<bool(const std::string&)> onLevel);
 
 void writeDiff(ASProto::AnimationDiff* diff, glm::ivec3 position, Modification::DiffType diffType);
 
@@ -27,4 +60,12 @@ std::pair<glm::ivec3, Modification::DiffType> readDiff(const ASProto::AnimationD
 void writeAnimation(ASProto::Animation* animation, const Modification::AnimationFrames& frames);
 
 Modification::AnimationFrames readAnimation(const ASProto::Animation& animation);
+
+// Packs each index with the smallest width able to hold the largest index
+void writePalette(ASProto::Palette* palette, const std::vector<glm::u8vec3>& colours,
+    const std::vector<uint32_t>& indices);
+
+// Returns the colours and count unpacked indices, indices are not range checked
+std::optional<std::pair<std::vector<glm::u8vec3>, std::vector<uint32_t>>> readPalette(
+    const ASProto::Palette& palette, size_t count);
 };
@@ -5,6 +5,8 @@
 
 #include "as_proto/contree.pb.h"
 
+#include <bit>
+
 namespace Serializers {
 
 std::ifstream loadContreeFile(std::filesystem::path directory)
@@ -22,10 +24,61 @@ std::ifstream loadContreeFile(std::filesystem::path directory)
     return inputStream;
 }
 
+static std::optional<Generators::CompactContree> readCompact(const ASProto::Contree& contree)
+{
+    int nodeCount = contree.child_masks_size();
+    if (contree.leaf_masks_size() != nodeCount || contree.child_offsets_size() != nodeCount
+        || contree.colour_offsets_size() != nodeCount) {
+        LOG_ERROR("Compact contree arrays differ in length\n");
+        return {};
+    }
+
+    Generators::CompactContree compact;
+    compact.nodes.reserve(nodeCount);
+    compact.offsets.reserve(nodeCount);
+    compact.colours.assign(contree.colours().begin(), contree.colours().end());
+
+    for (int i = 0; i < nodeCount; i++) {
+        Generators::CompactContreeNode node {
+            .childMask = contree.child_masks(i),
+            .leafMask = contree.leaf_masks(i),
+        };
+        Generators::CompactContreeOffset offset {
+            .child = contree.child_offsets(i),
+            .colour = contree.colour_offsets(i),
+        };
+
+        if ((node.childMask & node.leafMask) != 0
+            || offset.child + (uint64_t)std::popcount(node.childMask) > (uint64_t)nodeCount
+            || offset.colour + (uint64_t)std::popcount(node.leafMask) > compact.colours.size()) {
+            LOG_ERROR("Compact contree node {} is invalid\n", i);
+            return {};
+        }
+
+        compact.nodes.push_back(node);
+        compact.offsets.push_back(offset);
+    }
+
+    return compact;
+}
+
 std::optional<std::tuple<SerialInfo, std::vector<Generators::ContreeNode>>> loadContree(
     ASProto::Contree& contree)
 {
-    SerialInfo serialInfo = readHeader(contree.header());
+    auto header = readHeader(contree.header());
+    if (!header.has_value())
+        return {};
+    SerialInfo serialInfo = header.value();
+    serialInfo.format = contree.format();
+
+    if (serialInfo.format == static_cast<uint32_t>(Generators::ContreeFormat::COMPACT)
+        && serialInfo.levels == 0) {
+        auto compact = readCompact(contree);
+        if (!compact.has_value())
+            return {};
+
+        return std::make_pair(serialInfo, Generators::expandContree(compact.value()));
+    }
 
     size_t contreeNodes = contree.nodes_size();
     std::vector<Generators::ContreeNode> nodes;
@@ -37,9 +90,61 @@ std::optional<std::tuple<SerialInfo, std::vector<Generators::ContreeNode>>> load
         nodes.push_back(Generators::ContreeNode(node.high(), node.low()));
     }
 
+    // Levels of a progressive file, only present when the whole file was parsed
+    for (const ASProto::ContreeLevel& level : contree.levels()) {
+        for (const ASProto::ContreeNode& node : level.nodes())
+            nodes.push_back(Generators::ContreeNode(node.high(), node.low()));
+    }
+
     return std::make_pair(serialInfo, nodes);
 }
 
+bool loadContree(std::istream& stream,
+    std::function<bool(SerialInfo, std::vector<Generators::ContreeNode>)> onContree,
+    std::function<bool(std::vector<Generators::ContreeNode>)> onLevel)
+{
+    ASProto::Contree contree;
+    uint32_t expectedLevels = 0;
+    uint32_t levels = 0;
+
+    bool read = readLevels(
+        stream, contree, ASProto::Contree::kLevelsFieldNumber,
+        [&]() {
+            auto loaded = loadContree(contree);
+            if (!loaded.has_value())
+                return false;
+
+            auto& [serialInfo, nodes] = loaded.value();
+            expectedLevels = serialInfo.levels;
+
+            return onContree(serialInfo, std::move(nodes));
+        },
+        [&](const std::string& data) {
+            ASProto::ContreeLevel level;
+            if (!level.ParseFromString(data)) {
+                LOG_ERROR("Failed to parse contree level {}\n", levels);
+                return false;
+            }
+            levels++;
+
+            std::vector<Generators::ContreeNode> nodes;
+            nodes.reserve(level.nodes_size());
+            for (const ASProto::ContreeNode& node : level.nodes())
+                nodes.push_back(Generators::ContreeNode(node.high(), node.low()));
+
+            return onLevel(std::move(nodes));
+        });
+    if (!read)
+        return false;
+
+    if (levels != expectedLevels) {
+        LOG_ERROR("Contree has {} levels, expected {}\n", levels, expectedLevels);
+        return false;
+    }
+
+    return true;
+}
+
 std::optional<std::tuple<SerialInfo, std::vector<Generators::ContreeNode>>> loadContree(
     std::filesystem::path directory)
 {
@@ -61,7 +166,8 @@ std::optional<std::tuple<SerialInfo, std::vector<Generators::ContreeNode>>> load
 }
 
 void storeContree(std::filesystem::path output, const std::string& name, glm::uvec3 dimensions,
-    std::vector<Generators::ContreeNode> nodes, Generators::GenerationInfo generationInfo)
+    std::vector<Generators::ContreeNode> nodes, Generators::GenerationInfo generationInfo,
+    Generators::ContreeFormat format, bool progressive)
 {
     std::filesystem::path target = output / name / (name + ".voxcontree");
 
@@ -75,11 +181,41 @@ void storeContree(std::filesystem::path output, const std::string& name, glm::uv
     writeHeader(
         contree.mutable_header(), dimensions, generationInfo.voxelCount, generationInfo.nodes);
 
-    for (const auto& node : nodes) {
-        ASProto::ContreeNode* protoNode = contree.mutable_nodes()->Add();
-        std::array<uint64_t, 2> data = node.getData();
-        protoNode->set_high(data[0]);
-        protoNode->set_low(data[1]);
+    contree.set_format(static_cast<uint32_t>(format));
+
+    if (progressive) {
+        auto [ordered, levelEnds] = Generators::progressiveContree(nodes);
+        contree.mutable_header()->set_levels(levelEnds.size());
+
+        uint64_t start = 0;
+        for (uint64_t end : levelEnds) {
+            ASProto::ContreeLevel* level = contree.mutable_levels()->Add();
+            for (uint64_t i = start; i < end; i++) {
+                ASProto::ContreeNode* protoNode = level->mutable_nodes()->Add();
+                std::array<uint64_t, 2> data = ordered[i].getData();
+                protoNode->set_high(data[0]);
+                protoNode->set_low(data[1]);
+            }
+
+            start = end;
+        }
+    } else if (format == Generators::ContreeFormat::COMPACT) {
+        Generators::CompactContree compact = Generators::compactContree(nodes);
+
+        for (size_t i = 0; i < compact.nodes.size(); i++) {
+            contree.add_child_masks(compact.nodes[i].childMask);
+            contree.add_leaf_masks(compact.nodes[i].leafMask);
+            contree.add_child_offsets(compact.offsets[i].child);
+            contree.add_colour_offsets(compact.offsets[i].colour);
+        }
+        contree.mutable_colours()->Add(compact.colours.begin(), compact.colours.end());
+    } else {
+        for (const auto& node : nodes) {
+            ASProto::ContreeNode* protoNode = contree.mutable_nodes()->Add();
+            std::array<uint64_t, 2> data = node.getData();
+            protoNode->set_high(data[0]);
+            protoNode->set_low(data[1]);
+        }
     }
 
     contree.SerializeToOstream(&outputStream);
@@ -7,6 +7,7 @@
 
 #include <filesystem>
 #include <fstream>
+#include <functional>
 
 namespace Serializers {
 
@@ -18,6 +19,16 @@ std::optional<std::tuple<SerialInfo, std::vector<Generators::ContreeNode>>> load
 std::optional<std::tuple<SerialInfo, std::vector<Generators::ContreeNode>>> loadContree(
     const std::vector<uint8_t>& data);
 
+// Streams the file instead of parsing it whole. onContree is called once the header and the
+// nodes stored together are read, then onLevel with the nodes of each level of a progressive file
+// in order. False if the file is invalid or a callback returned false.
+bool loadContree(std::istream& stream,
+    std::function<bool(SerialInfo, std::vector<Generators::ContreeNode>)> onContree,
+    std::function<bool(std::vector<Generators::ContreeNode>)> onLevel);
+
+// Progressive files store the nodes of progressiveContree split into levels whatever the format,
+// which then only tells the reader how to encode them
 void storeContree(std::filesystem::path output, const std::string& name, glm::uvec3 dimensions,
-    std::vector<Generators::ContreeNode> nodes, Generators::GenerationInfo generationInfo);
+    std::vector<Generators::ContreeNode> nodes, Generators::GenerationInfo generationInfo,
+    Generators::ContreeFormat format = Generators::ContreeFormat::WIDE, bool progressive = false);
 }
@@ -1,6 +1,7 @@
 #include "grid.hpp"
 #include "as_proto/general.pb.h"
 #include "generators/grid.hpp"
+#include "generators/palette.hpp"
 #include "modification/diff.hpp"
 #include "serializers/common.hpp"
 
@@ -25,14 +26,42 @@ std::ifstream loadGridFile(std::filesystem::path directory)
     return inputStream;
 }
 
-std::optional<
-    std::tuple<SerialInfo, std::vector<Generators::GridVoxel>, Modification::AnimationFrames>>
+std::optional<std::tuple<SerialInfo, std::vector<Generators::GridVoxel>,
+    Modification::AnimationFrames, std::vector<uint8_t>>>
 loadGrid(ASProto::Grid& grid)
 {
-    SerialInfo info = readHeader(grid.header());
+    auto header = readHeader(grid.header());
+    if (!header.has_value())
+        return {};
+    SerialInfo info = header.value();
 
-    size_t voxelCount = grid.voxels_size();
     std::vector<Generators::GridVoxel> voxels;
+
+    if (grid.has_palette()) {
+        size_t voxelCount = (size_t)info.dimensions.x * info.dimensions.y * info.dimensions.z;
+
+        auto palette = readPalette(grid.palette(), voxelCount);
+        if (!palette.has_value())
+            return {};
+
+        const auto& [colours, indices] = palette.value();
+        info.paletteColours = colours.size();
+
+        voxels.reserve(voxelCount);
+        for (uint32_t index : indices) {
+            if (index > colours.size()) {
+                LOG_ERROR("Grid palette index {} out of range\n", index);
+                return {};
+            }
+
+            voxels.push_back(Generators::GridVoxel {
+                .visible = index != 0,
+                .colour = index != 0 ? colours[index - 1] : glm::u8vec3(0),
+            });
+        }
+    }
+
+    size_t voxelCount = grid.voxels_size();
     voxels.reserve(voxelCount);
 
     for (size_t i = 0; i < voxelCount; i++) {
@@ -60,11 +89,17 @@ loadGrid(ASProto::Grid& grid)
         animation = readAnimation(grid.animation());
     }
 
-    return std::make_tuple(info, voxels, animation);
+    std::vector<uint8_t> distances(grid.distances().begin(), grid.distances().end());
+    if (!distances.empty() && distances.size() != voxels.size()) {
+        LOG_ERROR("Grid distance field holds {} of {} voxels\n", distances.size(), voxels.size());
+        return {};
+    }
+
+    return std::make_tuple(info, voxels, animation, distances);
 }
 
-std::optional<
-    std::tuple<SerialInfo, std::vector<Generators::GridVoxel>, Modification::AnimationFrames>>
+std::optional<std::tuple<SerialInfo, std::vector<Generators::GridVoxel>,
+    Modification::AnimationFrames, std::vector<uint8_t>>>
 loadGrid(std::filesystem::path directory)
 {
     std::ifstream inputStream = loadGridFile(directory);
@@ -75,8 +110,8 @@ loadGrid(std::filesystem::path directory)
     return loadGrid(grid);
 }
 
-std::optional<
-    std::tuple<SerialInfo, std::vector<Generators::GridVoxel>, Modification::AnimationFrames>>
+std::optional<std::tuple<SerialInfo, std::vector<Generators::GridVoxel>,
+    Modification::AnimationFrames, std::vector<uint8_t>>>
 loadGrid(const std::vector<uint8_t>& data)
 {
     ASProto::Grid grid;
@@ -87,7 +122,8 @@ loadGrid(const std::vector<uint8_t>& data)
 
 void storeGrid(std::filesystem::path output, const std::string& name, glm::uvec3 dimensions,
     std::vector<Generators::GridVoxel> grid, Generators::GenerationInfo generationInfo,
-    const Modification::AnimationFrames& animation)
+    const Modification::AnimationFrames& animation, bool palette,
+    const std::vector<uint8_t>& distances)
 {
     std::filesystem::path target = output / name / (name + ".voxgrid");
 
@@ -102,17 +138,41 @@ void storeGrid(std::filesystem::path output, const std::string& name, glm::uvec3
     writeHeader(
         gridProto.mutable_header(), dimensions, generationInfo.voxelCount, generationInfo.nodes);
 
-    for (const auto& voxel : grid) {
-        uint32_t v = (((uint32_t)voxel.colour.r) << 24) | (((uint32_t)voxel.colour.g) << 16)
-            | (((uint32_t)voxel.colour.b) << 8) | (((uint32_t)voxel.visible) << 0);
-
-        gridProto.mutable_voxels()->Add(v);
+    if (palette) {
+        std::vector<glm::u8vec3> visibleColours;
+        for (const auto& voxel : grid) {
+            if (voxel.visible)
+                visibleColours.push_back(voxel.colour);
+        }
+
+        // Index 0 is reserved for empty voxels
+        Generators::Palette colourPalette = Generators::buildPalette(visibleColours, 255);
+
+        std::vector<uint32_t> indices;
+        indices.reserve(grid.size());
+        for (const auto& voxel : grid) {
+            indices.push_back(
+                voxel.visible ? Generators::paletteIndex(colourPalette, voxel.colour) + 1 : 0);
+        }
+
+        writePalette(gridProto.mutable_palette(), colourPalette.colours, indices);
+    } else {
+        for (const auto& voxel : grid) {
+            uint32_t v = (((uint32_t)voxel.colour.r) << 24) | (((uint32_t)voxel.colour.g) << 16)
+                | (((uint32_t)voxel.colour.b) << 8) | (((uint32_t)voxel.visible) << 0);
+
+            gridProto.mutable_voxels()->Add(v);
+        }
     }
 
     if (animation.size() != 0) {
         writeAnimation(gridProto.mutable_animation(), animation);
     }
 
+    if (!distances.empty()) {
+        gridProto.set_distances(distances.data(), distances.size());
+    }
+
     gridProto.SerializeToOstream(&outputStream);
 
     outputStream.close();
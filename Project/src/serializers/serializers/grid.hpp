@@ -15,16 +15,18 @@ namespace Serializers {
 
 std::ifstream loadGridFile(std::filesystem::path directory);
 
-std::optional<
-    std::tuple<SerialInfo, std::vector<Generators::GridVoxel>, Modification::AnimationFrames>>
+// The last element holds the distance field, empty when the file has none
+std::optional<std::tuple<SerialInfo, std::vector<Generators::GridVoxel>,
+    Modification::AnimationFrames, std::vector<uint8_t>>>
 loadGrid(std::filesystem::path directory);
 
-std::optional<
-    std::tuple<SerialInfo, std::vector<Generators::GridVoxel>, Modification::AnimationFrames>>
+std::optional<std::tuple<SerialInfo, std::vector<Generators::GridVoxel>,
+    Modification::AnimationFrames, std::vector<uint8_t>>>
 loadGrid(const std::vector<uint8_t>& data);
 
 void storeGrid(std::filesystem::path output, const std::string& name, glm::uvec3 dimensions,
     std::vector<Generators::GridVoxel> grid, Generators::GenerationInfo generationInfo,
-    const Modification::AnimationFrames& animation);
+    const Modification::AnimationFrames& animation, bool palette = false,
+    const std::vector<uint8_t>& distances = {});
 
 }
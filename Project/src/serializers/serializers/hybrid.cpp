@@ -0,0 +1,162 @@
+#include "hybrid.hpp"
+
+#include "common.hpp"
+
+#include "as_proto/hybrid.pb.h"
+
+#include "generators/common.hpp"
+#include "generators/hybrid.hpp"
+
+#include <bit>
+
+namespace Serializers {
+
+std::ifstream loadHybridFile(std::filesystem::path directory)
+{
+    std::string foldername = directory.filename();
+
+    std::filesystem::path file = directory / (foldername + ".voxhybrid");
+    std::ifstream inputStream(file.string(), std::ios::binary | std::ios::in);
+
+    if (!inputStream.is_open()) {
+        LOG_ERROR("Failed to open file: {}\n", file.string());
+        return {};
+    }
+
+    return inputStream;
+}
+
+// Every child, brick and colour referenced by a node must be stored
+static bool validNodes(const Generators::HybridOctree& hybrid)
+{
+    const uint64_t nodeCount = hybrid.nodes.size();
+    const uint64_t brickCount
+        = hybrid.occupancy.size() / Generators::hybridBrickWords(hybrid.brickSize);
+
+    for (size_t i = 0; i < hybrid.nodes.size(); i++) {
+        const Generators::HybridNode& node = hybrid.nodes[i];
+
+        bool valid = true;
+        switch (node.getType()) {
+        case Generators::HybridNode::INTERIOR:
+            valid = (uint64_t)node.index + std::popcount(node.getChildMask()) <= nodeCount;
+            break;
+        case Generators::HybridNode::SOLID:
+            break;
+        case Generators::HybridNode::BRICK: {
+            if (node.index >= brickCount) {
+                valid = false;
+                break;
+            }
+
+            const uint32_t words = Generators::hybridBrickWords(hybrid.brickSize);
+            uint64_t voxels = 0;
+            for (uint32_t w = 0; w < words; w++)
+                voxels += std::popcount(hybrid.occupancy[node.index * words + w]);
+            if (node.isUniform())
+                voxels = 1;
+
+            valid = node.getColourPtr() + voxels <= hybrid.colours.size();
+            break;
+        }
+        default:
+            valid = false;
+        }
+
+        if (!valid) {
+            LOG_ERROR("Hybrid node {} is invalid\n", i);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::optional<std::tuple<SerialInfo, Generators::HybridOctree>> loadHybrid(
+    const ASProto::Hybrid& proto)
+{
+    auto header = readHeader(proto.header());
+    if (!header.has_value())
+        return {};
+    SerialInfo serialInfo = header.value();
+
+    Generators::HybridOctree hybrid;
+    hybrid.brickSize = proto.brick_size();
+    if (hybrid.brickSize != 4 && hybrid.brickSize != 8) {
+        LOG_ERROR("Unsupported hybrid brick size {}\n", hybrid.brickSize);
+        return {};
+    }
+
+    if (proto.nodes_size() % 2 != 0 || proto.nodes_size() == 0
+        || proto.occupancy_size() % Generators::hybridBrickWords(hybrid.brickSize) != 0) {
+        LOG_ERROR("Hybrid arrays have invalid lengths\n");
+        return {};
+    }
+
+    hybrid.nodes.reserve(proto.nodes_size() / 2);
+    for (int i = 0; i < proto.nodes_size(); i += 2) {
+        hybrid.nodes.push_back(Generators::HybridNode {
+            .data = proto.nodes(i),
+            .index = proto.nodes(i + 1),
+        });
+    }
+
+    hybrid.occupancy.assign(proto.occupancy().begin(), proto.occupancy().end());
+    hybrid.colours.assign(proto.colours().begin(), proto.colours().end());
+
+    if (!validNodes(hybrid))
+        return {};
+
+    return std::make_tuple(serialInfo, std::move(hybrid));
+}
+
+std::optional<std::tuple<SerialInfo, Generators::HybridOctree>> loadHybrid(
+    std::filesystem::path directory)
+{
+    std::ifstream inputStream = loadHybridFile(directory);
+    ASProto::Hybrid hybrid;
+    hybrid.ParseFromIstream(&inputStream);
+
+    return loadHybrid(hybrid);
+}
+
+std::optional<std::tuple<SerialInfo, Generators::HybridOctree>> loadHybrid(
+    const std::vector<uint8_t>& data)
+{
+    ASProto::Hybrid hybrid;
+    hybrid.ParseFromArray(data.data(), data.size());
+
+    return loadHybrid(hybrid);
+}
+
+void storeHybrid(std::filesystem::path output, const std::string& name, glm::uvec3 dimensions,
+    const Generators::HybridOctree& hybrid, Generators::GenerationInfo generationInfo)
+{
+    std::filesystem::path target = output / name / (name + ".voxhybrid");
+
+    std::ofstream outputStream(target.string(), std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!outputStream.is_open()) {
+        fprintf(stderr, "Failed to open file %s\n", target.string().c_str());
+        exit(-1);
+    }
+
+    ASProto::Hybrid proto;
+
+    writeHeader(
+        proto.mutable_header(), dimensions, generationInfo.voxelCount, generationInfo.nodes);
+    proto.set_brick_size(hybrid.brickSize);
+
+    proto.mutable_nodes()->Reserve(hybrid.nodes.size() * 2);
+    for (const Generators::HybridNode& node : hybrid.nodes) {
+        proto.add_nodes(node.data);
+        proto.add_nodes(node.index);
+    }
+
+    proto.mutable_occupancy()->Add(hybrid.occupancy.begin(), hybrid.occupancy.end());
+    proto.mutable_colours()->Add(hybrid.colours.begin(), hybrid.colours.end());
+
+    proto.SerializeToOstream(&outputStream);
+
+    outputStream.close();
+}
+}
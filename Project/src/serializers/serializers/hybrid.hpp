@@ -0,0 +1,23 @@
+#pragma once
+
+#include "common.hpp"
+
+#include "generators/common.hpp"
+#include "generators/hybrid.hpp"
+
+#include <filesystem>
+#include <fstream>
+
+namespace Serializers {
+
+std::ifstream loadHybridFile(std::filesystem::path directory);
+
+std::optional<std::tuple<SerialInfo, Generators::HybridOctree>> loadHybrid(
+    std::filesystem::path directory);
+
+std::optional<std::tuple<SerialInfo, Generators::HybridOctree>> loadHybrid(
+    const std::vector<uint8_t>& data);
+
+void storeHybrid(std::filesystem::path output, const std::string& name, glm::uvec3 dimensions,
+    const Generators::HybridOctree& hybrid, Generators::GenerationInfo generationInfo);
+}
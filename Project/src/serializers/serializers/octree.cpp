@@ -24,10 +24,14 @@ std::ifstream loadOctreeFile(std::filesystem::path directory)
     return inputStream;
 }
 
-std::optional<std::tuple<SerialInfo, std::vector<Generators::OctreeNode>>> loadOctree(
-    ASProto::Octree& octree)
+std::optional<std::tuple<SerialInfo, std::vector<Generators::OctreeNode>, std::vector<uint32_t>,
+    std::vector<uint32_t>>>
+loadOctree(ASProto::Octree& octree)
 {
-    SerialInfo serialInfo = readHeader(octree.header());
+    auto header = readHeader(octree.header());
+    if (!header.has_value())
+        return {};
+    SerialInfo serialInfo = header.value();
 
     size_t nodeCount = octree.nodes_size();
     std::vector<Generators::OctreeNode> nodes;
@@ -39,11 +43,36 @@ std::optional<std::tuple<SerialInfo, std::vector<Generators::OctreeNode>>> loadO
         nodes.push_back(value);
     }
 
-    return std::make_pair(serialInfo, nodes);
+    // Levels of a progressive file, only present when the whole file was parsed
+    for (const ASProto::OctreeLevel& level : octree.levels()) {
+        for (const ASProto::OctreeNode& node : level.nodes())
+            nodes.push_back(node.data());
+    }
+
+    std::vector<uint32_t> ropes(octree.ropes().begin(), octree.ropes().end());
+    if (!ropes.empty() && ropes.size() != nodes.size() * Generators::RopeFaces) {
+        LOG_ERROR("Octree has {} ropes for {} nodes\n", ropes.size(), nodes.size());
+        return {};
+    }
+
+    std::vector<uint32_t> frameRoots(octree.frame_roots().begin(), octree.frame_roots().end());
+    for (uint32_t root : frameRoots) {
+        if (root >= nodes.size()) {
+            LOG_ERROR("Octree frame root {} outside of {} nodes\n", root, nodes.size());
+            return {};
+        }
+    }
+    if (!frameRoots.empty() && frameRoots[0] != 0) {
+        LOG_ERROR("Octree first frame root is {}, expected 0\n", frameRoots[0]);
+        return {};
+    }
+
+    return std::make_tuple(serialInfo, nodes, ropes, frameRoots);
 }
 
-std::optional<std::tuple<SerialInfo, std::vector<Generators::OctreeNode>>> loadOctree(
-    std::filesystem::path directory)
+std::optional<std::tuple<SerialInfo, std::vector<Generators::OctreeNode>, std::vector<uint32_t>,
+    std::vector<uint32_t>>>
+loadOctree(std::filesystem::path directory)
 {
     std::ifstream inputStream = loadOctreeFile(directory);
     ASProto::Octree octree;
@@ -52,8 +81,9 @@ std::optional<std::tuple<SerialInfo, std::vector<Generators::OctreeNode>>> loadO
     return loadOctree(octree);
 }
 
-std::optional<std::tuple<SerialInfo, std::vector<Generators::OctreeNode>>> loadOctree(
-    const std::vector<uint8_t>& data)
+std::optional<std::tuple<SerialInfo, std::vector<Generators::OctreeNode>, std::vector<uint32_t>,
+    std::vector<uint32_t>>>
+loadOctree(const std::vector<uint8_t>& data)
 {
     ASProto::Octree octree;
     octree.ParseFromArray(data.data(), data.size());
@@ -61,8 +91,61 @@ std::optional<std::tuple<SerialInfo, std::vector<Generators::OctreeNode>>> loadO
     return loadOctree(octree);
 }
 
+bool loadOctree(std::istream& stream,
+    std::function<bool(SerialInfo, std::vector<Generators::OctreeNode>, std::vector<uint32_t>,
+        std::vector<uint32_t>)>
+        onOctree,
+    std::function<bool(std::vector<Generators::OctreeNode>, std::vector<uint32_t>)> onLevel)
+{
+    ASProto::Octree octree;
+    uint32_t expectedLevels = 0;
+    uint32_t levels = 0;
+
+    bool read = readLevels(
+        stream, octree, ASProto::Octree::kLevelsFieldNumber,
+        [&]() {
+            auto loaded = loadOctree(octree);
+            if (!loaded.has_value())
+                return false;
+
+            auto& [serialInfo, nodes, ropes, frameRoots] = loaded.value();
+            expectedLevels = serialInfo.levels;
+
+            return onOctree(
+                serialInfo, std::move(nodes), std::move(ropes), std::move(frameRoots));
+        },
+        [&](const std::string& data) {
+            ASProto::OctreeLevel level;
+            if (!level.ParseFromString(data)) {
+                LOG_ERROR("Failed to parse octree level {}\n", levels);
+                return false;
+            }
+            levels++;
+
+            std::vector<Generators::OctreeNode> nodes;
+            nodes.reserve(level.nodes_size());
+            for (const ASProto::OctreeNode& node : level.nodes())
+                nodes.push_back(node.data());
+
+            return onLevel(
+                std::move(nodes), std::vector<uint32_t>(level.averages().begin(),
+                                      level.averages().end()));
+        });
+    if (!read)
+        return false;
+
+    if (levels != expectedLevels) {
+        LOG_ERROR("Octree has {} levels, expected {}\n", levels, expectedLevels);
+        return false;
+    }
+
+    return true;
+}
+
 void storeOctree(std::filesystem::path output, const std::string& name, glm::uvec3 dimensions,
-    std::vector<Generators::OctreeNode> nodes, Generators::GenerationInfo generationInfo)
+    std::vector<Generators::OctreeNode> nodes, Generators::GenerationInfo generationInfo,
+    Generators::OctreeLayout layout, const std::vector<uint32_t>& ropes,
+    const std::vector<uint32_t>& frameRoots, bool progressive)
 {
     std::filesystem::path target = output / name / (name + ".voxoctree");
 
@@ -76,12 +159,33 @@ void storeOctree(std::filesystem::path output, const std::string& name, glm::uve
 
     writeHeader(
         octree.mutable_header(), dimensions, generationInfo.voxelCount, generationInfo.nodes);
-
-    for (const auto& node : nodes) {
-        uint32_t data = node.getData();
-
-        ASProto::OctreeNode* protoNode = octree.mutable_nodes()->Add();
-        protoNode->set_data(data);
+    octree.mutable_header()->set_layout(static_cast<uint32_t>(layout));
+
+    if (progressive) {
+        std::vector<Generators::OctreeLevel> levels = Generators::splitOctreeLevels(nodes);
+        octree.mutable_header()->set_levels(levels.size());
+        octree.mutable_header()->set_layout(
+            static_cast<uint32_t>(Generators::OctreeLayout::BREADTH_FIRST));
+
+        uint64_t start = 0;
+        for (const Generators::OctreeLevel& level : levels) {
+            ASProto::OctreeLevel* protoLevel = octree.mutable_levels()->Add();
+            for (uint64_t i = start; i < level.end; i++)
+                protoLevel->mutable_nodes()->Add()->set_data(nodes[i].getData());
+            protoLevel->mutable_averages()->Add(level.averages.begin(), level.averages.end());
+
+            start = level.end;
+        }
+    } else {
+        for (const auto& node : nodes) {
+            uint32_t data = node.getData();
+
+            ASProto::OctreeNode* protoNode = octree.mutable_nodes()->Add();
+            protoNode->set_data(data);
+        }
+
+        octree.mutable_ropes()->Add(ropes.begin(), ropes.end());
+        octree.mutable_frame_roots()->Add(frameRoots.begin(), frameRoots.end());
     }
 
     octree.SerializeToOstream(&outputStream);
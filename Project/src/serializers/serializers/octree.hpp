@@ -7,17 +7,35 @@
 
 #include <filesystem>
 #include <fstream>
+#include <functional>
 
 namespace Serializers {
 
 std::ifstream loadOctreeFile(std::filesystem::path directory);
 
-std::optional<std::tuple<SerialInfo, std::vector<Generators::OctreeNode>>> loadOctree(
-    std::filesystem::path directory);
-
-std::optional<std::tuple<SerialInfo, std::vector<Generators::OctreeNode>>> loadOctree(
-    const std::vector<uint8_t>& data);
-
+std::optional<std::tuple<SerialInfo, std::vector<Generators::OctreeNode>, std::vector<uint32_t>,
+    std::vector<uint32_t>>>
+loadOctree(std::filesystem::path directory);
+
+std::optional<std::tuple<SerialInfo, std::vector<Generators::OctreeNode>, std::vector<uint32_t>,
+    std::vector<uint32_t>>>
+loadOctree(const std::vector<uint8_t>& data);
+
+// Streams the file instead of parsing it whole. onOctree is called once the header, the nodes
+// stored together, the ropes and frame roots are read, then onLevel with the nodes and averages
+// of each level of a progressive file in order. False if the file is invalid or a callback
+// returned false.
+bool loadOctree(std::istream& stream,
+    std::function<bool(SerialInfo, std::vector<Generators::OctreeNode>, std::vector<uint32_t>,
+        std::vector<uint32_t>)>
+        onOctree,
+    std::function<bool(std::vector<Generators::OctreeNode>, std::vector<uint32_t>)> onLevel);
+
+// Progressive files split the nodes into levels, nodes must then be in
+// OctreeLayout::BREADTH_FIRST order and ropes and frame roots are not stored
 void storeOctree(std::filesystem::path output, const std::string& name, glm::uvec3 dimensions,
-    std::vector<Generators::OctreeNode> nodes, Generators::GenerationInfo generationInfo);
+    std::vector<Generators::OctreeNode> nodes, Generators::GenerationInfo generationInfo,
+    Generators::OctreeLayout layout = Generators::OctreeLayout::DEPTH_FIRST,
+    const std::vector<uint32_t>& ropes = {}, const std::vector<uint32_t>& frameRoots = {},
+    bool progressive = false);
 }
@@ -0,0 +1,118 @@
+#include "partial_tree.hpp"
+
+#include "common.hpp"
+
+#include "as_proto/partial_tree.pb.h"
+
+#include "generators/partial_tree.hpp"
+#include "logger/logger.hpp"
+
+#include <fstream>
+
+namespace Serializers {
+
+static Generators::PartialNode readNode(const ASProto::PartialNode& node)
+{
+    return Generators::PartialNode {
+        .colour = glm::vec3(node.r(), node.g(), node.b()),
+        .visible = node.visible(),
+        .parent = node.parent(),
+        .childMask = node.child_mask(),
+        .childStartIndex = node.child_start_index(),
+        .childCount = node.child_count(),
+    };
+}
+
+static void writeNode(ASProto::PartialNode* proto, const Generators::PartialNode& node)
+{
+    proto->set_r(node.colour.r);
+    proto->set_g(node.colour.g);
+    proto->set_b(node.colour.b);
+    proto->set_visible(node.visible);
+    proto->set_parent(node.parent);
+    proto->set_child_mask(node.childMask);
+    proto->set_child_start_index(node.childStartIndex);
+    proto->set_child_count(node.childCount);
+}
+
+std::optional<Generators::PartialTree> loadPartialTree(std::filesystem::path file)
+{
+    std::ifstream inputStream(file.string(), std::ios::binary | std::ios::in);
+    if (!inputStream.is_open()) {
+        LOG_ERROR("Failed to open file: {}\n", file.string());
+        return {};
+    }
+
+    ASProto::PartialTree proto;
+    if (!proto.ParseFromIstream(&inputStream)) {
+        LOG_ERROR("Failed to parse partial tree: {}\n", file.string());
+        return {};
+    }
+
+    if (proto.first() > proto.last()) {
+        LOG_ERROR("Partial tree range {} to {} is invalid\n", proto.first(), proto.last());
+        return {};
+    }
+
+    Generators::PartialTree partial {
+        .loaderDimensions = glm::uvec3 { proto.loader_dimensions().x(),
+            proto.loader_dimensions().y(), proto.loader_dimensions().z() },
+        .subtreeLevels = proto.subtree_levels(),
+        .first = proto.first(),
+        .last = proto.last(),
+        .subtrees = {},
+    };
+    partial.subtrees.reserve(proto.subtrees_size());
+
+    for (const ASProto::PartialSubtree& subtree : proto.subtrees()) {
+        Generators::PartialSubtree& loaded = partial.subtrees.emplace_back();
+        loaded.index = subtree.index();
+        loaded.voxelCount = subtree.voxel_count();
+        loaded.root = readNode(subtree.root());
+
+        loaded.nodes.reserve(subtree.nodes_size());
+        for (const ASProto::PartialNode& node : subtree.nodes()) {
+            loaded.nodes.push_back(readNode(node));
+        }
+    }
+
+    return partial;
+}
+
+void storePartialTree(std::filesystem::path file, const Generators::PartialTree& partial)
+{
+    std::filesystem::path temporary = file;
+    temporary += ".tmp";
+
+    std::ofstream outputStream(
+        temporary.string(), std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!outputStream.is_open()) {
+        fprintf(stderr, "Failed to open file %s\n", temporary.string().c_str());
+        exit(-1);
+    }
+
+    ASProto::PartialTree proto;
+    proto.mutable_loader_dimensions()->set_x(partial.loaderDimensions.x);
+    proto.mutable_loader_dimensions()->set_y(partial.loaderDimensions.y);
+    proto.mutable_loader_dimensions()->set_z(partial.loaderDimensions.z);
+    proto.set_subtree_levels(partial.subtreeLevels);
+    proto.set_first(partial.first);
+    proto.set_last(partial.last);
+
+    for (const Generators::PartialSubtree& subtree : partial.subtrees) {
+        ASProto::PartialSubtree* protoSubtree = proto.add_subtrees();
+        protoSubtree->set_index(subtree.index);
+        protoSubtree->set_voxel_count(subtree.voxelCount);
+        writeNode(protoSubtree->mutable_root(), subtree.root);
+
+        for (const Generators::PartialNode& node : subtree.nodes) {
+            writeNode(protoSubtree->add_nodes(), node);
+        }
+    }
+
+    proto.SerializeToOstream(&outputStream);
+    outputStream.close();
+
+    std::filesystem::rename(temporary, file);
+}
+}
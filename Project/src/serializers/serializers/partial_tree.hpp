@@ -0,0 +1,18 @@
+#pragma once
+
+#include "common.hpp"
+
+#include "generators/partial_tree.hpp"
+
+#include <filesystem>
+#include <optional>
+
+namespace Serializers {
+
+// Partial trees are exchanged between processes rather than loaded by the renderer, so are read
+// and written as single files
+std::optional<Generators::PartialTree> loadPartialTree(std::filesystem::path file);
+
+// Written beside the target and renamed into place, so a reader never sees a partial file
+void storePartialTree(std::filesystem::path file, const Generators::PartialTree& partial);
+}
@@ -1,6 +1,7 @@
 #include "texture.hpp"
 
 #include "common.hpp"
+#include "generators/palette.hpp"
 #include "generators/texture.hpp"
 #include "modification/diff.hpp"
 
@@ -28,10 +29,40 @@ std::optional<
     std::tuple<SerialInfo, std::vector<Generators::TextureVoxel>, Modification::AnimationFrames>>
 loadTexture(ASProto::Texture& texture)
 {
-    SerialInfo serialInfo = readHeader(texture.header());
+    auto header = readHeader(texture.header());
+    if (!header.has_value())
+        return {};
+    SerialInfo serialInfo = header.value();
 
-    size_t voxelCount = texture.voxels_size();
     std::vector<Generators::TextureVoxel> voxels;
+
+    if (texture.has_palette()) {
+        size_t voxelCount = (size_t)serialInfo.dimensions.x * serialInfo.dimensions.y
+            * serialInfo.dimensions.z;
+
+        auto palette = readPalette(texture.palette(), voxelCount);
+        if (!palette.has_value())
+            return {};
+
+        const auto& [colours, indices] = palette.value();
+        serialInfo.paletteColours = colours.size();
+
+        voxels.reserve(voxelCount);
+        for (uint32_t index : indices) {
+            if (index > colours.size()) {
+                LOG_ERROR("Texture palette index {} out of range\n", index);
+                return {};
+            }
+
+            if (index == 0) {
+                voxels.push_back(glm::u8vec4(0));
+            } else {
+                voxels.push_back(glm::u8vec4(colours[index - 1], 1));
+            }
+        }
+    }
+
+    size_t voxelCount = texture.voxels_size();
     voxels.reserve(voxelCount);
 
     for (size_t i = 0; i < voxelCount; i++) {
@@ -78,7 +109,7 @@ loadTexture(const std::vector<uint8_t>& data)
 
 void storeTexture(std::filesystem::path output, const std::string& name, glm::uvec3 dimensions,
     std::vector<Generators::TextureVoxel> voxels, Generators::GenerationInfo generationInfo,
-    const Modification::AnimationFrames& animation)
+    const Modification::AnimationFrames& animation, bool palette)
 {
     std::filesystem::path target = output / name / (name + ".voxtexture");
 
@@ -93,11 +124,32 @@ void storeTexture(std::filesystem::path output, const std::string& name, glm::uv
     writeHeader(
         textureProto.mutable_header(), dimensions, generationInfo.voxelCount, generationInfo.nodes);
 
-    for (const auto& voxel : voxels) {
-        uint32_t v = (((uint32_t)(voxel.r)) << 24) | (((uint32_t)(voxel.g)) << 16)
-            | (((uint32_t)(voxel.b)) << 8) | (((uint32_t)(voxel.a)) << 0);
-
-        textureProto.add_voxels(v);
+    if (palette) {
+        std::vector<glm::u8vec3> visibleColours;
+        for (const auto& voxel : voxels) {
+            if (voxel.a != 0)
+                visibleColours.push_back(glm::u8vec3(voxel));
+        }
+
+        // Index 0 is reserved for empty voxels
+        Generators::Palette colourPalette = Generators::buildPalette(visibleColours, 255);
+
+        std::vector<uint32_t> indices;
+        indices.reserve(voxels.size());
+        for (const auto& voxel : voxels) {
+            indices.push_back(voxel.a != 0
+                    ? Generators::paletteIndex(colourPalette, glm::u8vec3(voxel)) + 1
+                    : 0);
+        }
+
+        writePalette(textureProto.mutable_palette(), colourPalette.colours, indices);
+    } else {
+        for (const auto& voxel : voxels) {
+            uint32_t v = (((uint32_t)(voxel.r)) << 24) | (((uint32_t)(voxel.g)) << 16)
+                | (((uint32_t)(voxel.b)) << 8) | (((uint32_t)(voxel.a)) << 0);
+
+            textureProto.add_voxels(v);
+        }
     }
 
     if (animation.size() != 0) {
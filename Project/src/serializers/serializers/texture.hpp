@@ -22,5 +22,5 @@ loadTexture(const std::vector<uint8_t>& data);
 
 void storeTexture(std::filesystem::path output, const std::string& name, glm::uvec3 dimensions,
     std::vector<Generators::TextureVoxel> voxels, Generators::GenerationInfo generationInfo,
-    const Modification::AnimationFrames& animation);
+    const Modification::AnimationFrames& animation, bool palette = false);
 }
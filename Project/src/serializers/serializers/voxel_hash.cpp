@@ -0,0 +1,128 @@
+#include "voxel_hash.hpp"
+
+#include "common.hpp"
+
+#include "as_proto/voxel_hash.pb.h"
+
+#include "generators/common.hpp"
+#include "generators/voxel_hash.hpp"
+
+#include <bit>
+
+namespace Serializers {
+
+std::ifstream loadVoxelHashFile(std::filesystem::path directory)
+{
+    std::string foldername = directory.filename();
+
+    std::filesystem::path file = directory / (foldername + ".voxhash");
+    std::ifstream inputStream(file.string(), std::ios::binary | std::ios::in);
+
+    if (!inputStream.is_open()) {
+        LOG_ERROR("Failed to open file: {}\n", file.string());
+        return {};
+    }
+
+    return inputStream;
+}
+
+std::optional<std::tuple<SerialInfo, Generators::VoxelHash>> loadVoxelHash(
+    const ASProto::VoxelHash& proto)
+{
+    auto header = readHeader(proto.header());
+    if (!header.has_value())
+        return {};
+    SerialInfo serialInfo = header.value();
+
+    // The table is rebuilt by insertion, only the blocks are stored
+    Generators::VoxelHash hash(proto.blocks_size());
+    for (int i = 0; i < proto.blocks_size(); i++) {
+        const ASProto::HashBlock& stored = proto.blocks(i);
+        const glm::ivec3 position(stored.x(), stored.y(), stored.z());
+
+        if (stored.occupancy_size() != Generators::HashBlock::Words) {
+            LOG_ERROR("Hash block {} has {} occupancy words\n", i, stored.occupancy_size());
+            return {};
+        }
+
+        if (hash.findBlock(position) != nullptr) {
+            LOG_ERROR("Hash block ({}, {}, {}) is stored twice\n", position.x, position.y,
+                position.z);
+            return {};
+        }
+
+        Generators::HashBlock& block = hash.insertBlock(position);
+
+        int colour = 0;
+        for (uint32_t w = 0; w < Generators::HashBlock::Words; w++) {
+            block.occupancy[w] = stored.occupancy(w);
+
+            for (uint64_t word = block.occupancy[w]; word != 0; word &= word - 1) {
+                if (colour >= stored.colours_size()) {
+                    LOG_ERROR("Hash block {} is missing colours\n", i);
+                    return {};
+                }
+
+                block.colours[w * 64 + std::countr_zero(word)] = stored.colours(colour++);
+            }
+        }
+    }
+
+    return std::make_tuple(serialInfo, std::move(hash));
+}
+
+std::optional<std::tuple<SerialInfo, Generators::VoxelHash>> loadVoxelHash(
+    std::filesystem::path directory)
+{
+    std::ifstream inputStream = loadVoxelHashFile(directory);
+    ASProto::VoxelHash hash;
+    hash.ParseFromIstream(&inputStream);
+
+    return loadVoxelHash(hash);
+}
+
+std::optional<std::tuple<SerialInfo, Generators::VoxelHash>> loadVoxelHash(
+    const std::vector<uint8_t>& data)
+{
+    ASProto::VoxelHash hash;
+    hash.ParseFromArray(data.data(), data.size());
+
+    return loadVoxelHash(hash);
+}
+
+void storeVoxelHash(std::filesystem::path output, const std::string& name, glm::uvec3 dimensions,
+    const Generators::VoxelHash& hash, Generators::GenerationInfo generationInfo)
+{
+    std::filesystem::path target = output / name / (name + ".voxhash");
+
+    std::ofstream outputStream(target.string(), std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!outputStream.is_open()) {
+        fprintf(stderr, "Failed to open file %s\n", target.string().c_str());
+        exit(-1);
+    }
+
+    ASProto::VoxelHash proto;
+
+    writeHeader(
+        proto.mutable_header(), dimensions, generationInfo.voxelCount, generationInfo.nodes);
+
+    proto.mutable_blocks()->Reserve(hash.getBlocks().size());
+    for (const Generators::HashBlock& block : hash.getBlocks()) {
+        ASProto::HashBlock* stored = proto.add_blocks();
+        stored->set_x(block.position.x);
+        stored->set_y(block.position.y);
+        stored->set_z(block.position.z);
+
+        for (uint32_t w = 0; w < Generators::HashBlock::Words; w++) {
+            stored->add_occupancy(block.occupancy[w]);
+
+            for (uint64_t word = block.occupancy[w]; word != 0; word &= word - 1)
+                stored->add_colours(block.colours[w * 64 + std::countr_zero(word)]);
+        }
+    }
+
+    proto.SerializeToOstream(&outputStream);
+
+    outputStream.close();
+}
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "common.hpp"
+
+#include "generators/common.hpp"
+#include "generators/voxel_hash.hpp"
+
+#include <filesystem>
+#include <fstream>
+
+namespace Serializers {
+
+std::ifstream loadVoxelHashFile(std::filesystem::path directory);
+
+std::optional<std::tuple<SerialInfo, Generators::VoxelHash>> loadVoxelHash(
+    std::filesystem::path directory);
+
+std::optional<std::tuple<SerialInfo, Generators::VoxelHash>> loadVoxelHash(
+    const std::vector<uint8_t>& data);
+
+void storeVoxelHash(std::filesystem::path output, const std::string& name, glm::uvec3 dimensions,
+    const Generators::VoxelHash& hash, Generators::GenerationInfo generationInfo);
+}
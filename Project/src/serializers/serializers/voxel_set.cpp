@@ -0,0 +1,89 @@
+#include "voxel_set.hpp"
+
+#include "common.hpp"
+
+#include "as_proto/voxel_set.pb.h"
+
+#include "logger/logger.hpp"
+
+#include <fstream>
+
+namespace Serializers {
+
+std::optional<std::tuple<glm::uvec3, VoxelFrames>> loadVoxelSet(std::filesystem::path file)
+{
+    std::ifstream inputStream(file.string(), std::ios::binary | std::ios::in);
+    if (!inputStream.is_open()) {
+        LOG_ERROR("Failed to open file: {}\n", file.string());
+        return {};
+    }
+
+    ASProto::VoxelSet voxelSet;
+    if (!voxelSet.ParseFromIstream(&inputStream)) {
+        LOG_ERROR("Failed to parse voxel set: {}\n", file.string());
+        return {};
+    }
+
+    auto header = readHeader(voxelSet.header());
+    if (!header.has_value())
+        return {};
+    SerialInfo serialInfo = header.value();
+
+    VoxelFrames frames;
+    frames.reserve(voxelSet.frames_size());
+    for (const ASProto::VoxelFrame& frame : voxelSet.frames()) {
+        if (frame.positions_size() != frame.colours_size()
+            || frame.positions_size() % 3 != 0) {
+            LOG_ERROR("Voxel frame has {} positions for {} colours\n", frame.positions_size(),
+                frame.colours_size());
+            return {};
+        }
+
+        auto& voxels = frames.emplace_back();
+        voxels.reserve(frame.positions_size() / 3);
+        for (int i = 0; i < frame.positions_size(); i += 3) {
+            glm::ivec3 position(frame.positions(i), frame.positions(i + 1), frame.positions(i + 2));
+            voxels[position]
+                = glm::vec3(frame.colours(i), frame.colours(i + 1), frame.colours(i + 2));
+        }
+    }
+
+    return std::make_tuple(serialInfo.dimensions, std::move(frames));
+}
+
+void storeVoxelSet(std::filesystem::path file, glm::uvec3 dimensions, const VoxelFrames& frames)
+{
+    std::filesystem::path temporary = file;
+    temporary += ".tmp";
+
+    std::ofstream outputStream(
+        temporary.string(), std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!outputStream.is_open()) {
+        fprintf(stderr, "Failed to open file %s\n", temporary.string().c_str());
+        exit(-1);
+    }
+
+    ASProto::VoxelSet voxelSet;
+    writeHeader(voxelSet.mutable_header(), dimensions, frames.empty() ? 0 : frames[0].size(), 0);
+
+    for (const auto& voxels : frames) {
+        ASProto::VoxelFrame* frame = voxelSet.add_frames();
+        frame->mutable_positions()->Reserve(voxels.size() * 3);
+        frame->mutable_colours()->Reserve(voxels.size() * 3);
+
+        for (const auto& [position, colour] : voxels) {
+            frame->add_positions(position.x);
+            frame->add_positions(position.y);
+            frame->add_positions(position.z);
+            frame->add_colours(colour.r);
+            frame->add_colours(colour.g);
+            frame->add_colours(colour.b);
+        }
+    }
+
+    voxelSet.SerializeToOstream(&outputStream);
+    outputStream.close();
+
+    std::filesystem::rename(temporary, file);
+}
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtx/hash.hpp>
+
+#include <filesystem>
+#include <optional>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace Serializers {
+
+using VoxelFrames = std::vector<std::unordered_map<glm::ivec3, glm::vec3>>;
+
+std::optional<std::tuple<glm::uvec3, VoxelFrames>> loadVoxelSet(std::filesystem::path file);
+
+// Written beside the target and renamed into place, so a reader never sees a partial file
+void storeVoxelSet(std::filesystem::path file, glm::uvec3 dimensions, const VoxelFrames& frames);
+}
@@ -0,0 +1,214 @@
+#include "generation_cache.hpp"
+
+#include "parser.hpp"
+
+#include "serializers/voxel_set.hpp"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+// FNV-1a, enough to tell apart the inputs of one cache directory
+class KeyBuilder {
+  public:
+    KeyBuilder& add(const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) {
+            m_Hash ^= bytes[i];
+            m_Hash *= 0x100000001b3;
+        }
+        return *this;
+    }
+
+    KeyBuilder& add(uint64_t value) { return add(&value, sizeof(value)); }
+
+    KeyBuilder& add(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return add((uint64_t)bits);
+    }
+
+    KeyBuilder& add(const std::string& value)
+    {
+        add((uint64_t)value.size());
+        return add(value.data(), value.size());
+    }
+
+    // False if the file could not be read
+    bool addFile(const std::filesystem::path& path)
+    {
+        std::ifstream stream(path, std::ios::binary | std::ios::in);
+        if (!stream.is_open())
+            return false;
+
+        char buffer[1 << 16];
+        while (stream.read(buffer, sizeof(buffer)) || stream.gcount() > 0)
+            add(buffer, stream.gcount());
+
+        return true;
+    }
+
+    uint64_t get() const { return m_Hash; }
+
+  private:
+    uint64_t m_Hash = 0xcbf29ce484222325;
+};
+
+static std::string hexKey(uint64_t key)
+{
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016" PRIx64, key);
+    return buffer;
+}
+
+GenerationCache::GenerationCache(std::filesystem::path directory, const ParserArgs& args)
+    : m_Directory(directory), m_Args(args)
+{
+    std::filesystem::create_directories(m_Directory / "voxels");
+    std::filesystem::create_directories(m_Directory / "structures");
+
+    const std::filesystem::path input = m_Args.filename;
+
+    KeyBuilder key;
+    key.add((uint64_t)GeneratorVersion);
+    key.add(input.extension().string());
+    key.add((uint64_t)m_Args.voxels_per_unit);
+    key.add(m_Args.units);
+    key.add((uint64_t)m_Args.animation);
+    key.add((uint64_t)m_Args.frames);
+    key.addFile(input);
+
+    m_InputKey = key.get();
+}
+
+std::optional<std::tuple<glm::uvec3, GenerationCache::Frames>> GenerationCache::loadVoxels()
+{
+    // Files referenced by the last parse of this input, one path per line
+    std::ifstream manifest(m_Directory / "voxels" / (hexKey(m_InputKey) + ".deps"));
+    if (!manifest.is_open())
+        return {};
+
+    KeyBuilder key;
+    key.add(m_InputKey);
+
+    std::string line;
+    while (std::getline(manifest, line)) {
+        key.add(line);
+        if (!key.addFile(line))
+            return {};
+    }
+
+    const std::filesystem::path file
+        = m_Directory / "voxels" / (hexKey(key.get()) + ".voxset");
+    if (!std::filesystem::exists(file))
+        return {};
+
+    auto voxels = Serializers::loadVoxelSet(file);
+    if (!voxels.has_value())
+        return {};
+
+    m_VoxelKey = key.get();
+    return voxels;
+}
+
+void GenerationCache::storeVoxels(glm::uvec3 dimensions, const Frames& frames,
+    const std::vector<std::filesystem::path>& dependencies)
+{
+    KeyBuilder key;
+    key.add(m_InputKey);
+
+    std::ofstream manifest(m_Directory / "voxels" / (hexKey(m_InputKey) + ".deps"),
+        std::ios::out | std::ios::trunc);
+    for (const std::filesystem::path& dependency : dependencies) {
+        // Made absolute so the manifest does not depend on the working directory
+        const std::string path = std::filesystem::absolute(dependency).string();
+        manifest << path << "\n";
+
+        key.add(path);
+        key.addFile(path);
+    }
+
+    m_VoxelKey = key.get();
+    Serializers::storeVoxelSet(
+        m_Directory / "voxels" / (hexKey(key.get()) + ".voxset"), dimensions, frames);
+}
+
+std::string GenerationCache::structureKey(uint32_t structure) const
+{
+    KeyBuilder key;
+    key.add(m_VoxelKey.value());
+    key.add((uint64_t)structure);
+
+    // Only the arguments read by the structure's generator and serializer
+    switch (structure) {
+    case GRID:
+        key.add((uint64_t)m_Args.animation);
+        key.add((uint64_t)m_Args.palette);
+        key.add((uint64_t)m_Args.distance_field);
+        break;
+    case TEXTURE:
+        key.add((uint64_t)m_Args.animation);
+        key.add((uint64_t)m_Args.palette);
+        break;
+    case OCTREE:
+        key.add((uint64_t)m_Args.animation);
+        key.add((uint64_t)m_Args.octree_layout);
+        key.add((uint64_t)m_Args.octree_ropes);
+        key.add((uint64_t)m_Args.progressive);
+        break;
+    case CONTREE:
+        key.add((uint64_t)m_Args.contree_format);
+        key.add((uint64_t)m_Args.progressive);
+        break;
+    case BRICKMAP:
+        key.add((uint64_t)m_Args.animation);
+        key.add((uint64_t)m_Args.brick_size);
+        key.add((uint64_t)m_Args.brickmap_dedup);
+        key.add((uint64_t)m_Args.palette);
+        key.add((uint64_t)m_Args.brickgrid_layout);
+        break;
+    case HYBRID:
+        key.add((uint64_t)m_Args.hybrid_brick_size);
+        break;
+    default:
+        break;
+    }
+
+    return hexKey(key.get());
+}
+
+bool GenerationCache::restoreStructure(uint32_t structure, const std::filesystem::path& target)
+{
+    if (!m_VoxelKey.has_value())
+        return false;
+
+    const std::filesystem::path file = m_Directory / "structures" / structureKey(structure);
+    if (!std::filesystem::exists(file))
+        return false;
+
+    std::error_code error;
+    std::filesystem::copy_file(
+        file, target, std::filesystem::copy_options::overwrite_existing, error);
+    return !error;
+}
+
+void GenerationCache::storeStructure(uint32_t structure, const std::filesystem::path& source)
+{
+    if (!m_VoxelKey.has_value() || !std::filesystem::exists(source))
+        return;
+
+    const std::filesystem::path file = m_Directory / "structures" / structureKey(structure);
+
+    // Copied beside the entry and renamed so a concurrent run never restores a partial file
+    std::filesystem::path temporary = file;
+    temporary += ".tmp";
+
+    std::error_code error;
+    std::filesystem::copy_file(
+        source, temporary, std::filesystem::copy_options::overwrite_existing, error);
+    if (!error)
+        std::filesystem::rename(temporary, file, error);
+}
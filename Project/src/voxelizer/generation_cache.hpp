@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtx/hash.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "parser_args.hpp"
+
+// Increase whenever a parser or generator changes its output, so older cache entries stop
+// matching
+static constexpr uint32_t GeneratorVersion = 2;
+
+// Content addressed cache of voxelizer stages. The parsed voxels are keyed by the input file, the
+// files it referenced and the arguments affecting parsing. Each structure file is keyed by the
+// voxels' key and the arguments that structure reads, so enabling another structure only runs
+// the new generator.
+class GenerationCache {
+  public:
+    using Frames = std::vector<std::unordered_map<glm::ivec3, glm::vec3>>;
+
+    GenerationCache(std::filesystem::path directory, const ParserArgs& args);
+
+    // Voxels of a previous parse whose input and referenced files are unchanged
+    std::optional<std::tuple<glm::uvec3, Frames>> loadVoxels();
+    void storeVoxels(glm::uvec3 dimensions, const Frames& frames,
+        const std::vector<std::filesystem::path>& dependencies);
+
+    // Copies a cached structure file to target, false if the structure is not cached. Only valid
+    // once the voxels have been loaded or stored.
+    bool restoreStructure(uint32_t structure, const std::filesystem::path& target);
+    void storeStructure(uint32_t structure, const std::filesystem::path& source);
+
+  private:
+    std::string structureKey(uint32_t structure) const;
+
+  private:
+    std::filesystem::path m_Directory;
+    ParserArgs m_Args;
+
+    // Input contents and parser arguments
+    uint64_t m_InputKey;
+    // Input key combined with the contents of every referenced file
+    std::optional<uint64_t> m_VoxelKey;
+};
@@ -5,6 +5,10 @@
 
 #include "parser.hpp"
 
+#include "generators/task_scheduler.hpp"
+
+#include <map>
+
 int main(int argc, char** argv)
 {
     CLI::App app { "Convert Meshes into Voxel formats" };
@@ -18,17 +22,116 @@ int main(int argc, char** argv)
     app.add_option("-n,--name", args.name, "Output name (Defaults to filename)");
     app.add_option("-u,--units", args.units, "Number of units the model should reside over");
     app.add_option("-f,--frames", args.frames, "Number of frames for animations");
+    app.add_option("-j,--threads", args.threads, "Worker threads (Defaults to all cores)");
+    app.add_option("--brick-size", args.brick_size, "Brickmap brick edge length")
+        ->check(CLI::IsMember({ 4, 8, 16 }));
+    app.add_option("--hybrid-brick-size", args.hybrid_brick_size, "Hybrid octree brick edge length")
+        ->check(CLI::IsMember({ 4, 8 }));
+
+    std::map<std::string, Generators::OctreeLayout> layouts {
+        { "dfs", Generators::OctreeLayout::DEPTH_FIRST },
+        { "bfs", Generators::OctreeLayout::BREADTH_FIRST },
+        { "veb", Generators::OctreeLayout::VAN_EMDE_BOAS },
+    };
+    app.add_option("--layout", args.octree_layout, "Octree node layout (dfs, bfs or veb)")
+        ->transform(CLI::CheckedTransformer(layouts, CLI::ignore_case));
 
-    app.add_flag("-a", args.flag_all, "Enable all generators. Equivalent to -gtocb");
+    std::map<std::string, Generators::ContreeFormat> contreeFormats {
+        { "wide", Generators::ContreeFormat::WIDE },
+        { "compact", Generators::ContreeFormat::COMPACT },
+    };
+    app.add_option("--contree-format", args.contree_format, "Contree encoding (wide or compact)")
+        ->transform(CLI::CheckedTransformer(contreeFormats, CLI::ignore_case));
+
+    std::map<std::string, Generators::BrickgridLayout> brickgridLayouts {
+        { "linear", Generators::BrickgridLayout::LINEAR },
+        { "tiled", Generators::BrickgridLayout::TILED },
+        { "paged", Generators::BrickgridLayout::PAGED },
+    };
+    app.add_option(
+        "--brick-layout", args.brickgrid_layout, "Brickgrid layout (linear, tiled or paged)")
+        ->transform(CLI::CheckedTransformer(brickgridLayouts, CLI::ignore_case));
+
+    app.add_flag("-a", args.flag_all, "Enable all generators. Equivalent to -gtocby");
     app.add_flag("-g", args.flag_grid, "Enable grid generator");
     app.add_flag("-t", args.flag_texture, "Enable texture generator");
     app.add_flag("-o", args.flag_octree, "Enable octree generator");
     app.add_flag("-c", args.flag_contree, "Enable contree generator");
     app.add_flag("-b", args.flag_brickmap, "Enable brickmap generator");
-    app.add_flag("--anim", args.animation, "Enable animation");
+    app.add_flag("-y", args.flag_hybrid, "Enable hybrid octree generator");
+    app.add_flag(
+        "-s", args.flag_voxel_hash, "Enable spatially hashed block generator, not included in -a");
+    app.add_flag("-l", args.flag_column_rle,
+        "Enable run-length encoded column generator, not included in -a");
+    app.add_flag("--auto", args.auto_select,
+        "Only generate the one or two structures predicted best for the scene, ignoring the "
+        "structure flags");
+    app.add_flag("--estimate", args.estimate,
+        "Print the predicted size and generation time of the enabled structures (all when none "
+        "are enabled) instead of generating them");
+    app.add_flag("--anim", args.animation,
+        "Enable animation, octrees store every frame with unchanged subtrees shared");
+    app.add_flag("--dedup", args.brickmap_dedup, "Share identical bricks in the brickmap");
+    app.add_flag("--pipeline", args.pipeline,
+        "Scan the volume once and share it between every enabled generator");
+    app.add_flag("--palette", args.palette,
+        "Store grid, texture and brickmap colours as palette indices (at most 256 colours)");
+    app.add_flag("--distance-field", args.distance_field,
+        "Store a distance field with the grid so rays can skip empty space");
+    app.add_flag("--direct", args.direct,
+        "Build octrees and contrees straight from the mesh's triangles without storing every "
+        "voxel, other structures are skipped");
+    app.add_flag("--ropes", args.octree_ropes,
+        "Store face neighbour ropes with the octree for stackless traversal");
+    app.add_flag("--progressive", args.progressive,
+        "Store octrees and contrees split into levels so they can be drawn while still loading");
+
+    auto workers = app.add_option("--workers", args.workers,
+        "Split octree and contree generation between worker processes over the Morton range");
+    app.add_option("--worker", args.worker_index,
+           "Run as this worker, writing its share of the trees to the work directory")
+        ->needs(workers);
+    app.add_option("--work-dir", args.work_dir,
+        "Directory shared with the workers (Defaults to parts in the output directory)");
+    app.add_flag("--external-workers", args.external_workers,
+        "Wait for workers started separately, such as on other hosts, instead of launching them");
+
+    app.add_option("--cache", args.cache,
+        "Cache directory, reuses parsed voxels and structures of runs with the same inputs");
+
+    args.command.assign(argv, argv + argc);
 
     CLI11_PARSE(app, argc, argv);
 
+    if (args.worker_index >= 0 && (uint32_t)args.worker_index >= args.workers) {
+        fprintf(stderr, "Worker %d is outside of the %u workers\n", args.worker_index,
+            args.workers);
+        return -1;
+    }
+
+    if (args.direct
+        && (args.animation || args.auto_select || args.estimate || args.pipeline
+            || args.workers > 0)) {
+        fprintf(stderr,
+            "--direct builds a single frame in one process and cannot be combined with --anim, "
+            "--auto, --estimate, --pipeline or --workers\n");
+        return -1;
+    }
+
+    if (args.progressive) {
+        // Levels are contiguous in the breadth first layout only, and ropes are never stored
+        if (args.octree_layout != Generators::OctreeLayout::BREADTH_FIRST) {
+            printf("Progressive octrees use the bfs layout\n");
+            args.octree_layout = Generators::OctreeLayout::BREADTH_FIRST;
+        }
+        if (args.octree_ropes) {
+            printf("Progressive octrees are stored without ropes\n");
+            args.octree_ropes = false;
+        }
+    }
+
+    Generators::TaskScheduler::getInstance().init(args.threads);
+
     Parser parser(args);
 
     return 0;
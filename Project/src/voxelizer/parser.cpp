@@ -1,19 +1,29 @@
 #include "parser.hpp"
 
+#include "generators/block_stream.hpp"
 #include "generators/brickmap.hpp"
+#include "generators/column_rle.hpp"
 #include "generators/common.hpp"
 #include "generators/contree.hpp"
+#include "generators/distance_field.hpp"
+#include "generators/hybrid.hpp"
 #include "generators/octree.hpp"
+#include "generators/scene_analysis.hpp"
 #include "generators/texture.hpp"
+#include "generators/voxel_hash.hpp"
 #include "loaders/sparse_loader.hpp"
 
 #include "generators/grid.hpp"
 
 #include "modification/diff.hpp"
 #include "serializers/brickmap.hpp"
+#include "serializers/column_rle.hpp"
 #include "serializers/contree.hpp"
 #include "serializers/grid.hpp"
+#include "serializers/hybrid.hpp"
 #include "serializers/octree.hpp"
+#include "serializers/partial_tree.hpp"
+#include "serializers/voxel_hash.hpp"
 
 #include <glm/gtx/string_cast.hpp>
 
@@ -27,21 +37,53 @@
 #include "pgbar/DynamicBar.hpp"
 #include "pgbar/ProgressBar.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
 #include <cmath>
+#include <condition_variable>
 #include <cstring>
 #include <filesystem>
+#include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <spawn.h>
+#include <sys/wait.h>
 #include <unordered_map>
 #include <vector>
 
+extern char** environ;
+
+static_assert((uint32_t)Generators::StructureType::COUNT == AS_COUNT,
+    "Structure and Generators::StructureType must match");
+
+// Score difference below which the runner up is generated alongside the best structure, the
+// model being too coarse to order them
+static constexpr float AutoSelectMargin = 0.5f;
+
+static std::map<Structure, const char*> structureExtension {
+    { GRID,       ".voxgrid" },
+    { TEXTURE,    ".voxtexture" },
+    { OCTREE,     ".voxoctree" },
+    { CONTREE,    ".voxcontree" },
+    { BRICKMAP,   ".voxbrick" },
+    { HYBRID,     ".voxhybrid" },
+    { VOXEL_HASH, ".voxhash" },
+    { COLUMN_RLE, ".voxcolumns" },
+};
+
 static std::map<Structure, const char*> structureToString {
     { GRID,     "[Grid]    " },
     { TEXTURE,  "[Texture] " },
     { OCTREE,   "[Octree]  " },
     { CONTREE,  "[Contree] " },
     { BRICKMAP, "[Brickmap]" },
+    { HYBRID,   "[Hybrid]  " },
+    { VOXEL_HASH, "[Hash]    " },
+    { COLUMN_RLE, "[Columns] " },
 };
 
 Parser::Parser(ParserArgs args) : m_Args(args)
@@ -58,11 +100,60 @@ Parser::Parser(ParserArgs args) : m_Args(args)
         m_ValidStructures[CONTREE] = true;
     if (m_Args.flag_all || m_Args.flag_brickmap)
         m_ValidStructures[BRICKMAP] = true;
+    if (m_Args.flag_all || m_Args.flag_hybrid)
+        m_ValidStructures[HYBRID] = true;
+    // Not drawn by the renderer, so only built when asked for
+    if (m_Args.flag_voxel_hash)
+        m_ValidStructures[VOXEL_HASH] = true;
+    if (m_Args.flag_column_rle)
+        m_ValidStructures[COLUMN_RLE] = true;
+
+    if (m_Args.direct) {
+        for (size_t i = 0; i < AS_COUNT; i++) {
+            if (m_ValidStructures[i] && i != OCTREE && i != CONTREE) {
+                printf("%s Needs every voxel, skipped when voxelizing directly\n",
+                    structureToString[(Structure)i]);
+                m_ValidStructures[i] = false;
+            }
+        }
+
+        // The trees are built straight from the triangles, a single empty frame stands in for
+        // the voxels
+        const glm::uvec3 dimensions = loadMesh();
+        generateStructures(dimensions, std::vector<std::unordered_map<glm::ivec3, glm::vec3>>(1));
+        return;
+    }
+
+    if (!m_Args.cache.empty())
+        m_Cache.emplace(m_Args.cache, m_Args);
+
+    // The partial trees record the volume the workers read
+    if (onlyMerges()) {
+        generateStructures(
+            glm::uvec3(0), std::vector<std::unordered_map<glm::ivec3, glm::vec3>>(1));
+        return;
+    }
 
     glm::uvec3 dimensions;
     std::vector<std::unordered_map<glm::ivec3, glm::vec3>> frames;
-    std::tie(dimensions, frames) = parseFile();
-    generateStructures(dimensions, frames);
+
+    auto cached = m_Cache ? m_Cache->loadVoxels() : std::nullopt;
+    if (cached.has_value()) {
+        printf("Using cached voxels\n");
+        std::tie(dimensions, frames) = std::move(cached.value());
+    } else {
+        std::tie(dimensions, frames) = parseFile();
+        // Workers run alongside the coordinator, which is the only process writing the cache
+        if (m_Cache && m_Args.worker_index < 0)
+            m_Cache->storeVoxels(dimensions, frames, ParserImpl::getDependencies());
+    }
+
+    if (m_Args.estimate) {
+        printEstimates(dimensions, frames[0]);
+        return;
+    }
+
+    generateStructures(dimensions, std::move(frames));
 }
 
 Parser::~Parser()
@@ -90,8 +181,45 @@ ParserImpl::ParserRet Parser::parseFile()
     }
 }
 
+glm::uvec3 Parser::loadMesh()
+{
+    std::filesystem::path path = m_Args.filename;
+    auto extension = path.extension();
+
+    ParserImpl::Meshes meshes;
+    if (!strcmp(extension.c_str(), ".obj")) {
+        meshes = ParserImpl::loadObj(path, m_Args);
+    } else if (!strcmp(extension.c_str(), ".gltf") || !strcmp(extension.c_str(), ".glb")) {
+        meshes = ParserImpl::loadAssimp(path, m_Args);
+    } else {
+        fprintf(stderr, "Only meshes can be voxelized directly\n");
+        exit(-1);
+    }
+
+    const ParserImpl::VoxelSpace space = ParserImpl::meshSpace({ meshes.frames[0] }, m_Args);
+    m_Mesh = std::make_unique<ParserImpl::MeshLoader>(
+        space, std::move(meshes.frames[0]), std::move(meshes.materials));
+
+    return space.dimensions;
+}
+
+bool Parser::onlyMerges() const
+{
+    // Animations and structure selection read the voxels, animated octrees are not distributed
+    if (m_Args.workers == 0 || m_Args.worker_index >= 0 || m_Args.estimate || m_Args.animation
+        || m_Args.auto_select)
+        return false;
+
+    for (size_t i = 0; i < AS_COUNT; i++) {
+        if (m_ValidStructures[i] && i != OCTREE && i != CONTREE)
+            return false;
+    }
+
+    return true;
+}
+
 void Parser::generateStructures(
-    glm::uvec3 dimensions, const std::vector<std::unordered_map<glm::ivec3, glm::vec3>>& frames)
+    glm::uvec3 dimensions, std::vector<std::unordered_map<glm::ivec3, glm::vec3>> frames)
 {
     Modification::AnimationFrames animationFrames;
     if (m_Args.animation) {
@@ -110,72 +238,333 @@ void Parser::generateStructures(
         std::filesystem::create_directory(outputDirectory / outputName);
     }
 
-    printf("Voxel dimensions: %s\n", glm::to_string(dimensions).c_str());
+    const bool merging = onlyMerges();
+    if (merging)
+        printf("Voxel dimensions: read from the workers\n");
+    else
+        printf("Voxel dimensions: %s\n", glm::to_string(dimensions).c_str());
+
+    // Workers run the same analysis, so every process agrees on the structures
+    if (m_Args.auto_select)
+        selectStructures(dimensions, frames[0]);
+
+    // Animated octrees read every frame rather than the first frame's blocks
+    const bool temporalOctree = m_Args.animation && frames.size() > 1;
+
+    bool distributed[AS_COUNT] {};
+    distributed[OCTREE] = m_Args.workers > 0 && !temporalOctree;
+    distributed[CONTREE] = m_Args.workers > 0;
+
+    std::filesystem::path workDirectory = m_Args.work_dir;
+    if (workDirectory.empty())
+        workDirectory = outputDirectory / outputName / "parts";
+
+    if (m_Args.worker_index >= 0) {
+        generatePartials(dimensions, std::move(frames[0]), workDirectory, temporalOctree);
+        return;
+    }
+
+    // Structures already generated from the same voxels and arguments are copied from the cache
+    for (size_t i = 0; i < AS_COUNT && m_Cache; i++) {
+        const std::filesystem::path target
+            = outputDirectory / outputName / (outputName + structureExtension[(Structure)i]);
+        if (m_ValidStructures[i] && m_Cache->restoreStructure(i, target)) {
+            printf("%s Restored from cache\n", structureToString[(Structure)i]);
+            m_ValidStructures[i] = false;
+        }
+    }
+
+    std::vector<pid_t> workers;
+    std::jthread reaper;
+    if (m_Args.workers > 0 && (m_ValidStructures[OCTREE] || m_ValidStructures[CONTREE])) {
+        if (!m_Args.external_workers)
+            workers = launchWorkers(workDirectory);
+        else
+            printf("Waiting for %u workers in %s\n", m_Args.workers, workDirectory.c_str());
+
+        reaper = std::jthread([this, workers]() {
+            for (pid_t worker : workers) {
+                int status;
+                if (waitpid(worker, &status, 0) < 0 || !WIFEXITED(status)
+                    || WEXITSTATUS(status) != 0)
+                    m_WorkerFailed = true;
+            }
+        });
+    }
+
+    auto loadPartial = [&](std::stop_token stoken, Structure structure) {
+        return [this, stoken, structure, &workDirectory](uint32_t worker) {
+            return waitForPartial(stoken, workDirectory, structure, worker);
+        };
+    };
 
     std::jthread threads[AS_COUNT];
     Generators::GenerationInfo info[AS_COUNT] {};
-    bool finished[AS_COUNT];
+    // Set by the generators once they finish, only read by other threads after joining
+    bool completed[AS_COUNT] {};
+    // Set once a structure's thread returns, the progress bars wait on finishedSignal
+    std::atomic<bool> finished[AS_COUNT] {};
+    std::mutex finishedLock;
+    std::condition_variable finishedSignal;
+    // Structures whose merge or generation failed, nothing was stored for them
+    bool failed[AS_COUNT] {};
+
+    // Generators return without finishing when not stopped only if the structure outgrows the
+    // indices of its format
+    auto tooLarge = [&](std::stop_token stoken, Structure structure) {
+        if (completed[structure] || stoken.stop_requested())
+            return false;
+
+        fprintf(stderr, "%s Too many nodes for the format's indices, nothing stored\n",
+            structureToString[structure]);
+        failed[structure] = true;
+        completed[structure] = true;
+        return true;
+    };
+
+    // Every generator reads the same blocks from a single scan. Blocks are whole tree subtrees,
+    // so volumes smaller than one block use separate loaders.
+    std::unique_ptr<Generators::BlockStream> streams[AS_COUNT];
+    std::jthread producer;
+    const uint32_t longestSide = std::max({ dimensions.x, dimensions.y, dimensions.z });
+    if (m_Args.pipeline && !merging && longestSide >= Generators::VoxelBlock::Edge) {
+        std::vector<Generators::BlockStream*> consumers;
+        for (size_t i = 0; i < AS_COUNT; i++) {
+            if ((i == OCTREE && temporalOctree) || distributed[i])
+                continue;
+
+            if (m_ValidStructures[i]) {
+                streams[i] = std::make_unique<Generators::BlockStream>(dimensions);
+                consumers.push_back(streams[i].get());
+            }
+        }
+
+        producer = std::jthread([&, consumers](std::stop_token stoken) {
+            SparseLoader loader(dimensions, frames[0]);
+            Generators::scanBlocks(stoken, loader, consumers);
+        });
+    } else if (m_Args.pipeline && !merging) {
+        printf("Volume smaller than a block, generating without the pipeline\n");
+    }
+
+    auto makeLoader = [&]() -> std::unique_ptr<Loader> {
+        return std::make_unique<SparseLoader>(dimensions, frames[0]);
+    };
+
+    auto launch = [&](Structure structure, std::function<void(std::stop_token)> body) {
+        return std::jthread([&, structure, body](std::stop_token stoken) {
+            body(stoken);
+
+            {
+                std::lock_guard lock(finishedLock);
+                finished[structure] = true;
+            }
+            finishedSignal.notify_all();
+        });
+    };
 
     if (m_ValidStructures[GRID]) {
-        threads[GRID] = std::jthread([&](std::stop_token stoken) {
-            std::unique_ptr<Loader> loader = std::make_unique<SparseLoader>(dimensions, frames[0]);
+        threads[GRID] = launch(GRID, [&](std::stop_token stoken) {
             glm::uvec3 dimensions;
 
-            auto voxels = Generators::generateGrid(
-                stoken, std::move(loader), info[GRID], dimensions, finished[GRID]);
+            auto voxels = streams[GRID]
+                ? Generators::generateGrid(
+                      stoken, *streams[GRID], info[GRID], dimensions, completed[GRID])
+                : Generators::generateGrid(
+                      stoken, makeLoader(), info[GRID], dimensions, completed[GRID]);
+
+            std::vector<uint8_t> distances;
+            if (m_Args.distance_field && !stoken.stop_requested())
+                distances = Generators::generateDistanceField(voxels, dimensions);
 
-            Serializers::storeGrid(
-                outputDirectory, outputName, dimensions, voxels, info[GRID], animationFrames);
+            Serializers::storeGrid(outputDirectory, outputName, dimensions, voxels, info[GRID],
+                animationFrames, m_Args.palette, distances);
         });
     }
 
     if (m_ValidStructures[TEXTURE]) {
-        threads[TEXTURE] = std::jthread([&](std::stop_token stoken) {
-            std::unique_ptr<Loader> loader = std::make_unique<SparseLoader>(dimensions, frames[0]);
+        threads[TEXTURE] = launch(TEXTURE, [&](std::stop_token stoken) {
             glm::uvec3 dimensions;
-            auto nodes = Generators::generateTexture(
-                stoken, std::move(loader), info[TEXTURE], dimensions, finished[TEXTURE]);
-
-            Serializers::storeTexture(
-                outputDirectory, outputName, dimensions, nodes, info[TEXTURE], animationFrames);
+            auto nodes = streams[TEXTURE]
+                ? Generators::generateTexture(
+                      stoken, *streams[TEXTURE], info[TEXTURE], dimensions, completed[TEXTURE])
+                : Generators::generateTexture(
+                      stoken, makeLoader(), info[TEXTURE], dimensions, completed[TEXTURE]);
+
+            Serializers::storeTexture(outputDirectory, outputName, dimensions, nodes,
+                info[TEXTURE], animationFrames, m_Args.palette);
         });
     }
 
-    if (m_ValidStructures[OCTREE]) {
-        threads[OCTREE] = std::jthread([&](std::stop_token stoken) {
-            std::unique_ptr<Loader> loader = std::make_unique<SparseLoader>(dimensions, frames[0]);
+    if (m_ValidStructures[OCTREE] && temporalOctree) {
+        threads[OCTREE] = launch(OCTREE, [&](std::stop_token stoken) {
+            auto loadFrame = [&](size_t frame) -> std::unique_ptr<Loader> {
+                return std::make_unique<SparseLoader>(dimensions, frames[frame]);
+            };
+
             glm::uvec3 dimensions;
-            auto nodes = Generators::generateOctree(
-                stoken, std::move(loader), info[OCTREE], dimensions, finished[OCTREE]);
+            auto octree = Generators::generateTemporalOctree(
+                stoken, frames.size(), loadFrame, info[OCTREE], dimensions, completed[OCTREE]);
+            if (tooLarge(stoken, OCTREE))
+                return;
+
+            // Shared nodes have a neighbour per frame, so ropes are not stored
+            if (m_Args.octree_ropes)
+                printf("Animated octrees are stored without ropes\n");
+            // Levels are split below the first frame's root, the other frames would be lost
+            if (m_Args.progressive)
+                printf("Animated octrees are not stored progressively\n");
+
+            Serializers::storeOctree(outputDirectory, outputName, dimensions, octree.nodes,
+                info[OCTREE], Generators::OctreeLayout::BREADTH_FIRST, {}, octree.roots);
+        });
+    } else if (m_ValidStructures[OCTREE] && distributed[OCTREE]) {
+        threads[OCTREE] = launch(OCTREE, [&](std::stop_token stoken) {
+            glm::uvec3 dimensions;
+            auto nodes = Generators::mergeOctreePartials(stoken, loadPartial(stoken, OCTREE),
+                m_Args.workers, info[OCTREE], dimensions, completed[OCTREE], m_Args.octree_layout);
+            if (!nodes.has_value()) {
+                fprintf(stderr, "Failed to merge the octree from the workers\n");
+                failed[OCTREE] = true;
+                completed[OCTREE] = true;
+                return;
+            }
+            if (tooLarge(stoken, OCTREE))
+                return;
+
+            std::vector<uint32_t> ropes;
+            if (m_Args.octree_ropes && !stoken.stop_requested()) {
+                auto generated = Generators::generateOctreeRopes(nodes.value());
+                if (generated.has_value())
+                    ropes = std::move(generated.value());
+                else
+                    fprintf(stderr, "Octree has too many nodes for ropes, storing without\n");
+            }
+
+            Serializers::storeOctree(outputDirectory, outputName, dimensions, nodes.value(),
+                info[OCTREE], m_Args.octree_layout, ropes, {}, m_Args.progressive);
+        });
+    } else if (m_ValidStructures[OCTREE]) {
+        threads[OCTREE] = launch(OCTREE, [&](std::stop_token stoken) {
+            glm::uvec3 dimensions;
+            std::vector<Generators::OctreeNode> nodes;
+            if (m_Mesh)
+                nodes = Generators::generateOctree(stoken, *m_Mesh, info[OCTREE], dimensions,
+                    completed[OCTREE], m_Args.octree_layout);
+            else if (streams[OCTREE])
+                nodes = Generators::generateOctree(stoken, *streams[OCTREE], info[OCTREE],
+                    dimensions, completed[OCTREE], m_Args.octree_layout);
+            else
+                nodes = Generators::generateOctree(stoken, makeLoader(), info[OCTREE], dimensions,
+                    completed[OCTREE], m_Args.octree_layout);
+            if (tooLarge(stoken, OCTREE))
+                return;
+
+            std::vector<uint32_t> ropes;
+            if (m_Args.octree_ropes && !stoken.stop_requested()) {
+                auto generated = Generators::generateOctreeRopes(nodes);
+                if (generated.has_value())
+                    ropes = std::move(generated.value());
+                else
+                    fprintf(stderr, "Octree has too many nodes for ropes, storing without\n");
+            }
 
-            Serializers::storeOctree(outputDirectory, outputName, dimensions, nodes, info[OCTREE]);
+            Serializers::storeOctree(outputDirectory, outputName, dimensions, nodes, info[OCTREE],
+                m_Args.octree_layout, ropes, {}, m_Args.progressive);
         });
     }
 
-    if (m_ValidStructures[CONTREE]) {
-        threads[CONTREE] = std::jthread([&](std::stop_token stoken) {
-            std::unique_ptr<Loader> loader = std::make_unique<SparseLoader>(dimensions, frames[0]);
+    if (m_ValidStructures[CONTREE] && distributed[CONTREE]) {
+        threads[CONTREE] = launch(CONTREE, [&](std::stop_token stoken) {
             glm::uvec3 dimensions;
-            auto nodes = Generators::generateContree(
-                stoken, std::move(loader), info[CONTREE], dimensions, finished[CONTREE]);
+            auto nodes = Generators::mergeContreePartials(stoken, loadPartial(stoken, CONTREE),
+                m_Args.workers, info[CONTREE], dimensions, completed[CONTREE]);
+            if (!nodes.has_value()) {
+                fprintf(stderr, "Failed to merge the contree from the workers\n");
+                failed[CONTREE] = true;
+                completed[CONTREE] = true;
+                return;
+            }
+            if (tooLarge(stoken, CONTREE))
+                return;
 
-            Serializers::storeContree(
-                outputDirectory, outputName, dimensions, nodes, info[CONTREE]);
+            Serializers::storeContree(outputDirectory, outputName, dimensions, nodes.value(),
+                info[CONTREE], m_Args.contree_format, m_Args.progressive);
+        });
+    } else if (m_ValidStructures[CONTREE]) {
+        threads[CONTREE] = launch(CONTREE, [&](std::stop_token stoken) {
+            glm::uvec3 dimensions;
+            std::vector<Generators::ContreeNode> nodes;
+            if (m_Mesh)
+                nodes = Generators::generateContree(
+                    stoken, *m_Mesh, info[CONTREE], dimensions, completed[CONTREE]);
+            else if (streams[CONTREE])
+                nodes = Generators::generateContree(
+                    stoken, *streams[CONTREE], info[CONTREE], dimensions, completed[CONTREE]);
+            else
+                nodes = Generators::generateContree(
+                    stoken, makeLoader(), info[CONTREE], dimensions, completed[CONTREE]);
+            if (tooLarge(stoken, CONTREE))
+                return;
+
+            Serializers::storeContree(outputDirectory, outputName, dimensions, nodes,
+                info[CONTREE], m_Args.contree_format, m_Args.progressive);
         });
     }
 
     if (m_ValidStructures[BRICKMAP]) {
-        threads[BRICKMAP] = std::jthread([&](std::stop_token stoken) {
-            std::unique_ptr<Loader> loader = std::make_unique<SparseLoader>(dimensions, frames[0]);
+        threads[BRICKMAP] = launch(BRICKMAP, [&](std::stop_token stoken) {
+            if (streams[BRICKMAP]) {
+                generateBrickmap(stoken, *streams[BRICKMAP], info[BRICKMAP], completed[BRICKMAP],
+                    outputDirectory, outputName, animationFrames);
+            } else {
+                generateBrickmap(stoken, makeLoader(), info[BRICKMAP], completed[BRICKMAP],
+                    outputDirectory, outputName, animationFrames);
+            }
+            tooLarge(stoken, BRICKMAP);
+        });
+    }
+
+    if (m_ValidStructures[HYBRID]) {
+        threads[HYBRID] = launch(HYBRID, [&](std::stop_token stoken) {
             glm::uvec3 dimensions;
-            std::vector<Generators::BrickgridPtr> brickgrid;
-            std::vector<Generators::Brickmap> brickmaps;
-            std::vector<Generators::BrickmapColour> colours;
-            std::tie(brickgrid, brickmaps, colours) = Generators::generateBrickmap(
-                stoken, std::move(loader), info[BRICKMAP], dimensions, finished[BRICKMAP]);
-
-            Serializers::storeBrickmap(outputDirectory, outputName, dimensions, brickgrid,
-                brickmaps, colours, info[BRICKMAP], animationFrames);
+            auto hybrid = streams[HYBRID]
+                ? Generators::generateHybrid(stoken, *streams[HYBRID], info[HYBRID], dimensions,
+                      completed[HYBRID], m_Args.hybrid_brick_size)
+                : Generators::generateHybrid(stoken, makeLoader(), info[HYBRID], dimensions,
+                      completed[HYBRID], m_Args.hybrid_brick_size);
+            if (tooLarge(stoken, HYBRID))
+                return;
+
+            Serializers::storeHybrid(outputDirectory, outputName, dimensions, hybrid, info[HYBRID]);
+        });
+    }
+
+    if (m_ValidStructures[VOXEL_HASH]) {
+        threads[VOXEL_HASH] = launch(VOXEL_HASH, [&](std::stop_token stoken) {
+            glm::uvec3 dimensions;
+            auto hash = streams[VOXEL_HASH]
+                ? Generators::generateVoxelHash(stoken, *streams[VOXEL_HASH], info[VOXEL_HASH],
+                      dimensions, completed[VOXEL_HASH])
+                : Generators::generateVoxelHash(
+                      stoken, makeLoader(), info[VOXEL_HASH], dimensions, completed[VOXEL_HASH]);
+
+            Serializers::storeVoxelHash(
+                outputDirectory, outputName, dimensions, hash, info[VOXEL_HASH]);
+        });
+    }
+
+    if (m_ValidStructures[COLUMN_RLE]) {
+        threads[COLUMN_RLE] = launch(COLUMN_RLE, [&](std::stop_token stoken) {
+            glm::uvec3 dimensions;
+            auto columns = streams[COLUMN_RLE]
+                ? Generators::generateColumnRLE(stoken, *streams[COLUMN_RLE], info[COLUMN_RLE],
+                      dimensions, completed[COLUMN_RLE])
+                : Generators::generateColumnRLE(
+                      stoken, makeLoader(), info[COLUMN_RLE], dimensions, completed[COLUMN_RLE]);
+
+            Serializers::storeColumnRLE(
+                outputDirectory, outputName, dimensions, columns, info[COLUMN_RLE]);
         });
     }
 
@@ -187,7 +576,7 @@ void Parser::generateStructures(
             continue;
         }
 
-        barPool[i] = std::thread([i, &info, &finished, &dynamicBar]() {
+        barPool[i] = std::thread([&, i]() {
             auto bar = dynamicBar.insert(pgbar::config::Line(pgbar::option::Tasks(10000)));
 
             bar->config().enable().percent().elapsed().countdown();
@@ -195,12 +584,14 @@ void Parser::generateStructures(
             bar->config().prefix(structureToString[(Structure)i]);
 
             float prev = 0.0f;
+            std::unique_lock lock(finishedLock);
             do {
                 if (fabs(info[i].completionPercent - prev) > 0.0001) {
                     bar->tick((info[i].completionPercent - prev) * 10000);
                     prev = info[i].completionPercent;
                 }
-            } while (!finished[i]);
+            } while (!finishedSignal.wait_for(
+                lock, std::chrono::milliseconds(50), [&]() { return finished[i].load(); }));
             bar->tick_to(100);
         });
     }
@@ -211,6 +602,220 @@ void Parser::generateStructures(
             barPool[i].join();
         }
     }
+
+    if (producer.joinable())
+        producer.join();
+
+    if (reaper.joinable())
+        reaper.join();
+
+    // Only generators building through a tracked resource report their scratch memory
+    for (size_t i = 0; i < AS_COUNT; i++) {
+        if (m_ValidStructures[i] && completed[i] && info[i].allocatedBytes != 0) {
+            printf("%s scratch memory: peak %.2f MiB, allocated %.2f MiB\n",
+                structureToString[(Structure)i], info[i].peakBytes / (1024.f * 1024.f),
+                info[i].allocatedBytes / (1024.f * 1024.f));
+        }
+    }
+
+    for (size_t i = 0; i < AS_COUNT && m_Cache; i++) {
+        if (m_ValidStructures[i] && completed[i] && !failed[i]) {
+            m_Cache->storeStructure(i,
+                outputDirectory / outputName / (outputName + structureExtension[(Structure)i]));
+        }
+    }
+}
+
+static std::filesystem::path partialFile(
+    const std::filesystem::path& workDirectory, Structure structure, uint32_t worker)
+{
+    const char* name = structure == OCTREE ? "octree" : "contree";
+    return workDirectory / (std::string(name) + "." + std::to_string(worker) + ".part");
+}
+
+void Parser::generatePartials(glm::uvec3 dimensions,
+    std::unordered_map<glm::ivec3, glm::vec3> voxels, const std::filesystem::path& workDirectory,
+    bool temporalOctree)
+{
+    const uint32_t worker = m_Args.worker_index;
+    std::filesystem::create_directories(workDirectory);
+
+    const bool octree = m_ValidStructures[OCTREE] && !temporalOctree;
+    const bool contree = m_ValidStructures[CONTREE];
+    auto inOctree = Generators::octreePartialFilter(dimensions, worker, m_Args.workers);
+    auto inContree = Generators::contreePartialFilter(dimensions, worker, m_Args.workers);
+    std::erase_if(voxels, [&](const auto& voxel) {
+        const glm::uvec3 position = voxel.first;
+        return !(octree && inOctree(position)) && !(contree && inContree(position));
+    });
+    voxels.rehash(0);
+
+    auto makeLoader = [&]() -> std::unique_ptr<Loader> {
+        return std::make_unique<SparseLoader>(dimensions, voxels);
+    };
+
+    for (Structure structure : { OCTREE, CONTREE }) {
+        if (!m_ValidStructures[structure] || (structure == OCTREE && temporalOctree))
+            continue;
+
+        Generators::GenerationInfo info {};
+        auto partial = structure == OCTREE
+            ? Generators::generateOctreePartial(
+                  std::stop_token {}, makeLoader(), info, worker, m_Args.workers)
+            : Generators::generateContreePartial(
+                  std::stop_token {}, makeLoader(), info, worker, m_Args.workers);
+
+        if (!partial.has_value()) {
+            fprintf(stderr, "Worker %u failed to build its share\n", worker);
+            exit(-1);
+        }
+
+        Serializers::storePartialTree(partialFile(workDirectory, structure, worker), *partial);
+        printf("%s Worker %u of %u built %zu subtrees\n", structureToString[structure], worker,
+            m_Args.workers, partial->subtrees.size());
+    }
+}
+
+// Workers are given the same arguments, so they parse the same volume and agree on the work
+// directory
+std::vector<pid_t> Parser::launchWorkers(const std::filesystem::path& workDirectory)
+{
+    std::filesystem::create_directories(workDirectory);
+
+    // Stale partial trees from an earlier run would be merged before the workers replace them
+    for (uint32_t worker = 0; worker < m_Args.workers; worker++) {
+        std::filesystem::remove(partialFile(workDirectory, OCTREE, worker));
+        std::filesystem::remove(partialFile(workDirectory, CONTREE, worker));
+    }
+
+    std::vector<pid_t> workers;
+    for (uint32_t worker = 0; worker < m_Args.workers; worker++) {
+        std::vector<std::string> arguments = m_Args.command;
+        arguments.push_back("--worker");
+        arguments.push_back(std::to_string(worker));
+
+        std::vector<char*> argv;
+        for (std::string& argument : arguments)
+            argv.push_back(argument.data());
+        argv.push_back(nullptr);
+
+        pid_t pid;
+        if (posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0) {
+            fprintf(stderr, "Failed to launch worker %u\n", worker);
+            m_WorkerFailed = true;
+            break;
+        }
+
+        workers.push_back(pid);
+    }
+
+    printf("Launched %zu workers\n", workers.size());
+    return workers;
+}
+
+std::optional<Generators::PartialTree> Parser::waitForPartial(std::stop_token stoken,
+    const std::filesystem::path& workDirectory, Structure structure, uint32_t worker)
+{
+    const std::filesystem::path file = partialFile(workDirectory, structure, worker);
+
+    while (!std::filesystem::exists(file)) {
+        if (stoken.stop_requested())
+            return {};
+
+        // The worker may have written the file just before exiting
+        if (m_WorkerFailed && !std::filesystem::exists(file)) {
+            fprintf(stderr, "Worker %u exited without writing %s\n", worker, file.c_str());
+            return {};
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    return Serializers::loadPartialTree(file);
+}
+
+template <typename Source>
+void Parser::generateBrickmap(std::stop_token stoken, Source&& source,
+    Generators::GenerationInfo& info, bool& finished, const std::filesystem::path& outputDirectory,
+    const std::string& outputName, const Modification::AnimationFrames& animationFrames)
+{
+    switch (m_Args.brick_size) {
+    case 4:
+        generateBrickmap<4>(stoken, std::forward<Source>(source), info, finished, outputDirectory,
+            outputName, animationFrames);
+        break;
+    case 16:
+        generateBrickmap<16>(stoken, std::forward<Source>(source), info, finished,
+            outputDirectory, outputName, animationFrames);
+        break;
+    default:
+        generateBrickmap<8>(stoken, std::forward<Source>(source), info, finished, outputDirectory,
+            outputName, animationFrames);
+        break;
+    }
+}
+
+template <uint32_t BrickSize, typename Source>
+void Parser::generateBrickmap(std::stop_token stoken, Source&& source,
+    Generators::GenerationInfo& info, bool& finished, const std::filesystem::path& outputDirectory,
+    const std::string& outputName, const Modification::AnimationFrames& animationFrames)
+{
+    glm::uvec3 dimensions;
+    std::vector<Generators::BrickgridPtr> brickgrid;
+    std::vector<Generators::SizedBrickmap<BrickSize>> brickmaps;
+    std::vector<Generators::BrickmapColour> colours;
+    std::tie(brickgrid, brickmaps, colours)
+        = Generators::generateBrickmap<BrickSize>(stoken, std::forward<Source>(source), info,
+            dimensions, finished, m_Args.brickmap_dedup, m_Args.brickgrid_layout);
+    // Left for the caller to report
+    if (!finished && !stoken.stop_requested())
+        return;
+
+    Serializers::storeBrickmap<BrickSize>(outputDirectory, outputName, dimensions, brickgrid,
+        brickmaps, colours, info, animationFrames, m_Args.palette, m_Args.brickgrid_layout);
+}
+
+void Parser::printEstimates(
+    glm::uvec3 dimensions, const std::unordered_map<glm::ivec3, glm::vec3>& voxels)
+{
+    SparseLoader loader(dimensions, voxels);
+    Generators::SceneStatistics statistics = Generators::sampleScene(std::stop_token {}, loader);
+
+    printf("Voxel dimensions: %s\n", glm::to_string(dimensions).c_str());
+
+    const bool anyEnabled = std::find(m_ValidStructures, m_ValidStructures + AS_COUNT, true)
+        != m_ValidStructures + AS_COUNT;
+    for (size_t i = 0; i < AS_COUNT; i++) {
+        if (anyEnabled && !m_ValidStructures[i])
+            continue;
+
+        Generators::StructureCost cost
+            = Generators::predictCost((Generators::StructureType)i, statistics);
+        printf("%s %10" PRIu64 " nodes %10.2f MiB %8.1f s\n", structureToString[(Structure)i],
+            cost.nodes, cost.bytes / (1024.f * 1024.f), cost.buildSeconds);
+    }
+}
+
+void Parser::selectStructures(
+    glm::uvec3 dimensions, const std::unordered_map<glm::ivec3, glm::vec3>& voxels)
+{
+    SparseLoader loader(dimensions, voxels);
+    Generators::SceneStatistics statistics = Generators::analyzeScene(std::stop_token {}, loader);
+
+    printf("Surface ratio: %.3f, colour entropy: %.2f bits\n", statistics.surfaceRatio(),
+        statistics.colourEntropy);
+
+    std::vector<Generators::StructureCost> ranking = Generators::rankStructures(statistics);
+    for (const Generators::StructureCost& cost : ranking) {
+        printf("%s %10" PRIu64 " nodes %8.2f MiB  cost %7.2f  score %5.2f\n",
+            structureToString[(Structure)cost.type], cost.nodes,
+            cost.bytes / (1024.f * 1024.f), cost.traversalCost, cost.score);
+    }
+
+    memset(m_ValidStructures, 0, AS_COUNT * sizeof(bool));
+    m_ValidStructures[(size_t)ranking[0].type] = true;
+    if (ranking.size() > 1 && ranking[1].score - ranking[0].score < AutoSelectMargin)
+        m_ValidStructures[(size_t)ranking[1].type] = true;
 }
 
 Modification::AnimationFrames Parser::generateAnimations(
@@ -234,7 +839,7 @@ Modification::AnimationFrames Parser::generateAnimations(
 
     pgbar::ProgressBar<pgbar::Channel::Stderr, pgbar::Policy::Async, pgbar::Region::Relative> bar;
 
-    bar.config().tasks(dimensions.x * dimensions.y * dimensions.z);
+    bar.config().tasks((size_t)dimensions.x * dimensions.y * dimensions.z);
     bar.config().enable().percent().elapsed().countdown();
     bar.config().disable().speed();
     bar.config().prefix("Processing animations");
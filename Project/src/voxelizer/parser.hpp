@@ -3,15 +3,36 @@
 #include <glm/glm.hpp>
 #include <glm/gtx/hash.hpp>
 
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <sys/types.h>
 #include <unordered_map>
 
+#include "generators/common.hpp"
+#include "generators/partial_tree.hpp"
+#include "loaders/loader.hpp"
 #include "modification/diff.hpp"
 #include "modification/mod_type.hpp"
 
+#include "generation_cache.hpp"
 #include "parser_args.hpp"
 #include "parsers/general.hpp"
 
-enum Structure { GRID = 0, TEXTURE = 1, OCTREE = 2, CONTREE = 3, BRICKMAP = 4, AS_COUNT = 5 };
+enum Structure {
+    GRID = 0,
+    TEXTURE = 1,
+    OCTREE = 2,
+    CONTREE = 3,
+    BRICKMAP = 4,
+    HYBRID = 5,
+    VOXEL_HASH = 6,
+    COLUMN_RLE = 7,
+    AS_COUNT = 8
+};
 
 class Parser {
   public:
@@ -21,8 +42,42 @@ class Parser {
   private:
     ParserImpl::ParserRet parseFile();
 
-    void generateStructures(glm::uvec3 dimensions,
-        const std::vector<std::unordered_map<glm::ivec3, glm::vec3>>& frames);
+    // Loads the mesh's triangles into m_Mesh and returns its voxel dimensions
+    glm::uvec3 loadMesh();
+
+    void generateStructures(
+        glm::uvec3 dimensions, std::vector<std::unordered_map<glm::ivec3, glm::vec3>> frames);
+
+    void printEstimates(
+        glm::uvec3 dimensions, const std::unordered_map<glm::ivec3, glm::vec3>& voxels);
+
+    // Replaces the enabled structures with the best one or two of rankStructures
+    void selectStructures(
+        glm::uvec3 dimensions, const std::unordered_map<glm::ivec3, glm::vec3>& voxels);
+
+    // Source is either a loader or a block stream
+    template <typename Source>
+    void generateBrickmap(std::stop_token stoken, Source&& source,
+        Generators::GenerationInfo& info, bool& finished,
+        const std::filesystem::path& outputDirectory, const std::string& outputName,
+        const Modification::AnimationFrames& animationFrames);
+
+    template <uint32_t BrickSize, typename Source>
+    void generateBrickmap(std::stop_token stoken, Source&& source,
+        Generators::GenerationInfo& info, bool& finished,
+        const std::filesystem::path& outputDirectory, const std::string& outputName,
+        const Modification::AnimationFrames& animationFrames);
+
+    // Distributed generation, each worker writes its partial trees to the work directory and the
+    // coordinator merges them as they appear. Workers only keep the voxels of their own subtrees.
+    void generatePartials(glm::uvec3 dimensions, std::unordered_map<glm::ivec3, glm::vec3> voxels,
+        const std::filesystem::path& workDirectory, bool temporalOctree);
+    // Set when the coordinator's structures are all built by the workers, it then merges their
+    // partial trees without reading the voxels
+    bool onlyMerges() const;
+    std::vector<pid_t> launchWorkers(const std::filesystem::path& workDirectory);
+    std::optional<Generators::PartialTree> waitForPartial(std::stop_token stoken,
+        const std::filesystem::path& workDirectory, Structure structure, uint32_t worker);
 
     Modification::AnimationFrames generateAnimations(
         const std::vector<std::unordered_map<glm::ivec3, glm::vec3>>& frames,
@@ -32,4 +87,12 @@ class Parser {
     ParserArgs m_Args;
 
     bool m_ValidStructures[AS_COUNT];
+
+    std::optional<GenerationCache> m_Cache;
+
+    // Set when voxelizing directly, trees are built from its triangles
+    std::unique_ptr<ParserImpl::MeshLoader> m_Mesh;
+
+    // Set once a local worker exits without writing its partial trees
+    std::atomic<bool> m_WorkerFailed = false;
 };
@@ -2,6 +2,12 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
+
+#include "generators/brickmap.hpp"
+#include "generators/contree.hpp"
+#include "generators/hybrid.hpp"
+#include "generators/octree.hpp"
 
 struct ParserArgs {
     std::string filename = "";
@@ -13,8 +19,40 @@ struct ParserArgs {
     bool flag_octree = false;
     bool flag_contree = false;
     bool flag_brickmap = false;
+    bool flag_hybrid = false;
+    bool flag_voxel_hash = false;
+    bool flag_column_rle = false;
+    // Structures are chosen from the scene's predicted costs instead of the flags
+    bool auto_select = false;
+    // Only predict the structures' sizes from a sample of the voxels
+    bool estimate = false;
     bool animation = false;
+    bool brickmap_dedup = false;
+    bool palette = false;
+    bool distance_field = false;
+    bool octree_ropes = false;
+    bool pipeline = false;
+    // Octrees and contrees are built from the mesh's triangles, the voxels are never stored
+    bool direct = false;
+    // Octrees and contrees are stored split into levels the renderer loads coarse levels first
+    bool progressive = false;
+    uint32_t brick_size = 8;
+    uint32_t hybrid_brick_size = Generators::HybridBrickSize;
+    Generators::OctreeLayout octree_layout = Generators::OctreeLayout::DEPTH_FIRST;
+    Generators::ContreeFormat contree_format = Generators::ContreeFormat::WIDE;
+    Generators::BrickgridLayout brickgrid_layout = Generators::BrickgridLayout::LINEAR;
     uint32_t voxels_per_unit = 1;
     float units = 128.f;
     uint32_t frames = 1;
+    uint32_t threads = 0;
+    // Octree and contree generation is split between this many processes when non zero
+    uint32_t workers = 0;
+    // Set on worker processes, which only write their share of the distributed trees
+    int32_t worker_index = -1;
+    std::string work_dir = "";
+    bool external_workers = false;
+    // Directory of cached voxels and structure files, disabled when empty
+    std::string cache = "";
+    // Arguments the process was started with, reused to launch local workers
+    std::vector<std::string> command;
 };
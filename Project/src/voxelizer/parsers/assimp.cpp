@@ -1,5 +1,6 @@
 #include "assimp.hpp"
 
+#include "assimp/DefaultIOSystem.h"
 #include "assimp/Importer.hpp"
 #include "assimp/anim.h"
 #include "assimp/matrix4x4.h"
@@ -206,8 +207,13 @@ Mesh processMesh(
                 const Bone& bone = parseInfo.bones[boneID];
 
                 if (bone.vertexWeights.contains(vertexIndex)) {
-                    vertex.boneIDs.push_back(boneID);
-                    vertex.boneWeights.push_back(bone.vertexWeights.at(vertexIndex));
+                    // Importing limits the weights, so this only guards malformed files
+                    if (vertex.boneCount == Vertex::MaxBoneInfluences)
+                        break;
+
+                    vertex.boneIDs[vertex.boneCount] = boneID;
+                    vertex.boneWeights[vertex.boneCount] = bone.vertexWeights.at(vertexIndex);
+                    vertex.boneCount++;
                 }
             }
 
@@ -418,12 +424,25 @@ std::vector<Triangle> evaluateNodes(
     return triangles;
 }
 
-ParserRet parseAssimp(std::filesystem::path path, const ParserArgs& args)
+// Records every file Assimp opens, which includes external buffers and textures
+class DependencyIOSystem : public Assimp::DefaultIOSystem {
+  public:
+    Assimp::IOStream* Open(const char* file, const char* mode) override
+    {
+        addDependency(file);
+        return DefaultIOSystem::Open(file, mode);
+    }
+};
+
+Meshes loadAssimp(std::filesystem::path path, const ParserArgs& args)
 {
     Assimp::Importer importer;
+    // Owned by the importer
+    importer.SetIOHandler(new DependencyIOSystem());
 
     const aiScene* scene = importer.ReadFile(
-        path.string().c_str(), aiProcess_Triangulate | aiProcess_ConvertToLeftHanded);
+        path.string().c_str(),
+        aiProcess_Triangulate | aiProcess_ConvertToLeftHanded | aiProcess_LimitBoneWeights);
 
     if (!scene || (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) != 0 || !scene->mRootNode) {
         fprintf(
@@ -437,9 +456,6 @@ ParserRet parseAssimp(std::filesystem::path path, const ParserArgs& args)
 
     Node baseNode = parseAssimpNode(path.parent_path(), scene->mRootNode, scene, parseInfo);
 
-    glm::uvec3 dimensions;
-    std::vector<std::unordered_map<glm::ivec3, glm::vec3>> baseVoxels;
-
     std::vector<std::vector<Triangle>> meshes;
 
     EvaluateInfo info;
@@ -474,8 +490,12 @@ ParserRet parseAssimp(std::filesystem::path path, const ParserArgs& args)
         meshes.push_back(evaluateNodes(baseNode, info));
     }
 
-    std::tie(dimensions, baseVoxels) = parseMeshes(meshes, parseInfo.materials, args);
+    return Meshes { .frames = meshes, .materials = parseInfo.materials };
+}
 
-    return { dimensions, baseVoxels };
+ParserRet parseAssimp(std::filesystem::path path, const ParserArgs& args)
+{
+    Meshes meshes = loadAssimp(path, args);
+    return parseMeshes(meshes.frames, meshes.materials, args);
 }
 }
@@ -7,6 +7,8 @@
 
 namespace ParserImpl {
 
+// Triangles and materials of the file, without voxelizing them
+Meshes loadAssimp(std::filesystem::path path, const ParserArgs& args);
 ParserRet parseAssimp(std::filesystem::path path, const ParserArgs& args);
 
 }
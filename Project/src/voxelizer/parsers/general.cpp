@@ -4,13 +4,21 @@
 #include "glm/gtx/hash.hpp"
 #include "pgbar/ProgressBar.hpp"
 
+#include "generators/memory.hpp"
+#include "generators/task_scheduler.hpp"
+
 #include <algorithm>
+#include <memory_resource>
+#include <mutex>
 
 #include <stb/stb_image.h>
 #include <unordered_map>
 
 namespace ParserImpl {
 
+// Triangles voxelized by a single task
+static constexpr size_t TriangleTile = 256;
+
 bool aabbTriangleSAT(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, glm::vec3 aabbSize, glm::vec3 axis)
 {
     float p0 = glm::dot(v0, axis);
@@ -168,7 +176,7 @@ Triangle transformTriangle(Triangle t, std::vector<glm::mat4> boneTransforms)
         const Vertex& vertex = t.vertices[v];
 
         glm::mat4 skinMat(0.f);
-        for (uint32_t i = 0; i < vertex.boneIDs.size(); i++) {
+        for (uint32_t i = 0; i < vertex.boneCount; i++) {
             skinMat += vertex.boneWeights[i] * boneTransforms[vertex.boneIDs[i]];
         }
 
@@ -199,75 +207,120 @@ std::vector<std::string> split(std::string str, std::string delim)
     return components;
 }
 
-template <typename T>
-ParserRet parseMesh(const std::vector<Triangle>& triangles,
-    const std::unordered_map<int32_t, Material>& materials, const ParserArgs& args,
-    glm::vec3 minBound, glm::vec3 maxBound, T& bar)
+// Colour a triangle gives to a voxel it touches
+static glm::vec3 triangleColour(const Triangle& t,
+    const std::unordered_map<int32_t, Material>& materials, glm::vec3 cubeMin, glm::vec3 cellSize)
 {
-    std::unordered_map<glm::ivec3, glm::vec3> voxels;
+    if (t.matIndex == -1)
+        return glm::vec3(1);
 
-    glm::vec3 size = glm::max(maxBound - minBound, glm::vec3(glm::epsilon<float>()));
-    float maxSide = fmax(size.x, fmax(size.y, size.z));
-    glm::vec3 aspect = size / maxSide;
+    const Material& mat = materials.at(t.matIndex);
+    if (!mat.validTexture)
+        return mat.diffuse;
 
-    // World space to voxel space
-    glm::vec3 scalar = (aspect * (float)args.voxels_per_unit * args.units) / size;
+    glm::vec3 tex = calculateTexCoords(t, cubeMin, cellSize);
 
-    glm::uvec3 dimensions = glm::max(glm::uvec3(glm::ceil(size * scalar)), glm::uvec3(1));
-
-    glm::vec3 cellSize = glm::vec3(1.f) / scalar;
-
-    for (const auto& t : triangles) {
-        glm::uvec3 triangleMin
-            = glm::floor((glm::min(t.vertices[0].position,
-                              glm::min(t.vertices[1].position, t.vertices[2].position))
-                             - minBound)
-                * scalar);
-        glm::uvec3 triangleMax = glm::max(
-            glm::uvec3(glm::ceil((glm::max(t.vertices[0].position,
-                                      glm::max(t.vertices[1].position, t.vertices[2].position))
-                                     - minBound)
-                * scalar)),
-            glm::uvec3(1));
-
-        for (int z = triangleMin.z; z < triangleMax.z; z++) {
-            for (int y = triangleMin.y; y < triangleMax.y; y++) {
-                for (int x = triangleMin.x; x < triangleMax.x; x++) {
-                    glm::ivec3 index = glm::ivec3(x, y, z);
-                    glm::vec3 cubeMin = (glm::vec3(index) / scalar) + minBound;
-
-                    if (aabbTriangleIntersection(t, cubeMin, cellSize)) {
-                        if (t.matIndex != -1) {
-                            const Material& mat = materials.at(t.matIndex);
-                            if (mat.validTexture) {
-                                glm::vec3 tex = calculateTexCoords(t, cubeMin, cellSize);
-
-                                int x = std::clamp((int)(tex.x * mat.width), 0, mat.width - 1);
-                                int y = std::clamp((int)(tex.y * mat.height), 0, mat.height - 1);
-                                size_t colourIndex = (x + y * mat.width) * mat.colourDepth;
-
-                                glm::vec3 colour = {
-                                    mat.data[colourIndex + 0] / 255.f,
-                                    mat.data[colourIndex + 1] / 255.f,
-                                    mat.data[colourIndex + 2] / 255.f,
-                                };
-
-                                voxels[index] = colour;
-                            } else {
-                                voxels[index] = mat.diffuse;
-                            }
-                        } else {
-                            voxels[index] = glm::vec3(1);
-                        }
-                    }
-                }
+    int x = std::clamp((int)(tex.x * mat.width), 0, mat.width - 1);
+    int y = std::clamp((int)(tex.y * mat.height), 0, mat.height - 1);
+    size_t colourIndex = (x + y * mat.width) * mat.colourDepth;
+
+    return {
+        mat.data[colourIndex + 0] / 255.f,
+        mat.data[colourIndex + 1] / 255.f,
+        mat.data[colourIndex + 2] / 255.f,
+    };
+}
+
+// Voxels a triangle is tested against, from the first up to but excluding the second
+static std::pair<glm::uvec3, glm::uvec3> triangleBounds(
+    const Triangle& t, glm::vec3 minBound, glm::vec3 scalar)
+{
+    glm::uvec3 triangleMin
+        = glm::floor((glm::min(t.vertices[0].position,
+                          glm::min(t.vertices[1].position, t.vertices[2].position))
+                         - minBound)
+            * scalar);
+    glm::uvec3 triangleMax = glm::max(
+        glm::uvec3(glm::ceil((glm::max(t.vertices[0].position,
+                                  glm::max(t.vertices[1].position, t.vertices[2].position))
+                                 - minBound)
+            * scalar)),
+        glm::uvec3(1));
+
+    return { triangleMin, triangleMax };
+}
+
+// Voxels touched by a single triangle, later triangles overwrite the colour of earlier ones
+static void voxelizeTriangle(const Triangle& t,
+    const std::unordered_map<int32_t, Material>& materials, glm::vec3 minBound, glm::vec3 scalar,
+    glm::vec3 cellSize, std::pmr::unordered_map<glm::ivec3, glm::vec3>& voxels)
+{
+    const auto [triangleMin, triangleMax] = triangleBounds(t, minBound, scalar);
+
+    for (int z = triangleMin.z; z < triangleMax.z; z++) {
+        for (int y = triangleMin.y; y < triangleMax.y; y++) {
+            for (int x = triangleMin.x; x < triangleMax.x; x++) {
+                glm::ivec3 index = glm::ivec3(x, y, z);
+                glm::vec3 cubeMin = (glm::vec3(index) / scalar) + minBound;
+
+                if (aabbTriangleIntersection(t, cubeMin, cellSize))
+                    voxels[index] = triangleColour(t, materials, cubeMin, cellSize);
             }
         }
+    }
+}
+
+// Voxels of one tile of triangles, every allocation of the map is released with the arena
+struct TileVoxels {
+    explicit TileVoxels(std::pmr::memory_resource* upstream) : arena(upstream) { }
 
-        bar.tick();
+    std::pmr::monotonic_buffer_resource arena;
+    std::pmr::unordered_map<glm::ivec3, glm::vec3> voxels { &arena };
+};
+
+template <typename T>
+ParserRet parseMesh(const std::vector<Triangle>& triangles,
+    const std::unordered_map<int32_t, Material>& materials, const VoxelSpace& space, T& bar)
+{
+    std::unordered_map<glm::ivec3, glm::vec3> voxels;
+
+    const glm::vec3 minBound = space.minBound;
+    const glm::vec3 scalar = space.scalar;
+    const glm::vec3 cellSize = space.cellSize;
+
+    // Tiles of triangles are voxelized on the task scheduler and merged in order, so later
+    // triangles still take priority as in a sequential pass. Each tile allocates from its own
+    // arena so the threads never contend on the heap.
+    const size_t tileCount = (triangles.size() + TriangleTile - 1) / TriangleTile;
+    Generators::TrackingResource memory;
+    std::vector<std::unique_ptr<TileVoxels>> tiles(tileCount);
+    std::mutex barMutex;
+
+    Generators::TaskScheduler::getInstance().parallelFor(tileCount, 1, [&](size_t tile) {
+        const size_t first = tile * TriangleTile;
+        const size_t last = std::min(first + TriangleTile, triangles.size());
+
+        tiles[tile] = std::make_unique<TileVoxels>(&memory);
+        for (size_t i = first; i < last; i++) {
+            voxelizeTriangle(
+                triangles[i], materials, minBound, scalar, cellSize, tiles[tile]->voxels);
+        }
+
+        std::lock_guard<std::mutex> lock(barMutex);
+        for (size_t i = first; i < last; i++)
+            bar.tick();
+    });
+
+    for (auto& tile : tiles) {
+        for (const auto& [index, colour] : tile->voxels)
+            voxels.insert_or_assign(index, colour);
+        tile.reset();
     }
 
-    return std::make_tuple(dimensions, std::vector { voxels });
+    printf("Parse scratch memory: peak %.2f MiB, allocated %.2f MiB\n",
+        memory.getPeakBytes() / (1024.f * 1024.f), memory.getAllocatedBytes() / (1024.f * 1024.f));
+
+    return std::make_tuple(space.dimensions, std::vector { voxels });
 }
 
 ParserRet parseMesh(const std::vector<Triangle>& triangles,
@@ -276,15 +329,12 @@ ParserRet parseMesh(const std::vector<Triangle>& triangles,
     return parseMeshes({ triangles }, materials, args);
 }
 
-ParserRet parseMeshes(const std::vector<std::vector<Triangle>>& meshes,
-    const std::unordered_map<int32_t, Material>& materials, const ParserArgs& args)
+VoxelSpace meshSpace(const std::vector<std::vector<Triangle>>& meshes, const ParserArgs& args)
 {
     glm::vec3 minBound(1000000);
     glm::vec3 maxBound(-1000000);
 
-    uint32_t triangleCount = 0;
     for (const auto& mesh : meshes) {
-        triangleCount += mesh.size();
         for (size_t i = 0; i < mesh.size(); i++) {
             for (size_t j = 0; j < 3; j++) {
                 maxBound = glm::max(maxBound, mesh[i].vertices[j].position);
@@ -296,6 +346,29 @@ ParserRet parseMeshes(const std::vector<std::vector<Triangle>>& meshes,
     maxBound += glm::epsilon<float>();
     minBound -= glm::epsilon<float>();
 
+    glm::vec3 size = glm::max(maxBound - minBound, glm::vec3(glm::epsilon<float>()));
+    float maxSide = fmax(size.x, fmax(size.y, size.z));
+    glm::vec3 aspect = size / maxSide;
+
+    glm::vec3 scalar = (aspect * (float)args.voxels_per_unit * args.units) / size;
+
+    return VoxelSpace {
+        .minBound = minBound,
+        .scalar = scalar,
+        .cellSize = glm::vec3(1.f) / scalar,
+        .dimensions = glm::max(glm::uvec3(glm::ceil(size * scalar)), glm::uvec3(1)),
+    };
+}
+
+ParserRet parseMeshes(const std::vector<std::vector<Triangle>>& meshes,
+    const std::unordered_map<int32_t, Material>& materials, const ParserArgs& args)
+{
+    const VoxelSpace space = meshSpace(meshes, args);
+
+    uint32_t triangleCount = 0;
+    for (const auto& mesh : meshes)
+        triangleCount += mesh.size();
+
     std::vector<std::unordered_map<glm::ivec3, glm::vec3>> voxels;
     voxels.reserve(meshes.size());
 
@@ -306,20 +379,107 @@ ParserRet parseMeshes(const std::vector<std::vector<Triangle>>& meshes,
     bar.config().prefix("Voxelizing triangles");
     bar.config().tasks(triangleCount);
 
-    glm::uvec3 dimensions;
-
     for (const auto& mesh : meshes) {
         std::vector<std::unordered_map<glm::ivec3, glm::vec3>> tempVoxels;
-        std::tie(dimensions, tempVoxels)
-            = parseMesh(mesh, materials, args, minBound, maxBound, bar);
+        std::tie(std::ignore, tempVoxels) = parseMesh(mesh, materials, space, bar);
         voxels.push_back(tempVoxels[0]);
     }
 
-    return { dimensions, voxels };
+    return { space.dimensions, voxels };
+}
+
+MeshLoader::MeshLoader(const VoxelSpace& space, std::vector<Triangle> triangles,
+    std::unordered_map<int32_t, Material> materials)
+    : PrimitiveLoader(space.dimensions), m_Space(space), m_Triangles(std::move(triangles)),
+      m_Materials(std::move(materials))
+{
+    m_Bounds.reserve(m_Triangles.size());
+    for (const Triangle& triangle : m_Triangles)
+        m_Bounds.push_back(triangleBounds(triangle, m_Space.minBound, m_Space.scalar));
+}
+
+uint32_t MeshLoader::getPrimitiveCount() const { return m_Triangles.size(); }
+
+void MeshLoader::overlapping(const std::vector<uint32_t>& candidates, glm::uvec3 origin,
+    uint32_t edge, std::vector<uint32_t>& overlaps)
+{
+    // Grown by half a voxel on every side, so rounding never drops a triangle whose voxel test
+    // would pass
+    const glm::vec3 cellMin
+        = glm::vec3(origin) / m_Space.scalar + m_Space.minBound - m_Space.cellSize * 0.5f;
+    const glm::vec3 cellSize = m_Space.cellSize * ((float)edge + 1.f);
+
+    const glm::uvec3 cellMax = origin + edge;
+    for (uint32_t candidate : candidates) {
+        const auto& [triangleMin, triangleMax] = m_Bounds[candidate];
+        if (glm::any(glm::greaterThanEqual(origin, triangleMax))
+            || glm::any(glm::lessThanEqual(cellMax, triangleMin)))
+            continue;
+
+        if (aabbTriangleIntersection(m_Triangles[candidate], cellMin, cellSize))
+            overlaps.push_back(candidate);
+    }
+}
+
+std::optional<glm::vec3> MeshLoader::voxelColour(uint32_t triangle, glm::uvec3 index) const
+{
+    const auto& [triangleMin, triangleMax] = m_Bounds[triangle];
+    if (glm::any(glm::lessThan(index, triangleMin))
+        || glm::any(glm::greaterThanEqual(index, triangleMax)))
+        return {};
+
+    const Triangle& t = m_Triangles[triangle];
+    glm::vec3 cubeMin = (glm::vec3(index) / m_Space.scalar) + m_Space.minBound;
+    if (!aabbTriangleIntersection(t, cubeMin, m_Space.cellSize))
+        return {};
+
+    return triangleColour(t, m_Materials, cubeMin, m_Space.cellSize);
+}
+
+std::optional<glm::vec3> MeshLoader::getVoxel(
+    const std::vector<uint32_t>& candidates, glm::uvec3 index)
+{
+    // The last triangle touching the voxel sets its colour
+    for (auto candidate = candidates.rbegin(); candidate != candidates.rend(); candidate++) {
+        auto colour = voxelColour(*candidate, index);
+        if (colour.has_value())
+            return colour;
+    }
+
+    return {};
+}
+
+std::optional<glm::vec3> MeshLoader::getVoxel(glm::uvec3 index)
+{
+    for (uint32_t triangle = m_Triangles.size(); triangle > 0; triangle--) {
+        auto colour = voxelColour(triangle - 1, index);
+        if (colour.has_value())
+            return colour;
+    }
+
+    return {};
+}
+
+static std::mutex s_DependencyLock;
+static std::vector<std::filesystem::path> s_Dependencies;
+
+void addDependency(std::filesystem::path filepath)
+{
+    std::lock_guard lock(s_DependencyLock);
+    if (std::find(s_Dependencies.begin(), s_Dependencies.end(), filepath) == s_Dependencies.end())
+        s_Dependencies.push_back(filepath);
+}
+
+std::vector<std::filesystem::path> getDependencies()
+{
+    std::lock_guard lock(s_DependencyLock);
+    return s_Dependencies;
 }
 
 void parseImage(std::filesystem::path filepath, Material& material)
 {
+    addDependency(filepath);
+
     stbi_set_flip_vertically_on_load(true);
     material.data = stbi_load(
         filepath.string().c_str(), &material.width, &material.height, &material.colourDepth, 0);
@@ -8,8 +8,12 @@
 #include <filesystem>
 
 #include "../parser_args.hpp"
+#include "loaders/primitive_loader.hpp"
 
+#include <array>
+#include <optional>
 #include <string>
+#include <vector>
 
 namespace ParserImpl {
 
@@ -17,11 +21,16 @@ namespace ParserImpl {
 typedef std::tuple<glm::uvec3, std::vector<std::unordered_map<glm::ivec3, glm::vec3>>> ParserRet;
 
 struct Vertex {
+    // Matches the limit the importer reduces each vertex's weights to
+    static constexpr uint32_t MaxBoneInfluences = 4;
+
     glm::vec3 position;
     glm::vec3 texture;
 
-    std::vector<size_t> boneIDs;
-    std::vector<float> boneWeights;
+    // Held inline so triangles stay trivially copyable and never allocate
+    std::array<uint32_t, MaxBoneInfluences> boneIDs {};
+    std::array<float, MaxBoneInfluences> boneWeights {};
+    uint32_t boneCount = 0;
 };
 
 struct Triangle {
@@ -39,6 +48,54 @@ struct Material {
     glm::vec3 diffuse;
 };
 
+// Triangles of every frame along with the materials they index
+struct Meshes {
+    std::vector<std::vector<Triangle>> frames;
+    std::unordered_map<int32_t, Material> materials;
+};
+
+// Mapping from world space onto the voxel grid
+struct VoxelSpace {
+    glm::vec3 minBound;
+    // World space to voxel space
+    glm::vec3 scalar;
+    glm::vec3 cellSize;
+    glm::uvec3 dimensions;
+};
+
+// Fits the triangles of every frame into the grid given by the resolution arguments
+VoxelSpace meshSpace(const std::vector<std::vector<Triangle>>& meshes, const ParserArgs& args);
+
+// Voxelizes triangles on demand, giving the same voxels as parseMesh. Trees built from it with
+// PrimitiveLoader never hold the voxels of the whole mesh.
+class MeshLoader : public PrimitiveLoader {
+  public:
+    MeshLoader(const VoxelSpace& space, std::vector<Triangle> triangles,
+        std::unordered_map<int32_t, Material> materials);
+
+    ~MeshLoader() { }
+
+    uint32_t getPrimitiveCount() const override;
+
+    void overlapping(const std::vector<uint32_t>& candidates, glm::uvec3 origin, uint32_t edge,
+        std::vector<uint32_t>& overlaps) override;
+
+    std::optional<glm::vec3> getVoxel(
+        const std::vector<uint32_t>& candidates, glm::uvec3 index) override;
+    std::optional<glm::vec3> getVoxel(glm::uvec3 index) override;
+
+  private:
+    // Colour the triangle gives the voxel, nothing if it does not touch it
+    std::optional<glm::vec3> voxelColour(uint32_t triangle, glm::uvec3 index) const;
+
+  private:
+    VoxelSpace m_Space;
+    std::vector<Triangle> m_Triangles;
+    // Voxels each triangle is tested against, from min up to but excluding max
+    std::vector<std::pair<glm::uvec3, glm::uvec3>> m_Bounds;
+    std::unordered_map<int32_t, Material> m_Materials;
+};
+
 Triangle transformTriangle(Triangle t, glm::mat4 transform);
 Triangle transformTriangle(Triangle t, std::vector<glm::mat4> boneTransforms);
 
@@ -52,4 +109,9 @@ ParserRet parseMesh(const std::vector<Triangle>& triangles,
 
 void parseImage(std::filesystem::path filepath, Material& material);
 
+// Files read while parsing besides the input itself, such as material libraries, textures and
+// buffers. Used to tell whether cached voxels are still valid.
+void addDependency(std::filesystem::path filepath);
+std::vector<std::filesystem::path> getDependencies();
+
 }
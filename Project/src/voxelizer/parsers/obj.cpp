@@ -18,6 +18,8 @@ namespace ParserImpl {
 void parseMaterialLib(
     std::filesystem::path filepath, std::unordered_map<std::string, Material>& materials)
 {
+    addDependency(filepath);
+
     std::ifstream materialFile(filepath.string());
     if (!materialFile) {
         fprintf(stderr, "Failed to open material lib: %s\n", filepath.string().c_str());
@@ -69,7 +71,7 @@ void parseMaterialLib(
         materials[currentMaterial] = material;
 }
 
-ParserRet parseObj(std::filesystem::path filepath, const ParserArgs& args)
+Meshes loadObj(std::filesystem::path filepath, const ParserArgs& args)
 {
     std::vector<Triangle> triangles;
 
@@ -230,7 +232,13 @@ ParserRet parseObj(std::filesystem::path filepath, const ParserArgs& args)
         mappedMaterials.insert({ materialToIndex[material.first], material.second });
     }
 
-    return parseMesh(triangles, mappedMaterials, args);
+    return Meshes { .frames = { triangles }, .materials = mappedMaterials };
+}
+
+ParserRet parseObj(std::filesystem::path filepath, const ParserArgs& args)
+{
+    Meshes meshes = loadObj(filepath, args);
+    return parseMesh(meshes.frames[0], meshes.materials, args);
 }
 
 }
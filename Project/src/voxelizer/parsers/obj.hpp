@@ -8,6 +8,8 @@
 
 namespace ParserImpl {
 
+// Triangles and materials of the file, without voxelizing them
+Meshes loadObj(std::filesystem::path path, const ParserArgs& args);
 ParserRet parseObj(std::filesystem::path path, const ParserArgs& args);
 
 }